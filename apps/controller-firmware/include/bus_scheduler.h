@@ -0,0 +1,79 @@
+/**
+ * TerraHub Controller Firmware - Slave Bus Polling Scheduler
+ *
+ * Gathers GET_SENSOR_VALUES and GET_PORT_STATE from every enumerated slave
+ * without stalling the control loop. Each call to busSchedulerLoop() spends
+ * at most BUS_TICK_BUDGET_US on the bus. A node's requests run back to back
+ * as one batch, and the node whose data is oldest relative to its deadline
+ * goes next. Once every node has been visited, the readings gathered in
+ * that cycle are published together as one snapshot.
+ */
+
+#ifndef TERRAHUB_BUS_SCHEDULER_H
+#define TERRAHUB_BUS_SCHEDULER_H
+
+#include <stdint.h>
+#include "config.h"
+#include "i2c_master.h"
+
+#define BUS_MAX_SLAVES (MAX_NODES - 1)
+
+struct NodeSensorReading {
+  uint8_t type;        // protocol sensor type (0x01 temperature, ...)
+  uint8_t unit;
+  int16_t value;       // raw protocol value; light level is unsigned
+};
+
+struct NodeReading {
+  uint8_t nodeId;
+  bool online;         // every request of the last batch succeeded
+  uint32_t sampledAt;  // millis() when the batch completed
+  uint8_t sensorCount;
+  NodeSensorReading sensors[BUS_MAX_SENSORS_PER_NODE];
+  uint8_t portStates;  // bit per port
+  uint16_t portCurrentMa[NUM_RELAY_CHANNELS];
+};
+
+struct ClusterSnapshot {
+  uint32_t cycle;      // 0 until the first full cycle completes
+  uint32_t publishedAt;
+  uint8_t nodeCount;
+  NodeReading nodes[BUS_MAX_SLAVES];
+};
+
+struct BusNodeStats {
+  uint32_t transactions;
+  uint32_t failures;
+  uint32_t retries;
+  uint32_t lastLatencyMs;
+  uint32_t maxLatencyMs;
+};
+
+struct BusSchedulerStats {
+  uint32_t cycles;
+  uint32_t lastCycleMs;
+  uint32_t lastCycleBusyUs;  // time spent in bus transfers during that cycle
+  uint8_t utilizationPct;    // lastCycleBusyUs relative to lastCycleMs
+};
+
+// Start polling the given node ids; replaces any previous node list
+void busSchedulerBegin(const I2cBus &bus, const uint8_t *nodeIds, uint8_t count, uint32_t now);
+
+/**
+ * Run bus work for at most BUS_TICK_BUDGET_US; call every loop iteration.
+ * Returns true while a node batch is in flight, i.e. the caller should come
+ * back soon rather than sleep.
+ */
+bool busSchedulerLoop(uint32_t now);
+
+// When busSchedulerLoop() next has work: the next node due, or the retry
+// delay of the batch in flight. False if there are no nodes.
+bool busSchedulerNextDeadline(uint32_t &deadline);
+
+// Readings from the last completed cycle
+const ClusterSnapshot &busSchedulerSnapshot();
+
+const BusSchedulerStats &busSchedulerStats();
+const BusNodeStats &busSchedulerNodeStats(uint8_t index);
+
+#endif // TERRAHUB_BUS_SCHEDULER_H
@@ -22,13 +22,68 @@
 // Maximum number of nodes in a chain
 #define MAX_NODES 16
 
-// Relay states (active high or active low depending on relay module)
-#define RELAY_ON_STATE HIGH
-#define RELAY_OFF_STATE LOW
+// I2C master timing (in milliseconds, see docs/protocol.md): how long a
+// node may answer BUSY, the pause before a retry, and how often a BUSY
+// node is re-read
+#define I2C_COMMAND_TIMEOUT_MS 50
+#define I2C_RETRY_COUNT 3
+#define I2C_RETRY_DELAY_MS 10
+#define I2C_RESPONSE_POLL_MS 2
+
+// Enumeration: how often to probe for the next node while it boots, and how
+// long after enabling downstream to wait before deciding the chain ends
+// (in milliseconds)
+#define ENUM_HELLO_INTERVAL_MS 10
+#define ENUM_NODE_BOOT_TIMEOUT_MS 1500
+
+// Slave polling: how often each node's sensors and ports are refreshed (in
+// milliseconds), the bus time one control loop iteration may spend on it
+// (in microseconds), and the sensors kept per node
+#define BUS_POLL_INTERVAL_MS 1000
+#define BUS_TICK_BUDGET_US 2000
+#define BUS_MAX_SENSORS_PER_NODE 4
+
+// Slave configuration sync: bytes per chunk (kept well inside the 128-byte
+// Wire buffer), largest image, chunk hashes read per request, nodes updated
+// at once, and how long a node that failed waits before the next attempt
+// (in milliseconds)
+#define CONFIG_CHUNK_BYTES 64
+#define CONFIG_IMAGE_MAX_BYTES 8192
+#define CONFIG_HASHES_PER_REQUEST 16
+#define CONFIG_SYNC_PIPELINE_DEPTH 4
+#define CONFIG_SYNC_RETRY_MS 30000
+
+// Received I2C frames queued for the slave command handlers (power of two)
+#define I2C_RX_SLOTS 4
+
+// Command handlers the I2C slave dispatcher can hold
+#define I2C_MAX_HANDLERS 16
+
+// Relay drive level: 1 for active-high relay modules, 0 for active-low
+#define RELAY_ACTIVE_HIGH 1
+
+// Default arbitration when several rules drive the same relay
+// (RELAY_POLICY_PRIORITY, RELAY_POLICY_ANY_ON or RELAY_POLICY_ALL_ON)
+#define RELAY_DEFAULT_POLICY RELAY_POLICY_PRIORITY
 
 // Current threshold for fault detection (in mA)
 #define CURRENT_FAULT_THRESHOLD_MA 50
 
+// Current sampling: mains frequency (in Hz), whole mains cycles per RMS
+// window, total ADC rate shared by all channels (in Hz, the ESP32 DMA mode
+// needs at least 20000) and sensor scale (in mA per ADC count; 4.36 is a
+// 185 mV/A sensor on the 3.3 V, 12-bit ADC)
+#define CURRENT_MAINS_HZ 50
+#define CURRENT_RMS_CYCLES 5
+#define CURRENT_SAMPLE_RATE_HZ 20000
+#define CURRENT_MA_PER_COUNT 4.36f
+
+// Consecutive RMS windows that must agree before a load fault is raised or
+// cleared, and how long a channel is ignored after its relay switched (in
+// milliseconds)
+#define CURRENT_FAULT_WINDOWS 2
+#define CURRENT_SETTLE_MS 300
+
 // Buzzer settings
 #define BUZZER_BEEP_DURATION_MS 500
 #define BUZZER_PAUSE_DURATION_MS 500
@@ -37,13 +92,97 @@
 // Sensor polling interval (in milliseconds)
 #define SENSOR_POLL_INTERVAL_MS 1000
 
+// Control task pass budget (in microseconds; longer passes count as
+// overruns), command queue slots (power of two) and timed wakes per
+// published timing window
+#define CONTROL_PASS_BUDGET_US 10000
+#define CONTROL_COMMAND_QUEUE_SIZE 16
+#define CONTROL_STATS_WAKES 100
+
+// Stage timing histograms for /api/metrics; build with -DTERRAHUB_METRICS=0
+// to compile the timers out
+#ifndef TERRAHUB_METRICS
+#define TERRAHUB_METRICS 1
+#endif
+
+// Power management: CPU frequency range while automatic light sleep or
+// frequency scaling is available (in MHz), and the longest the network loop
+// sleeps without a deadline (in milliseconds)
+#define POWER_MAX_CPU_MHZ 240
+#define POWER_MIN_CPU_MHZ 80
+#define POWER_IDLE_MAX_MS 500
+
+// Sensor history tiers: bucket length (in seconds) and buckets kept per
+// tier. The defaults cover 1 hour at 10 s, 1 day at 5 min and 1 week at
+// 15 min in about 24 KB (18 bytes per bucket).
+#define HISTORY_TIER0_SECONDS 10
+#define HISTORY_TIER0_BUCKETS 360
+#define HISTORY_TIER1_SECONDS 300
+#define HISTORY_TIER1_BUCKETS 288
+#define HISTORY_TIER2_SECONDS 900
+#define HISTORY_TIER2_BUCKETS 672
+
 // Web server port
 #define WEB_SERVER_PORT 80
 
+// Cached /api/status and /api/config bodies are rebuilt when their state
+// changes, and otherwise once their counters (passes, timing, current) are
+// this old (in milliseconds)
+#define STATUS_REFRESH_MS 1000
+
+// Live status push (/api/live): subscribers served at once, how long one may
+// keep a full send queue before it is disconnected (in milliseconds) and
+// how many rule transitions one message carries (the rest follow next pass)
+#define LIVE_MAX_CLIENTS 4
+#define LIVE_STALL_TIMEOUT_MS 10000
+#define LIVE_MAX_RULE_CHANGES 8
+
+// Longest rule id, rule name and condition sensor/op accepted (in characters)
+#define MAX_RULE_ID_LENGTH 32
+#define MAX_RULE_NAME_LENGTH 64
+#define MAX_RULE_TOKEN_LENGTH 16
+
+// Most terms (comparisons plus all/any/not) in one compound rule condition
+#define MAX_RULE_TERMS 8
+
+// Rate-of-change inputs compare the latest reading with one taken about a
+// window ago (in milliseconds); a reading is kept every
+// RULE_RATE_WINDOW_MS / RULE_RATE_SAMPLES
+#define RULE_RATE_WINDOW_MS 60000
+#define RULE_RATE_SAMPLES 6
+
+// Rule edits are written to NVS once no further edit arrived for the
+// debounce period, or at the latest after the max delay (in milliseconds)
+#define RULES_SAVE_DEBOUNCE_MS 2000
+#define RULES_SAVE_MAX_DELAY_MS 10000
+
+// Largest HTTP request body accepted by the API (in bytes)
+#define MAX_REQUEST_BODY_BYTES 8192
+
 // NTP server
 #define NTP_SERVER "pool.ntp.org"
 
+// Local time zone for schedules, as a POSIX TZ string (e.g.
+// "CET-1CEST,M3.5.0,M10.5.0/3" for central Europe with DST)
+#define TIME_ZONE "UTC0"
+
+// Schedules stored at most, time entries per schedule, and how far the
+// control task's clock may drift from the system clock before it is
+// corrected (in milliseconds)
+#define MAX_SCHEDULES 16
+#define MAX_SCHEDULE_ENTRIES 8
+#define SCHEDULE_CLOCK_TOLERANCE_MS 1000
+
 // WiFi connection timeout (in seconds)
 #define WIFI_CONNECT_TIMEOUT_SEC 30
 
+// Longest station SSID, passphrase and hostname accepted (in characters)
+#define WIFI_SSID_MAX_LENGTH 32
+#define WIFI_PASSWORD_MAX_LENGTH 64
+#define WIFI_HOSTNAME_MAX_LENGTH 32
+
+// WiFi retry backoff, doubled after every failed attempt (in milliseconds)
+#define WIFI_RETRY_BACKOFF_MIN_MS 1000
+#define WIFI_RETRY_BACKOFF_MAX_MS 60000
+
 #endif // TERRAHUB_CONFIG_H
@@ -0,0 +1,94 @@
+/**
+ * TerraHub Controller Firmware - Slave Configuration Sync
+ *
+ * Distributes the controller's configuration image (the binary rule record
+ * from rule_store.h) to every slave with SET_CONFIG_CHUNK, sending only the
+ * CONFIG_CHUNK_BYTES chunks a node does not already hold:
+ *
+ * 1. GET_CONFIG_HASH tells whether the node already has the image.
+ * 2. If not, the node's chunk hashes come from what this controller last
+ *    pushed to it, or are read from the node when that is unknown.
+ * 3. Differing chunks are written, the header chunk last, so the node's
+ *    image only becomes valid once every other chunk is in place.
+ * 4. A final GET_CONFIG_HASH confirms the node matches.
+ *
+ * Up to CONFIG_SYNC_PIPELINE_DEPTH nodes are worked on at once, so one
+ * node being busy does not hold up the others.
+ */
+
+#ifndef TERRAHUB_CONFIG_SYNC_H
+#define TERRAHUB_CONFIG_SYNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "i2c_master.h"
+
+#define CONFIG_MAX_CHUNKS (CONFIG_IMAGE_MAX_BYTES / CONFIG_CHUNK_BYTES)
+
+enum ConfigSyncNodeState : uint8_t {
+  CONFIG_NODE_UNKNOWN = 0,  // not checked against the current image yet
+  CONFIG_NODE_SYNCING,
+  CONFIG_NODE_IN_SYNC,
+  CONFIG_NODE_FAILED        // retried after CONFIG_SYNC_RETRY_MS
+};
+
+struct ConfigSyncNodeStatus {
+  uint8_t nodeId;
+  ConfigSyncNodeState state;
+  uint32_t hash;            // last hash reported by the node
+  uint16_t chunksSent;      // for the current image
+  uint16_t chunksToSend;
+};
+
+struct ConfigSyncStats {
+  uint32_t imageHash;
+  uint16_t imageBytes;      // unpadded image length
+  uint16_t chunkCount;
+  uint8_t nodesInSync;
+  uint8_t nodesPending;     // unknown or syncing
+  uint8_t nodesFailed;
+  uint32_t bytesSent;       // chunk and hash payload bytes on the bus
+  uint32_t fullPushBytes;   // what pushing the whole image would have cost
+};
+
+const char *configSyncNodeStateName(ConfigSyncNodeState state);
+
+/**
+ * Total length of the image in `image` (capacity bytes) when its header and
+ * payload CRC check out, else 0. Slaves use it to tell a complete image from
+ * one still being written.
+ */
+uint16_t configImageLength(const uint8_t *image, size_t capacity);
+
+// Hash of chunk `index` of a CONFIG_IMAGE_MAX_BYTES buffer
+uint32_t configChunkHash(const uint8_t *image, uint16_t index);
+
+// Sync the given node ids; replaces any previous node list
+void configSyncBegin(const I2cBus &bus, const uint8_t *nodeIds, uint8_t count);
+
+/**
+ * Make `image` the configuration every node should hold. Nodes are only
+ * re-synced when its hash changed. Returns false if the image is larger
+ * than CONFIG_IMAGE_MAX_BYTES.
+ */
+bool configSyncSetImage(const uint8_t *image, size_t length);
+
+// True while some node still has to be checked or updated
+bool configSyncPending(uint32_t now);
+
+// Earliest retry of a node whose sync failed; false if none is waiting
+bool configSyncNextDeadline(uint32_t &deadline);
+
+/**
+ * Run sync work for at most BUS_TICK_BUDGET_US; returns true while a
+ * transfer is in flight. The bus must not be used by anything else until
+ * configSyncPending() turns false.
+ */
+bool configSyncLoop(uint32_t now);
+
+const ConfigSyncStats &configSyncStats();
+uint8_t configSyncNodeCount();
+ConfigSyncNodeStatus configSyncNode(uint8_t index);
+
+#endif // TERRAHUB_CONFIG_SYNC_H
@@ -0,0 +1,134 @@
+/**
+ * TerraHub Controller Firmware - Control Task
+ *
+ * The controller's sensor poll -> rule and schedule evaluation -> relay
+ * output pipeline, run by a high-priority task pinned to CONTROL_TASK_CORE
+ * whenever a command arrives or a sensor poll, minimum-duration expiry or
+ * schedule transition comes due. Once started, the task alone owns the
+ * running program, the rule and schedule states and timers, the sensor
+ * values and the relay output stage. Networking, HTTP, the slave bus and persistence (the
+ * network side) never touch them and never share a lock with the task.
+ *
+ * State crosses only through:
+ *   - the command queue, network side -> task: relay overrides, sensor
+ *     values, relay policies, the local time and new programs;
+ *   - the retired queue, task -> network side: replaced rule programs,
+ *     freed there so the task never calls the allocator;
+ *   - a double-buffered ControlSnapshot published at the end of every
+ *     pass;
+ *   - the active flags inside each ControlProgram, written only by the task.
+ *
+ * Both queues are single-producer single-consumer. Every caller on the
+ * network side must hold the controller lock, which makes the network side
+ * a single producer and consumer however many tasks it runs on.
+ */
+
+#ifndef TERRAHUB_CONTROL_TASK_H
+#define TERRAHUB_CONTROL_TASK_H
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include <Arduino.h>
+#endif
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+#include "config.h"
+#include "relay_output.h"
+#include "rules.h"
+#include "schedule.h"
+#include "timer_queue.h"
+
+/**
+ * Compiled rules and schedules on their way to the task. Built and sized
+ * entirely on the network side; the task only fills in the states and
+ * timers when it switches over, and hands the previous program back through
+ * the retired queue.
+ */
+struct ControlProgram {
+  uint32_t generation;
+  RuleProgram program;
+  std::vector<RuleId> ids;            // rule id per program index
+  std::vector<int32_t> inheritFrom;   // index in the previous program whose state carries over, -1 for none
+  std::vector<RuleState> states;
+  std::unique_ptr<std::atomic<bool>[]> active;  // mirror of states[i].active for the network side
+  std::vector<uint32_t> memo;         // ExprEvaluation stamp per condition node
+  TimerQueue timers;
+  SensorMask dirtySensors;            // re-evaluated right after the switch
+  uint32_t dirtyRelays;
+
+  ScheduleProgram schedules;
+  std::vector<uint8_t> scheduleStates;  // SCHEDULE_STATE_* per compiled schedule
+  TimerQueue scheduleTimers;            // next transition of each schedule
+};
+
+enum ScheduleState : uint8_t {
+  SCHEDULE_STATE_UNKNOWN = 0,  // no local time yet; the schedule does not vote
+  SCHEDULE_STATE_OFF,
+  SCHEDULE_STATE_ON
+};
+
+// Pass timing over the last CONTROL_STATS_WAKES deadline wakes
+struct ControlTiming {
+  uint32_t jitterMeanUs;   // mean |wake - deadline|
+  uint32_t jitterMaxUs;
+  uint32_t busyMaxUs;      // longest pass
+  uint32_t jitterWorstUs;  // since start
+  uint32_t overruns;       // passes over CONTROL_PASS_BUDGET_US, since start
+};
+
+struct ControlSnapshot {
+  uint32_t passes;             // completed since start
+  uint32_t generation;         // rule program in effect
+  uint32_t relays;             // bit per relay, set while on
+  uint32_t toggleCounts[NUM_RELAY_CHANNELS];
+  RelayPolicy policies[NUM_RELAY_CHANNELS];
+  SensorValues sensors;
+  SensorValues rates;          // change per minute, NaN until a full RULE_RATE_WINDOW_MS of readings
+  uint32_t sensorPolls;        // bumped on every sensor poll
+  uint32_t sensorPolledAt;     // halMillis() of the last poll
+  uint32_t rulesEvaluated;     // by the last pass that evaluated any
+  uint32_t nodesEvaluated;     // condition nodes computed by that pass
+  uint32_t ruleEvaluations;    // since start, wrapping
+  uint32_t schedulesOn;        // bit per compiled schedule, set while on
+  bool clockValid;             // schedules are running on local time
+  ControlTiming timing;
+};
+
+static_assert(MAX_SCHEDULES <= 32, "ControlSnapshot::schedulesOn holds one bit per schedule");
+
+// Prepare the queues and the first snapshot; call before anything is queued
+void controlBegin();
+
+#if defined(ARDUINO_ARCH_ESP32)
+// Start the task. Commands queued before this run in its first pass.
+bool controlStart();
+TaskHandle_t controlTaskHandle();
+#endif
+
+// Host builds, which have no task: run one pass on the calling thread at
+// the HAL clock's time. Never call it once the task is running.
+void controlRunPass();
+// When the next pass is due on its own (sensor poll, minimum-duration
+// expiry or schedule transition), in halMillis() time
+uint32_t controlNextDeadline();
+
+// Network side. Each returns false if the command queue is full.
+bool controlSetRelay(uint8_t relay, bool on);
+bool controlSetSensor(uint8_t slot, float value);
+bool controlSetPolicy(uint8_t relay, RelayPolicy policy);
+// Local time: `weekMs` into the week (see schedule.h) at halMillis() `at`.
+// Schedules jump straight to the state for that time.
+bool controlSetClock(uint32_t weekMs, uint32_t at);
+// On success the task owns `program` until it comes back from
+// controlTakeRetired()
+bool controlLoadProgram(ControlProgram *program);
+
+// Network side. Next program replaced by the task, or nullptr; the caller
+// deletes it.
+ControlProgram *controlTakeRetired();
+
+// Any task
+ControlSnapshot controlSnapshot();
+
+#endif // TERRAHUB_CONTROL_TASK_H
@@ -0,0 +1,65 @@
+/**
+ * TerraHub Controller Firmware - Current Signal Processing
+ *
+ * Per-channel RMS over a window of whole mains cycles, and the load fault
+ * check that compares each channel's current against its relay state. Plain
+ * integer/float code with no hardware access, so it runs unchanged on a
+ * host against synthetic waveforms.
+ */
+
+#ifndef TERRAHUB_CURRENT_DSP_H
+#define TERRAHUB_CURRENT_DSP_H
+
+#include <stdint.h>
+#include "config.h"
+
+// Samples per channel in one RMS window at `channelRateHz`, rounded to the
+// nearest sample
+uint16_t currentWindowSamples(uint32_t channelRateHz, uint16_t mainsHz, uint8_t cycles);
+
+/**
+ * Running sums for one channel. The DC bias of the sensor is removed over
+ * the same window, which is exact because the window spans whole cycles.
+ */
+struct CurrentRmsWindow {
+  uint16_t windowSamples;
+  uint16_t count;
+  uint32_t sum;
+  uint64_t sumSquares;
+};
+
+void currentRmsBegin(CurrentRmsWindow &window, uint16_t windowSamples);
+
+/**
+ * Add one raw ADC sample. Returns true when it completes a window; `rmsCounts`
+ * then holds the AC RMS of that window in ADC counts and the next window
+ * starts empty.
+ */
+bool currentRmsAdd(CurrentRmsWindow &window, uint16_t raw, float &rmsCounts);
+
+enum CurrentFault : uint8_t {
+  CURRENT_FAULT_NONE = 0,
+  CURRENT_FAULT_NO_LOAD,        // relay on, no current
+  CURRENT_FAULT_UNEXPECTED_LOAD // relay off, current flowing
+};
+
+const char *currentFaultName(CurrentFault fault);
+
+struct CurrentFaultState {
+  bool relayOn;
+  uint32_t relayChangedAt;
+  uint8_t strikes;          // consecutive windows disagreeing with `fault`
+  CurrentFault fault;
+};
+
+void currentFaultBegin(CurrentFaultState &state, bool relayOn, uint32_t now);
+
+/**
+ * Feed one window's RMS and the relay state. Windows within CURRENT_SETTLE_MS
+ * of a relay change are ignored; a fault is raised or cleared once
+ * CURRENT_FAULT_WINDOWS consecutive windows agree. Returns true when the
+ * fault state changed.
+ */
+bool currentFaultUpdate(CurrentFaultState &state, bool relayOn, float rmsMa, uint32_t now);
+
+#endif // TERRAHUB_CURRENT_DSP_H
@@ -0,0 +1,40 @@
+/**
+ * TerraHub Controller Firmware - Current Monitor
+ *
+ * Samples every usable current channel continuously with the ADC's DMA
+ * mode. A dedicated task drains the DMA buffers, runs the RMS and fault
+ * checks from current_dsp.h and publishes the results. Nothing here calls
+ * analogRead or runs on the control loop; the loop only reads the
+ * published values.
+ *
+ * Channels whose pin is not on ADC1 (the only unit the DMA mode can
+ * sample) or doubles as a relay output are reported as unavailable.
+ */
+
+#ifndef TERRAHUB_CURRENT_MONITOR_H
+#define TERRAHUB_CURRENT_MONITOR_H
+
+#include <stdint.h>
+#include "config.h"
+#include "current_dsp.h"
+
+struct CurrentChannelStatus {
+  bool available;
+  uint16_t rmsMa;        // last completed window
+  CurrentFault fault;
+  uint32_t windows;      // RMS windows completed since boot
+};
+
+// Configure the ADC, start DMA sampling and the processing task. Returns
+// false when no channel can be sampled.
+bool currentMonitorBegin();
+
+CurrentChannelStatus currentMonitorChannel(uint8_t channel);
+
+// Bit per channel currently in fault; cheap enough to check every loop
+uint32_t currentMonitorFaultMask();
+
+// Bumped on every fault raised or cleared
+uint32_t currentMonitorFaultEvents();
+
+#endif // TERRAHUB_CURRENT_MONITOR_H
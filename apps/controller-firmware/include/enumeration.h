@@ -0,0 +1,56 @@
+/**
+ * TerraHub Controller Firmware - Daisy-Chain Enumeration
+ *
+ * Non-blocking bring-up of the slave chain, advanced from the controller
+ * loop so it overlaps with the network bring-up. Per node:
+ *
+ *   1. HELLO_UNASSIGNED at the default address, repeated every
+ *      ENUM_HELLO_INTERVAL_MS until the node has booted
+ *   2. ASSIGN_ID at the default address
+ *   3. ENABLE_DOWNSTREAM at the new address, which also proves the node
+ *      moved there, so no separate PING round trip is needed
+ *
+ * Step 3 powers up the next node, whose HELLO probing starts immediately.
+ * The chain ends when no node answers within ENUM_NODE_BOOT_TIMEOUT_MS or
+ * MAX_NODES is reached.
+ */
+
+#ifndef TERRAHUB_ENUMERATION_H
+#define TERRAHUB_ENUMERATION_H
+
+#include <stdint.h>
+#include "config.h"
+#include "i2c_master.h"
+
+enum EnumerationState : uint8_t {
+  ENUM_STATE_IDLE = 0,
+  ENUM_STATE_PROBING,
+  ENUM_STATE_ASSIGNING,
+  ENUM_STATE_ENABLING,
+  ENUM_STATE_DONE,
+  ENUM_STATE_FAILED      // a node answered HELLO but could not be configured
+};
+
+struct EnumeratedNode {
+  uint8_t nodeId;
+  uint8_t fwMajor;
+  uint8_t fwMinor;
+  uint32_t bootMs;       // downstream enabled until the node answered HELLO
+  uint32_t configureMs;  // HELLO answered until downstream enabled on the node
+};
+
+const char *enumerationStateName(EnumerationState state);
+
+// Start enumerating; the controller's own SYNC_OUT must already be high
+void enumerationBegin(const I2cBus &bus, uint32_t now);
+
+// Advance enumeration; returns true while it is still running
+bool enumerationLoop(uint32_t now);
+
+EnumerationState enumerationState();
+// Time from enumerationBegin() until DONE/FAILED, or so far while running
+uint32_t enumerationElapsedMs(uint32_t now);
+uint8_t enumerationNodeCount();
+const EnumeratedNode &enumerationNode(uint8_t index);
+
+#endif // TERRAHUB_ENUMERATION_H
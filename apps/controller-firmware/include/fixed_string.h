@@ -0,0 +1,74 @@
+/**
+ * TerraHub Controller Firmware - Fixed-Capacity String
+ *
+ * Inline, NUL-terminated string of at most Capacity characters. Used instead
+ * of Arduino String in long-lived models so copying, reloading and comparing
+ * them never touches the heap.
+ */
+
+#ifndef TERRAHUB_FIXED_STRING_H
+#define TERRAHUB_FIXED_STRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+template <size_t Capacity>
+class FixedString {
+  static_assert(Capacity <= 255, "FixedString length is stored in one byte");
+
+ public:
+  static const size_t capacity = Capacity;
+
+  FixedString() : size_(0) {
+    text_[0] = '\0';
+  }
+
+  /**
+   * Replace the contents. Returns false and leaves the string unchanged if
+   * `value` is longer than Capacity.
+   */
+  bool assign(const char *value, size_t length) {
+    if (length > Capacity) {
+      return false;
+    }
+    memmove(text_, value, length);
+    text_[length] = '\0';
+    size_ = static_cast<uint8_t>(length);
+    return true;
+  }
+
+  bool assign(const char *value) {
+    return assign(value ? value : "", value ? strlen(value) : 0);
+  }
+
+  void clear() {
+    size_ = 0;
+    text_[0] = '\0';
+  }
+
+  const char *c_str() const { return text_; }
+  size_t length() const { return size_; }
+  bool isEmpty() const { return size_ == 0; }
+
+  bool operator==(const char *other) const {
+    return other && strcmp(text_, other) == 0;
+  }
+  bool operator!=(const char *other) const {
+    return !(*this == other);
+  }
+  template <size_t OtherCapacity>
+  bool operator==(const FixedString<OtherCapacity> &other) const {
+    return size_ == other.length() && memcmp(text_, other.c_str(), size_) == 0;
+  }
+  template <size_t OtherCapacity>
+  bool operator!=(const FixedString<OtherCapacity> &other) const {
+    return !(*this == other);
+  }
+
+ private:
+  char text_[Capacity + 1];
+  uint8_t size_;
+};
+
+#endif // TERRAHUB_FIXED_STRING_H
@@ -0,0 +1,110 @@
+/**
+ * TerraHub Controller Firmware - Hardware Abstraction Layer
+ *
+ * The few hardware services the engine modules (rules, schedules, relay
+ * output, the control pipeline, slave bus and persistence) need, so the
+ * same code builds for the ESP32 and for a plain host. hal_esp32.cpp maps
+ * them onto the Arduino core, Preferences and Wire; hal_native.cpp keeps
+ * in-memory stand-ins that tests and benchmarks drive directly through the
+ * halNative* controls below.
+ *
+ * Wi-Fi, the web server, ADC sampling and the slave side of the bus stay
+ * device-only and are not part of the HAL.
+ */
+
+#ifndef TERRAHUB_HAL_H
+#define TERRAHUB_HAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "i2c_master.h"
+
+// ============================================================================
+// Clock
+// ============================================================================
+
+// Milliseconds and microseconds since boot; both wrap around
+uint32_t halMillis();
+uint32_t halMicros();
+
+// The calling core's cycle counter (wraps every few seconds) and the clock
+// it counts at right now, which frequency scaling may change between calls
+uint32_t halCycleCount();
+uint32_t halCpuMhz();
+
+// ============================================================================
+// GPIO
+// ============================================================================
+
+void halPinOutput(uint8_t pin);
+void halDigitalWrite(uint8_t pin, bool high);
+
+// ============================================================================
+// Persistent Storage
+// ============================================================================
+
+// One key-value namespace ("terrahub" in NVS on the device). Blobs and
+// strings are separate types: a key written as one does not read as the
+// other.
+
+// Stored blob length, 0 when the key is absent
+size_t halNvsBlobLength(const char *key);
+// Copy up to `capacity` bytes of a blob; returns the bytes copied
+size_t halNvsReadBlob(const char *key, void *data, size_t capacity);
+// False if the write did not complete
+bool halNvsWriteBlob(const char *key, const void *data, size_t length);
+// False when the key is absent; `value` is left empty then
+bool halNvsReadString(const char *key, std::string &value);
+bool halNvsWriteString(const char *key, const char *value);
+void halNvsRemove(const char *key);
+
+// ============================================================================
+// I2C Master
+// ============================================================================
+
+// Bus to the slave chain; valid for the lifetime of the program
+const I2cBus &halI2cBus();
+
+// ============================================================================
+// Logging
+// ============================================================================
+
+// printf to the serial console on the device, stdout on a host
+void halLog(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+// ============================================================================
+// Native Controls
+// ============================================================================
+
+#if !defined(ARDUINO_ARCH_ESP32)
+
+// The clock only moves when told to, so runs are reproducible
+void halNativeSetMicros(uint64_t us);
+void halNativeAdvanceMicros(uint64_t us);
+void halNativeAdvanceMillis(uint32_t ms);
+
+// Last level written to `pin`, false before any write
+bool halNativePinLevel(uint8_t pin);
+uint32_t halNativePinWrites();
+
+// Forget every stored key, zero the write counters and stop failing writes
+void halNativeNvsClear();
+// Make every write fail, as a full or worn NVS partition would
+void halNativeNvsSetFailing(bool failing);
+uint32_t halNativeNvsWrites();
+size_t halNativeNvsBytesWritten();
+
+/**
+ * Route halI2cBus() to simulated nodes. Every byte moved costs
+ * 90 us on the clock, as on a 100 kHz bus. Without a bus
+ * installed nothing ACKs.
+ */
+void halNativeSetI2cBus(const I2cBus *bus);
+
+// Drop halLog() output, e.g. while benchmarking
+void halNativeSetLogging(bool enabled);
+
+#endif
+
+#endif // TERRAHUB_HAL_H
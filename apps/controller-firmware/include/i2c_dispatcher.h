@@ -0,0 +1,65 @@
+/**
+ * TerraHub Controller Firmware - I2C Slave Dispatcher
+ *
+ * Split between the Wire receive/request callbacks and the main loop:
+ *
+ * - onReceive reads the frame straight into the next slot of a fixed ring
+ *   (i2cDispatcherRxBuffer / i2cDispatcherRxCommit), checks it and publishes
+ *   it. No allocation, locks or handler code run in the callback.
+ * - i2cDispatcherPoll(), called from the main loop, hands each frame to its
+ *   command handler as a view into the ring slot. The handler writes its
+ *   payload directly into the next response frame.
+ * - onRequest gets a pointer to the ready-made response frame for the
+ *   latest request (i2cDispatcherTxFrame), or a canned BUSY frame while that
+ *   request is still queued.
+ *
+ * The protocol is strictly request/response, so a new request never
+ * arrives while the previous response is still being read.
+ */
+
+#ifndef TERRAHUB_I2C_DISPATCHER_H
+#define TERRAHUB_I2C_DISPATCHER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "i2c_frame.h"
+
+/**
+ * Command handler. Writes up to I2C_FRAME_MAX_PAYLOAD bytes into
+ * `response`, sets `responseLength` and returns the status code.
+ */
+typedef uint8_t (*I2cCommandHandler)(const I2cFrameView &request, uint8_t *response, uint8_t &responseLength);
+
+struct I2cDispatcherStats {
+  uint32_t framesReceived;   // valid frames queued
+  uint32_t framesHandled;
+  uint32_t framesRejected;   // bad length or checksum
+  uint32_t overruns;         // dropped because the ring was full
+  uint32_t unknownCommands;
+  uint32_t responsesSent;    // handler responses handed to the master
+};
+
+// Clear the ring, handlers and counters
+void i2cDispatcherBegin();
+
+// Register (or replace) the handler for `command`; false when the table is full
+bool i2cDispatcherRegister(uint8_t command, I2cCommandHandler handler);
+
+// Callback side: slot for the incoming frame (I2C_FRAME_MAX_BYTES long), or
+// nullptr when the ring is full
+uint8_t *i2cDispatcherRxBuffer();
+
+// Callback side: validate and publish the `length` bytes written to the slot.
+// Call it for every received frame, also when no slot was available.
+void i2cDispatcherRxCommit(size_t length);
+
+// Callback side: response frame for the latest request; returns its size
+size_t i2cDispatcherTxFrame(const uint8_t **frame);
+
+// Main loop side: run handlers for queued frames; returns how many ran
+uint8_t i2cDispatcherPoll();
+
+const I2cDispatcherStats &i2cDispatcherStats();
+
+#endif // TERRAHUB_I2C_DISPATCHER_H
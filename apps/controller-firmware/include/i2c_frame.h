@@ -0,0 +1,73 @@
+/**
+ * TerraHub Controller Firmware - I2C Frame Codec
+ *
+ * Framing from docs/protocol.md: command (or status in responses), payload
+ * length, payload and an XOR checksum of all preceding bytes. Decoding never
+ * copies; the decoded view points into the caller's buffer.
+ */
+
+#ifndef TERRAHUB_I2C_FRAME_H
+#define TERRAHUB_I2C_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define I2C_FRAME_MAX_PAYLOAD 254
+#define I2C_FRAME_OVERHEAD 3
+#define I2C_FRAME_MAX_BYTES (I2C_FRAME_MAX_PAYLOAD + I2C_FRAME_OVERHEAD)
+
+enum I2cCommand : uint8_t {
+  I2C_CMD_HELLO_UNASSIGNED = 0x01,
+  I2C_CMD_ASSIGN_ID = 0x02,
+  I2C_CMD_ENABLE_DOWNSTREAM = 0x03,
+  I2C_CMD_PING = 0x10,
+  I2C_CMD_GET_NODE_INFO = 0x11,
+  I2C_CMD_GET_PORTS = 0x12,
+  I2C_CMD_GET_PORT_STATE = 0x13,
+  I2C_CMD_SET_PORT_STATE = 0x14,
+  I2C_CMD_GET_SENSOR_VALUES = 0x20,
+  I2C_CMD_SET_CONFIG_CHUNK = 0x30,
+  I2C_CMD_GET_CONFIG_HASH = 0x31
+};
+
+enum I2cStatus : uint8_t {
+  I2C_STATUS_OK = 0x00,
+  I2C_STATUS_UNKNOWN_COMMAND = 0x01,
+  I2C_STATUS_INVALID_PARAMS = 0x02,
+  I2C_STATUS_BUSY = 0x03,
+  I2C_STATUS_HARDWARE_ERROR = 0x04,
+  I2C_STATUS_GENERAL_ERROR = 0xFF
+};
+
+enum I2cFrameResult : uint8_t {
+  I2C_FRAME_OK = 0,
+  I2C_FRAME_TRUNCATED,     // fewer bytes than the length field announces
+  I2C_FRAME_TRAILING,      // more bytes than the length field announces
+  I2C_FRAME_BAD_CHECKSUM
+};
+
+// Decoded frame; `payload` points into the buffer that was decoded
+struct I2cFrameView {
+  uint8_t code;            // command in requests, status in responses
+  uint8_t length;
+  const uint8_t *payload;
+};
+
+uint8_t i2cChecksum(const uint8_t *data, size_t length);
+
+/**
+ * Encode a frame into `out`. Returns the frame size, or 0 if `length`
+ * exceeds I2C_FRAME_MAX_PAYLOAD or `capacity` is too small. `payload` may
+ * already sit at out + 2, in which case it is not moved.
+ */
+size_t i2cEncodeFrame(uint8_t code, const uint8_t *payload, uint8_t length, uint8_t *out, size_t capacity);
+
+/**
+ * Finish a frame whose payload was written in place at frame + 2: fills in
+ * the header and checksum and returns the frame size.
+ */
+size_t i2cSealFrame(uint8_t *frame, uint8_t code, uint8_t length);
+
+I2cFrameResult i2cDecodeFrame(const uint8_t *data, size_t length, I2cFrameView &frame);
+
+#endif // TERRAHUB_I2C_FRAME_H
@@ -0,0 +1,59 @@
+/**
+ * TerraHub Controller Firmware - I2C Master Transactions
+ *
+ * One request/response exchange with a node, advanced without blocking:
+ * send the request, re-read while the node answers BUSY, and retry the
+ * whole exchange on NACK, timeout or a corrupt frame, with the timing
+ * from docs/protocol.md. The bus itself is reached through an I2cBus so
+ * the same code drives Wire on the device and a simulated bus on a host.
+ */
+
+#ifndef TERRAHUB_I2C_MASTER_H
+#define TERRAHUB_I2C_MASTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "i2c_frame.h"
+
+struct I2cBus {
+  // Write one frame to `address`; false when the address does not ACK
+  bool (*write)(uint8_t address, const uint8_t *data, size_t length);
+  // Read up to `length` bytes from `address`; returns the bytes received
+  size_t (*read)(uint8_t address, uint8_t *data, size_t length);
+};
+
+enum I2cTransactionState : uint8_t {
+  I2C_TXN_IDLE = 0,
+  I2C_TXN_PENDING,
+  I2C_TXN_DONE,      // `reply` holds the node's status and payload
+  I2C_TXN_FAILED     // no valid answer after I2C_RETRY_COUNT retries
+};
+
+struct I2cTransaction {
+  I2cTransactionState state;
+  uint8_t phase;
+  uint8_t address;
+  uint8_t attempts;
+  uint16_t readLength;
+  uint16_t requestLength;
+  uint32_t startedAt;
+  uint32_t attemptDeadline;
+  uint32_t nextActionAt;
+  uint32_t latencyMs;          // start to completion, DONE or FAILED
+  I2cFrameView reply;          // points into `response`
+  uint8_t request[I2C_FRAME_MAX_BYTES];
+  uint8_t response[I2C_FRAME_MAX_BYTES];
+};
+
+/**
+ * Begin an exchange. `maxResponseLength` is the largest payload the
+ * command can answer with and bounds how much is read back.
+ */
+void i2cTransactionStart(I2cTransaction &txn, uint8_t address, uint8_t command, const uint8_t *payload,
+                         uint8_t length, uint8_t maxResponseLength, uint32_t now);
+
+// Advance the exchange; cheap to call every loop iteration
+I2cTransactionState i2cTransactionPoll(I2cTransaction &txn, const I2cBus &bus, uint32_t now);
+
+#endif // TERRAHUB_I2C_MASTER_H
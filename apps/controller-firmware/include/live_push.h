@@ -0,0 +1,58 @@
+/**
+ * TerraHub Controller Firmware - Live Status Push
+ *
+ * WebSocket endpoint (/api/live) that pushes state changes to subscribers
+ * instead of having them poll /api/status. The control loop builds each
+ * message once and livePushBroadcast() hands the same bytes to every
+ * subscriber.
+ *
+ * Messages carry absolute values, never increments, so a subscriber that
+ * misses some of them only needs a fresh snapshot to catch up. A subscriber
+ * whose send queue is full is skipped instead of queued to: everything it
+ * missed collapses into one snapshot once it can take messages again. One
+ * that stays full for LIVE_STALL_TIMEOUT_MS is disconnected. A slow client
+ * therefore costs at most its own queue and never blocks the control loop.
+ */
+
+#ifndef TERRAHUB_LIVE_PUSH_H
+#define TERRAHUB_LIVE_PUSH_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+// Serializes the full current state into `out`
+typedef void (*LiveSnapshotWriter)(String &out);
+
+struct LivePushStats {
+  uint8_t subscribers;
+  uint32_t messages;      // deltas broadcast
+  uint32_t snapshots;     // snapshots sent, initial ones included
+  uint32_t skipped;       // deltas not sent to a subscriber that was behind
+  uint32_t disconnected;  // subscribers dropped for stalling or over the limit
+};
+
+// Register the WebSocket handler; call before server.begin()
+void livePushBegin(AsyncWebServer &server);
+
+bool livePushHasSubscribers();
+
+// Send one message to every subscriber that is in sync
+void livePushBroadcast(const char *message, size_t length);
+
+// Make every subscriber start over from a snapshot, e.g. after the rule set
+// was replaced
+void livePushResync();
+
+/**
+ * Send a snapshot to subscribers that need one and can take it, and close
+ * the ones stalled for too long. The snapshot is written at most once per
+ * call. Call from the main loop after the pass's broadcast.
+ */
+void livePushLoop(uint32_t now, LiveSnapshotWriter writeSnapshot);
+
+LivePushStats livePushStats();
+
+#endif // TERRAHUB_LIVE_PUSH_H
@@ -0,0 +1,92 @@
+/**
+ * TerraHub Controller Firmware - Metrics
+ *
+ * Latency histograms for the hot paths (HTTP handlers, the network loop,
+ * each stage of a control pass and NVS writes), timed with the CPU cycle
+ * counter and served with heap and task stack gauges at /api/metrics in the
+ * Prometheus text format.
+ *
+ * Recording reads the cycle counter twice, divides once and bumps three
+ * counters with relaxed atomics, so it stays on in production and a scrape
+ * never blocks a writer. Bucket bounds are powers of two in microseconds,
+ * which makes picking one a count-leading-zeros. Every timed task is pinned
+ * to a core, so both reads of the per-core counter come from the same one.
+ *
+ * Build with -DTERRAHUB_METRICS=0 to compile the timers out; the endpoint
+ * then serves the gauges only.
+ */
+
+#ifndef TERRAHUB_METRICS_H
+#define TERRAHUB_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "hal.h"
+
+// le 1 us, 2 us, 4 us ... 65.536 ms, then +Inf
+#define METRICS_BUCKETS 18
+
+enum MetricStage : uint8_t {
+  METRIC_STAGE_HTTP = 0,       // one HTTP request handler
+  METRIC_STAGE_NETWORK_LOOP,   // one pass of the controller's network loop
+  METRIC_STAGE_CONTROL_PASS,   // one control task pass, commands to snapshot
+  METRIC_STAGE_SENSOR_POLL,
+  METRIC_STAGE_RULES,          // rule and schedule evaluation
+  METRIC_STAGE_RELAY_OUTPUT,   // relay arbitration and the GPIO writes
+  METRIC_STAGE_NVS_WRITE,
+  METRIC_STAGE_COUNT
+};
+
+struct MetricsHistogram {
+  uint32_t buckets[METRICS_BUCKETS];  // per bucket, not cumulative
+  uint32_t count;
+  uint64_t sumNs;
+};
+
+const char *metricStageName(uint8_t stage);
+
+// `cycles` of the calling core's counter spent in `stage`
+void metricsRecord(uint8_t stage, uint32_t cycles);
+
+// Copy of a stage's histogram; counters may move while it is taken
+MetricsHistogram metricsHistogram(uint8_t stage);
+
+// Times the enclosing scope into a stage
+class MetricsTimer {
+ public:
+#if TERRAHUB_METRICS
+  explicit MetricsTimer(uint8_t stage) : stage_(stage), start_(halCycleCount()) {}
+  ~MetricsTimer() { metricsRecord(stage_, halCycleCount() - start_); }
+#else
+  explicit MetricsTimer(uint8_t) {}
+#endif
+  MetricsTimer(const MetricsTimer &) = delete;
+  MetricsTimer &operator=(const MetricsTimer &) = delete;
+
+ private:
+#if TERRAHUB_METRICS
+  uint8_t stage_;
+  uint32_t start_;
+#endif
+};
+
+// ============================================================================
+// Prometheus Text Format
+// ============================================================================
+
+// Where the exposition goes: an HTTP response stream on the device
+struct MetricsWriter {
+  void (*write)(const char *text, size_t length, void *context);
+  void *context;
+};
+
+// "# HELP" and "# TYPE" lines of a metric family
+void metricsWriteFamily(const MetricsWriter &writer, const char *name, const char *type, const char *help);
+// One sample; `labels` is the text between the braces, or nullptr
+void metricsWriteSample(const MetricsWriter &writer, const char *name, const char *labels, uint64_t value);
+
+// terrahub_stage_duration_seconds for every stage; nothing when compiled out
+void metricsWriteHistograms(const MetricsWriter &writer);
+
+#endif // TERRAHUB_METRICS_H
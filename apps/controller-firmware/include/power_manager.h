@@ -0,0 +1,63 @@
+/**
+ * TerraHub Controller Firmware - Power Management
+ *
+ * The control task and the network loop each sleep until their own next
+ * deadline instead of waking on a fixed tick. powerWait() blocks the calling
+ * task until its deadline or until another task calls powerWake() for it,
+ * and accounts the time in between: while either task is awake the
+ * controller is ACTIVE, while both wait it is IDLE, or LIGHT_SLEEP when
+ * automatic light sleep is available to the build.
+ *
+ * Other tasks (async TCP, current sampling) are not tracked; their work
+ * counts towards whatever state the two tracked tasks are in.
+ */
+
+#ifndef TERRAHUB_POWER_MANAGER_H
+#define TERRAHUB_POWER_MANAGER_H
+
+#include <stdint.h>
+#include "config.h"
+
+enum PowerTask : uint8_t {
+  POWER_TASK_CONTROL = 0,
+  POWER_TASK_NETWORK,
+  POWER_TASK_COUNT
+};
+
+enum PowerState : uint8_t {
+  POWER_STATE_ACTIVE = 0,
+  POWER_STATE_IDLE,
+  POWER_STATE_LIGHT_SLEEP,
+  POWER_STATE_COUNT
+};
+
+struct PowerStats {
+  uint64_t stateUs[POWER_STATE_COUNT];  // since powerBegin()
+  uint32_t wakeups[POWER_TASK_COUNT];   // waits that ended
+  uint32_t woken[POWER_TASK_COUNT];     // of those, ended by powerWake() before the deadline
+  bool lightSleep;                      // automatic light sleep configured
+  bool cpuScaling;                      // frequency scaling between POWER_*_CPU_MHZ
+  bool modemSleep;                      // Wi-Fi modem sleep in effect
+};
+
+const char *powerStateName(uint8_t state);
+
+// Configure frequency scaling, light sleep and modem sleep where the build
+// supports them; call once after WiFi.mode()
+void powerBegin();
+
+// Called by a task once, before its first powerWait()
+void powerRegister(PowerTask task);
+
+/**
+ * Block the calling task for up to `timeoutMs` (at least one tick) or until
+ * powerWake(task). Returns true if it was woken early.
+ */
+bool powerWait(PowerTask task, uint32_t timeoutMs);
+
+// Any task; a no-op for the calling task itself or an unregistered one
+void powerWake(PowerTask task);
+
+PowerStats powerStats();
+
+#endif // TERRAHUB_POWER_MANAGER_H
@@ -0,0 +1,51 @@
+/**
+ * TerraHub Controller Firmware - Relay Output Stage
+ *
+ * Collects the relay states requested during an evaluation pass, resolves
+ * conflicting requests per relay and drives only the relays that actually
+ * change, with one GPIO register write per bank.
+ */
+
+#ifndef TERRAHUB_RELAY_OUTPUT_H
+#define TERRAHUB_RELAY_OUTPUT_H
+
+#include <stdint.h>
+#include "config.h"
+
+// How conflicting requests for the same relay are resolved
+enum RelayPolicy : uint8_t {
+  RELAY_POLICY_PRIORITY = 0,  // highest priority request wins, ties go to the last one
+  RELAY_POLICY_ANY_ON,        // on if any request is on
+  RELAY_POLICY_ALL_ON,        // on only if every request is on
+  RELAY_POLICY_COUNT
+};
+
+const char *relayPolicyName(uint8_t policy);
+// Returns RELAY_POLICY_COUNT for unknown names
+RelayPolicy relayPolicyFromName(const char *name);
+
+void relayOutputBegin();
+void relayOutputSetPolicy(uint8_t relay, RelayPolicy policy);
+RelayPolicy relayOutputPolicy(uint8_t relay);
+
+/**
+ * Request a relay state for the current pass. Requests from active rules
+ * always beat fallback requests (released rules); fallback requests only
+ * decide the relay when no active rule asks for anything.
+ */
+void relayOutputVote(uint8_t relay, bool on, int8_t priority, bool active);
+
+// Manual override for the current pass, wins over any vote
+void relayOutputForce(uint8_t relay, bool on);
+
+/**
+ * Resolve all requests made since the last commit and write the relays that
+ * changed. Relays without requests keep their state. Returns the mask of
+ * relays that toggled.
+ */
+uint32_t relayOutputCommit();
+
+bool relayOutputState(uint8_t relay);
+uint32_t relayOutputToggleCount(uint8_t relay);
+
+#endif // TERRAHUB_RELAY_OUTPUT_H
@@ -0,0 +1,57 @@
+/**
+ * TerraHub Controller Firmware - Rule JSON Codec
+ *
+ * Conversion between RuleDefinition and the JSON shape used by the HTTP API
+ * and NVS storage.
+ *
+ * `condition` is either the flat { sensor, op, threshold, hysteresis } of
+ * the original API or a compound condition built from
+ *   { "all": [ ... ] }, { "any": [ ... ] }, { "not": { ... } }
+ * and comparisons { sensor, op, threshold, hysteresis?, rate?, against? }.
+ * `rate: true` compares the sensor's rate of change per minute instead of
+ * its value; `against` names a sensor whose value is added to the
+ * threshold. A condition object using none of these keys is read as flat.
+ */
+
+#ifndef TERRAHUB_RULE_JSON_H
+#define TERRAHUB_RULE_JSON_H
+
+#include <ArduinoJson.h>
+#include "config.h"
+#include "rules.h"
+
+// ArduinoJson pool needed to write a single rule; strings are stored by
+// pointer. Every term is at most a 6-member object, and all operand arrays
+// together hold fewer than MAX_RULE_TERMS entries.
+#define RULE_JSON_CAPACITY \
+  (JSON_OBJECT_SIZE(6) + JSON_OBJECT_SIZE(3) + MAX_RULE_TERMS * JSON_OBJECT_SIZE(6) + JSON_ARRAY_SIZE(MAX_RULE_TERMS))
+
+// Upper bound of one serialized rule: every string character escaped to two
+// bytes plus keys, punctuation and numbers, and up to 144 bytes per term
+#define RULE_JSON_MAX_BYTES \
+  (2 * (MAX_RULE_ID_LENGTH + MAX_RULE_NAME_LENGTH + 2 * MAX_RULE_TOKEN_LENGTH) + 256 + MAX_RULE_TERMS * 144)
+
+/**
+ * Read a rule object. Returns false when a string field exceeds its
+ * MAX_RULE_* limit or a compound condition is malformed: an unknown sensor
+ * or op, an empty all/any, more than MAX_RULE_TERMS terms. `rule` is left
+ * partially filled in that case.
+ */
+bool readRuleJson(JsonObject obj, RuleDefinition &rule);
+
+/**
+ * Overwrite only the fields present in `obj`, leaving the rest of `rule`
+ * untouched. A compound condition is always replaced as a whole; on a rule
+ * with a compound condition, flat condition fields are only accepted as a
+ * complete flat condition (at least sensor and op), which replaces it.
+ * Same return value as readRuleJson().
+ */
+bool patchRuleJson(JsonObject obj, RuleDefinition &rule);
+
+/**
+ * Write a rule into `obj`. Strings are referenced, not copied, so `rule`
+ * must outlive serialization of the document.
+ */
+void writeRuleJson(const RuleDefinition &rule, JsonObject obj);
+
+#endif // TERRAHUB_RULE_JSON_H
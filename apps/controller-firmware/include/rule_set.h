@@ -0,0 +1,92 @@
+/**
+ * TerraHub Controller Firmware - Rule and Schedule Set
+ *
+ * The network side's copy of the rule and schedule definitions. Edits from
+ * the HTTP API are validated here, compiled into a ControlProgram and
+ * handed to the control task; rules and schedules are persisted through
+ * the HAL. Request bodies go in as text and come back as a status and an
+ * error body, so the same handling runs behind the web server on the
+ * device and in host tests and benchmarks.
+ *
+ * Nothing here locks. On the device every call is made under the
+ * controller lock (see main.cpp).
+ */
+
+#ifndef TERRAHUB_RULE_SET_H
+#define TERRAHUB_RULE_SET_H
+
+#include <stdint.h>
+#include <vector>
+#include "config.h"
+#include "control_task.h"
+#include "rules.h"
+#include "schedule.h"
+
+// Outcome of a request: HTTP status and a JSON error body, or nullptr when
+// the response has no body
+struct RuleSetResponse {
+  uint16_t status;
+  const char *body;
+};
+
+const std::vector<RuleDefinition> &ruleSetRules();
+// Bumped whenever the rule set is replaced
+uint32_t ruleSetGeneration();
+const std::vector<ScheduleDefinition> &ruleSetSchedules();
+// Last program handed to the control task, nullptr before the first
+const ControlProgram *ruleSetProgram();
+
+// Free the programs the control task has switched away from
+void ruleSetDrainRetired();
+
+/**
+ * Replace the rules or the schedules. Return false, leaving the set
+ * unchanged, if the control task's command queue is full.
+ *
+ * When `editedId` is given, only that rule differs from the current set;
+ * see applyProgram() in rule_set.cpp for how state carries over.
+ */
+bool ruleSetApplyRules(std::vector<RuleDefinition> &nextRules, const RuleId *editedId = nullptr);
+bool ruleSetApplySchedules(std::vector<ScheduleDefinition> &nextSchedules);
+
+// ============================================================================
+// Requests
+// ============================================================================
+
+// `body` is the NUL-terminated request body, nullptr if none arrived.
+// Rule edits schedule a debounced save; schedules are saved at once.
+
+// POST /api/rules: replace every rule
+RuleSetResponse ruleSetReplaceRules(const char *body);
+// PUT /api/rules/{id}: create or replace one rule
+RuleSetResponse ruleSetPutRule(const RuleId &id, const char *body);
+// PATCH /api/rules/{id}: change the given fields of one rule
+RuleSetResponse ruleSetPatchRule(const RuleId &id, const char *body);
+// DELETE /api/rules/{id}
+RuleSetResponse ruleSetDeleteRule(const RuleId &id);
+// POST /api/schedules: replace every schedule
+RuleSetResponse ruleSetReplaceSchedules(const char *body);
+
+// ============================================================================
+// Persistence
+// ============================================================================
+
+// Rules, then schedules; call once before the control task starts
+void ruleSetLoad();
+
+bool ruleSetSaveRules();
+bool ruleSetSaveSchedules();
+
+/**
+ * Rule edits are written once a burst from the UI has settled: each edit
+ * pushes the write back by RULES_SAVE_DEBOUNCE_MS, but never past
+ * RULES_SAVE_MAX_DELAY_MS after the first unsaved edit.
+ */
+void ruleSetScheduleSave(uint32_t now);
+// Returns true when the deferred write came due and was made. A failed
+// write stays pending and is retried RULES_SAVE_DEBOUNCE_MS later.
+bool ruleSetFlushSave(uint32_t now);
+// When ruleSetFlushSave() next has work; false if nothing is pending
+bool ruleSetSaveDeadline(uint32_t &deadline);
+
+#endif // TERRAHUB_RULE_SET_H
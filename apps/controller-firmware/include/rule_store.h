@@ -0,0 +1,67 @@
+/**
+ * TerraHub Controller Firmware - Binary Rule Storage
+ *
+ * Compact record format used to persist the rule set in NVS. Layout (all
+ * fields little-endian):
+ *
+ *   header  u8 version, u8 reserved, u16 rule count,
+ *           u32 payload length, u32 CRC-32 of the payload
+ *   record  u8 flags (bit 0 enabled, bit 1 turnOn), i8 priority,
+ *           u8 relayIndex, u8 reserved, f32 threshold, f32 hysteresis,
+ *           u32 minDurationMs, then id, name, sensor and op each as
+ *           u8 length + bytes, then u8 term count and the compound
+ *           condition's terms in pre-order
+ *   term    u8 type, u8 operands, u8 op, u8 input, u8 against,
+ *           f32 threshold, f32 hysteresis
+ *
+ * Version 1 records end after op and always have a flat condition.
+ *
+ * Bump RULE_STORE_VERSION whenever the record layout changes and teach
+ * ruleStoreDecode() to read the older versions.
+ */
+
+#ifndef TERRAHUB_RULE_STORE_H
+#define TERRAHUB_RULE_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "config.h"
+#include "rules.h"
+
+#define RULE_STORE_VERSION 2
+#define RULE_STORE_HEADER_BYTES 12
+// Numeric fields of a record plus the four string length bytes and the
+// term count (not present in version 1)
+#define RULE_STORE_RECORD_FIXED_BYTES 21
+#define RULE_STORE_V1_RECORD_FIXED_BYTES 20
+#define RULE_STORE_TERM_BYTES 13
+
+enum RuleStoreResult : uint8_t {
+  RULE_STORE_OK = 0,
+  RULE_STORE_TRUNCATED,
+  RULE_STORE_BAD_VERSION,
+  RULE_STORE_BAD_CRC,
+  RULE_STORE_BAD_RECORD
+};
+
+const char *ruleStoreResultName(RuleStoreResult result);
+
+uint32_t ruleStoreCrc32(const uint8_t *data, size_t length);
+
+// Exact number of bytes ruleStoreEncode() will write for `rules`
+size_t ruleStoreEncodedSize(const std::vector<RuleDefinition> &rules);
+
+/**
+ * Encode `rules` into `buffer`. Returns the number of bytes written, or 0 if
+ * `capacity` is too small or a string field exceeds its MAX_RULE_* limit.
+ */
+size_t ruleStoreEncode(const std::vector<RuleDefinition> &rules, uint8_t *buffer, size_t capacity);
+
+/**
+ * Decode a blob written by ruleStoreEncode(). `rules` is only replaced when
+ * the whole blob is valid.
+ */
+RuleStoreResult ruleStoreDecode(const uint8_t *data, size_t length, std::vector<RuleDefinition> &rules);
+
+#endif // TERRAHUB_RULE_STORE_H
@@ -0,0 +1,230 @@
+/**
+ * TerraHub Controller Firmware - Rules Engine
+ *
+ * Rule definitions as exchanged over the HTTP API and persisted in NVS, plus
+ * the compiled form that the control loop evaluates every tick.
+ *
+ * A condition is either the flat single comparison of the original API or
+ * a tree of all/any/not terms over comparisons. Compiling a rule set merges
+ * the conditions of all rules into one expression DAG: a sub-expression
+ * used by several rules becomes a single node whose result is computed at
+ * most once per evaluation round.
+ */
+
+#ifndef TERRAHUB_RULES_H
+#define TERRAHUB_RULES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "config.h"
+#include "fixed_string.h"
+
+// ============================================================================
+// Sensors
+// ============================================================================
+
+// Sensor slots evaluated by the rules engine
+enum SensorSlot : uint8_t {
+  SENSOR_TEMPERATURE = 0,
+  SENSOR_HUMIDITY,
+  SENSOR_LIGHT_LEVEL,
+  SENSOR_SLOT_COUNT,
+  SENSOR_SLOT_INVALID = 0xFF
+};
+
+// Sensor values that the ESP evaluates locally, indexed by SensorSlot
+struct SensorValues {
+  float slots[SENSOR_SLOT_COUNT];
+};
+
+// What a condition can read: each sensor's value (input = SensorSlot), then
+// its rate of change per minute (input = SENSOR_SLOT_COUNT + SensorSlot)
+#define RULE_INPUT_COUNT (2 * SENSOR_SLOT_COUNT)
+#define RULE_INPUT_NONE 0xFF
+
+struct RuleInputs {
+  float values[RULE_INPUT_COUNT];
+};
+
+inline uint8_t ruleRateInput(uint8_t slot) {
+  return SENSOR_SLOT_COUNT + slot;
+}
+
+// ============================================================================
+// Rule Definitions
+// ============================================================================
+
+typedef FixedString<MAX_RULE_ID_LENGTH> RuleId;
+typedef FixedString<MAX_RULE_NAME_LENGTH> RuleName;
+typedef FixedString<MAX_RULE_TOKEN_LENGTH> RuleToken;
+
+enum CompareOp : uint8_t {
+  COMPARE_GT = 0,
+  COMPARE_LT,
+  COMPARE_GTE,
+  COMPARE_LTE,
+  COMPARE_BAND,    // eq: value within threshold +/- hysteresis
+  COMPARE_NEVER    // unknown operator or sensor, never matches
+};
+
+// Flat condition of the original API. Names are kept as sent, so a rule
+// with an unknown sensor or op round-trips unchanged (and never matches).
+struct RuleCondition {
+  RuleToken sensor;
+  RuleToken op;        // gt, lt, gte, lte, eq
+  float threshold;
+  float hysteresis;
+};
+
+enum RuleTermType : uint8_t {
+  RULE_TERM_COMPARE = 0,
+  RULE_TERM_ALL,       // and
+  RULE_TERM_ANY,       // or
+  RULE_TERM_NOT,
+  RULE_TERM_TYPE_COUNT
+};
+
+/**
+ * One term of a compound condition. A comparison reads `input` and
+ * compares it with `threshold`, or with the value of `against` plus
+ * `threshold` when `against` is set. Names are resolved when the rule is
+ * read, so unlike the flat condition every field is known to be valid.
+ */
+struct RuleTerm {
+  float threshold;
+  float hysteresis;
+  RuleTermType type;
+  uint8_t operands;    // all/any: operand count; not: 1
+  CompareOp op;
+  uint8_t input;       // RuleInput
+  uint8_t against;     // RuleInput, RULE_INPUT_NONE to compare with threshold alone
+};
+
+// Compound condition, terms in pre-order: an all/any/not term is followed
+// by its operands, each with its own operands
+struct RuleExpression {
+  uint8_t termCount;   // 0: the rule uses its flat condition
+  RuleTerm terms[MAX_RULE_TERMS];
+};
+
+struct RuleAction {
+  uint8_t relayIndex;
+  bool turnOn;
+  uint32_t minDurationMs;
+};
+
+struct RuleDefinition {
+  RuleId id;
+  RuleName name;
+  bool enabled;
+  int8_t priority;     // relay arbitration, higher wins
+
+  RuleCondition condition;
+  RuleExpression expression;
+  RuleAction action;
+};
+
+// ============================================================================
+// Compiled Rules
+// ============================================================================
+
+enum ExprNodeType : uint8_t {
+  EXPR_COMPARE = 0,
+  EXPR_ALL,
+  EXPR_ANY,
+  EXPR_NOT
+};
+
+// Node of the shared condition DAG. Operands of all/any/not are
+// exprOperands[firstOperand .. firstOperand + operandCount) and always
+// come earlier in RuleProgram::nodes than the node itself.
+struct ExprNode {
+  ExprNodeType type;
+  CompareOp op;
+  uint8_t input;
+  uint8_t against;        // RuleInput added to low/high, RULE_INPUT_NONE for none
+  uint16_t firstOperand;
+  uint16_t operandCount;
+  float low;              // threshold, or lower band edge for COMPARE_BAND
+  float high;             // upper band edge for COMPARE_BAND
+};
+
+#define RULE_CONDITION_NEVER 0xFFFF
+
+// Bit mask with one bit per rule input, used for dirty tracking
+typedef uint32_t SensorMask;
+static const SensorMask SENSOR_MASK_ALL = (1u << RULE_INPUT_COUNT) - 1;
+
+// String-free form of an enabled rule. Built once whenever the rule set
+// changes so that evaluation is a walk over a few DAG nodes.
+struct CompiledRule {
+  uint16_t condition;  // root node, RULE_CONDITION_NEVER if it can never match
+  int8_t priority;
+  uint16_t ruleIndex;  // index into the source rule list
+  SensorMask inputs;   // inputs the condition reads
+  RuleAction action;
+};
+
+// Runtime state of a compiled rule, indexed like RuleProgram::rules
+struct RuleState {
+  uint32_t minEndTime;
+  bool active;              // condition met and action applied
+  bool minDurationElapsed;  // action may be released once the condition clears
+  uint32_t evaluatedRound;  // last evaluation round that looked at the rule
+};
+
+// Enabled rules in evaluation order, their condition DAG, plus input ->
+// dependent rules and relay -> driving rules indexes. Rules reading input i
+// are inputRules[inputRuleStart[i] .. inputRuleStart[i + 1]), likewise for
+// relays; a rule reading several inputs is listed under each.
+struct RuleProgram {
+  std::vector<CompiledRule> rules;
+  std::vector<ExprNode> nodes;
+  std::vector<uint16_t> exprOperands;
+  uint16_t inputRuleStart[RULE_INPUT_COUNT + 1];
+  std::vector<uint16_t> inputRules;
+  uint16_t relayRuleStart[NUM_RELAY_CHANNELS + 1];
+  std::vector<uint16_t> relayRules;
+};
+
+uint8_t sensorSlotFromName(const char *name);
+const char *sensorSlotName(uint8_t slot);
+CompareOp compareOpFromName(const char *name);
+const char *compareOpName(uint8_t op);
+
+void compileRules(const std::vector<RuleDefinition> &rules, RuleProgram &program);
+
+// True if the two rules' conditions compiled to the same expression, however
+// their nodes are numbered
+bool sameCompiledCondition(const RuleProgram &a, const CompiledRule &ruleA, const RuleProgram &b,
+                           const CompiledRule &ruleB);
+
+// ============================================================================
+// Evaluation
+// ============================================================================
+
+// Rounds wrap before the round number would overflow a memo stamp
+#define EXPR_MAX_ROUND 0x7FFFFFFFUL
+
+/**
+ * One evaluation round over a program. Inputs must not change during a
+ * round; each node's result is memoized in `memo` (one stamp per node,
+ * (round << 1) | result) the first time it is needed.
+ */
+struct ExprEvaluation {
+  const RuleProgram *program;
+  const RuleInputs *inputs;
+  uint32_t *memo;
+  uint32_t round;           // 1 .. EXPR_MAX_ROUND
+  uint32_t nodesEvaluated;  // nodes computed rather than taken from the memo
+};
+
+/**
+ * Evaluate a rule's condition. All/any stop at the first operand that
+ * decides the result. NaN readings never match a comparison because every
+ * comparison against NaN is false, but `not` of such a comparison does.
+ */
+bool evaluateCompiledRule(const CompiledRule &rule, ExprEvaluation &evaluation);
+
+#endif // TERRAHUB_RULES_H
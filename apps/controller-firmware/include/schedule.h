@@ -0,0 +1,105 @@
+/**
+ * TerraHub Controller Firmware - Time-of-Day Schedules
+ *
+ * Schedule definitions as exchanged over the HTTP API and persisted in NVS,
+ * plus the compiled form the control task runs. A schedule switches one of
+ * the controller's relays at fixed local times on the days it is active;
+ * between two entries the relay keeps the state of the earlier one.
+ *
+ * Compiled schedules are a sorted list of transitions within a week, so the
+ * state at any moment and the time of the next transition are a binary
+ * search away. Positions in the week are milliseconds since Monday 00:00
+ * local time.
+ */
+
+#ifndef TERRAHUB_SCHEDULE_H
+#define TERRAHUB_SCHEDULE_H
+
+#include <stdint.h>
+#include <vector>
+#include "config.h"
+#include "fixed_string.h"
+
+#define SCHEDULE_DAY_MS 86400000UL
+#define SCHEDULE_WEEK_MS (7 * SCHEDULE_DAY_MS)
+
+// Bit per day of the week, Monday first
+enum ScheduleDay : uint8_t {
+  SCHEDULE_MONDAY = 0,
+  SCHEDULE_TUESDAY,
+  SCHEDULE_WEDNESDAY,
+  SCHEDULE_THURSDAY,
+  SCHEDULE_FRIDAY,
+  SCHEDULE_SATURDAY,
+  SCHEDULE_SUNDAY,
+  SCHEDULE_DAY_COUNT
+};
+
+static const uint8_t SCHEDULE_EVERY_DAY = (1u << SCHEDULE_DAY_COUNT) - 1;
+
+// ============================================================================
+// Schedule Definitions
+// ============================================================================
+
+typedef FixedString<MAX_RULE_ID_LENGTH> ScheduleId;
+typedef FixedString<MAX_RULE_NAME_LENGTH> ScheduleName;
+
+struct ScheduleEntry {
+  uint16_t minuteOfDay;  // 0 - 1439, from "HH:MM"
+  bool state;
+};
+
+// Trivially copyable, so the whole set is stored in NVS as one blob
+struct ScheduleDefinition {
+  ScheduleId id;
+  ScheduleName name;
+  bool enabled;
+  int8_t priority;     // relay arbitration against rules, higher wins
+  uint8_t nodeId;      // only the controller (1) can be scheduled
+  uint8_t portId;      // 1-based, relay portId - 1
+  uint8_t days;        // ScheduleDay bits
+  uint8_t entryCount;
+  ScheduleEntry entries[MAX_SCHEDULE_ENTRIES];
+};
+
+const char *scheduleDayName(uint8_t day);
+// SCHEDULE_DAY_COUNT for an unknown name
+uint8_t scheduleDayFromName(const char *name);
+
+// "HH:MM" -> minute of day; false if malformed or out of range
+bool scheduleParseTime(const char *text, uint16_t &minuteOfDay);
+// minute of day -> "HH:MM"; `text` holds at least 6 bytes
+void scheduleFormatTime(uint16_t minuteOfDay, char *text);
+
+// ============================================================================
+// Compiled Schedules
+// ============================================================================
+
+struct ScheduleTransition {
+  uint32_t weekMs;
+  bool state;
+};
+
+// An enabled schedule with at least one transition, sorted by weekMs
+struct CompiledSchedule {
+  uint8_t relayIndex;
+  int8_t priority;
+  uint16_t scheduleIndex;  // index into the source schedule list
+  std::vector<ScheduleTransition> transitions;
+};
+
+struct ScheduleProgram {
+  std::vector<CompiledSchedule> schedules;
+};
+
+void compileSchedules(const std::vector<ScheduleDefinition> &schedules, ScheduleProgram &program);
+
+// State of `schedule` at `weekMs`: that of the last transition at or before
+// it, wrapping around to the previous week
+bool scheduleStateAt(const CompiledSchedule &schedule, uint32_t weekMs);
+
+// Milliseconds from `weekMs` until the next transition after it (at most
+// one week)
+uint32_t scheduleMsUntilNext(const CompiledSchedule &schedule, uint32_t weekMs);
+
+#endif // TERRAHUB_SCHEDULE_H
@@ -0,0 +1,33 @@
+/**
+ * TerraHub Controller Firmware - Schedule JSON Codec
+ *
+ * Conversion between ScheduleDefinition and the JSON shape of the
+ * config-schema Schedule used by the HTTP API.
+ */
+
+#ifndef TERRAHUB_SCHEDULE_JSON_H
+#define TERRAHUB_SCHEDULE_JSON_H
+
+#include <ArduinoJson.h>
+#include "config.h"
+#include "schedule.h"
+
+// ArduinoJson pool needed to write a single schedule; entry times are copied
+#define SCHEDULE_JSON_CAPACITY \
+  (JSON_OBJECT_SIZE(8) + JSON_ARRAY_SIZE(SCHEDULE_DAY_COUNT) + JSON_ARRAY_SIZE(MAX_SCHEDULE_ENTRIES) + \
+   MAX_SCHEDULE_ENTRIES * (JSON_OBJECT_SIZE(2) + 6))
+
+/**
+ * Read a schedule object. Returns false when a string is longer than its
+ * MAX_RULE_* limit, a day name or "HH:MM" time is malformed or there are
+ * more than MAX_SCHEDULE_ENTRIES entries.
+ */
+bool readScheduleJson(JsonObject obj, ScheduleDefinition &schedule);
+
+/**
+ * Write a schedule into `obj`. Id and name are referenced, not copied, so
+ * `schedule` must outlive serialization of the document.
+ */
+void writeScheduleJson(const ScheduleDefinition &schedule, JsonObject obj);
+
+#endif // TERRAHUB_SCHEDULE_JSON_H
@@ -0,0 +1,73 @@
+/**
+ * TerraHub Controller Firmware - Sensor History
+ *
+ * Fixed-size, in-memory time series of every sensor slot at
+ * HISTORY_TIER_COUNT resolutions. Each tier is a ring of buckets holding
+ * the min, max and mean of the samples that fell into it, quantized to
+ * 16 bits per value. All storage is static and sized by config.h.
+ *
+ * Export format (little-endian), streamed by historyExportRead():
+ *
+ *   header  u8 version, u8 tier, u8 slot count, u8 reserved,
+ *           u32 bucket seconds, u32 start of the first bucket,
+ *           u32 now (both in seconds since boot), u16 bucket count,
+ *           u16 reserved, then f32 scale per slot
+ *   columns for each slot: i16 min[count], i16 max[count], i16 mean[count]
+ *
+ * A value is `raw * scale`. Buckets without samples hold -32768. The last
+ * bucket is the one still being filled.
+ */
+
+#ifndef TERRAHUB_SENSOR_HISTORY_H
+#define TERRAHUB_SENSOR_HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "rules.h"
+
+#define HISTORY_TIER_COUNT 3
+#define HISTORY_FORMAT_VERSION 1
+#define HISTORY_EMPTY INT16_MIN
+#define HISTORY_HEADER_BYTES (20 + 4 * SENSOR_SLOT_COUNT)
+
+struct HistoryTierInfo {
+  uint32_t bucketSeconds;
+  uint16_t bucketCount;
+};
+
+void historyBegin(uint32_t nowMs);
+
+// Record one sample of every slot; O(1) unless polling stalled for longer
+// than a bucket, in which case the skipped buckets are marked empty
+void historyAppend(const SensorValues &values, uint32_t nowMs);
+
+HistoryTierInfo historyTier(uint8_t tier);
+
+// Static bytes used by all tiers
+size_t historyMemoryBytes();
+
+/**
+ * Cursor of one export. The bucket range is fixed when the export begins;
+ * buckets that get overwritten while it streams are sent as empty, so the
+ * columns always line up with the header.
+ */
+struct HistoryExport {
+  uint8_t tier;
+  uint32_t firstBucket;     // absolute bucket number
+  uint16_t bucketCount;
+  size_t totalBytes;
+  size_t position;
+  uint8_t header[HISTORY_HEADER_BYTES];
+};
+
+/**
+ * Start exporting `tier`, limited to buckets that start within the last
+ * `sinceSeconds` (0 for the whole tier). Returns false for an unknown tier.
+ */
+bool historyExportBegin(HistoryExport &exp, uint8_t tier, uint32_t sinceSeconds);
+
+// Copy up to `maxLen` further bytes into `buffer`; 0 once complete
+size_t historyExportRead(HistoryExport &exp, uint8_t *buffer, size_t maxLen);
+
+#endif // TERRAHUB_SENSOR_HISTORY_H
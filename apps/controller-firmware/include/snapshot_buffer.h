@@ -0,0 +1,60 @@
+/**
+ * TerraHub Controller Firmware - Double-Buffered Snapshot
+ *
+ * Lets one writer task publish a struct that any number of reader tasks
+ * copy out, without a lock and without the writer ever waiting. The writer
+ * fills the slot readers are not using and then flips a sequence counter.
+ * A reader copies the current slot and retries if the counter moved while
+ * it was copying, which can only happen if the writer published twice in
+ * the meantime.
+ *
+ * T must be trivially copyable.
+ */
+
+#ifndef TERRAHUB_SNAPSHOT_BUFFER_H
+#define TERRAHUB_SNAPSHOT_BUFFER_H
+
+#include <atomic>
+#include <stdint.h>
+
+template <typename T>
+class SnapshotBuffer {
+ public:
+  explicit SnapshotBuffer(const T &initial) : sequence_(0) {
+    slots_[0] = initial;
+    slots_[1] = initial;
+  }
+
+  // Writer side; only one task may publish
+  void publish(const T &value) {
+    const uint32_t next = sequence_.load(std::memory_order_relaxed) + 1;
+    // The previous publish must be visible before this one starts
+    // overwriting the slot it retired
+    std::atomic_thread_fence(std::memory_order_release);
+    slots_[next & 1] = value;
+    sequence_.store(next, std::memory_order_release);
+  }
+
+  // Reader side; any task
+  T read() const {
+    for (;;) {
+      const uint32_t sequence = sequence_.load(std::memory_order_acquire);
+      const T copy = slots_[sequence & 1];
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sequence_.load(std::memory_order_relaxed) == sequence) {
+        return copy;
+      }
+    }
+  }
+
+  // Bumped on every publish
+  uint32_t sequence() const {
+    return sequence_.load(std::memory_order_acquire);
+  }
+
+ private:
+  T slots_[2];
+  std::atomic<uint32_t> sequence_;
+};
+
+#endif // TERRAHUB_SNAPSHOT_BUFFER_H
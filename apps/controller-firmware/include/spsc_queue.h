@@ -0,0 +1,71 @@
+/**
+ * TerraHub Controller Firmware - Single-Producer Single-Consumer Queue
+ *
+ * Fixed-capacity ring for handing items from one task to another without a
+ * lock. Exactly one task may push and exactly one task may pop; neither ever
+ * blocks or allocates. Items are copied in and out, so keep them small.
+ */
+
+#ifndef TERRAHUB_SPSC_QUEUE_H
+#define TERRAHUB_SPSC_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename T, size_t Capacity>
+class SpscQueue {
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+ public:
+  static const size_t capacity = Capacity;
+
+  SpscQueue() : head_(0), tail_(0) {}
+
+  // Producer side. Returns false and drops nothing if the queue is full.
+  bool push(const T &item) {
+    const uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == Capacity) {
+      return false;
+    }
+    items_[tail & (Capacity - 1)] = item;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Copies the oldest item without removing it.
+  bool peek(T &item) const {
+    const uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = items_[head & (Capacity - 1)];
+    return true;
+  }
+
+  // Consumer side. Returns false if the queue is empty.
+  bool pop(T &item) {
+    if (!peek(item)) {
+      return false;
+    }
+    head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Exact on either side for its own end, a snapshot for the other one
+  size_t size() const {
+    return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+  }
+
+  // Producer side. Free slots right now; only grows until the next push.
+  size_t space() const {
+    return Capacity - size();
+  }
+
+ private:
+  T items_[Capacity];
+  std::atomic<uint32_t> head_;  // next slot to pop, written by the consumer
+  std::atomic<uint32_t> tail_;  // next slot to push, written by the producer
+};
+
+#endif // TERRAHUB_SPSC_QUEUE_H
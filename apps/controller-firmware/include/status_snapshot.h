@@ -0,0 +1,103 @@
+/**
+ * TerraHub Controller Firmware - Cached Status Snapshots
+ *
+ * Pre-serialized bodies for the read-only endpoints dashboards poll
+ * (/api/status, /api/config). A cache keeps the body with the state it was
+ * built from. A request gathers that state again, a few dozen loads, and
+ * the body is only rebuilt when it differs or when its counters are older
+ * than STATUS_REFRESH_MS. Every body is a new version with a strong ETag,
+ * the CRC-32 of its bytes, so a client that already has it gets a 304 with
+ * no body at all, and a tag stays valid across reboots as long as the body
+ * is the same.
+ *
+ * Bodies are immutable once stored and shared with the responses still
+ * sending them, so a rebuild never pulls one from under a slow client.
+ */
+
+#ifndef TERRAHUB_STATUS_SNAPSHOT_H
+#define TERRAHUB_STATUS_SNAPSHOT_H
+
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "config.h"
+#include "control_task.h"
+#include "current_dsp.h"
+#include "power_manager.h"
+
+// ============================================================================
+// Cache
+// ============================================================================
+
+struct StatusCache {
+  std::shared_ptr<const std::string> body;  // nullptr until the first build
+  std::string key;                          // state the body was built from
+  char etag[11] = "";                       // quoted CRC-32 in hex
+  uint32_t version = 0;                     // bodies built since boot
+  uint32_t builtAt = 0;                     // halMillis()
+};
+
+// Whether the body must be rebuilt for `key`: never built, built from other
+// state, or built `maxAgeMs` or longer before `now`
+bool statusCacheStale(const StatusCache &cache, const void *key, size_t keyLength, uint32_t now,
+                      uint32_t maxAgeMs);
+
+// Replace the body and tag it; the previous body lives on in any response
+// still holding it
+void statusCacheStore(StatusCache &cache, const void *key, size_t keyLength, uint32_t now, std::string &&body);
+
+// Whether an If-None-Match header value ("*" or a comma-separated list of
+// tags, weak or strong) names the cached body
+bool statusCacheMatches(const StatusCache &cache, const char *ifNoneMatch);
+
+// ============================================================================
+// /api/status
+// ============================================================================
+
+/**
+ * The state /api/status is rebuilt for. Compared byte for byte, so
+ * fill it from a zeroed copy (statusStateFromControl() does) to keep the
+ * padding equal; NaN readings compare equal to themselves that way too.
+ */
+struct StatusState {
+  uint8_t nodeId;
+  bool isController;
+  bool online;
+  bool clockValid;
+  uint32_t ip;                  // as IPAddress holds it, first octet lowest
+  uint32_t relays;              // bit per relay, set while on
+  uint32_t toggleCounts[NUM_RELAY_CHANNELS];
+  RelayPolicy policies[NUM_RELAY_CHANNELS];
+  uint8_t currentAvailable;     // bit per current sensor
+  CurrentFault currentFaults[NUM_CURRENT_SENSORS];
+  SensorValues sensors;
+  SensorValues rates;
+  uint32_t ruleGeneration;
+  uint32_t ruleCount;
+  uint32_t scheduleCount;
+  uint32_t rulesEvaluated;      // by the last pass that evaluated any
+  uint32_t nodesEvaluated;
+};
+
+// Counters that move on every pass; refreshed by age only
+struct StatusCounters {
+  uint16_t currentMa[NUM_CURRENT_SENSORS];
+  uint32_t passes;
+  ControlTiming timing;
+  uint8_t liveSubscribers;
+  uint32_t liveMessages;
+  uint32_t liveSnapshots;
+  uint32_t liveSkipped;
+  uint32_t liveDisconnected;
+  PowerStats power;
+};
+
+// Zero `state`, then fill the control task's part of it from `control`
+void statusStateFromControl(const ControlSnapshot &control, StatusState &state);
+
+// Serialize the /api/status document into `out`
+void statusWriteJson(const char *version, const StatusState &state, const StatusCounters &counters,
+                     std::string &out);
+
+#endif // TERRAHUB_STATUS_SNAPSHOT_H
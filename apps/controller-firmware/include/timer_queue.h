@@ -0,0 +1,43 @@
+/**
+ * TerraHub Controller Firmware - Timer Queue
+ *
+ * Binary min-heap of millis() deadlines keyed by a small integer id. Expiry
+ * costs O(log n) per expired entry, independent of how many are pending.
+ */
+
+#ifndef TERRAHUB_TIMER_QUEUE_H
+#define TERRAHUB_TIMER_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Longest delay that still orders correctly across millis() wraparound
+#define TIMER_MAX_DELAY_MS 0x7FFFFFFFUL
+
+/**
+ * Wraparound-safe deadline check. Valid as long as deadlines are never more
+ * than TIMER_MAX_DELAY_MS (~24.8 days) away from `now`.
+ */
+inline bool deadlineReached(uint32_t now, uint32_t deadline) {
+  return static_cast<int32_t>(now - deadline) >= 0;
+}
+
+struct TimerEntry {
+  uint32_t deadline;
+  uint16_t id;
+};
+
+struct TimerQueue {
+  std::vector<TimerEntry> heap;
+};
+
+// Drop all entries and reserve room for `capacity` so pushes never allocate
+void timerQueueReset(TimerQueue &queue, size_t capacity);
+void timerQueuePush(TimerQueue &queue, uint16_t id, uint32_t deadline);
+// Pop the earliest entry if it is due at `now`; returns false otherwise
+bool timerQueuePopExpired(TimerQueue &queue, uint32_t now, uint16_t &id);
+// Earliest pending deadline; returns false when the queue is empty
+bool timerQueueNextDeadline(const TimerQueue &queue, uint32_t &deadline);
+
+#endif // TERRAHUB_TIMER_QUEUE_H
@@ -0,0 +1,115 @@
+/**
+ * TerraHub Controller Firmware - Sensor Trace Replay
+ *
+ * Feeds a recorded or generated sensor trace through the control pipeline
+ * on the native HAL's clock. Each sample is queued like a reading pushed by
+ * the network side; between samples the pipeline runs at every deadline the
+ * control task would wake for (sensor polls, minimum durations, schedule
+ * transitions), so months of readings replay in seconds through the same
+ * rule code the controller runs.
+ *
+ * Trace formats:
+ *
+ *   CSV     A header naming the columns: "t" (seconds from the start of
+ *           the trace) followed by sensor slot names as used in rules, e.g.
+ *           "t,temperatureC,humidityPercent". Unknown columns are skipped.
+ *           An empty field keeps the slot's last value and "nan" marks the
+ *           sensor as unavailable. Blank lines and lines starting with '#'
+ *           are ignored.
+ *   Binary  "THRT", a version byte, the slot count and two reserved bytes,
+ *           then per sample its time in ms (uint64), a mask of the slots it
+ *           carries (uint32) and one float per slot in the mask, all
+ *           little-endian. Much faster to read than CSV for long traces.
+ *
+ * Host builds only.
+ */
+
+#ifndef TERRAHUB_TRACE_REPLAY_H
+#define TERRAHUB_TRACE_REPLAY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "config.h"
+#include "rules.h"
+
+#define REPLAY_BINARY_VERSION 1
+#define REPLAY_MAX_COLUMNS 16
+#define REPLAY_MAX_LINE_BYTES 512
+
+struct ReplaySample {
+  uint64_t atMs;     // from the start of the trace
+  uint32_t present;  // bit per sensor slot this sample carries
+  float values[SENSOR_SLOT_COUNT];
+};
+
+enum ReplayTraceKind : uint8_t {
+  REPLAY_TRACE_CSV = 0,
+  REPLAY_TRACE_BINARY,
+  REPLAY_TRACE_GENERATED
+};
+
+struct ReplayTrace {
+  ReplayTraceKind kind;
+  FILE *file;
+  uint8_t fileSlotCount;                     // binary: slots per record in the file
+  uint8_t columnCount;                       // CSV
+  uint8_t columnSlots[REPLAY_MAX_COLUMNS];   // CSV column -> slot, SENSOR_SLOT_INVALID to skip
+  uint32_t line;                             // CSV line or binary record last read
+  uint64_t lastAtMs;
+  uint64_t nextAtMs;                         // generated: time of the next sample
+  uint64_t endMs;                            // generated: first time past the trace
+  uint32_t stepMs;                           // generated
+  uint32_t seed;                             // generated
+  char error[96];                            // why reading stopped early, empty at a clean end
+};
+
+// ============================================================================
+// Traces
+// ============================================================================
+
+// CSV or binary, told apart by the binary magic. False with `trace.error`
+// set if the file cannot be read or its header is malformed.
+bool replayOpenFile(ReplayTrace &trace, const char *path);
+
+/**
+ * A synthetic terrarium: temperature and humidity follow a daily cycle with
+ * a slow weekly drift and a little noise, light follows a 12 h day. One
+ * sample of every slot each `stepMs`; the same seed gives the same trace.
+ */
+void replayOpenGenerated(ReplayTrace &trace, uint32_t days, uint32_t stepMs, uint32_t seed);
+
+// False at the end of the trace or on bad input (see `trace.error`).
+// Samples must not go back in time.
+bool replayNextSample(ReplayTrace &trace, ReplaySample &sample);
+
+void replayClose(ReplayTrace &trace);
+
+bool replayWriteBinaryHeader(FILE *file);
+bool replayWriteBinarySample(FILE *file, const ReplaySample &sample);
+
+// ============================================================================
+// Replay
+// ============================================================================
+
+struct ReplayStats {
+  uint64_t samples;
+  uint64_t passes;           // control passes run
+  uint64_t ruleEvaluations;
+  uint64_t simulatedMs;      // trace time covered
+  uint64_t relayOnMs[NUM_RELAY_CHANNELS];
+  uint32_t relayToggles[NUM_RELAY_CHANNELS];
+};
+
+typedef void (*ReplayTransitionHandler)(uint64_t atMs, uint8_t relay, bool on, void *context);
+
+/**
+ * Replay `trace` from the current HAL time, which becomes trace time 0.
+ * Call after controlBegin() and relayOutputBegin() with the rules and
+ * schedules to test already applied. `onTransition`, if given, is called
+ * for every relay that switches, at trace time. Returns false if the trace
+ * ended on bad input; `stats` then covers the samples before it.
+ */
+bool replayRun(ReplayTrace &trace, ReplayStats &stats, ReplayTransitionHandler onTransition = nullptr,
+               void *context = nullptr);
+
+#endif // TERRAHUB_TRACE_REPLAY_H
@@ -0,0 +1,53 @@
+/**
+ * TerraHub Controller Firmware - Wi-Fi Station Manager
+ *
+ * Event-driven station connection state machine. Connecting, retrying with
+ * exponential backoff and reconnecting after a drop all happen from
+ * wifiManagerLoop(), which never blocks.
+ */
+
+#ifndef TERRAHUB_WIFI_MANAGER_H
+#define TERRAHUB_WIFI_MANAGER_H
+
+#include <Arduino.h>
+#include <stdint.h>
+#include "config.h"
+#include "fixed_string.h"
+
+struct WifiConfig {
+  FixedString<WIFI_SSID_MAX_LENGTH> ssid;
+  FixedString<WIFI_PASSWORD_MAX_LENGTH> password;
+  FixedString<WIFI_HOSTNAME_MAX_LENGTH> hostname;
+  bool configured;
+};
+
+enum WifiState : uint8_t {
+  WIFI_STATE_UNCONFIGURED = 0,
+  WIFI_STATE_CONNECTING,
+  WIFI_STATE_CONNECTED,
+  WIFI_STATE_BACKOFF
+};
+
+const char *wifiStateName(WifiState state);
+
+// Register Wi-Fi event handlers; call once after WiFi.mode()
+void wifiManagerBegin();
+
+// Start (or restart) connecting with the given credentials; returns immediately
+void wifiManagerConnect(const WifiConfig &config);
+
+// Advance the state machine; call from the main loop
+void wifiManagerLoop(uint32_t now);
+
+// Next time wifiManagerLoop() has timed work (connect timeout or retry);
+// false while it only waits for Wi-Fi events, which wake the network loop
+bool wifiManagerNextDeadline(uint32_t now, uint32_t &deadline);
+
+WifiState wifiManagerState();
+bool wifiManagerConnected();
+// Failed attempts since the last successful connection
+uint16_t wifiManagerFailedAttempts();
+// Milliseconds until the next retry while in WIFI_STATE_BACKOFF, else 0
+uint32_t wifiManagerRetryInMs(uint32_t now);
+
+#endif // TERRAHUB_WIFI_MANAGER_H
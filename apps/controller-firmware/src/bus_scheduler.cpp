@@ -0,0 +1,229 @@
+/**
+ * TerraHub Controller Firmware - Slave Bus Polling Scheduler
+ *
+ * Each node's requests run back to back as one batch. Readings land in a
+ * working snapshot that is copied to the published one only when every node
+ * has been visited, so readers always see a single coherent cycle.
+ */
+
+#include <string.h>
+#include "bus_scheduler.h"
+#include "hal.h"
+#include "timer_queue.h"
+
+// Requests per node batch: sensors first, then one GET_PORT_STATE per port
+#define JOB_SENSORS 0
+#define JOB_COUNT (1 + NUM_RELAY_CHANNELS)
+
+// Largest GET_SENSOR_VALUES payload we read back
+#define SENSOR_RESPONSE_MAX (1 + 4 * BUS_MAX_SENSORS_PER_NODE)
+
+struct NodeSchedule {
+  uint8_t nodeId;
+  uint32_t dueAt;
+  bool batchOk;
+};
+
+static const I2cBus *bus = nullptr;
+static NodeSchedule schedule[BUS_MAX_SLAVES];
+static BusNodeStats nodeStats[BUS_MAX_SLAVES];
+static uint8_t nodeCount = 0;
+
+static I2cTransaction txn;
+static int8_t activeNode = -1;
+static uint8_t activeJob = 0;
+static uint8_t roundRobin = 0;
+
+// Nodes still to visit in the current cycle, and the readings gathered so far
+static uint32_t cyclePending = 0;
+static uint32_t cycleStartedAt = 0;
+static uint32_t cycleBusyUs = 0;
+static ClusterSnapshot working;
+static ClusterSnapshot published;
+static BusSchedulerStats stats;
+
+static uint32_t allNodesMask() {
+  return nodeCount >= 32 ? 0xFFFFFFFFu : (1u << nodeCount) - 1;
+}
+
+void busSchedulerBegin(const I2cBus &busToUse, const uint8_t *nodeIds, uint8_t count, uint32_t now) {
+  bus = &busToUse;
+  nodeCount = count < BUS_MAX_SLAVES ? count : BUS_MAX_SLAVES;
+  memset(&working, 0, sizeof(working));
+  memset(&published, 0, sizeof(published));
+  memset(&stats, 0, sizeof(stats));
+  memset(nodeStats, 0, sizeof(nodeStats));
+
+  for (uint8_t i = 0; i < nodeCount; i++) {
+    schedule[i] = NodeSchedule{nodeIds[i], now, true};
+    working.nodes[i].nodeId = nodeIds[i];
+    published.nodes[i].nodeId = nodeIds[i];
+  }
+  working.nodeCount = nodeCount;
+  published.nodeCount = nodeCount;
+
+  activeNode = -1;
+  roundRobin = 0;
+  cyclePending = allNodesMask();
+  cycleStartedAt = now;
+  cycleBusyUs = 0;
+}
+
+/**
+ * Earliest-deadline-first among nodes that are due and not yet visited this
+ * cycle; ties go round-robin so no node is starved.
+ */
+static int8_t pickNode(uint32_t now) {
+  int8_t best = -1;
+  for (uint8_t n = 0; n < nodeCount; n++) {
+    const uint8_t i = (roundRobin + n) % nodeCount;
+    if (!(cyclePending & (1u << i)) || !deadlineReached(now, schedule[i].dueAt)) continue;
+    if (best < 0 || static_cast<int32_t>(schedule[i].dueAt - schedule[best].dueAt) < 0) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+static void startJob(uint32_t now) {
+  const uint8_t address = I2C_ADDRESS_BASE + schedule[activeNode].nodeId;
+  if (activeJob == JOB_SENSORS) {
+    i2cTransactionStart(txn, address, I2C_CMD_GET_SENSOR_VALUES, nullptr, 0, SENSOR_RESPONSE_MAX, now);
+  } else {
+    const uint8_t port = activeJob - 1;
+    i2cTransactionStart(txn, address, I2C_CMD_GET_PORT_STATE, &port, 1, 4, now);
+  }
+}
+
+static void storeReply(NodeReading &reading, const I2cFrameView &reply) {
+  if (activeJob == JOB_SENSORS) {
+    const uint8_t count = reply.length > 0 ? reply.payload[0] : 0;
+    reading.sensorCount = 0;
+    for (uint8_t s = 0; s < count && s < BUS_MAX_SENSORS_PER_NODE; s++) {
+      const uint8_t *entry = reply.payload + 1 + 4 * s;
+      if (entry + 4 > reply.payload + reply.length) break;
+      NodeSensorReading &sensor = reading.sensors[reading.sensorCount++];
+      sensor.type = entry[0];
+      sensor.value = static_cast<int16_t>(entry[1] | (entry[2] << 8));
+      sensor.unit = entry[3];
+    }
+    return;
+  }
+
+  if (reply.length < 4) return;
+  const uint8_t port = reply.payload[0];
+  if (port >= NUM_RELAY_CHANNELS) return;
+  if (reply.payload[1]) {
+    reading.portStates |= 1u << port;
+  } else {
+    reading.portStates &= ~(1u << port);
+  }
+  reading.portCurrentMa[port] = reply.payload[2] | (reply.payload[3] << 8);
+}
+
+static void finishBatch(uint32_t now) {
+  NodeSchedule &node = schedule[activeNode];
+  NodeReading &reading = working.nodes[activeNode];
+  reading.online = node.batchOk;
+  reading.sampledAt = now;
+  node.dueAt = now + BUS_POLL_INTERVAL_MS;
+
+  cyclePending &= ~(1u << activeNode);
+  roundRobin = (activeNode + 1) % nodeCount;
+  activeNode = -1;
+
+  if (cyclePending == 0) {
+    working.cycle = published.cycle + 1;
+    working.publishedAt = now;
+    published = working;
+
+    stats.cycles++;
+    stats.lastCycleMs = now - cycleStartedAt;
+    stats.lastCycleBusyUs = cycleBusyUs;
+    const uint64_t cycleUs = static_cast<uint64_t>(stats.lastCycleMs) * 1000;
+    const uint64_t percent = cycleUs ? static_cast<uint64_t>(cycleBusyUs) * 100 / cycleUs : 0;
+    stats.utilizationPct = percent > 100 ? 100 : static_cast<uint8_t>(percent);
+
+    cyclePending = allNodesMask();
+    cycleStartedAt = now;
+    cycleBusyUs = 0;
+  }
+}
+
+bool busSchedulerLoop(uint32_t now) {
+  if (bus == nullptr || nodeCount == 0) {
+    return false;
+  }
+
+  const uint32_t startedUs = halMicros();
+  for (; halMicros() - startedUs < BUS_TICK_BUDGET_US; now = halMillis()) {
+    if (activeNode < 0) {
+      activeNode = pickNode(now);
+      if (activeNode < 0) return false;  // nothing due yet
+      activeJob = JOB_SENSORS;
+      schedule[activeNode].batchOk = true;
+      startJob(now);
+    }
+
+    // Waiting on a BUSY node or a retry delay: come back next tick
+    if (!deadlineReached(now, txn.nextActionAt)) return true;
+
+    const uint32_t busyStart = halMicros();
+    const I2cTransactionState result = i2cTransactionPoll(txn, *bus, now);
+    cycleBusyUs += halMicros() - busyStart;
+    if (result == I2C_TXN_PENDING) continue;
+
+    BusNodeStats &nodeStat = nodeStats[activeNode];
+    nodeStat.transactions++;
+    nodeStat.retries += txn.attempts > 1 ? txn.attempts - 1 : 0;
+    nodeStat.lastLatencyMs = txn.latencyMs;
+    if (txn.latencyMs > nodeStat.maxLatencyMs) nodeStat.maxLatencyMs = txn.latencyMs;
+
+    if (result == I2C_TXN_DONE && txn.reply.code == I2C_STATUS_OK) {
+      storeReply(working.nodes[activeNode], txn.reply);
+    } else {
+      nodeStat.failures++;
+      schedule[activeNode].batchOk = false;
+    }
+
+    // An unreachable node fails every request; skip the rest of its batch
+    if (++activeJob >= JOB_COUNT || result == I2C_TXN_FAILED) {
+      finishBatch(now);
+    } else {
+      startJob(now);
+    }
+  }
+  return activeNode >= 0;
+}
+
+bool busSchedulerNextDeadline(uint32_t &deadline) {
+  if (bus == nullptr || nodeCount == 0) {
+    return false;
+  }
+  if (activeNode >= 0) {
+    deadline = txn.nextActionAt;
+    return true;
+  }
+
+  bool found = false;
+  for (uint8_t i = 0; i < nodeCount; i++) {
+    if (!(cyclePending & (1u << i))) continue;
+    if (!found || static_cast<int32_t>(schedule[i].dueAt - deadline) < 0) {
+      deadline = schedule[i].dueAt;
+      found = true;
+    }
+  }
+  return found;
+}
+
+const ClusterSnapshot &busSchedulerSnapshot() {
+  return published;
+}
+
+const BusSchedulerStats &busSchedulerStats() {
+  return stats;
+}
+
+const BusNodeStats &busSchedulerNodeStats(uint8_t index) {
+  return nodeStats[index < BUS_MAX_SLAVES ? index : 0];
+}
@@ -0,0 +1,421 @@
+/**
+ * TerraHub Controller Firmware - Slave Configuration Sync
+ */
+
+#include <string.h>
+#include <vector>
+#include "config_sync.h"
+#include "hal.h"
+#include "rule_store.h"
+#include "timer_queue.h"
+
+// Sync attempts per image before a node is marked failed; the second one
+// re-reads the node's chunk hashes instead of trusting the cached ones
+#define SYNC_ATTEMPTS 2
+
+enum SyncPhase : uint8_t {
+  PHASE_CHECK = 0,     // GET_CONFIG_HASH
+  PHASE_FETCH_HASHES,  // GET_CONFIG_HASH for a range of chunks
+  PHASE_SEND,          // SET_CONFIG_CHUNK for each differing chunk
+  PHASE_VERIFY         // GET_CONFIG_HASH after the last chunk
+};
+
+struct SyncNode {
+  uint8_t nodeId;
+  ConfigSyncNodeState state;
+  SyncPhase phase;
+  int8_t slot;                 // pipeline slot, -1 when idle
+  uint8_t attempts;
+  uint32_t generation;         // image generation this work is for
+  uint32_t retryAt;
+  uint32_t hash;               // last hash the node reported
+  uint16_t cursor;             // next chunk (position in send order while sending)
+  uint16_t chunksSent;
+  uint16_t chunksToSend;
+  uint16_t sendingChunk;       // chunk in flight and its hash
+  uint32_t sendingHash;
+  // Chunk hashes of the node's buffer while it reports knownHash
+  uint32_t knownHash;
+  std::vector<uint32_t> knownChunks;
+};
+
+static const char *const nodeStateNames[] = {
+  "unknown",
+  "syncing",
+  "in-sync",
+  "failed"
+};
+
+static const I2cBus *bus = nullptr;
+static SyncNode nodes[MAX_NODES - 1];
+static uint8_t nodeCount = 0;
+
+static I2cTransaction slots[CONFIG_SYNC_PIPELINE_DEPTH];
+static int8_t slotNode[CONFIG_SYNC_PIPELINE_DEPTH];
+
+// Target image, zero-padded to whole chunks
+static std::vector<uint8_t> image;
+static std::vector<uint32_t> chunkHashes;
+static uint32_t imageGeneration = 0;
+static ConfigSyncStats stats;
+
+const char *configSyncNodeStateName(ConfigSyncNodeState state) {
+  return state <= CONFIG_NODE_FAILED ? nodeStateNames[state] : "";
+}
+
+static uint32_t readU32(const uint8_t *data) {
+  return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+         (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+uint16_t configImageLength(const uint8_t *image, size_t capacity) {
+  if (capacity < RULE_STORE_HEADER_BYTES || image[0] != RULE_STORE_VERSION) {
+    return 0;
+  }
+  const uint32_t payloadLength = readU32(image + 4);
+  if (payloadLength > capacity - RULE_STORE_HEADER_BYTES ||
+      ruleStoreCrc32(image + RULE_STORE_HEADER_BYTES, payloadLength) != readU32(image + 8)) {
+    return 0;
+  }
+  return RULE_STORE_HEADER_BYTES + payloadLength;
+}
+
+uint32_t configChunkHash(const uint8_t *image, uint16_t index) {
+  return ruleStoreCrc32(image + static_cast<size_t>(index) * CONFIG_CHUNK_BYTES, CONFIG_CHUNK_BYTES);
+}
+
+static void resetNode(SyncNode &node) {
+  node.state = CONFIG_NODE_UNKNOWN;
+  node.attempts = 0;
+  node.chunksSent = 0;
+  node.chunksToSend = 0;
+}
+
+void configSyncBegin(const I2cBus &busToUse, const uint8_t *nodeIds, uint8_t count) {
+  bus = &busToUse;
+  nodeCount = count < MAX_NODES - 1 ? count : MAX_NODES - 1;
+  for (uint8_t i = 0; i < nodeCount; i++) {
+    SyncNode &node = nodes[i];
+    node.nodeId = nodeIds[i];
+    node.slot = -1;
+    node.hash = 0;
+    node.knownHash = 0;
+    node.knownChunks.clear();
+    resetNode(node);
+  }
+  for (uint8_t s = 0; s < CONFIG_SYNC_PIPELINE_DEPTH; s++) {
+    slotNode[s] = -1;
+  }
+}
+
+bool configSyncSetImage(const uint8_t *data, size_t length) {
+  if (length == 0 || length > CONFIG_IMAGE_MAX_BYTES) {
+    return false;
+  }
+  const uint32_t hash = ruleStoreCrc32(data, length);
+  if (!image.empty() && hash == stats.imageHash && length == stats.imageBytes) {
+    return true;
+  }
+
+  const uint16_t chunkCount = (length + CONFIG_CHUNK_BYTES - 1) / CONFIG_CHUNK_BYTES;
+  image.assign(static_cast<size_t>(chunkCount) * CONFIG_CHUNK_BYTES, 0);
+  memcpy(image.data(), data, length);
+  chunkHashes.resize(chunkCount);
+  for (uint16_t i = 0; i < chunkCount; i++) {
+    chunkHashes[i] = configChunkHash(image.data(), i);
+  }
+
+  imageGeneration++;
+  stats.imageHash = hash;
+  stats.imageBytes = length;
+  stats.chunkCount = chunkCount;
+  for (uint8_t i = 0; i < nodeCount; i++) {
+    resetNode(nodes[i]);
+  }
+  return true;
+}
+
+static bool needsWork(const SyncNode &node, uint32_t now) {
+  if (node.slot >= 0) return false;
+  return node.state == CONFIG_NODE_UNKNOWN ||
+         (node.state == CONFIG_NODE_FAILED && deadlineReached(now, node.retryAt));
+}
+
+bool configSyncPending(uint32_t now) {
+  if (bus == nullptr || image.empty()) {
+    return false;
+  }
+  for (uint8_t i = 0; i < nodeCount; i++) {
+    if (nodes[i].slot >= 0 || needsWork(nodes[i], now)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool configSyncNextDeadline(uint32_t &deadline) {
+  if (bus == nullptr || image.empty()) {
+    return false;
+  }
+  bool found = false;
+  for (uint8_t i = 0; i < nodeCount; i++) {
+    if (nodes[i].slot >= 0 || nodes[i].state != CONFIG_NODE_FAILED) continue;
+    if (!found || static_cast<int32_t>(nodes[i].retryAt - deadline) < 0) {
+      deadline = nodes[i].retryAt;
+      found = true;
+    }
+  }
+  return found;
+}
+
+// ============================================================================
+// Per-node steps
+// ============================================================================
+
+static uint8_t nodeAddress(const SyncNode &node) {
+  return I2C_ADDRESS_BASE + node.nodeId;
+}
+
+static void requestHash(SyncNode &node, I2cTransaction &txn, uint32_t now) {
+  i2cTransactionStart(txn, nodeAddress(node), I2C_CMD_GET_CONFIG_HASH, nullptr, 0, 6, now);
+}
+
+static void requestChunkHashes(SyncNode &node, I2cTransaction &txn, uint32_t now) {
+  uint8_t count = CONFIG_HASHES_PER_REQUEST;
+  if (stats.chunkCount - node.cursor < count) count = stats.chunkCount - node.cursor;
+  const uint8_t payload[3] = {static_cast<uint8_t>(node.cursor & 0xFF), static_cast<uint8_t>(node.cursor >> 8), count};
+  i2cTransactionStart(txn, nodeAddress(node), I2C_CMD_GET_CONFIG_HASH, payload, sizeof(payload), 4 * count, now);
+}
+
+// Chunk at `position` in send order: 1, 2, ..., n-1 and the header chunk 0 last
+static uint16_t chunkAt(uint16_t position) {
+  return (position + 1) % stats.chunkCount;
+}
+
+static bool chunkDiffers(const SyncNode &node, uint16_t chunk) {
+  return node.knownChunks[chunk] != chunkHashes[chunk];
+}
+
+/**
+ * Start the next differing chunk, or the verification once all are written
+ */
+static void sendNextChunk(SyncNode &node, I2cTransaction &txn, uint32_t now) {
+  while (node.cursor < stats.chunkCount && !chunkDiffers(node, chunkAt(node.cursor))) {
+    node.cursor++;
+  }
+  if (node.cursor >= stats.chunkCount) {
+    node.phase = PHASE_VERIFY;
+    requestHash(node, txn, now);
+    return;
+  }
+
+  const uint16_t chunk = chunkAt(node.cursor);
+  const uint16_t offset = chunk * CONFIG_CHUNK_BYTES;
+  uint8_t payload[2 + CONFIG_CHUNK_BYTES];
+  payload[0] = offset & 0xFF;
+  payload[1] = offset >> 8;
+  memcpy(payload + 2, image.data() + offset, CONFIG_CHUNK_BYTES);
+  node.sendingChunk = chunk;
+  node.sendingHash = chunkHashes[chunk];
+  i2cTransactionStart(txn, nodeAddress(node), I2C_CMD_SET_CONFIG_CHUNK, payload, sizeof(payload), 2, now);
+}
+
+static void startSend(SyncNode &node, I2cTransaction &txn, uint32_t now) {
+  node.phase = PHASE_SEND;
+  node.cursor = 0;
+  node.chunksSent = 0;
+  node.chunksToSend = 0;
+  // Chunks past the end of the node's previous image are unknown
+  if (node.knownChunks.size() < stats.chunkCount) {
+    node.knownChunks.resize(stats.chunkCount, 0);
+  }
+  for (uint16_t chunk = 0; chunk < stats.chunkCount; chunk++) {
+    if (chunkDiffers(node, chunk)) node.chunksToSend++;
+  }
+  sendNextChunk(node, txn, now);
+}
+
+static void startNode(SyncNode &node, uint8_t slot, uint32_t now) {
+  node.slot = slot;
+  node.generation = imageGeneration;
+  node.state = CONFIG_NODE_SYNCING;
+  node.phase = PHASE_CHECK;
+  node.attempts++;
+  slotNode[slot] = &node - nodes;
+  requestHash(node, slots[slot], now);
+}
+
+static void releaseNode(SyncNode &node, ConfigSyncNodeState state, uint32_t now) {
+  slotNode[node.slot] = -1;
+  node.slot = -1;
+  node.state = state;
+  if (state == CONFIG_NODE_FAILED) {
+    node.retryAt = now + CONFIG_SYNC_RETRY_MS;
+    node.attempts = 0;
+  } else if (state == CONFIG_NODE_IN_SYNC) {
+    stats.fullPushBytes += static_cast<uint32_t>(stats.chunkCount) * CONFIG_CHUNK_BYTES;
+  }
+}
+
+/**
+ * Handle a finished exchange and start the node's next one on the same slot
+ */
+static void advanceNode(SyncNode &node, I2cTransactionState result, uint32_t now) {
+  I2cTransaction &txn = slots[node.slot];
+  const bool ok = result == I2C_TXN_DONE && txn.reply.code == I2C_STATUS_OK;
+
+  // A chunk the node acknowledged is in its buffer whatever image it was
+  // for. Once a payload chunk lands, the old header's CRC no longer matches
+  // and the node reports hash 0 until the header chunk, sent last, lands
+  // too; the cache is keyed on that. (A chunk past the old payload leaves
+  // the old hash, and the next check just fetches the chunk hashes.)
+  if (ok && node.phase == PHASE_SEND) {
+    node.knownChunks[node.sendingChunk] = node.sendingHash;
+    if (node.sendingChunk == 0) {
+      node.knownHash = node.generation == imageGeneration ? stats.imageHash : 0;
+    } else {
+      node.knownHash = 0;
+    }
+  }
+
+  if (node.generation != imageGeneration) {
+    // The image changed while this exchange was on the bus; start over
+    node.attempts = 0;
+    startNode(node, node.slot, now);
+    return;
+  }
+  if (!ok) {
+    releaseNode(node, CONFIG_NODE_FAILED, now);
+    return;
+  }
+
+  switch (node.phase) {
+    case PHASE_CHECK:
+      if (txn.reply.length < 4) {
+        releaseNode(node, CONFIG_NODE_FAILED, now);
+        return;
+      }
+      node.hash = readU32(txn.reply.payload);
+      if (node.hash == stats.imageHash) {
+        node.knownHash = node.hash;
+        node.knownChunks = chunkHashes;
+        releaseNode(node, CONFIG_NODE_IN_SYNC, now);
+      } else if (node.hash == node.knownHash && !node.knownChunks.empty()) {
+        startSend(node, txn, now);
+      } else {
+        node.phase = PHASE_FETCH_HASHES;
+        node.cursor = 0;
+        node.knownChunks.assign(stats.chunkCount, 0);
+        requestChunkHashes(node, txn, now);
+      }
+      return;
+
+    case PHASE_FETCH_HASHES: {
+      const uint8_t count = txn.reply.length / 4;
+      for (uint8_t i = 0; i < count && node.cursor < stats.chunkCount; i++) {
+        node.knownChunks[node.cursor++] = readU32(txn.reply.payload + 4 * i);
+      }
+      stats.bytesSent += txn.reply.length;
+      if (count == 0) {
+        releaseNode(node, CONFIG_NODE_FAILED, now);
+      } else if (node.cursor < stats.chunkCount) {
+        requestChunkHashes(node, txn, now);
+      } else {
+        node.knownHash = node.hash;
+        startSend(node, txn, now);
+      }
+      return;
+    }
+
+    case PHASE_SEND:
+      node.chunksSent++;
+      node.cursor++;
+      stats.bytesSent += CONFIG_CHUNK_BYTES;
+      sendNextChunk(node, txn, now);
+      return;
+
+    case PHASE_VERIFY:
+      node.hash = txn.reply.length >= 4 ? readU32(txn.reply.payload) : 0;
+      if (node.hash == stats.imageHash) {
+        node.knownHash = node.hash;
+        node.knownChunks = chunkHashes;
+        releaseNode(node, CONFIG_NODE_IN_SYNC, now);
+      } else if (node.attempts < SYNC_ATTEMPTS) {
+        // The cached chunk hashes were wrong (e.g. the node rebooted mid-push)
+        node.knownHash = 0;
+        node.knownChunks.clear();
+        startNode(node, node.slot, now);
+      } else {
+        releaseNode(node, CONFIG_NODE_FAILED, now);
+      }
+      return;
+  }
+}
+
+static void fillSlots(uint32_t now) {
+  uint8_t next = 0;
+  for (uint8_t s = 0; s < CONFIG_SYNC_PIPELINE_DEPTH; s++) {
+    if (slotNode[s] >= 0) continue;
+    while (next < nodeCount && !needsWork(nodes[next], now)) next++;
+    if (next >= nodeCount) return;
+    startNode(nodes[next], s, now);
+  }
+}
+
+bool configSyncLoop(uint32_t now) {
+  if (bus == nullptr || image.empty()) {
+    return false;
+  }
+
+  const uint32_t startedUs = halMicros();
+  fillSlots(now);
+  bool active = true;
+  while (active && halMicros() - startedUs < BUS_TICK_BUDGET_US) {
+    // Visit every slot in turn so transfers to different nodes overlap
+    bool progressed = false;
+    active = false;
+    for (uint8_t s = 0; s < CONFIG_SYNC_PIPELINE_DEPTH; s++) {
+      if (slotNode[s] < 0) continue;
+      active = true;
+      if (!deadlineReached(now, slots[s].nextActionAt)) continue;
+
+      progressed = true;
+      const I2cTransactionState result = i2cTransactionPoll(slots[s], *bus, now);
+      if (result != I2C_TXN_PENDING) {
+        advanceNode(nodes[slotNode[s]], result, now);
+      }
+    }
+    if (!progressed) break;
+    now = halMillis();
+    fillSlots(now);
+  }
+
+  stats.nodesInSync = 0;
+  stats.nodesPending = 0;
+  stats.nodesFailed = 0;
+  for (uint8_t i = 0; i < nodeCount; i++) {
+    switch (nodes[i].state) {
+      case CONFIG_NODE_IN_SYNC: stats.nodesInSync++; break;
+      case CONFIG_NODE_FAILED: stats.nodesFailed++; break;
+      default: stats.nodesPending++; break;
+    }
+  }
+
+  for (uint8_t s = 0; s < CONFIG_SYNC_PIPELINE_DEPTH; s++) {
+    if (slotNode[s] >= 0) return true;
+  }
+  return false;
+}
+
+const ConfigSyncStats &configSyncStats() {
+  return stats;
+}
+
+uint8_t configSyncNodeCount() {
+  return nodeCount;
+}
+
+ConfigSyncNodeStatus configSyncNode(uint8_t index) {
+  const SyncNode &node = nodes[index < nodeCount ? index : 0];
+  return ConfigSyncNodeStatus{node.nodeId, node.state, node.hash, node.chunksSent, node.chunksToSend};
+}
@@ -0,0 +1,582 @@
+/**
+ * TerraHub Controller Firmware - Control Task
+ *
+ * Each pass drains the command queue, polls the sensors when due,
+ * re-evaluates the rules that depend on what changed and the schedules
+ * whose transition came, commits the relays and publishes a snapshot.
+ * Nothing in a pass blocks, logs or allocates. Between passes the task
+ * sleeps until the next sensor poll, minimum-duration expiry or schedule
+ * transition, whichever comes first; queued commands wake it early.
+ */
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include "control_task.h"
+#include "hal.h"
+#include "metrics.h"
+#include "power_manager.h"
+#include "snapshot_buffer.h"
+#include "spsc_queue.h"
+
+// Pipeline task. Core 1 keeps it away from the Wi-Fi stack and the async
+// TCP task on core 0; its priority puts it ahead of the Arduino loop task
+// it shares core 1 with.
+#define CONTROL_TASK_STACK_BYTES 4096
+#define CONTROL_TASK_PRIORITY 6
+#define CONTROL_TASK_CORE 1
+
+// Rate-of-change readings: one kept per interval, enough to always span a
+// full window
+#define RATE_SAMPLE_INTERVAL_MS (RULE_RATE_WINDOW_MS / RULE_RATE_SAMPLES)
+#define RATE_SAMPLE_SLOTS (RULE_RATE_SAMPLES + 1)
+
+enum ControlCommandType : uint8_t {
+  COMMAND_SET_RELAY = 0,
+  COMMAND_SET_SENSOR,
+  COMMAND_SET_POLICY,
+  COMMAND_SET_CLOCK,
+  COMMAND_LOAD_PROGRAM
+};
+
+struct ControlCommand {
+  ControlCommandType type;
+  uint8_t index;            // relay or sensor slot
+  uint8_t arg;              // relay state or policy
+  float value;              // sensor value
+  uint32_t weekMs;          // COMMAND_SET_CLOCK
+  uint32_t at;
+  ControlProgram *program;  // COMMAND_LOAD_PROGRAM
+};
+
+static SpscQueue<ControlCommand, CONTROL_COMMAND_QUEUE_SIZE> commands;
+static SpscQueue<ControlProgram *, CONTROL_COMMAND_QUEUE_SIZE> retired;
+static SnapshotBuffer<ControlSnapshot> snapshots{ControlSnapshot()};
+#if defined(ARDUINO_ARCH_ESP32)
+static TaskHandle_t task = nullptr;
+#endif
+
+// Owned by the task once it runs
+static ControlProgram *running = nullptr;
+static RuleInputs inputs{{0.0f, 0.0f, 0.0f, NAN, NAN, NAN}};
+static SensorMask dirtySensors = SENSOR_MASK_ALL;
+static uint32_t dirtyRelays = 0;
+static uint32_t rulesEvaluated = 0;
+static uint32_t nodesEvaluated = 0;
+static uint32_t evaluationRound = 0;
+
+// Ring of sensor readings for the rate-of-change inputs
+static float rateSamples[RATE_SAMPLE_SLOTS][SENSOR_SLOT_COUNT];
+static uint32_t rateSampleTimes[RATE_SAMPLE_SLOTS];
+static uint8_t rateSampleCount = 0;
+static uint8_t rateSampleNext = 0;
+static uint32_t lastSensorPoll = 0;
+static ControlSnapshot working;
+
+// Local time: at halMillis() clockAt it was clockWeekMs into the week
+static bool clockValid = false;
+static uint32_t clockAt = 0;
+static uint32_t clockWeekMs = 0;
+static bool schedulesStale = false;  // clock or program changed, resync all
+
+// Timing window in progress
+static uint32_t windowWakes = 0;
+static uint32_t windowJitterSumUs = 0;
+static uint32_t windowJitterMaxUs = 0;
+static uint32_t windowBusyMaxUs = 0;
+
+// ============================================================================
+// Rule pipeline
+// ============================================================================
+
+static void markRelayDirty(uint8_t relay) {
+  if (relay < NUM_RELAY_CHANNELS) {
+    dirtyRelays |= 1u << relay;
+  }
+}
+
+static void setInput(uint8_t input, float value) {
+  const float current = inputs.values[input];
+  if (value == current || (isnan(value) && isnan(current))) {
+    return;
+  }
+
+  inputs.values[input] = value;
+  dirtySensors |= 1u << input;
+}
+
+static void setSensorValue(uint8_t slot, float value) {
+  if (slot < SENSOR_SLOT_COUNT) {
+    setInput(slot, value);
+  }
+}
+
+/**
+ * Keep a reading every RATE_SAMPLE_INTERVAL_MS and update each sensor's
+ * rate input from the oldest one kept, which is between one window and one
+ * window plus an interval old. Rates stay NaN, and never match, until the
+ * readings span a full window.
+ */
+static void updateRates(uint32_t now) {
+  const uint8_t newest = (rateSampleNext + RATE_SAMPLE_SLOTS - 1) % RATE_SAMPLE_SLOTS;
+  if (rateSampleCount == 0 || now - rateSampleTimes[newest] >= RATE_SAMPLE_INTERVAL_MS) {
+    memcpy(rateSamples[rateSampleNext], inputs.values, sizeof(rateSamples[rateSampleNext]));
+    rateSampleTimes[rateSampleNext] = now;
+    rateSampleNext = (rateSampleNext + 1) % RATE_SAMPLE_SLOTS;
+    if (rateSampleCount < RATE_SAMPLE_SLOTS) rateSampleCount++;
+  }
+
+  if (rateSampleCount < RATE_SAMPLE_SLOTS) {
+    return;
+  }
+  const uint8_t oldest = rateSampleNext;
+  const float minutes = (now - rateSampleTimes[oldest]) / 60000.0f;
+  for (uint8_t slot = 0; slot < SENSOR_SLOT_COUNT; slot++) {
+    setInput(ruleRateInput(slot), (inputs.values[slot] - rateSamples[oldest][slot]) / minutes);
+  }
+}
+
+static void setRuleActive(uint16_t programIndex, bool active) {
+  running->states[programIndex].active = active;
+  running->active[programIndex].store(active, std::memory_order_relaxed);
+}
+
+static void pollSensors(uint32_t now) {
+  // TODO: Replace with real sensor reads. For now we keep the last values
+  // and allow the UI to push overrides via /api/sensors/mock. Real reads
+  // must go through setSensorValue() so dependent rules get re-evaluated.
+  working.sensorPolls++;
+  working.sensorPolledAt = now;
+  updateRates(now);
+}
+
+// Start a new evaluation round: node results memoized earlier are stale
+static void nextEvaluationRound() {
+  if (++evaluationRound > EXPR_MAX_ROUND) {
+    std::fill(running->memo.begin(), running->memo.end(), 0);
+    for (RuleState &state : running->states) {
+      state.evaluatedRound = 0;
+    }
+    evaluationRound = 1;
+  }
+}
+
+static bool evaluateCondition(const CompiledRule &compiled) {
+  ExprEvaluation evaluation{&running->program, &inputs, running->memo.data(), evaluationRound, 0};
+  const bool met = evaluateCompiledRule(compiled, evaluation);
+  nodesEvaluated += evaluation.nodesEvaluated;
+  return met;
+}
+
+/**
+ * Re-check rules whose minimum duration just ran out. Rules whose condition
+ * has cleared in the meantime release their relay; the others stay active
+ * until a sensor change clears them.
+ */
+static void processExpiredActions(uint32_t now) {
+  uint16_t programIndex;
+  while (timerQueuePopExpired(running->timers, now, programIndex)) {
+    const CompiledRule &compiled = running->program.rules[programIndex];
+    RuleState &state = running->states[programIndex];
+
+    rulesEvaluated++;
+    state.evaluatedRound = evaluationRound;
+    if (evaluateCondition(compiled)) {
+      state.minDurationElapsed = true;
+    } else {
+      setRuleActive(programIndex, false);
+      markRelayDirty(compiled.action.relayIndex);
+    }
+  }
+}
+
+// A rule reading several changed inputs is only looked at once per round
+static void evaluateProgramRule(uint16_t programIndex, uint32_t now) {
+  const CompiledRule &compiled = running->program.rules[programIndex];
+  RuleState &state = running->states[programIndex];
+  if (state.evaluatedRound == evaluationRound) {
+    return;
+  }
+  state.evaluatedRound = evaluationRound;
+  bool conditionMet = evaluateCondition(compiled);
+  rulesEvaluated++;
+
+  if (conditionMet) {
+    if (!state.active) {
+      setRuleActive(programIndex, true);
+      state.minEndTime = now + compiled.action.minDurationMs;
+      state.minDurationElapsed = compiled.action.minDurationMs == 0;
+      if (!state.minDurationElapsed) {
+        timerQueuePush(running->timers, programIndex, state.minEndTime);
+      }
+      markRelayDirty(compiled.action.relayIndex);
+    }
+  } else if (state.active && state.minDurationElapsed) {
+    // Condition cleared after the minimum duration was respected
+    setRuleActive(programIndex, false);
+    markRelayDirty(compiled.action.relayIndex);
+  }
+}
+
+// ============================================================================
+// Schedules
+// ============================================================================
+
+static uint32_t weekMsAt(uint32_t now) {
+  return (clockWeekMs + static_cast<uint64_t>(now - clockAt)) % SCHEDULE_WEEK_MS;
+}
+
+static void setScheduleState(uint16_t index, uint8_t state) {
+  if (running->scheduleStates[index] != state) {
+    running->scheduleStates[index] = state;
+    markRelayDirty(running->schedules.schedules[index].relayIndex);
+  }
+}
+
+/**
+ * Put every schedule into the state for the current time and queue its
+ * next transition. Runs after a program switch or clock change, so a
+ * reboot, NTP sync or clock jump never waits for the next transition.
+ */
+static void syncSchedules(uint32_t now) {
+  timerQueueReset(running->scheduleTimers, running->schedules.schedules.size());
+  const uint32_t weekMs = weekMsAt(now);
+  for (uint16_t i = 0; i < running->schedules.schedules.size(); i++) {
+    const CompiledSchedule &schedule = running->schedules.schedules[i];
+    if (!clockValid) {
+      setScheduleState(i, SCHEDULE_STATE_UNKNOWN);
+      continue;
+    }
+    setScheduleState(i, scheduleStateAt(schedule, weekMs) ? SCHEDULE_STATE_ON : SCHEDULE_STATE_OFF);
+    timerQueuePush(running->scheduleTimers, i, now + scheduleMsUntilNext(schedule, weekMs));
+  }
+}
+
+// Only schedules whose next transition came are looked at
+static void processScheduleTransitions(uint32_t now) {
+  uint16_t index;
+  while (timerQueuePopExpired(running->scheduleTimers, now, index)) {
+    const CompiledSchedule &schedule = running->schedules.schedules[index];
+    const uint32_t weekMs = weekMsAt(now);
+    setScheduleState(index, scheduleStateAt(schedule, weekMs) ? SCHEDULE_STATE_ON : SCHEDULE_STATE_OFF);
+    timerQueuePush(running->scheduleTimers, index, now + scheduleMsUntilNext(schedule, weekMs));
+  }
+}
+
+/**
+ * Arbitrate every relay touched this pass across all schedules and rules
+ * driving it, then write the relays that changed (manual overrides
+ * included) in one go. Schedules vote first, so a rule wins a priority tie.
+ */
+static void resolveRelays() {
+  const uint32_t dirty = dirtyRelays;
+  dirtyRelays = 0;
+  const RuleProgram &program = running->program;
+  const std::vector<CompiledSchedule> &schedules = running->schedules.schedules;
+  for (uint8_t relay = 0; relay < NUM_RELAY_CHANNELS; relay++) {
+    if (!(dirty & (1u << relay))) continue;
+
+    for (uint16_t i = 0; i < schedules.size(); i++) {
+      const uint8_t state = running->scheduleStates[i];
+      if (schedules[i].relayIndex == relay && state != SCHEDULE_STATE_UNKNOWN) {
+        relayOutputVote(relay, state == SCHEDULE_STATE_ON, schedules[i].priority, true);
+      }
+    }
+
+    for (uint16_t i = program.relayRuleStart[relay]; i < program.relayRuleStart[relay + 1]; i++) {
+      const uint16_t programIndex = program.relayRules[i];
+      const CompiledRule &compiled = program.rules[programIndex];
+      const bool active = running->states[programIndex].active;
+      relayOutputVote(relay, active ? compiled.action.turnOn : !compiled.action.turnOn, compiled.priority, active);
+    }
+  }
+
+  relayOutputCommit();
+}
+
+/**
+ * Re-evaluate only the rules that read an input (sensor value or rate)
+ * changed since the last pass, plus rules whose minimum duration expired.
+ * Condition nodes shared by several of them are computed once. The relays
+ * they touched are left dirty for resolveRelays().
+ */
+static void evaluateRules(uint32_t now) {
+  rulesEvaluated = 0;
+  nodesEvaluated = 0;
+  nextEvaluationRound();
+
+  processExpiredActions(now);
+
+  const SensorMask dirty = dirtySensors;
+  dirtySensors = 0;
+  const RuleProgram &program = running->program;
+  for (uint8_t input = 0; input < RULE_INPUT_COUNT; input++) {
+    if (!(dirty & (1u << input))) continue;
+
+    for (uint16_t i = program.inputRuleStart[input]; i < program.inputRuleStart[input + 1]; i++) {
+      evaluateProgramRule(program.inputRules[i], now);
+    }
+  }
+
+  if (rulesEvaluated > 0) {
+    working.rulesEvaluated = rulesEvaluated;
+    working.nodesEvaluated = nodesEvaluated;
+    working.ruleEvaluations += rulesEvaluated;
+  }
+}
+
+/**
+ * Switch to a new program. Rules the network side matched to a rule of the
+ * running program keep its state and pending minimum-duration timer.
+ */
+static void loadProgram(ControlProgram *next) {
+  for (size_t i = 0; i < next->states.size(); i++) {
+    if (next->inheritFrom[i] >= 0) {
+      next->states[i] = running->states[next->inheritFrom[i]];
+    }
+    next->active[i].store(next->states[i].active, std::memory_order_relaxed);
+    if (next->states[i].active && !next->states[i].minDurationElapsed) {
+      timerQueuePush(next->timers, static_cast<uint16_t>(i), next->states[i].minEndTime);
+    }
+  }
+
+  dirtySensors |= next->dirtySensors;
+  dirtyRelays |= next->dirtyRelays;
+  // Relays the old schedules drove lose their votes
+  for (const CompiledSchedule &schedule : running->schedules.schedules) {
+    markRelayDirty(schedule.relayIndex);
+  }
+  schedulesStale = true;
+  retired.push(running);
+  running = next;
+  working.generation = next->generation;
+}
+
+static void drainCommands() {
+  ControlCommand command;
+  while (commands.peek(command)) {
+    // A program can only be taken while the replaced one has somewhere to
+    // go; otherwise it waits in the queue for a later pass
+    if (command.type == COMMAND_LOAD_PROGRAM && retired.space() == 0) {
+      return;  // controlTakeRetired() wakes the task once there is room
+    }
+    commands.pop(command);
+
+    switch (command.type) {
+      case COMMAND_SET_RELAY:
+        relayOutputForce(command.index, command.arg != 0);
+        break;
+      case COMMAND_SET_SENSOR:
+        setSensorValue(command.index, command.value);
+        break;
+      case COMMAND_SET_POLICY:
+        relayOutputSetPolicy(command.index, static_cast<RelayPolicy>(command.arg));
+        markRelayDirty(command.index);
+        break;
+      case COMMAND_SET_CLOCK:
+        clockValid = true;
+        clockAt = command.at;
+        clockWeekMs = command.weekMs % SCHEDULE_WEEK_MS;
+        schedulesStale = true;
+        break;
+      case COMMAND_LOAD_PROGRAM:
+        loadProgram(command.program);
+        break;
+    }
+  }
+}
+
+// ============================================================================
+// Task
+// ============================================================================
+
+// `timedWake`: the pass started because its deadline came, not a command,
+// so how far it started from `expectedStartUs` is the wake jitter
+static void recordTiming(uint32_t startUs, uint32_t busyUs, bool timedWake, uint32_t expectedStartUs) {
+  if (timedWake) {
+    const int32_t offset = static_cast<int32_t>(startUs - expectedStartUs);
+    const uint32_t jitter = offset < 0 ? -offset : offset;
+    windowJitterSumUs += jitter;
+    if (jitter > windowJitterMaxUs) windowJitterMaxUs = jitter;
+    if (jitter > working.timing.jitterWorstUs) working.timing.jitterWorstUs = jitter;
+    windowWakes++;
+  }
+
+  if (busyUs > windowBusyMaxUs) windowBusyMaxUs = busyUs;
+  if (busyUs > CONTROL_PASS_BUDGET_US) working.timing.overruns++;
+
+  if (windowWakes >= CONTROL_STATS_WAKES) {
+    working.timing.jitterMeanUs = windowJitterSumUs / windowWakes;
+    working.timing.jitterMaxUs = windowJitterMaxUs;
+    working.timing.busyMaxUs = windowBusyMaxUs;
+    windowWakes = 0;
+    windowJitterSumUs = 0;
+    windowJitterMaxUs = 0;
+    windowBusyMaxUs = 0;
+  }
+}
+
+static void publishSnapshot() {
+  working.relays = 0;
+  for (uint8_t i = 0; i < NUM_RELAY_CHANNELS; i++) {
+    if (relayOutputState(i)) working.relays |= 1u << i;
+    working.toggleCounts[i] = relayOutputToggleCount(i);
+    working.policies[i] = relayOutputPolicy(i);
+  }
+  memcpy(working.sensors.slots, inputs.values, sizeof(working.sensors.slots));
+  memcpy(working.rates.slots, inputs.values + SENSOR_SLOT_COUNT, sizeof(working.rates.slots));
+  working.schedulesOn = 0;
+  for (uint16_t i = 0; i < running->scheduleStates.size(); i++) {
+    if (running->scheduleStates[i] == SCHEDULE_STATE_ON) working.schedulesOn |= 1u << i;
+  }
+  working.clockValid = clockValid;
+  snapshots.publish(working);
+}
+
+// Earliest of the next sensor poll, minimum-duration expiry and schedule
+// transition. The sensor poll is always pending, so it bounds every sleep.
+static uint32_t nextDeadline() {
+  uint32_t deadline = lastSensorPoll + SENSOR_POLL_INTERVAL_MS;
+  uint32_t timer;
+  if (timerQueueNextDeadline(running->timers, timer) && static_cast<int32_t>(timer - deadline) < 0) {
+    deadline = timer;
+  }
+  if (timerQueueNextDeadline(running->scheduleTimers, timer) && static_cast<int32_t>(timer - deadline) < 0) {
+    deadline = timer;
+  }
+  return deadline;
+}
+
+// One pass of the pipeline; `timedWake` and `expectedStartUs` describe the
+// wake that started it, for the jitter statistics
+static void runPass(bool timedWake, uint32_t expectedStartUs) {
+  MetricsTimer passTimer(METRIC_STAGE_CONTROL_PASS);
+  const uint32_t startUs = halMicros();
+  const uint32_t now = halMillis();
+
+  drainCommands();
+  if (now - lastSensorPoll >= SENSOR_POLL_INTERVAL_MS) {
+    MetricsTimer timer(METRIC_STAGE_SENSOR_POLL);
+    lastSensorPoll = now;
+    pollSensors(now);
+  }
+  {
+    MetricsTimer timer(METRIC_STAGE_RULES);
+    if (schedulesStale) {
+      schedulesStale = false;
+      syncSchedules(now);
+    } else {
+      processScheduleTransitions(now);
+    }
+    evaluateRules(now);
+  }
+  {
+    MetricsTimer timer(METRIC_STAGE_RELAY_OUTPUT);
+    resolveRelays();
+  }
+
+  recordTiming(startUs, halMicros() - startUs, timedWake, expectedStartUs);
+  working.passes++;
+  publishSnapshot();
+}
+
+#if defined(ARDUINO_ARCH_ESP32)
+
+static void controlTask(void *) {
+  powerRegister(POWER_TASK_CONTROL);
+  bool timedWake = false;
+  uint32_t expectedStartUs = 0;
+  for (;;) {
+    runPass(timedWake, expectedStartUs);
+
+    // Relays, sensor polls and retired programs are picked up by the
+    // network side
+    powerWake(POWER_TASK_NETWORK);
+
+    const uint32_t after = halMillis();
+    const uint32_t deadline = nextDeadline();
+    const uint32_t sleepMs = deadlineReached(after, deadline) ? 0 : deadline - after;
+    expectedStartUs = halMicros() + (sleepMs > 0 ? sleepMs : 1) * 1000;
+    timedWake = !powerWait(POWER_TASK_CONTROL, sleepMs);
+  }
+}
+
+#endif
+
+void controlBegin() {
+  lastSensorPoll = halMillis();
+
+  // An empty program, so the task never has to check for one
+  running = new ControlProgram();
+  running->generation = 0;
+  compileRules(std::vector<RuleDefinition>(), running->program);
+  running->dirtySensors = 0;
+  running->dirtyRelays = 0;
+
+  working = ControlSnapshot();
+  publishSnapshot();
+}
+
+#if defined(ARDUINO_ARCH_ESP32)
+
+bool controlStart() {
+  lastSensorPoll = halMillis();
+  return xTaskCreatePinnedToCore(controlTask, "control", CONTROL_TASK_STACK_BYTES, nullptr, CONTROL_TASK_PRIORITY,
+                                 &task, CONTROL_TASK_CORE) == pdPASS;
+}
+
+TaskHandle_t controlTaskHandle() {
+  return task;
+}
+
+#endif
+
+void controlRunPass() {
+  runPass(false, 0);
+}
+
+uint32_t controlNextDeadline() {
+  return nextDeadline();
+}
+
+static bool queueCommand(const ControlCommand &command) {
+  if (!commands.push(command)) {
+    return false;
+  }
+  powerWake(POWER_TASK_CONTROL);
+  return true;
+}
+
+bool controlSetRelay(uint8_t relay, bool on) {
+  return queueCommand(ControlCommand{COMMAND_SET_RELAY, relay, on, 0.0f, 0, 0, nullptr});
+}
+
+bool controlSetSensor(uint8_t slot, float value) {
+  return queueCommand(ControlCommand{COMMAND_SET_SENSOR, slot, 0, value, 0, 0, nullptr});
+}
+
+bool controlSetPolicy(uint8_t relay, RelayPolicy policy) {
+  return queueCommand(ControlCommand{COMMAND_SET_POLICY, relay, policy, 0.0f, 0, 0, nullptr});
+}
+
+bool controlSetClock(uint32_t weekMs, uint32_t at) {
+  return queueCommand(ControlCommand{COMMAND_SET_CLOCK, 0, 0, 0.0f, weekMs, at, nullptr});
+}
+
+bool controlLoadProgram(ControlProgram *program) {
+  return queueCommand(ControlCommand{COMMAND_LOAD_PROGRAM, 0, 0, 0.0f, 0, 0, program});
+}
+
+ControlProgram *controlTakeRetired() {
+  ControlProgram *program = nullptr;
+  if (!retired.pop(program)) {
+    return nullptr;
+  }
+  // A program load may be waiting for this slot
+  powerWake(POWER_TASK_CONTROL);
+  return program;
+}
+
+ControlSnapshot controlSnapshot() {
+  return snapshots.read();
+}
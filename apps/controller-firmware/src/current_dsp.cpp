@@ -0,0 +1,92 @@
+/**
+ * TerraHub Controller Firmware - Current Signal Processing
+ */
+
+#include <math.h>
+#include "current_dsp.h"
+#include "timer_queue.h"
+
+static const char *const faultNames[] = {
+  "none",
+  "no-load",
+  "unexpected-load"
+};
+
+uint16_t currentWindowSamples(uint32_t channelRateHz, uint16_t mainsHz, uint8_t cycles) {
+  if (mainsHz == 0) {
+    return 0;
+  }
+  const uint32_t samples = (channelRateHz * cycles + mainsHz / 2) / mainsHz;
+  return samples > UINT16_MAX ? UINT16_MAX : static_cast<uint16_t>(samples);
+}
+
+void currentRmsBegin(CurrentRmsWindow &window, uint16_t windowSamples) {
+  window.windowSamples = windowSamples;
+  window.count = 0;
+  window.sum = 0;
+  window.sumSquares = 0;
+}
+
+bool currentRmsAdd(CurrentRmsWindow &window, uint16_t raw, float &rmsCounts) {
+  window.sum += raw;
+  window.sumSquares += static_cast<uint32_t>(raw) * raw;
+  if (++window.count < window.windowSamples) {
+    return false;
+  }
+
+  // Variance about the window mean: E[x^2] - E[x]^2, in integers so the
+  // large DC bias does not eat float precision
+  const uint64_t n = window.count;
+  const uint64_t sum = window.sum;
+  const uint64_t scaled = window.sumSquares * n;
+  const uint64_t bias = sum * sum;
+  const float variance = scaled > bias ? static_cast<float>(scaled - bias) / static_cast<float>(n * n) : 0.0f;
+  rmsCounts = sqrtf(variance);
+
+  window.count = 0;
+  window.sum = 0;
+  window.sumSquares = 0;
+  return true;
+}
+
+const char *currentFaultName(CurrentFault fault) {
+  return fault <= CURRENT_FAULT_UNEXPECTED_LOAD ? faultNames[fault] : "";
+}
+
+void currentFaultBegin(CurrentFaultState &state, bool relayOn, uint32_t now) {
+  state.relayOn = relayOn;
+  state.relayChangedAt = now;
+  state.strikes = 0;
+  state.fault = CURRENT_FAULT_NONE;
+}
+
+bool currentFaultUpdate(CurrentFaultState &state, bool relayOn, float rmsMa, uint32_t now) {
+  if (relayOn != state.relayOn) {
+    state.relayOn = relayOn;
+    state.relayChangedAt = now;
+    state.strikes = 0;
+  }
+  // Contact bounce, inrush and the window straddling the switch
+  if (!deadlineReached(now, state.relayChangedAt + CURRENT_SETTLE_MS)) {
+    return false;
+  }
+
+  const bool flowing = rmsMa >= CURRENT_FAULT_THRESHOLD_MA;
+  CurrentFault observed = CURRENT_FAULT_NONE;
+  if (relayOn && !flowing) {
+    observed = CURRENT_FAULT_NO_LOAD;
+  } else if (!relayOn && flowing) {
+    observed = CURRENT_FAULT_UNEXPECTED_LOAD;
+  }
+
+  if (observed == state.fault) {
+    state.strikes = 0;
+    return false;
+  }
+  if (++state.strikes < CURRENT_FAULT_WINDOWS) {
+    return false;
+  }
+  state.fault = observed;
+  state.strikes = 0;
+  return true;
+}
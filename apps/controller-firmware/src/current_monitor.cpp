@@ -0,0 +1,201 @@
+/**
+ * TerraHub Controller Firmware - Current Monitor
+ *
+ * The ADC converts the channel pattern round-robin at CURRENT_SAMPLE_RATE_HZ
+ * and the I2S DMA engine writes the samples into the driver's ring of
+ * DMA_STORE_BYTES. The sampling task drains one DMA_FRAME_BYTES frame at a
+ * time while DMA keeps filling the rest of the ring, so conversion never
+ * waits on processing.
+ */
+
+#include <Arduino.h>
+#include <atomic>
+#include <math.h>
+#include <string.h>
+#include "current_monitor.h"
+#include "pinout.h"
+#include "power_manager.h"
+#include "relay_output.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include "driver/adc.h"
+#endif
+
+// Bytes per DMA read (2 bytes per sample, ~25 ms at 20 kHz) and the ring
+// the driver keeps behind it
+#define DMA_FRAME_BYTES 1024
+#define DMA_STORE_BYTES (4 * DMA_FRAME_BYTES)
+
+// Sampling task; core 0 keeps it off the Arduino loop's core
+#define SAMPLING_TASK_STACK_BYTES 3072
+#define SAMPLING_TASK_PRIORITY 5
+#define SAMPLING_TASK_CORE 0
+
+// The DMA mode samples ADC1 only, channels 0-7
+#define ADC1_CHANNEL_COUNT 8
+
+// Written by the sampling task, read by the control loop and HTTP handlers
+static portMUX_TYPE resultsMux = portMUX_INITIALIZER_UNLOCKED;
+static CurrentChannelStatus results[NUM_CURRENT_SENSORS];
+static std::atomic<uint32_t> faultMask(0);
+static std::atomic<uint32_t> faultEvents(0);
+
+#if defined(ARDUINO_ARCH_ESP32)
+
+static CurrentRmsWindow windows[NUM_CURRENT_SENSORS];
+static CurrentFaultState faultStates[NUM_CURRENT_SENSORS];
+static uint8_t adcToSensor[16];  // ADC1 channel -> current channel, 0xFF if unused
+
+static bool isRelayPin(int pin) {
+  for (uint8_t i = 0; i < NUM_RELAY_CHANNELS; i++) {
+    if (relayPins[i] == pin) return true;
+  }
+  return false;
+}
+
+/**
+ * Record a completed window. Runs on the sampling task; the relay state is
+ * a single word written by the control loop, so reading it here is safe.
+ */
+static void publishWindow(uint8_t channel, float rmsMa, uint32_t now) {
+  const bool changed = currentFaultUpdate(faultStates[channel], relayOutputState(channel), rmsMa, now);
+
+  portENTER_CRITICAL(&resultsMux);
+  results[channel].rmsMa = rmsMa >= UINT16_MAX ? UINT16_MAX : static_cast<uint16_t>(lroundf(rmsMa));
+  results[channel].fault = faultStates[channel].fault;
+  results[channel].windows++;
+  portEXIT_CRITICAL(&resultsMux);
+
+  if (changed) {
+    const uint32_t bit = 1u << channel;
+    if (faultStates[channel].fault != CURRENT_FAULT_NONE) {
+      faultMask.fetch_or(bit);
+    } else {
+      faultMask.fetch_and(~bit);
+    }
+    faultEvents.fetch_add(1);
+    // Faults are reported from the network loop
+    powerWake(POWER_TASK_NETWORK);
+  }
+}
+
+static void processFrame(const uint8_t *data, uint32_t length) {
+  const uint32_t now = millis();
+  const adc_digi_output_data_t *samples = reinterpret_cast<const adc_digi_output_data_t *>(data);
+  for (uint32_t i = 0; i < length / sizeof(adc_digi_output_data_t); i++) {
+    const uint8_t channel = adcToSensor[samples[i].type1.channel];
+    float rmsCounts;
+    if (channel == 0xFF || !currentRmsAdd(windows[channel], samples[i].type1.data, rmsCounts)) continue;
+    publishWindow(channel, rmsCounts * CURRENT_MA_PER_COUNT, now);
+  }
+}
+
+static void samplingTask(void *) {
+  static uint8_t frame[DMA_FRAME_BYTES];
+  for (;;) {
+    uint32_t length = 0;
+    // ESP_ERR_INVALID_STATE means the ring overflowed; the bytes read are
+    // still valid, the windows in progress just lose some samples
+    const esp_err_t err = adc_digi_read_bytes(frame, sizeof(frame), &length, ADC_MAX_DELAY);
+    if (err == ESP_OK || err == ESP_ERR_INVALID_STATE) {
+      processFrame(frame, length);
+    }
+  }
+}
+
+static bool startSampling(uint32_t adcMask, adc_digi_pattern_config_t *pattern, uint8_t patternCount) {
+  adc_digi_init_config_t init = {};
+  init.max_store_buf_size = DMA_STORE_BYTES;
+  init.conv_num_each_intr = DMA_FRAME_BYTES;
+  init.adc1_chan_mask = adcMask;
+  init.adc2_chan_mask = 0;
+  if (adc_digi_initialize(&init) != ESP_OK) {
+    return false;
+  }
+
+  adc_digi_configuration_t config = {};
+  config.conv_limit_en = true;  // required on the ESP32
+  config.conv_limit_num = 250;
+  config.pattern_num = patternCount;
+  config.adc_pattern = pattern;
+  config.sample_freq_hz = CURRENT_SAMPLE_RATE_HZ;
+  config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+  config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+  if (adc_digi_controller_configure(&config) != ESP_OK || adc_digi_start() != ESP_OK) {
+    adc_digi_deinitialize();
+    return false;
+  }
+
+  return xTaskCreatePinnedToCore(samplingTask, "current", SAMPLING_TASK_STACK_BYTES, nullptr,
+                                 SAMPLING_TASK_PRIORITY, nullptr, SAMPLING_TASK_CORE) == pdPASS;
+}
+
+bool currentMonitorBegin() {
+  memset(adcToSensor, 0xFF, sizeof(adcToSensor));
+  adc_digi_pattern_config_t pattern[NUM_CURRENT_SENSORS];
+  uint8_t patternCount = 0;
+  uint32_t adcMask = 0;
+
+  for (uint8_t i = 0; i < NUM_CURRENT_SENSORS; i++) {
+    const int pin = currentSensorPins[i];
+    const int adcChannel = digitalPinToAnalogChannel(pin);
+    results[i] = CurrentChannelStatus{false, 0, CURRENT_FAULT_NONE, 0};
+    if (adcChannel < 0 || adcChannel >= ADC1_CHANNEL_COUNT || isRelayPin(pin)) continue;
+
+    results[i].available = true;
+    adcToSensor[adcChannel] = i;
+    adcMask |= 1u << adcChannel;
+    pattern[patternCount].atten = ADC_ATTEN_DB_11;
+    pattern[patternCount].channel = adcChannel;
+    pattern[patternCount].unit = 0;  // ADC1
+    pattern[patternCount].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+    patternCount++;
+  }
+  if (patternCount == 0) {
+    return false;
+  }
+
+  // The pattern is converted round-robin, so each channel gets an equal share
+  const uint16_t windowSamples =
+      currentWindowSamples(CURRENT_SAMPLE_RATE_HZ / patternCount, CURRENT_MAINS_HZ, CURRENT_RMS_CYCLES);
+  const uint32_t now = millis();
+  for (uint8_t i = 0; i < NUM_CURRENT_SENSORS; i++) {
+    currentRmsBegin(windows[i], windowSamples);
+    currentFaultBegin(faultStates[i], relayOutputState(i), now);
+  }
+
+  if (!startSampling(adcMask, pattern, patternCount)) {
+    for (uint8_t i = 0; i < NUM_CURRENT_SENSORS; i++) {
+      results[i].available = false;
+    }
+    return false;
+  }
+  return true;
+}
+
+#else
+
+bool currentMonitorBegin() {
+  memset(results, 0, sizeof(results));
+  return false;
+}
+
+#endif
+
+CurrentChannelStatus currentMonitorChannel(uint8_t channel) {
+  if (channel >= NUM_CURRENT_SENSORS) {
+    return CurrentChannelStatus{false, 0, CURRENT_FAULT_NONE, 0};
+  }
+  portENTER_CRITICAL(&resultsMux);
+  const CurrentChannelStatus status = results[channel];
+  portEXIT_CRITICAL(&resultsMux);
+  return status;
+}
+
+uint32_t currentMonitorFaultMask() {
+  return faultMask.load();
+}
+
+uint32_t currentMonitorFaultEvents() {
+  return faultEvents.load();
+}
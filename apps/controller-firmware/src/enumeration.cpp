@@ -0,0 +1,144 @@
+/**
+ * TerraHub Controller Firmware - Daisy-Chain Enumeration
+ */
+
+#include "enumeration.h"
+#include "hal.h"
+#include "timer_queue.h"
+
+// Slave ids start after the controller (node 1)
+#define FIRST_SLAVE_ID 2
+
+static const char *const stateNames[] = {
+  "idle",
+  "probing",
+  "assigning",
+  "enabling",
+  "done",
+  "failed"
+};
+
+static const I2cBus *bus = nullptr;
+static EnumerationState state = ENUM_STATE_IDLE;
+static I2cTransaction txn;
+static EnumeratedNode nodes[MAX_NODES - 1];
+static uint8_t nodeCount = 0;
+static uint32_t startedAt = 0;
+static uint32_t finishedAt = 0;
+static uint32_t downstreamEnabledAt = 0;  // last SYNC_OUT enable in the chain
+static uint32_t helloAnsweredAt = 0;
+
+const char *enumerationStateName(EnumerationState value) {
+  return value <= ENUM_STATE_FAILED ? stateNames[value] : "";
+}
+
+static uint8_t nextNodeId() {
+  return FIRST_SLAVE_ID + nodeCount;
+}
+
+static bool running() {
+  return state == ENUM_STATE_PROBING || state == ENUM_STATE_ASSIGNING || state == ENUM_STATE_ENABLING;
+}
+
+static void finish(EnumerationState next, uint32_t now) {
+  state = next;
+  finishedAt = now;
+  halLog("Enumeration %s: %u nodes in %lu ms\n", stateNames[next], nodeCount,
+         static_cast<unsigned long>(finishedAt - startedAt));
+  for (uint8_t i = 0; i < nodeCount; i++) {
+    halLog("  node %u: fw %u.%u, boot %lu ms, configure %lu ms\n", nodes[i].nodeId, nodes[i].fwMajor,
+           nodes[i].fwMinor, static_cast<unsigned long>(nodes[i].bootMs),
+           static_cast<unsigned long>(nodes[i].configureMs));
+  }
+}
+
+static void startProbe(uint32_t now) {
+  i2cTransactionStart(txn, I2C_DEFAULT_ADDRESS, I2C_CMD_HELLO_UNASSIGNED, nullptr, 0, 2, now);
+  state = ENUM_STATE_PROBING;
+}
+
+void enumerationBegin(const I2cBus &busToUse, uint32_t now) {
+  bus = &busToUse;
+  nodeCount = 0;
+  startedAt = now;
+  finishedAt = now;
+  downstreamEnabledAt = now;
+  startProbe(now);
+}
+
+bool enumerationLoop(uint32_t now) {
+  if (!running()) {
+    return false;
+  }
+
+  const I2cTransactionState result = i2cTransactionPoll(txn, *bus, now);
+  if (result == I2C_TXN_PENDING) {
+    return true;
+  }
+  const bool ok = result == I2C_TXN_DONE && txn.reply.code == I2C_STATUS_OK;
+  EnumeratedNode &node = nodes[nodeCount];
+
+  switch (state) {
+    case ENUM_STATE_PROBING:
+      if (ok && txn.reply.length >= 2) {
+        helloAnsweredAt = now;
+        node.nodeId = nextNodeId();
+        node.fwMajor = txn.reply.payload[0];
+        node.fwMinor = txn.reply.payload[1];
+        node.bootMs = now - downstreamEnabledAt;
+        i2cTransactionStart(txn, I2C_DEFAULT_ADDRESS, I2C_CMD_ASSIGN_ID, &node.nodeId, 1, 1, now);
+        state = ENUM_STATE_ASSIGNING;
+      } else if (now - downstreamEnabledAt >= ENUM_NODE_BOOT_TIMEOUT_MS) {
+        // Nobody downstream: the chain ends here
+        finish(ENUM_STATE_DONE, now);
+      } else {
+        startProbe(now);
+        txn.nextActionAt = now + ENUM_HELLO_INTERVAL_MS;
+      }
+      break;
+
+    case ENUM_STATE_ASSIGNING:
+      // Even if the acknowledgment was lost the node may already have moved
+      // to its new address; ENABLE_DOWNSTREAM there settles it either way
+      i2cTransactionStart(txn, I2C_ADDRESS_BASE + node.nodeId, I2C_CMD_ENABLE_DOWNSTREAM, nullptr, 0, 0, now);
+      state = ENUM_STATE_ENABLING;
+      break;
+
+    case ENUM_STATE_ENABLING:
+      if (!ok) {
+        halLog("Enumeration: node %u did not take its address\n", node.nodeId);
+        finish(ENUM_STATE_FAILED, now);
+        break;
+      }
+      node.configureMs = now - helloAnsweredAt;
+      downstreamEnabledAt = now;
+      nodeCount++;
+      if (nextNodeId() > MAX_NODES) {
+        finish(ENUM_STATE_DONE, now);
+      } else {
+        startProbe(now);
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  return running();
+}
+
+EnumerationState enumerationState() {
+  return state;
+}
+
+uint32_t enumerationElapsedMs(uint32_t now) {
+  return (running() ? now : finishedAt) - startedAt;
+}
+
+uint8_t enumerationNodeCount() {
+  return nodeCount;
+}
+
+const EnumeratedNode &enumerationNode(uint8_t index) {
+  return nodes[index < nodeCount ? index : 0];
+}
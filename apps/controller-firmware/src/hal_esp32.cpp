@@ -0,0 +1,128 @@
+/**
+ * TerraHub Controller Firmware - Hardware Abstraction Layer (ESP32)
+ *
+ * The HAL on the Arduino core: NVS through Preferences, opened per call in
+ * the "terrahub" namespace, and the controller side of the slave bus on
+ * Wire. The slave side of Wire is set up in main.cpp. NVS writes and
+ * removals are timed for /api/metrics.
+ */
+
+#if defined(ARDUINO_ARCH_ESP32)
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <Wire.h>
+#include <stdarg.h>
+#if __has_include("esp32/rom/ets_sys.h")
+#include "esp32/rom/ets_sys.h"
+#else
+#include "rom/ets_sys.h"
+#endif
+#include "hal.h"
+#include "metrics.h"
+
+#define HAL_NVS_NAMESPACE "terrahub"
+
+static Preferences preferences;
+
+uint32_t halMillis() {
+  return millis();
+}
+
+uint32_t halMicros() {
+  return micros();
+}
+
+uint32_t halCycleCount() {
+  return ESP.getCycleCount();
+}
+
+uint32_t halCpuMhz() {
+  // A ROM variable kept current by every clock switch; much cheaper than
+  // getCpuFrequencyMhz(), which decodes the clock registers
+  return ets_get_cpu_frequency();
+}
+
+void halPinOutput(uint8_t pin) {
+  pinMode(pin, OUTPUT);
+}
+
+void halDigitalWrite(uint8_t pin, bool high) {
+  digitalWrite(pin, high ? HIGH : LOW);
+}
+
+size_t halNvsBlobLength(const char *key) {
+  preferences.begin(HAL_NVS_NAMESPACE, true);
+  const size_t length = preferences.getBytesLength(key);
+  preferences.end();
+  return length;
+}
+
+size_t halNvsReadBlob(const char *key, void *data, size_t capacity) {
+  preferences.begin(HAL_NVS_NAMESPACE, true);
+  const size_t length = preferences.getBytes(key, data, capacity);
+  preferences.end();
+  return length;
+}
+
+bool halNvsWriteBlob(const char *key, const void *data, size_t length) {
+  MetricsTimer timer(METRIC_STAGE_NVS_WRITE);
+  preferences.begin(HAL_NVS_NAMESPACE, false);
+  const bool saved = preferences.putBytes(key, data, length) == length;
+  preferences.end();
+  return saved;
+}
+
+bool halNvsReadString(const char *key, std::string &value) {
+  preferences.begin(HAL_NVS_NAMESPACE, true);
+  const bool found = preferences.isKey(key);
+  value = found ? preferences.getString(key, "").c_str() : "";
+  preferences.end();
+  return found;
+}
+
+bool halNvsWriteString(const char *key, const char *value) {
+  MetricsTimer timer(METRIC_STAGE_NVS_WRITE);
+  preferences.begin(HAL_NVS_NAMESPACE, false);
+  const bool saved = preferences.putString(key, value) == strlen(value);
+  preferences.end();
+  return saved;
+}
+
+void halNvsRemove(const char *key) {
+  MetricsTimer timer(METRIC_STAGE_NVS_WRITE);
+  preferences.begin(HAL_NVS_NAMESPACE, false);
+  preferences.remove(key);
+  preferences.end();
+}
+
+static bool wireWrite(uint8_t address, const uint8_t *data, size_t length) {
+  Wire.beginTransmission(address);
+  Wire.write(data, length);
+  return Wire.endTransmission() == 0;
+}
+
+static size_t wireRead(uint8_t address, uint8_t *data, size_t length) {
+  const size_t received = Wire.requestFrom(address, length);
+  for (size_t i = 0; i < received; i++) {
+    data[i] = static_cast<uint8_t>(Wire.read());
+  }
+  return received;
+}
+
+static const I2cBus wireBus = {wireWrite, wireRead};
+
+const I2cBus &halI2cBus() {
+  return wireBus;
+}
+
+void halLog(const char *format, ...) {
+  char line[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  Serial.print(line);
+}
+
+#endif
@@ -0,0 +1,222 @@
+/**
+ * TerraHub Controller Firmware - Hardware Abstraction Layer (Native)
+ *
+ * In-memory stand-ins for a host build: a clock that only moves when the
+ * caller advances it, pin levels kept in an array, NVS as a map of typed
+ * values and a bus that forwards to simulated nodes while charging the
+ * clock for every byte moved.
+ */
+
+#if !defined(ARDUINO_ARCH_ESP32)
+
+#include <map>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "hal.h"
+
+// Transfer time per byte (8 data bits and the ACK) at 100 kHz
+#define HAL_NATIVE_I2C_BYTE_US 90
+
+#define HAL_NATIVE_PIN_COUNT 40
+
+// The cycle counter runs off the clock at the ESP32's top speed
+#define HAL_NATIVE_CPU_MHZ 240
+
+struct NvsValue {
+  bool isString;
+  std::vector<uint8_t> bytes;
+};
+
+static uint64_t clockUs = 0;
+static bool pinLevels[HAL_NATIVE_PIN_COUNT];
+static uint32_t pinWrites = 0;
+static std::map<std::string, NvsValue> nvs;
+static uint32_t nvsWrites = 0;
+static size_t nvsBytesWritten = 0;
+static bool nvsFailing = false;
+static const I2cBus *simulatedBus = nullptr;
+static bool logging = true;
+
+// ============================================================================
+// Clock
+// ============================================================================
+
+uint32_t halMillis() {
+  return static_cast<uint32_t>(clockUs / 1000);
+}
+
+uint32_t halMicros() {
+  return static_cast<uint32_t>(clockUs);
+}
+
+uint32_t halCycleCount() {
+  return static_cast<uint32_t>(clockUs * HAL_NATIVE_CPU_MHZ);
+}
+
+uint32_t halCpuMhz() {
+  return HAL_NATIVE_CPU_MHZ;
+}
+
+void halNativeSetMicros(uint64_t us) {
+  clockUs = us;
+}
+
+void halNativeAdvanceMicros(uint64_t us) {
+  clockUs += us;
+}
+
+void halNativeAdvanceMillis(uint32_t ms) {
+  clockUs += static_cast<uint64_t>(ms) * 1000;
+}
+
+// ============================================================================
+// GPIO
+// ============================================================================
+
+void halPinOutput(uint8_t pin) {
+  (void)pin;
+}
+
+void halDigitalWrite(uint8_t pin, bool high) {
+  if (pin < HAL_NATIVE_PIN_COUNT) {
+    pinLevels[pin] = high;
+    pinWrites++;
+  }
+}
+
+bool halNativePinLevel(uint8_t pin) {
+  return pin < HAL_NATIVE_PIN_COUNT && pinLevels[pin];
+}
+
+uint32_t halNativePinWrites() {
+  return pinWrites;
+}
+
+// ============================================================================
+// Persistent Storage
+// ============================================================================
+
+static const NvsValue *findValue(const char *key, bool isString) {
+  const auto it = nvs.find(key);
+  return it != nvs.end() && it->second.isString == isString ? &it->second : nullptr;
+}
+
+static void storeValue(const char *key, bool isString, const void *data, size_t length) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  nvs[key] = NvsValue{isString, std::vector<uint8_t>(bytes, bytes + length)};
+  nvsWrites++;
+  nvsBytesWritten += length;
+}
+
+size_t halNvsBlobLength(const char *key) {
+  const NvsValue *value = findValue(key, false);
+  return value != nullptr ? value->bytes.size() : 0;
+}
+
+size_t halNvsReadBlob(const char *key, void *data, size_t capacity) {
+  const NvsValue *value = findValue(key, false);
+  if (value == nullptr) {
+    return 0;
+  }
+  const size_t length = value->bytes.size() < capacity ? value->bytes.size() : capacity;
+  memcpy(data, value->bytes.data(), length);
+  return length;
+}
+
+bool halNvsWriteBlob(const char *key, const void *data, size_t length) {
+  if (nvsFailing) {
+    return false;
+  }
+  storeValue(key, false, data, length);
+  return true;
+}
+
+bool halNvsReadString(const char *key, std::string &value) {
+  const NvsValue *stored = findValue(key, true);
+  value.assign(stored != nullptr ? reinterpret_cast<const char *>(stored->bytes.data()) : "",
+               stored != nullptr ? stored->bytes.size() : 0);
+  return stored != nullptr;
+}
+
+bool halNvsWriteString(const char *key, const char *value) {
+  if (nvsFailing) {
+    return false;
+  }
+  storeValue(key, true, value, strlen(value));
+  return true;
+}
+
+void halNvsRemove(const char *key) {
+  nvs.erase(key);
+}
+
+void halNativeNvsClear() {
+  nvs.clear();
+  nvsWrites = 0;
+  nvsBytesWritten = 0;
+  nvsFailing = false;
+}
+
+void halNativeNvsSetFailing(bool failing) {
+  nvsFailing = failing;
+}
+
+uint32_t halNativeNvsWrites() {
+  return nvsWrites;
+}
+
+size_t halNativeNvsBytesWritten() {
+  return nvsBytesWritten;
+}
+
+// ============================================================================
+// I2C Master
+// ============================================================================
+
+static bool busWrite(uint8_t address, const uint8_t *data, size_t length) {
+  if (simulatedBus == nullptr) {
+    return false;
+  }
+  clockUs += length * HAL_NATIVE_I2C_BYTE_US;
+  return simulatedBus->write(address, data, length);
+}
+
+static size_t busRead(uint8_t address, uint8_t *data, size_t length) {
+  if (simulatedBus == nullptr) {
+    return 0;
+  }
+  clockUs += length * HAL_NATIVE_I2C_BYTE_US;
+  return simulatedBus->read(address, data, length);
+}
+
+static const I2cBus nativeBus = {busWrite, busRead};
+
+const I2cBus &halI2cBus() {
+  return nativeBus;
+}
+
+void halNativeSetI2cBus(const I2cBus *bus) {
+  simulatedBus = bus;
+}
+
+// ============================================================================
+// Logging
+// ============================================================================
+
+void halLog(const char *format, ...) {
+  if (!logging) {
+    return;
+  }
+  va_list args;
+  va_start(args, format);
+  vprintf(format, args);
+  va_end(args);
+}
+
+void halNativeSetLogging(bool enabled) {
+  logging = enabled;
+}
+
+#endif
@@ -0,0 +1,179 @@
+/**
+ * TerraHub Controller Firmware - I2C Slave Dispatcher
+ *
+ * The receive ring and the response double buffer are single-producer /
+ * single-consumer: the Wire callbacks only advance rxHead and read the
+ * published response, the main loop only advances rxTail and fills the
+ * back response buffer. Indices are published with release stores so the
+ * other side never sees a half-written frame.
+ */
+
+#include <atomic>
+#include <string.h>
+#include "i2c_dispatcher.h"
+
+static_assert((I2C_RX_SLOTS & (I2C_RX_SLOTS - 1)) == 0, "I2C_RX_SLOTS must be a power of two");
+
+struct RxSlot {
+  uint32_t sequence;
+  uint16_t length;
+  uint8_t data[I2C_FRAME_MAX_BYTES];
+};
+
+struct HandlerEntry {
+  uint8_t command;
+  I2cCommandHandler handler;
+};
+
+static RxSlot rxSlots[I2C_RX_SLOTS];
+static std::atomic<uint32_t> rxHead(0);
+static std::atomic<uint32_t> rxTail(0);
+static bool rxSlotClaimed = false;  // callback side only
+
+// Sequence number of the most recent request seen by onReceive, including
+// rejected and dropped ones
+static std::atomic<uint32_t> requestSequence(0);
+static std::atomic<uint32_t> rejectedSequence(0);
+
+static uint8_t txFrames[2][I2C_FRAME_MAX_BYTES];
+static size_t txLengths[2];
+static std::atomic<uint8_t> txFront(0);
+static std::atomic<uint32_t> txSequence(0);
+
+static const uint8_t busyFrame[I2C_FRAME_OVERHEAD] = {I2C_STATUS_BUSY, 0, I2C_STATUS_BUSY};
+static const uint8_t errorFrame[I2C_FRAME_OVERHEAD] = {I2C_STATUS_GENERAL_ERROR, 0, I2C_STATUS_GENERAL_ERROR};
+
+static HandlerEntry handlers[I2C_MAX_HANDLERS];
+static uint8_t handlerCount = 0;
+static I2cDispatcherStats stats;
+
+void i2cDispatcherBegin() {
+  rxHead.store(0);
+  rxTail.store(0);
+  rxSlotClaimed = false;
+  requestSequence.store(0);
+  rejectedSequence.store(0);
+  txFront.store(0);
+  txSequence.store(0);
+  txLengths[0] = 0;
+  txLengths[1] = 0;
+  handlerCount = 0;
+  memset(&stats, 0, sizeof(stats));
+}
+
+bool i2cDispatcherRegister(uint8_t command, I2cCommandHandler handler) {
+  for (uint8_t i = 0; i < handlerCount; i++) {
+    if (handlers[i].command == command) {
+      handlers[i].handler = handler;
+      return true;
+    }
+  }
+  if (handlerCount >= I2C_MAX_HANDLERS) {
+    return false;
+  }
+  handlers[handlerCount++] = HandlerEntry{command, handler};
+  return true;
+}
+
+static I2cCommandHandler findHandler(uint8_t command) {
+  for (uint8_t i = 0; i < handlerCount; i++) {
+    if (handlers[i].command == command) {
+      return handlers[i].handler;
+    }
+  }
+  return nullptr;
+}
+
+// ============================================================================
+// Wire callback side
+// ============================================================================
+
+uint8_t *i2cDispatcherRxBuffer() {
+  const uint32_t head = rxHead.load(std::memory_order_relaxed);
+  rxSlotClaimed = head - rxTail.load(std::memory_order_acquire) < I2C_RX_SLOTS;
+  return rxSlotClaimed ? rxSlots[head & (I2C_RX_SLOTS - 1)].data : nullptr;
+}
+
+void i2cDispatcherRxCommit(size_t length) {
+  const uint32_t sequence = requestSequence.load(std::memory_order_relaxed) + 1;
+  const uint32_t head = rxHead.load(std::memory_order_relaxed);
+  RxSlot &slot = rxSlots[head & (I2C_RX_SLOTS - 1)];
+
+  I2cFrameView frame;
+  if (!rxSlotClaimed) {
+    // Ring full: answer BUSY so the master retries
+    stats.overruns++;
+  } else if (i2cDecodeFrame(slot.data, length, frame) != I2C_FRAME_OK) {
+    stats.framesRejected++;
+    rejectedSequence.store(sequence, std::memory_order_relaxed);
+  } else {
+    slot.sequence = sequence;
+    slot.length = length;
+    stats.framesReceived++;
+    rxHead.store(head + 1, std::memory_order_release);
+  }
+  rxSlotClaimed = false;
+  requestSequence.store(sequence, std::memory_order_release);
+}
+
+size_t i2cDispatcherTxFrame(const uint8_t **frame) {
+  const uint32_t latest = requestSequence.load(std::memory_order_acquire);
+  if (rejectedSequence.load(std::memory_order_relaxed) == latest && latest != 0) {
+    *frame = errorFrame;
+    return sizeof(errorFrame);
+  }
+  if (txSequence.load(std::memory_order_acquire) != latest) {
+    *frame = busyFrame;
+    return sizeof(busyFrame);
+  }
+  const uint8_t front = txFront.load(std::memory_order_relaxed);
+  stats.responsesSent++;
+  *frame = txFrames[front];
+  return txLengths[front];
+}
+
+// ============================================================================
+// Main loop side
+// ============================================================================
+
+uint8_t i2cDispatcherPoll() {
+  uint8_t handled = 0;
+  uint32_t tail = rxTail.load(std::memory_order_relaxed);
+  while (tail != rxHead.load(std::memory_order_acquire)) {
+    const RxSlot &slot = rxSlots[tail & (I2C_RX_SLOTS - 1)];
+    I2cFrameView request;
+    i2cDecodeFrame(slot.data, slot.length, request);
+
+    const uint8_t back = txFront.load(std::memory_order_relaxed) ^ 1;
+    uint8_t *response = txFrames[back];
+    uint8_t responseLength = 0;
+    uint8_t status;
+
+    I2cCommandHandler handler = findHandler(request.code);
+    if (handler != nullptr) {
+      status = handler(request, response + 2, responseLength);
+      if (responseLength > I2C_FRAME_MAX_PAYLOAD) {
+        responseLength = 0;
+        status = I2C_STATUS_GENERAL_ERROR;
+      }
+    } else {
+      stats.unknownCommands++;
+      status = I2C_STATUS_UNKNOWN_COMMAND;
+    }
+
+    txLengths[back] = i2cSealFrame(response, status, responseLength);
+    txFront.store(back, std::memory_order_relaxed);
+    txSequence.store(slot.sequence, std::memory_order_release);
+
+    // Only release the slot once the handler is done reading from it
+    tail++;
+    rxTail.store(tail, std::memory_order_release);
+    stats.framesHandled++;
+    handled++;
+  }
+  return handled;
+}
+
+const I2cDispatcherStats &i2cDispatcherStats() {
+  return stats;
+}
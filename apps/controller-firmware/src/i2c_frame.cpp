@@ -0,0 +1,49 @@
+/**
+ * TerraHub Controller Firmware - I2C Frame Codec
+ */
+
+#include <string.h>
+#include "i2c_frame.h"
+
+uint8_t i2cChecksum(const uint8_t *data, size_t length) {
+  uint8_t sum = 0;
+  for (size_t i = 0; i < length; i++) {
+    sum ^= data[i];
+  }
+  return sum;
+}
+
+size_t i2cSealFrame(uint8_t *frame, uint8_t code, uint8_t length) {
+  frame[0] = code;
+  frame[1] = length;
+  frame[2 + length] = i2cChecksum(frame, 2 + length);
+  return length + I2C_FRAME_OVERHEAD;
+}
+
+size_t i2cEncodeFrame(uint8_t code, const uint8_t *payload, uint8_t length, uint8_t *out, size_t capacity) {
+  if (length > I2C_FRAME_MAX_PAYLOAD || capacity < static_cast<size_t>(length) + I2C_FRAME_OVERHEAD) {
+    return 0;
+  }
+  if (length > 0 && payload != out + 2) {
+    memmove(out + 2, payload, length);
+  }
+  return i2cSealFrame(out, code, length);
+}
+
+I2cFrameResult i2cDecodeFrame(const uint8_t *data, size_t length, I2cFrameView &frame) {
+  if (length < I2C_FRAME_OVERHEAD || length < static_cast<size_t>(data[1]) + I2C_FRAME_OVERHEAD) {
+    return I2C_FRAME_TRUNCATED;
+  }
+  const size_t frameLength = static_cast<size_t>(data[1]) + I2C_FRAME_OVERHEAD;
+  if (length > frameLength) {
+    return I2C_FRAME_TRAILING;
+  }
+  if (i2cChecksum(data, frameLength - 1) != data[frameLength - 1]) {
+    return I2C_FRAME_BAD_CHECKSUM;
+  }
+
+  frame.code = data[0];
+  frame.length = data[1];
+  frame.payload = data + 2;
+  return I2C_FRAME_OK;
+}
@@ -0,0 +1,79 @@
+/**
+ * TerraHub Controller Firmware - I2C Master Transactions
+ */
+
+#include "i2c_master.h"
+#include "timer_queue.h"
+
+enum TransactionPhase : uint8_t {
+  PHASE_SEND = 0,
+  PHASE_READ
+};
+
+void i2cTransactionStart(I2cTransaction &txn, uint8_t address, uint8_t command, const uint8_t *payload,
+                         uint8_t length, uint8_t maxResponseLength, uint32_t now) {
+  txn.address = address;
+  txn.attempts = 0;
+  txn.requestLength = i2cEncodeFrame(command, payload, length, txn.request, sizeof(txn.request));
+  txn.readLength = static_cast<uint16_t>(maxResponseLength) + I2C_FRAME_OVERHEAD;
+  txn.startedAt = now;
+  txn.nextActionAt = now;
+  txn.latencyMs = 0;
+  txn.phase = PHASE_SEND;
+  txn.state = txn.requestLength > 0 ? I2C_TXN_PENDING : I2C_TXN_FAILED;
+}
+
+static void finish(I2cTransaction &txn, I2cTransactionState state, uint32_t now) {
+  txn.state = state;
+  txn.latencyMs = now - txn.startedAt;
+}
+
+static void retry(I2cTransaction &txn, uint32_t now) {
+  if (txn.attempts > I2C_RETRY_COUNT) {
+    finish(txn, I2C_TXN_FAILED, now);
+    return;
+  }
+  txn.phase = PHASE_SEND;
+  txn.nextActionAt = now + I2C_RETRY_DELAY_MS;
+}
+
+I2cTransactionState i2cTransactionPoll(I2cTransaction &txn, const I2cBus &bus, uint32_t now) {
+  if (txn.state != I2C_TXN_PENDING || !deadlineReached(now, txn.nextActionAt)) {
+    return txn.state;
+  }
+
+  if (txn.phase == PHASE_SEND) {
+    txn.attempts++;
+    if (!bus.write(txn.address, txn.request, txn.requestLength)) {
+      retry(txn, now);
+      return txn.state;
+    }
+    txn.phase = PHASE_READ;
+    txn.attemptDeadline = now + I2C_COMMAND_TIMEOUT_MS;
+    txn.nextActionAt = now + I2C_RESPONSE_POLL_MS;
+    return txn.state;
+  }
+
+  const size_t received = bus.read(txn.address, txn.response, txn.readLength);
+  // Nodes pad short answers; the length byte says where the frame ends
+  const size_t frameLength = received >= 2 ? static_cast<size_t>(txn.response[1]) + I2C_FRAME_OVERHEAD : 0;
+  I2cFrameView frame;
+  if (received < 2 || frameLength > received ||
+      i2cDecodeFrame(txn.response, frameLength, frame) != I2C_FRAME_OK) {
+    retry(txn, now);
+    return txn.state;
+  }
+
+  if (frame.code == I2C_STATUS_BUSY) {
+    if (deadlineReached(now, txn.attemptDeadline)) {
+      retry(txn, now);
+    } else {
+      txn.nextActionAt = now + I2C_RESPONSE_POLL_MS;
+    }
+    return txn.state;
+  }
+
+  txn.reply = frame;
+  finish(txn, I2C_TXN_DONE, now);
+  return txn.state;
+}
@@ -0,0 +1,184 @@
+/**
+ * TerraHub Controller Firmware - Live Status Push
+ *
+ * Connects and disconnects arrive on the async TCP task, everything else
+ * runs on the control loop. The subscriber table is the only state the two
+ * share; it is copied out under the spinlock and the library calls are made
+ * outside it.
+ */
+
+#include <string.h>
+#include "live_push.h"
+
+struct Subscriber {
+  uint32_t clientId;      // 0 = free slot
+  bool inSync;            // got a snapshot and every message since
+  bool stalled;           // needs a snapshot but its queue is full
+  bool closing;
+  uint32_t stalledSince;
+};
+
+static AsyncWebSocket socket("/api/live");
+static portMUX_TYPE subscribersMux = portMUX_INITIALIZER_UNLOCKED;
+static Subscriber subscribers[LIVE_MAX_CLIENTS];
+static LivePushStats stats = {0, 0, 0, 0, 0};
+
+static void copySubscribers(Subscriber *view) {
+  portENTER_CRITICAL(&subscribersMux);
+  memcpy(view, subscribers, sizeof(subscribers));
+  portEXIT_CRITICAL(&subscribersMux);
+}
+
+// Write back a slot unless its client left in the meantime
+static void storeSubscriber(uint8_t slot, const Subscriber &sub) {
+  portENTER_CRITICAL(&subscribersMux);
+  if (subscribers[slot].clientId == sub.clientId) {
+    subscribers[slot] = sub;
+  }
+  portEXIT_CRITICAL(&subscribersMux);
+}
+
+static void onSocketEvent(AsyncWebSocket *, AsyncWebSocketClient *client, AwsEventType type, void *, uint8_t *,
+                          size_t) {
+  if (type == WS_EVT_CONNECT) {
+    bool added = false;
+    portENTER_CRITICAL(&subscribersMux);
+    for (uint8_t i = 0; i < LIVE_MAX_CLIENTS; i++) {
+      if (subscribers[i].clientId == 0) {
+        subscribers[i] = Subscriber{client->id(), false, false, false, 0};
+        stats.subscribers++;
+        added = true;
+        break;
+      }
+    }
+    if (!added) {
+      stats.disconnected++;
+    }
+    portEXIT_CRITICAL(&subscribersMux);
+    if (!added) {
+      client->close();
+    }
+  } else if (type == WS_EVT_DISCONNECT) {
+    portENTER_CRITICAL(&subscribersMux);
+    for (uint8_t i = 0; i < LIVE_MAX_CLIENTS; i++) {
+      if (subscribers[i].clientId == client->id()) {
+        subscribers[i] = Subscriber{0, false, false, false, 0};
+        stats.subscribers--;
+        break;
+      }
+    }
+    portEXIT_CRITICAL(&subscribersMux);
+  }
+  // Subscribers have nothing to say; incoming frames are ignored
+}
+
+void livePushBegin(AsyncWebServer &server) {
+  memset(subscribers, 0, sizeof(subscribers));
+  socket.onEvent(onSocketEvent);
+  server.addHandler(&socket);
+}
+
+bool livePushHasSubscribers() {
+  portENTER_CRITICAL(&subscribersMux);
+  const bool any = stats.subscribers > 0;
+  portEXIT_CRITICAL(&subscribersMux);
+  return any;
+}
+
+void livePushBroadcast(const char *message, size_t length) {
+  Subscriber view[LIVE_MAX_CLIENTS];
+  copySubscribers(view);
+
+  // textAll() queues to every connected client, so it is only safe while
+  // all of them are in sync and none has a full queue. A subscriber still
+  // waiting for its snapshot must not get a delta first.
+  bool allReady = true;
+  for (uint8_t i = 0; i < LIVE_MAX_CLIENTS; i++) {
+    if (view[i].clientId == 0) continue;
+    AsyncWebSocketClient *client = socket.client(view[i].clientId);
+    if (client != nullptr && (!view[i].inSync || !client->canSend())) {
+      allReady = false;
+    }
+  }
+
+  if (allReady) {
+    AsyncWebSocketMessageBuffer *buffer = socket.makeBuffer(length);
+    if (buffer == nullptr) {
+      return;
+    }
+    memcpy(buffer->get(), message, length);
+    socket.textAll(buffer);
+  } else {
+    for (uint8_t i = 0; i < LIVE_MAX_CLIENTS; i++) {
+      if (view[i].clientId == 0 || !view[i].inSync) continue;
+      AsyncWebSocketClient *client = socket.client(view[i].clientId);
+      if (client == nullptr) continue;
+      if (client->canSend()) {
+        client->text(message, length);
+      } else {
+        // Catches up from a snapshot instead of a backlog
+        view[i].inSync = false;
+        storeSubscriber(i, view[i]);
+        portENTER_CRITICAL(&subscribersMux);
+        stats.skipped++;
+        portEXIT_CRITICAL(&subscribersMux);
+      }
+    }
+  }
+
+  portENTER_CRITICAL(&subscribersMux);
+  stats.messages++;
+  portEXIT_CRITICAL(&subscribersMux);
+}
+
+void livePushResync() {
+  portENTER_CRITICAL(&subscribersMux);
+  for (uint8_t i = 0; i < LIVE_MAX_CLIENTS; i++) {
+    subscribers[i].inSync = false;
+  }
+  portEXIT_CRITICAL(&subscribersMux);
+}
+
+void livePushLoop(uint32_t now, LiveSnapshotWriter writeSnapshot) {
+  Subscriber view[LIVE_MAX_CLIENTS];
+  copySubscribers(view);
+
+  String snapshot;
+  bool written = false;
+  for (uint8_t i = 0; i < LIVE_MAX_CLIENTS; i++) {
+    Subscriber &sub = view[i];
+    if (sub.clientId == 0 || sub.inSync || sub.closing) continue;
+    AsyncWebSocketClient *client = socket.client(sub.clientId);
+    if (client == nullptr) continue;
+
+    if (client->canSend()) {
+      if (!written) {
+        writeSnapshot(snapshot);
+        written = true;
+      }
+      client->text(snapshot.c_str(), snapshot.length());
+      sub.inSync = true;
+      sub.stalled = false;
+      portENTER_CRITICAL(&subscribersMux);
+      stats.snapshots++;
+      portEXIT_CRITICAL(&subscribersMux);
+    } else if (!sub.stalled) {
+      sub.stalled = true;
+      sub.stalledSince = now;
+    } else if (now - sub.stalledSince >= LIVE_STALL_TIMEOUT_MS) {
+      sub.closing = true;
+      client->close();
+      portENTER_CRITICAL(&subscribersMux);
+      stats.disconnected++;
+      portEXIT_CRITICAL(&subscribersMux);
+    }
+    storeSubscriber(i, sub);
+  }
+}
+
+LivePushStats livePushStats() {
+  portENTER_CRITICAL(&subscribersMux);
+  const LivePushStats copy = stats;
+  portEXIT_CRITICAL(&subscribersMux);
+  return copy;
+}
@@ -7,101 +7,157 @@
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
-#include <Preferences.h>
 #include <Wire.h>
 #include <WiFi.h>
-#include <WebServer.h>
-#include <algorithm>
-#include <cmath>
+#include <ESPAsyncWebServer.h>
+#include <memory>
+#include <string>
+#include <sys/time.h>
+#include <time.h>
 #include <vector>
+#include "bus_scheduler.h"
 #include "config.h"
+#include "config_sync.h"
+#include "control_task.h"
+#include "current_monitor.h"
+#include "enumeration.h"
+#include "hal.h"
+#include "i2c_dispatcher.h"
+#include "i2c_master.h"
+#include "live_push.h"
+#include "metrics.h"
 #include "pinout.h"
+#include "power_manager.h"
+#include "relay_output.h"
+#include "rule_json.h"
+#include "rule_set.h"
+#include "rule_store.h"
+#include "rules.h"
+#include "schedule.h"
+#include "schedule_json.h"
+#include "sensor_history.h"
+#include "status_snapshot.h"
+#include "timer_queue.h"
+#include "wifi_manager.h"
 
 // Version info
 #ifndef TERRAHUB_VERSION
 #define TERRAHUB_VERSION "0.1.0"
 #endif
+#ifndef TERRAHUB_VERSION_MAJOR
+#define TERRAHUB_VERSION_MAJOR 0
+#define TERRAHUB_VERSION_MINOR 1
+#endif
 
 // Global state
 static uint8_t nodeId = 0;  // 0 = unassigned, 1 = controller, 2+ = slave
 static bool isController = false;
-static bool relayStates[NUM_RELAY_CHANNELS] = {false};
+static bool enumerating = false;
+static bool busPolling = false;   // a slave poll batch is in flight
+static bool configSyncing = false;  // a config transfer to a slave is in flight
+static uint8_t pendingSlaveAddress = 0;   // applied once the ASSIGN_ID reply was read
+static uint32_t assignReplySentMark = 0;
 static const char *provisioningApSsid = "TerraHub-Setup";
 static const char *provisioningApPassword = "terra-hub";
 
-struct WifiConfig {
-  String ssid;
-  String password;
-  String hostname;
-  bool configured;
-};
-
 static WifiConfig wifiConfig{.configured = false};
-static bool wifiConnected = false;
 
-// Sensor values that the ESP evaluates locally
-struct SensorValues {
-  float temperatureC;
-  float humidityPercent;
-  float lightLevelLux;
-};
-
-// Rule condition and actions
-struct RuleCondition {
-  String sensor;
-  String op;           // gt, lt, gte, lte, eq
-  float threshold;
-  float hysteresis;
-};
-
-struct RuleAction {
-  uint8_t relayIndex;
-  bool turnOn;
-  uint32_t minDurationMs;
+// Local time last handed to the control task: weekMs into the week at millis()
+static bool scheduleClockSent = false;
+static uint32_t scheduleClockAt = 0;
+static uint32_t scheduleClockWeekMs = 0;
+static RelayPolicy relayPolicies[NUM_RELAY_CHANNELS];  // as last requested, for persisting
+static uint32_t recordedSensorPolls = 0;  // control task polls already added to the history
+
+// Slave copy of the controller's configuration image (see config_sync.h)
+static std::vector<uint8_t> slaveConfigImage;
+static bool slaveConfigChanged = false;  // chunks written since the last check
+static uint16_t slaveConfigLength = 0;   // 0 while the image is incomplete
+static uint32_t slaveConfigHash = 0;
+static uint32_t slaveConfigSavedHash = 0;
+
+// State as last pushed to /api/live subscribers
+static bool livePushed = false;  // false while nobody listens
+static uint32_t liveSequence = 0;
+static uint32_t liveRelays = 0;
+static SensorValues liveSensors{{0.0f, 0.0f, 0.0f}};
+static CurrentFault liveFaults[NUM_CURRENT_SENSORS];
+static uint32_t liveRulesGeneration = 0;
+static std::vector<uint8_t> liveRuleActive;  // per program index
+
+static uint32_t reportedFaultEvents = 0;  // current monitor events already logged
+static uint32_t reportedFaultMask = 0;
+
+// Web server, serviced by the async TCP task
+AsyncWebServer server(WEB_SERVER_PORT);
+
+// Guards network-side state shared between the main loop and HTTP handlers.
+// The control task never takes it; see control_task.h. Releasing it from
+// another task wakes the main loop, which may have work from the change.
+static SemaphoreHandle_t controllerMutex = nullptr;
+
+class ControllerLock {
+ public:
+  ControllerLock() { xSemaphoreTakeRecursive(controllerMutex, portMAX_DELAY); }
+  ~ControllerLock() {
+    xSemaphoreGiveRecursive(controllerMutex);
+    powerWake(POWER_TASK_NETWORK);
+  }
+  ControllerLock(const ControllerLock &) = delete;
+  ControllerLock &operator=(const ControllerLock &) = delete;
 };
 
-struct RuleDefinition {
-  String id;
-  String name;
-  bool enabled;
-  RuleCondition condition;
-  RuleAction action;
-};
+#ifdef TERRAHUB_HEAP_TRACE
+// Count C++ allocations (new, STL containers) made by the control task.
+// Rule programs are built and freed on the network side, so this should
+// stay at zero even while rules are being edited.
+static TaskHandle_t controlLoopTask = nullptr;
+static volatile uint32_t controlLoopAllocations = 0;
 
-struct ActiveAction {
-  String ruleId;
-  uint32_t minEndTime;
-  RuleAction action;
-};
+void *operator new(size_t size) {
+  if (controlLoopTask != nullptr && xTaskGetCurrentTaskHandle() == controlLoopTask) {
+    controlLoopAllocations++;
+  }
+  void *ptr = malloc(size);
+  if (ptr == nullptr) {
+    abort();
+  }
+  return ptr;
+}
 
-static SensorValues sensorValues{0.0f, 0.0f, 0.0f};
-static unsigned long lastSensorPoll = 0;
-static Preferences preferences;
-static std::vector<RuleDefinition> rules;
-static std::vector<ActiveAction> activeActions;
+void operator delete(void *ptr) noexcept {
+  free(ptr);
+}
 
-// Web server
-WebServer server(WEB_SERVER_PORT);
+void operator delete(void *ptr, size_t) noexcept {
+  free(ptr);
+}
+#endif
 
 // Forward declarations
 void setupI2C();
+void beginI2cSlave(uint8_t address);
 void setupRelays();
 void setupSensors();
 void setupNetwork();
 void setupWebServer();
 void handleEnumeration();
+void startBusPolling();
 void handleI2CRequest();
-void loop_controller();
+uint32_t loop_controller();
 void loop_slave();
-void pollSensors();
-void evaluateRules();
-void loadRulesFromStorage();
-void saveRulesToStorage();
+uint32_t networkSleepMs(uint32_t now);
+void recordSensorPoll();
+void reportCurrentFaults();
+void pushLiveStatus();
+void syncScheduleClock(uint32_t now);
+void loadRelayPoliciesFromStorage();
+void saveRelayPoliciesToStorage();
+void publishConfigImage();
+void loadSlaveConfigFromStorage();
+void saveSlaveConfigToStorage();
 void loadWifiFromStorage();
 void saveWifiToStorage(const WifiConfig &config);
-bool connectToConfiguredWifi();
-float getSensorField(const String &key, const SensorValues &values);
-bool evaluateCondition(const RuleCondition &condition, const SensorValues &values);
 void setRelayState(uint8_t index, bool on);
 
 /**
@@ -120,10 +176,12 @@ void setup() {
   Serial.println("================================");
   Serial.println();
 
+  controllerMutex = xSemaphoreCreateRecursiveMutex();
+  controlBegin();
+
   // Initialize subsystems
   setupRelays();
   setupSensors();
-  setupI2C();
   
   // Determine if we are the controller
   // Controller has no upstream connection on SYNC_IN
@@ -141,19 +199,36 @@ void setup() {
     digitalWrite(SYNC_OUT_PIN, HIGH);
 
     // Start enumeration process
+    setupI2C();
     handleEnumeration();
 
     // Hydrate Wi-Fi configuration before bringing up the network interfaces
     loadWifiFromStorage();
     setupNetwork();
-    loadRulesFromStorage();
+    powerBegin();
+    powerRegister(POWER_TASK_NETWORK);
+    ruleSetLoad();
+    publishConfigImage();
     setupWebServer();
-    lastSensorPoll = millis();
+    historyBegin(millis());
+
+    // From here on sensors, rules and relays belong to the control task
+    if (!controlStart()) {
+      Serial.println("Failed to start control task");
+    }
+#ifdef TERRAHUB_HEAP_TRACE
+    controlLoopTask = controlTaskHandle();
+#endif
   } else {
     // Upstream connection detected - we are a slave
     isController = false;
     nodeId = 0;  // Will be assigned during enumeration
     Serial.println("Role: SLAVE (awaiting ID assignment)");
+
+    // Keep the next node powered down until the controller enables it
+    pinMode(SYNC_OUT_PIN, OUTPUT);
+    digitalWrite(SYNC_OUT_PIN, LOW);
+    setupI2C();
   }
   
   Serial.println("Setup complete!");
@@ -164,70 +239,320 @@ void setup() {
  */
 void loop() {
   if (isController) {
-    loop_controller();
+    // Sleep until the next network deadline, outside ControllerLock; HTTP
+    // handlers, Wi-Fi events, load faults and the control task wake the
+    // loop early
+    const uint32_t sleepMs = loop_controller();
+    powerWait(POWER_TASK_NETWORK, sleepMs);
   } else {
     loop_slave();
+    // Slave replies are waiting on the dispatcher
+    delay(1);
   }
-  
-  delay(10);  // Small delay to prevent watchdog issues
 }
 
 /**
- * Controller main loop
+ * Controller main loop. Returns how long it may sleep, worked out while it
+ * still holds ControllerLock since HTTP handlers move the same deadlines.
  */
-void loop_controller() {
-  // Handle web server requests
-  server.handleClient();
+uint32_t loop_controller() {
+  // HTTP requests are served concurrently by the async web server task and
+  // only synchronize with this loop through ControllerLock
+  ControllerLock lock;
+  MetricsTimer timer(METRIC_STAGE_NETWORK_LOOP);
+
+  // Advance the station connection without blocking the control loop
+  wifiManagerLoop(millis());
+
+  // Bring up the slave chain alongside the network, then keep polling it
+  if (enumerating) {
+    enumerating = enumerationLoop(millis());
+    if (!enumerating) {
+      startBusPolling();
+    }
+  } else if (!configSyncing && (busPolling || !configSyncPending(millis()))) {
+    busPolling = busSchedulerLoop(millis());
+  } else {
+    // Config transfers get the bus between poll batches; polling resumes
+    // once every node is in sync or has failed
+    configSyncing = configSyncLoop(millis());
+  }
+
+  // Faults are detected on the sampling task; only their reporting runs here
+  reportCurrentFaults();
+
+  // Persist rule edits once a burst of API changes has settled; slaves get
+  // them on the same debounce
+  if (ruleSetFlushSave(millis())) {
+    publishConfigImage();
+  }
+
+  // Sensors, rules, schedules and relays run on the control task; free the
+  // programs it switched away from, record its sensor polls and keep its
+  // clock in step with local time
+  ruleSetDrainRetired();
+  recordSensorPoll();
+  syncScheduleClock(millis());
+
+  // Whatever the control task changed since the last pass
+  pushLiveStatus();
+
+  return networkSleepMs(millis());
+}
 
-  // Poll sensors locally to keep the rules engine on the ESP
-  if (millis() - lastSensorPoll >= SENSOR_POLL_INTERVAL_MS) {
-    pollSensors();
-    evaluateRules();
-    lastSensorPoll = millis();
+static void keepEarlier(uint32_t &deadline, uint32_t candidate) {
+  if (static_cast<int32_t>(candidate - deadline) < 0) {
+    deadline = candidate;
   }
 }
 
+/**
+ * How long the controller loop may sleep: until the earliest deadline of
+ * the work it drives, but at most POWER_IDLE_MAX_MS so live push retries
+ * and stalled subscribers are still looked at. Call with ControllerLock held.
+ */
+uint32_t networkSleepMs(uint32_t now) {
+  // I2C round trips in flight are polled every tick
+  if (enumerating || busPolling || configSyncing || configSyncPending(now)) {
+    return 1;
+  }
+
+  uint32_t deadline = now + POWER_IDLE_MAX_MS;
+  uint32_t next;
+  if (busSchedulerNextDeadline(next)) keepEarlier(deadline, next);
+  if (configSyncNextDeadline(next)) keepEarlier(deadline, next);
+  if (wifiManagerNextDeadline(now, next)) keepEarlier(deadline, next);
+  if (ruleSetSaveDeadline(next)) keepEarlier(deadline, next);
+  return deadlineReached(now, deadline) ? 0 : deadline - now;
+}
+
 /**
  * Slave main loop
  */
 void loop_slave() {
-  // Handle I2C requests
-  // (handled by interrupt in Wire library)
-  
+  // Frames are queued by the Wire callbacks; run their handlers here
+  i2cDispatcherPoll();
+
+  // Move to the assigned address only after the controller read the reply
+  if (pendingSlaveAddress != 0 && i2cDispatcherStats().responsesSent != assignReplySentMark) {
+    beginI2cSlave(pendingSlaveAddress);
+    pendingSlaveAddress = 0;
+  }
+
+  // Persist the configuration image once a push has completed it
+  saveSlaveConfigToStorage();
+
+  reportCurrentFaults();
+
   // Local sensor polling
   // TODO: Implement sensor polling
 }
 
+// ============================================================================
+// I2C Slave Command Handlers
+// ============================================================================
+
+static uint8_t handleHello(const I2cFrameView &request, uint8_t *response, uint8_t &responseLength) {
+  response[0] = TERRAHUB_VERSION_MAJOR;
+  response[1] = TERRAHUB_VERSION_MINOR;
+  responseLength = 2;
+  return I2C_STATUS_OK;
+}
+
+static uint8_t handleAssignId(const I2cFrameView &request, uint8_t *response, uint8_t &responseLength) {
+  if (request.length != 1 || request.payload[0] < 2 || request.payload[0] > MAX_NODES) {
+    return I2C_STATUS_INVALID_PARAMS;
+  }
+  nodeId = request.payload[0];
+  pendingSlaveAddress = I2C_ADDRESS_BASE + nodeId;
+  assignReplySentMark = i2cDispatcherStats().responsesSent;
+  Serial.printf("Assigned node id %u\n", nodeId);
+
+  response[0] = nodeId;
+  responseLength = 1;
+  return I2C_STATUS_OK;
+}
+
+static uint8_t handleEnableDownstream(const I2cFrameView &request, uint8_t *response, uint8_t &responseLength) {
+  digitalWrite(SYNC_OUT_PIN, HIGH);
+  responseLength = 0;
+  return I2C_STATUS_OK;
+}
+
+static void putSensorValue(uint8_t *entry, uint8_t type, int16_t value, uint8_t decimals) {
+  entry[0] = type;
+  entry[1] = value & 0xFF;
+  entry[2] = (value >> 8) & 0xFF;
+  entry[3] = decimals;
+}
+
+static uint8_t handleGetSensorValues(const I2cFrameView &request, uint8_t *response, uint8_t &responseLength) {
+  const SensorValues sensorValues = controlSnapshot().sensors;
+  response[0] = 3;
+  putSensorValue(response + 1, 0x01, lroundf(sensorValues.slots[SENSOR_TEMPERATURE] * 10), 1);
+  putSensorValue(response + 5, 0x02, lroundf(sensorValues.slots[SENSOR_HUMIDITY] * 10), 1);
+  putSensorValue(response + 9, 0x03, static_cast<int16_t>(static_cast<uint16_t>(sensorValues.slots[SENSOR_LIGHT_LEVEL])), 0);
+  responseLength = 13;
+  return I2C_STATUS_OK;
+}
+
+/**
+ * Re-check the configuration image after chunks were written. It is valid
+ * once its header and payload CRC agree, i.e. after the controller wrote
+ * the header chunk last.
+ */
+static void refreshSlaveConfig() {
+  if (!slaveConfigChanged) {
+    return;
+  }
+  slaveConfigChanged = false;
+  slaveConfigLength = configImageLength(slaveConfigImage.data(), slaveConfigImage.size());
+  slaveConfigHash = slaveConfigLength ? ruleStoreCrc32(slaveConfigImage.data(), slaveConfigLength) : 0;
+}
+
+static uint8_t handleSetConfigChunk(const I2cFrameView &request, uint8_t *response, uint8_t &responseLength) {
+  if (request.length < 2) {
+    return I2C_STATUS_INVALID_PARAMS;
+  }
+  const uint16_t offset = request.payload[0] | (request.payload[1] << 8);
+  const uint16_t count = request.length - 2;
+  if (static_cast<size_t>(offset) + count > slaveConfigImage.size()) {
+    return I2C_STATUS_INVALID_PARAMS;
+  }
+  memcpy(slaveConfigImage.data() + offset, request.payload + 2, count);
+  slaveConfigChanged = true;
+
+  response[0] = count & 0xFF;
+  response[1] = count >> 8;
+  responseLength = 2;
+  return I2C_STATUS_OK;
+}
+
+static void putU32(uint8_t *data, uint32_t value) {
+  data[0] = value & 0xFF;
+  data[1] = (value >> 8) & 0xFF;
+  data[2] = (value >> 16) & 0xFF;
+  data[3] = value >> 24;
+}
+
+static uint8_t handleGetConfigHash(const I2cFrameView &request, uint8_t *response, uint8_t &responseLength) {
+  if (request.length == 0) {
+    refreshSlaveConfig();
+    putU32(response, slaveConfigHash);
+    response[4] = slaveConfigLength & 0xFF;
+    response[5] = slaveConfigLength >> 8;
+    responseLength = 6;
+    return I2C_STATUS_OK;
+  }
+
+  // Ranged form: hashes of `count` chunks starting at `first`
+  if (request.length != 3) {
+    return I2C_STATUS_INVALID_PARAMS;
+  }
+  const uint16_t first = request.payload[0] | (request.payload[1] << 8);
+  const uint8_t count = request.payload[2];
+  if (count > I2C_FRAME_MAX_PAYLOAD / 4 || first + count > CONFIG_MAX_CHUNKS) {
+    return I2C_STATUS_INVALID_PARAMS;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    putU32(response + 4 * i, configChunkHash(slaveConfigImage.data(), first + i));
+  }
+  responseLength = 4 * count;
+  return I2C_STATUS_OK;
+}
+
+static uint8_t handlePing(const I2cFrameView &request, uint8_t *response, uint8_t &responseLength) {
+  response[0] = nodeId;
+  responseLength = 1;
+  return I2C_STATUS_OK;
+}
+
+static uint8_t handleGetPortState(const I2cFrameView &request, uint8_t *response, uint8_t &responseLength) {
+  if (request.length != 1 || request.payload[0] >= NUM_RELAY_CHANNELS) {
+    return I2C_STATUS_INVALID_PARAMS;
+  }
+  const uint8_t port = request.payload[0];
+  response[0] = port;
+  const uint16_t currentMa = currentMonitorChannel(port).rmsMa;
+  response[1] = relayOutputState(port) ? 1 : 0;
+  response[2] = currentMa & 0xFF;
+  response[3] = currentMa >> 8;
+  responseLength = 4;
+  return I2C_STATUS_OK;
+}
+
+static uint8_t handleSetPortState(const I2cFrameView &request, uint8_t *response, uint8_t &responseLength) {
+  if (request.length != 2 || request.payload[0] >= NUM_RELAY_CHANNELS || request.payload[1] > 1) {
+    return I2C_STATUS_INVALID_PARAMS;
+  }
+  const uint8_t port = request.payload[0];
+  setRelayState(port, request.payload[1] == 1);
+  response[0] = port;
+  response[1] = relayOutputState(port) ? 1 : 0;
+  responseLength = 2;
+  return I2C_STATUS_OK;
+}
+
 /**
- * Initialize I2C bus
+ * Initialize I2C bus. The controller is bus master; slaves listen on the
+ * default address and answer through the frame dispatcher.
  */
 void setupI2C() {
-  Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
-  
-  if (!isController) {
-    // Slave mode - listen on default address
-    Wire.onReceive([](int numBytes) {
-      // Handle received command
-      // TODO: Implement command handling
-    });
-    Wire.onRequest([]() {
-      // Handle request for data
-      // TODO: Implement request handling
-    });
+  if (isController) {
+    // Transactions go through halI2cBus()
+    Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
+    Serial.println("I2C initialized (master)");
+    return;
   }
-  
-  Serial.println("I2C initialized");
+
+  i2cDispatcherBegin();
+  i2cDispatcherRegister(I2C_CMD_HELLO_UNASSIGNED, handleHello);
+  i2cDispatcherRegister(I2C_CMD_ASSIGN_ID, handleAssignId);
+  i2cDispatcherRegister(I2C_CMD_ENABLE_DOWNSTREAM, handleEnableDownstream);
+  i2cDispatcherRegister(I2C_CMD_PING, handlePing);
+  i2cDispatcherRegister(I2C_CMD_GET_PORT_STATE, handleGetPortState);
+  i2cDispatcherRegister(I2C_CMD_SET_PORT_STATE, handleSetPortState);
+  i2cDispatcherRegister(I2C_CMD_GET_SENSOR_VALUES, handleGetSensorValues);
+  i2cDispatcherRegister(I2C_CMD_SET_CONFIG_CHUNK, handleSetConfigChunk);
+  i2cDispatcherRegister(I2C_CMD_GET_CONFIG_HASH, handleGetConfigHash);
+  loadSlaveConfigFromStorage();
+
+  beginI2cSlave(I2C_DEFAULT_ADDRESS);
+  Serial.println("I2C initialized (slave)");
+}
+
+/**
+ * (Re)start the Wire slave on `address` with the dispatcher callbacks
+ */
+void beginI2cSlave(uint8_t address) {
+  Wire.end();
+  Wire.onReceive([](int numBytes) {
+    // Read straight into the dispatcher's ring slot
+    uint8_t *frame = i2cDispatcherRxBuffer();
+    size_t length = 0;
+    while (Wire.available()) {
+      const int value = Wire.read();
+      if (frame != nullptr && length < I2C_FRAME_MAX_BYTES) {
+        frame[length] = static_cast<uint8_t>(value);
+      }
+      length++;
+    }
+    i2cDispatcherRxCommit(length);
+  });
+  Wire.onRequest([]() {
+    const uint8_t *frame;
+    const size_t length = i2cDispatcherTxFrame(&frame);
+    Wire.write(frame, length);
+  });
+  Wire.begin(address, I2C_SDA_PIN, I2C_SCL_PIN, 0);
 }
 
 /**
  * Initialize relay outputs
  */
 void setupRelays() {
-  for (int i = 0; i < NUM_RELAY_CHANNELS; i++) {
-    pinMode(relayPins[i], OUTPUT);
-    digitalWrite(relayPins[i], RELAY_OFF_STATE);
-    relayStates[i] = false;
-  }
+  relayOutputBegin();
+  loadRelayPoliciesFromStorage();
   Serial.println("Relays initialized");
 }
 
@@ -236,440 +561,1108 @@ void setupRelays() {
  */
 void setupSensors() {
   // TODO: Initialize temperature/humidity sensors
-  // TODO: Initialize current sensors
+  if (currentMonitorBegin()) {
+    Serial.print("Current sensing on channels:");
+    for (uint8_t i = 0; i < NUM_CURRENT_SENSORS; i++) {
+      if (currentMonitorChannel(i).available) Serial.printf(" %u", i + 1);
+    }
+    Serial.println();
+  } else {
+    Serial.println("Current sensing unavailable");
+  }
   Serial.println("Sensors initialized");
 }
 
 /**
- * Setup web server routes
+ * Accumulate a request body into a buffer owned by the request. The server
+ * frees _tempObject together with the request. Oversized bodies are not
+ * collected; their handlers answer 413 through rejectOversizedBody().
+ */
+static void collectBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+  if (total > MAX_REQUEST_BODY_BYTES) {
+    return;
+  }
+  if (index == 0) {
+    request->_tempObject = malloc(total + 1);
+  }
+
+  char *body = static_cast<char *>(request->_tempObject);
+  if (body == nullptr) {
+    return;
+  }
+  memcpy(body + index, data, len);
+  if (index + len == total) {
+    body[total] = '\0';
+  }
+}
+
+/**
+ * Bodies over MAX_REQUEST_BODY_BYTES are never collected. Answers 413 and
+ * returns true for one, so it is not reported as missing.
+ */
+static bool rejectOversizedBody(AsyncWebServerRequest *request) {
+  if (request->contentLength() <= MAX_REQUEST_BODY_BYTES) {
+    return false;
+  }
+  request->send(413, "application/json", "{\"error\":\"Body too large\"}");
+  return true;
+}
+
+static bool parseJsonBody(AsyncWebServerRequest *request, JsonDocument &doc) {
+  if (rejectOversizedBody(request)) {
+    return false;
+  }
+  const char *body = static_cast<const char *>(request->_tempObject);
+  if (body == nullptr) {
+    request->send(400, "application/json", "{\"error\":\"Missing body\"}");
+    return false;
+  }
+  if (deserializeJson(doc, body)) {
+    request->send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+    return false;
+  }
+  return true;
+}
+
+/**
+ * server.on() with the request handler timed into the HTTP stage. Request
+ * bodies arrive in pieces before it runs and are not counted.
+ */
+static void onTimed(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                    ArUploadHandlerFunction onUpload = nullptr, ArBodyHandlerFunction onBody = nullptr) {
+#if TERRAHUB_METRICS
+  server.on(uri, method, [onRequest](AsyncWebServerRequest *request) {
+    MetricsTimer timer(METRIC_STAGE_HTTP);
+    onRequest(request);
+  }, onUpload, onBody);
+#else
+  server.on(uri, method, onRequest, onUpload, onBody);
+#endif
+}
+
+static void sendRuleSetResponse(AsyncWebServerRequest *request, const RuleSetResponse &response) {
+  if (response.body != nullptr) {
+    request->send(response.status, "application/json", response.body);
+  } else {
+    request->send(response.status);
+  }
+}
+
+/**
+ * Extract {id} from /api/rules/{id}. Sends 400 and returns false when the
+ * path has no id or the id is longer than MAX_RULE_ID_LENGTH.
+ */
+static bool ruleIdFromPath(AsyncWebServerRequest *request, RuleId &id) {
+  static const size_t prefixLength = sizeof("/api/rules/") - 1;
+  const String &url = request->url();
+  if (url.length() <= prefixLength || !id.assign(url.c_str() + prefixLength, url.length() - prefixLength)) {
+    request->send(400, "application/json", "{\"error\":\"Rule id required in path\"}");
+    return false;
+  }
+  return true;
+}
+
+// Worst-case /api/nodes document with a full chain
+#define NODES_JSON_CAPACITY \
+  (JSON_OBJECT_SIZE(5) + JSON_OBJECT_SIZE(3) + JSON_OBJECT_SIZE(8) + JSON_ARRAY_SIZE(BUS_MAX_SLAVES) + \
+   BUS_MAX_SLAVES * (JSON_OBJECT_SIZE(16) + JSON_OBJECT_SIZE(4) + JSON_ARRAY_SIZE(BUS_MAX_SENSORS_PER_NODE) + \
+                     BUS_MAX_SENSORS_PER_NODE * JSON_OBJECT_SIZE(3) + 2 * JSON_ARRAY_SIZE(NUM_RELAY_CHANNELS)))
+
+// Build with -DTERRAHUB_HEAP_TRACE to log the heap used by each JSON endpoint
+#ifdef TERRAHUB_HEAP_TRACE
+#define HEAP_TRACE_BEGIN() const uint32_t heapBefore = ESP.getFreeHeap()
+#define HEAP_TRACE_END(label) \
+  Serial.printf("[heap] %s: %ld bytes\n", label, static_cast<long>(heapBefore) - static_cast<long>(ESP.getFreeHeap()))
+#else
+#define HEAP_TRACE_BEGIN()
+#define HEAP_TRACE_END(label)
+#endif
+
+/**
+ * Cursor of a chunked GET /api/rules response. Rules are serialized one at a
+ * time into `pending` and copied out as the TCP stack asks for more, so the
+ * response costs the same memory for 1 or 1000 rules.
+ */
+struct RuleStream {
+  uint32_t generation;
+  size_t nextRule = 0;
+  bool opened = false;
+  bool closed = false;
+  size_t pendingLength = 0;
+  size_t pendingOffset = 0;
+  char pending[RULE_JSON_MAX_BYTES + 2];  // leading comma and NUL
+#ifdef TERRAHUB_HEAP_TRACE
+  uint32_t heapBefore;
+  uint32_t heapLowest = UINT32_MAX;
+#endif
+};
+
+/**
+ * Chunked-response filler. If the rule set is replaced mid-stream the array
+ * is closed early rather than mixing two rule sets.
+ */
+static size_t fillRuleStream(RuleStream &stream, uint8_t *buffer, size_t maxLen) {
+  size_t written = 0;
+  while (written < maxLen) {
+    if (stream.pendingOffset < stream.pendingLength) {
+      size_t count = stream.pendingLength - stream.pendingOffset;
+      if (count > maxLen - written) count = maxLen - written;
+      memcpy(buffer + written, stream.pending + stream.pendingOffset, count);
+      stream.pendingOffset += count;
+      written += count;
+      continue;
+    }
+    if (stream.closed) break;
+
+    stream.pendingOffset = 0;
+    if (!stream.opened) {
+      stream.pending[0] = '[';
+      stream.pendingLength = 1;
+      stream.opened = true;
+      continue;
+    }
+
+    ControllerLock lock;
+    const std::vector<RuleDefinition> &rules = ruleSetRules();
+    if (stream.generation != ruleSetGeneration() || stream.nextRule >= rules.size()) {
+      stream.pending[0] = ']';
+      stream.pendingLength = 1;
+      stream.closed = true;
+      continue;
+    }
+
+    StaticJsonDocument<RULE_JSON_CAPACITY> doc;
+    writeRuleJson(rules[stream.nextRule], doc.to<JsonObject>());
+    size_t offset = 0;
+    if (stream.nextRule > 0) {
+      stream.pending[offset++] = ',';
+    }
+    stream.pendingLength = offset + serializeJson(doc, stream.pending + offset, sizeof(stream.pending) - offset);
+    stream.nextRule++;
+  }
+
+#ifdef TERRAHUB_HEAP_TRACE
+  const uint32_t heapNow = ESP.getFreeHeap();
+  if (heapNow < stream.heapLowest) stream.heapLowest = heapNow;
+  if (written == 0) {
+    Serial.printf("[heap] /api/rules: %ld bytes peak\n",
+                  static_cast<long>(stream.heapBefore) - static_cast<long>(stream.heapLowest));
+  }
+#endif
+  return written;
+}
+
+// Cached GET /api/status and /api/config bodies, touched under ControllerLock
+static StatusCache statusCache;
+static StatusCache configCache;
+
+// What /api/config shows, less the retry countdown, which moves by age only
+struct ConfigState {
+  uint32_t apIp;
+  uint32_t stationIp;
+  bool stationConnected;
+  bool retrying;
+  bool wifiConfigured;
+  WifiState stationState;
+  uint16_t stationFailedAttempts;
+  char stationSsid[WIFI_SSID_MAX_LENGTH + 1];
+  char hostname[WIFI_HOSTNAME_MAX_LENGTH + 1];
+};
+
+static void refreshConfigCache(uint32_t now) {
+  ConfigState state;
+  memset(&state, 0, sizeof(state));
+  state.apIp = WiFi.softAPIP();
+  state.stationIp = WiFi.localIP();
+  state.stationConnected = wifiManagerConnected();
+  const uint32_t retryInMs = wifiManagerRetryInMs(now);
+  state.retrying = retryInMs > 0;
+  state.wifiConfigured = wifiConfig.configured;
+  state.stationState = wifiManagerState();
+  state.stationFailedAttempts = wifiManagerFailedAttempts();
+  strncpy(state.stationSsid, wifiConfig.ssid.c_str(), sizeof(state.stationSsid) - 1);
+  strncpy(state.hostname, wifiConfig.hostname.c_str(), sizeof(state.hostname) - 1);
+  if (!statusCacheStale(configCache, &state, sizeof(state), now, state.retrying ? STATUS_REFRESH_MS : UINT32_MAX)) {
+    return;
+  }
+
+  StaticJsonDocument<512> doc;
+  JsonObject root = doc.to<JsonObject>();
+  root["apSsid"] = provisioningApSsid;
+  root["apPassword"] = provisioningApPassword;
+  root["apIp"] = IPAddress(state.apIp).toString();
+  root["stationIp"] = IPAddress(state.stationIp).toString();
+  root["stationConnected"] = state.stationConnected;
+  root["stationState"] = wifiStateName(state.stationState);
+  root["stationFailedAttempts"] = state.stationFailedAttempts;
+  root["stationRetryInMs"] = retryInMs;
+  root["wifiConfigured"] = state.wifiConfigured;
+  root["stationSsid"] = static_cast<const char *>(state.stationSsid);
+  root["hostname"] = static_cast<const char *>(state.hostname);
+
+  std::string body;
+  body.resize(measureJson(doc) + 1);
+  body.resize(serializeJson(doc, &body[0], body.size()));
+  statusCacheStore(configCache, &state, sizeof(state), now, std::move(body));
+}
+
+static void refreshStatusCache(uint32_t now) {
+  const ControlSnapshot control = controlSnapshot();
+  StatusState state;
+  statusStateFromControl(control, state);
+  state.nodeId = nodeId;
+  state.isController = isController;
+  state.online = WiFi.isConnected();
+  state.ip = WiFi.localIP();
+  for (uint8_t i = 0; i < NUM_CURRENT_SENSORS; i++) {
+    const CurrentChannelStatus channel = currentMonitorChannel(i);
+    if (channel.available) {
+      state.currentAvailable |= 1u << i;
+      state.currentFaults[i] = channel.fault;
+    }
+  }
+  state.ruleCount = ruleSetRules().size();
+  state.scheduleCount = ruleSetSchedules().size();
+  if (!statusCacheStale(statusCache, &state, sizeof(state), now, STATUS_REFRESH_MS)) {
+    return;
+  }
+
+  HEAP_TRACE_BEGIN();
+  StatusCounters counters;
+  memset(&counters, 0, sizeof(counters));
+  for (uint8_t i = 0; i < NUM_CURRENT_SENSORS; i++) {
+    counters.currentMa[i] = currentMonitorChannel(i).rmsMa;
+  }
+  counters.passes = control.passes;
+  counters.timing = control.timing;
+  const LivePushStats liveStats = livePushStats();
+  counters.liveSubscribers = liveStats.subscribers;
+  counters.liveMessages = liveStats.messages;
+  counters.liveSnapshots = liveStats.snapshots;
+  counters.liveSkipped = liveStats.skipped;
+  counters.liveDisconnected = liveStats.disconnected;
+  counters.power = powerStats();
+
+  std::string body;
+  statusWriteJson(TERRAHUB_VERSION, state, counters, body);
+  statusCacheStore(statusCache, &state, sizeof(state), now, std::move(body));
+  HEAP_TRACE_END("/api/status rebuild");
+}
+
+/**
+ * Answer from a cache: 304 when the client already has the body, otherwise
+ * the body, copied out of the shared buffer as the TCP stack asks for it.
+ */
+static void sendCached(AsyncWebServerRequest *request, const StatusCache &cache) {
+  AsyncWebServerResponse *response;
+  const AsyncWebHeader *ifNoneMatch = request->getHeader("If-None-Match");
+  if (ifNoneMatch != nullptr && statusCacheMatches(cache, ifNoneMatch->value().c_str())) {
+    response = request->beginResponse(304);
+  } else {
+    std::shared_ptr<const std::string> body = cache.body;
+    response = request->beginResponse("application/json", body->size(),
+                                      [body](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      size_t count = body->size() - index;
+      if (count > maxLen) count = maxLen;
+      memcpy(buffer, body->data() + index, count);
+      return count;
+    });
+  }
+  response->addHeader("ETag", cache.etag);
+  // Counters change by the second: always revalidate, never reuse unasked
+  response->addHeader("Cache-Control", "no-cache");
+  request->send(response);
+}
+
+// Tasks whose stack headroom /api/metrics reports, by FreeRTOS task name
+static const char *const METRICS_TASKS[] = {"loopTask", "control", "current", "async_tcp"};
+
+static void writeToStream(const char *text, size_t length, void *context) {
+  static_cast<AsyncResponseStream *>(context)->write(reinterpret_cast<const uint8_t *>(text), length);
+}
+
+static void writeMetric(const MetricsWriter &writer, const char *name, const char *type, const char *help,
+                        uint64_t value) {
+  metricsWriteFamily(writer, name, type, help);
+  metricsWriteSample(writer, name, nullptr, value);
+}
+
+// Heap, task stacks and control task counters, after the stage histograms
+static void writeSystemMetrics(const MetricsWriter &writer) {
+  const uint32_t heapSize = ESP.getHeapSize();
+  const uint32_t heapMinFree = ESP.getMinFreeHeap();
+  writeMetric(writer, "terrahub_heap_size_bytes", "gauge", "Heap size.", heapSize);
+  writeMetric(writer, "terrahub_heap_free_bytes", "gauge", "Free heap.", ESP.getFreeHeap());
+  writeMetric(writer, "terrahub_heap_largest_free_block_bytes", "gauge", "Largest allocatable heap block.",
+              ESP.getMaxAllocHeap());
+  writeMetric(writer, "terrahub_heap_used_high_water_bytes", "gauge", "Most heap in use at once since boot.",
+              heapSize - heapMinFree);
+
+  metricsWriteFamily(writer, "terrahub_task_stack_free_min_bytes", "gauge",
+                     "Least free stack each task has had since it started.");
+  for (const char *name : METRICS_TASKS) {
+    const TaskHandle_t handle = xTaskGetHandle(name);
+    if (handle == nullptr) continue;
+    char labels[32];
+    snprintf(labels, sizeof(labels), "task=\"%s\"", name);
+    metricsWriteSample(writer, "terrahub_task_stack_free_min_bytes", labels, uxTaskGetStackHighWaterMark(handle));
+  }
+
+  const ControlSnapshot control = controlSnapshot();
+  writeMetric(writer, "terrahub_control_passes_total", "counter", "Control task passes.", control.passes);
+  writeMetric(writer, "terrahub_control_overruns_total", "counter", "Control passes over their time budget.",
+              control.timing.overruns);
+  writeMetric(writer, "terrahub_rule_evaluations_total", "counter", "Rules evaluated by the control task.",
+              control.ruleEvaluations);
+  metricsWriteFamily(writer, "terrahub_relay_toggles_total", "counter", "Relay switch operations.");
+  for (uint8_t i = 0; i < NUM_RELAY_CHANNELS; i++) {
+    char labels[16];
+    snprintf(labels, sizeof(labels), "relay=\"%u\"", i);
+    metricsWriteSample(writer, "terrahub_relay_toggles_total", labels, control.toggleCounts[i]);
+  }
+}
+
+/**
+ * Setup web server routes. Handlers run on the async TCP task, so every
+ * handler that touches controller state holds ControllerLock.
  */
 void setupWebServer() {
-  server.on("/", HTTP_GET, []() {
-    server.send(200, "text/html",
+  onTimed("/", HTTP_GET, [](AsyncWebServerRequest *request) {
+    request->send(200, "text/html",
       "<html><head><title>TerraHub</title></head>"
       "<body><h1>TerraHub Controller</h1>"
       "<p>Version: " TERRAHUB_VERSION "</p>"
       "</body></html>");
   });
 
-  server.on("/api/config", HTTP_GET, []() {
-    DynamicJsonDocument doc(1024);
-    JsonObject root = doc.to<JsonObject>();
-    root["apSsid"] = provisioningApSsid;
-    root["apPassword"] = provisioningApPassword;
-    root["apIp"] = WiFi.softAPIP().toString();
-    root["stationIp"] = WiFi.localIP().toString();
-    root["stationConnected"] = WiFi.status() == WL_CONNECTED;
-    root["wifiConfigured"] = wifiConfig.configured;
-    root["stationSsid"] = wifiConfig.ssid;
-    root["hostname"] = wifiConfig.hostname;
-
-    String output;
-    serializeJson(root, output);
-    server.send(200, "application/json", output);
+  onTimed("/api/config", HTTP_GET, [](AsyncWebServerRequest *request) {
+    ControllerLock lock;
+    refreshConfigCache(millis());
+    sendCached(request, configCache);
   });
 
-  server.on("/api/config/wifi", HTTP_POST, []() {
-    if (!server.hasArg("plain")) {
-      server.send(400, "application/json", "{\"error\":\"Missing body\"}");
-      return;
-    }
-
+  onTimed("/api/config/wifi", HTTP_POST, [](AsyncWebServerRequest *request) {
     DynamicJsonDocument doc(512);
-    auto error = deserializeJson(doc, server.arg("plain"));
-    if (error) {
-      server.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+    if (!parseJsonBody(request, doc)) {
       return;
     }
 
-    String ssid = doc["ssid"].as<String>();
-    String password = doc["password"].as<String>();
-    String hostname = doc["hostname"].as<String>();
+    ControllerLock lock;
 
-    if (ssid.isEmpty() || password.isEmpty()) {
-      server.send(400, "application/json", "{\"error\":\"ssid and password required\"}");
+    WifiConfig next = wifiConfig;
+    const char *hostname = doc["hostname"] | "";
+    if (!next.ssid.assign(doc["ssid"] | "") || !next.password.assign(doc["password"] | "") ||
+        (hostname[0] && !next.hostname.assign(hostname))) {
+      request->send(400, "application/json", "{\"error\":\"ssid, password or hostname too long\"}");
+      return;
+    }
+    if (next.ssid.isEmpty() || next.password.isEmpty()) {
+      request->send(400, "application/json", "{\"error\":\"ssid and password required\"}");
       return;
     }
 
-    wifiConfig.ssid = ssid;
-    wifiConfig.password = password;
-    wifiConfig.hostname = hostname.length() ? hostname : wifiConfig.hostname;
+    wifiConfig = next;
     wifiConfig.configured = true;
 
     saveWifiToStorage(wifiConfig);
-    bool connected = connectToConfiguredWifi();
+    wifiManagerConnect(wifiConfig);
 
+    // The connection proceeds in the background; progress is reported by /api/config
     DynamicJsonDocument resp(256);
-    resp["connected"] = connected;
-    resp["ip"] = WiFi.localIP().toString();
-    resp["ssid"] = wifiConfig.ssid;
-    resp["hostname"] = wifiConfig.hostname;
+    resp["connected"] = false;
+    resp["state"] = wifiStateName(WIFI_STATE_CONNECTING);
+    resp["ssid"] = wifiConfig.ssid.c_str();
+    resp["hostname"] = wifiConfig.hostname.c_str();
 
     String output;
     serializeJson(resp, output);
-    server.send(200, "application/json", output);
+    request->send(202, "application/json", output);
+  }, nullptr, collectBody);
+
+  // Rebuilt only when the state changed or the counters are a second old
+  onTimed("/api/status", HTTP_GET, [](AsyncWebServerRequest *request) {
+    ControllerLock lock;
+    refreshStatusCache(millis());
+    sendCached(request, statusCache);
   });
 
-  server.on("/api/status", HTTP_GET, []() {
-    DynamicJsonDocument doc(1024);
+  onTimed("/api/nodes", HTTP_GET, [](AsyncWebServerRequest *request) {
+    // Too large for the async task's stack with a full chain
+    DynamicJsonDocument doc(NODES_JSON_CAPACITY);
     JsonObject root = doc.to<JsonObject>();
-    root["version"] = TERRAHUB_VERSION;
-    root["role"] = isController ? "controller" : "slave";
-    root["nodeId"] = nodeId;
-    root["online"] = WiFi.isConnected();
-    root["ip"] = WiFi.localIP().toString();
-
-    JsonArray relays = root.createNestedArray("relays");
-    for (int i = 0; i < NUM_RELAY_CHANNELS; i++) {
-      relays.add(relayStates[i]);
+    {
+      ControllerLock lock;
+      const uint32_t now = millis();
+      root["enumeration"] = enumerationStateName(enumerationState());
+      root["enumerationMs"] = enumerationElapsedMs(now);
+
+      const BusSchedulerStats &busStats = busSchedulerStats();
+      const ClusterSnapshot &snapshot = busSchedulerSnapshot();
+      JsonObject busInfo = root.createNestedObject("bus");
+      busInfo["cycle"] = snapshot.cycle;
+      busInfo["cycleMs"] = busStats.lastCycleMs;
+      busInfo["utilizationPct"] = busStats.utilizationPct;
+
+      const ConfigSyncStats &syncStats = configSyncStats();
+      JsonObject sync = root.createNestedObject("configSync");
+      sync["hash"] = syncStats.imageHash;
+      sync["imageBytes"] = syncStats.imageBytes;
+      sync["chunks"] = syncStats.chunkCount;
+      sync["inSync"] = syncStats.nodesInSync;
+      sync["pending"] = syncStats.nodesPending;
+      sync["failed"] = syncStats.nodesFailed;
+      sync["bytesSent"] = syncStats.bytesSent;
+      sync["bytesSaved"] = syncStats.fullPushBytes > syncStats.bytesSent ? syncStats.fullPushBytes - syncStats.bytesSent : 0;
+
+      JsonArray nodes = root.createNestedArray("nodes");
+      for (uint8_t i = 0; i < enumerationNodeCount(); i++) {
+        const EnumeratedNode &node = enumerationNode(i);
+        JsonObject entry = nodes.createNestedObject();
+        entry["nodeId"] = node.nodeId;
+        entry["fwMajor"] = node.fwMajor;
+        entry["fwMinor"] = node.fwMinor;
+        entry["bootMs"] = node.bootMs;
+        entry["configureMs"] = node.configureMs;
+        if (i >= snapshot.nodeCount) continue;
+
+        const NodeReading &reading = snapshot.nodes[i];
+        const BusNodeStats &nodeStats = busSchedulerNodeStats(i);
+        entry["online"] = reading.online;
+        entry["ageMs"] = snapshot.cycle ? now - reading.sampledAt : 0;
+        entry["latencyMs"] = nodeStats.lastLatencyMs;
+        entry["maxLatencyMs"] = nodeStats.maxLatencyMs;
+        entry["transactions"] = nodeStats.transactions;
+        entry["failures"] = nodeStats.failures;
+        entry["retries"] = nodeStats.retries;
+
+        if (i < configSyncNodeCount()) {
+          const ConfigSyncNodeStatus nodeSync = configSyncNode(i);
+          JsonObject config = entry.createNestedObject("config");
+          config["state"] = configSyncNodeStateName(nodeSync.state);
+          config["hash"] = nodeSync.hash;
+          config["chunksSent"] = nodeSync.chunksSent;
+          config["chunksToSend"] = nodeSync.chunksToSend;
+        }
+
+        JsonArray sensors = entry.createNestedArray("sensors");
+        for (uint8_t s = 0; s < reading.sensorCount; s++) {
+          JsonObject sensor = sensors.createNestedObject();
+          sensor["type"] = reading.sensors[s].type;
+          sensor["value"] = reading.sensors[s].value;
+          sensor["decimals"] = reading.sensors[s].unit;
+        }
+        JsonArray ports = entry.createNestedArray("ports");
+        JsonArray currents = entry.createNestedArray("currentMa");
+        for (uint8_t p = 0; p < NUM_RELAY_CHANNELS; p++) {
+          ports.add((reading.portStates & (1u << p)) != 0);
+          currents.add(reading.portCurrentMa[p]);
+        }
+      }
     }
 
-    JsonObject sensors = root.createNestedObject("sensors");
-    sensors["temperatureC"] = sensorValues.temperatureC;
-    sensors["humidityPercent"] = sensorValues.humidityPercent;
-    sensors["lightLevelLux"] = sensorValues.lightLevelLux;
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    serializeJson(doc, *response);
+    request->send(response);
+  });
 
-    root["ruleCount"] = rules.size();
+  onTimed("/api/memory", HTTP_GET, [](AsyncWebServerRequest *request) {
+    StaticJsonDocument<JSON_OBJECT_SIZE(9)> doc;
+    JsonObject root = doc.to<JsonObject>();
+    root["heapSize"] = ESP.getHeapSize();
+    root["heapFree"] = ESP.getFreeHeap();
+    root["heapMinFree"] = ESP.getMinFreeHeap();
+    root["heapLargestBlock"] = ESP.getMaxAllocHeap();
+    root["historyBytes"] = historyMemoryBytes();
+    {
+      ControllerLock lock;
+      const std::vector<RuleDefinition> &rules = ruleSetRules();
+      const ControlProgram *latestProgram = ruleSetProgram();
+      root["ruleCount"] = rules.size();
+      size_t programBytes = 0;
+      if (latestProgram != nullptr) {
+        const RuleProgram &program = latestProgram->program;
+        programBytes = program.rules.capacity() * sizeof(CompiledRule) +
+                       program.nodes.capacity() * (sizeof(ExprNode) + sizeof(uint32_t)) +
+                       program.exprOperands.capacity() * sizeof(uint16_t) +
+                       latestProgram->states.capacity() * sizeof(RuleState);
+      }
+      root["ruleBytes"] = rules.capacity() * sizeof(RuleDefinition) + programBytes;
+    }
+#ifdef TERRAHUB_HEAP_TRACE
+    root["controlLoopAllocations"] = controlLoopAllocations;
+#endif
 
-    String output;
-    serializeJson(root, output);
-    server.send(200, "application/json", output);
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    serializeJson(doc, *response);
+    request->send(response);
   });
 
-  server.on("/api/rules", HTTP_GET, []() {
-    DynamicJsonDocument doc(3072);
-    JsonArray arr = doc.to<JsonArray>();
-    for (const auto &rule : rules) {
-      JsonObject obj = arr.createNestedObject();
-      obj["id"] = rule.id;
-      obj["name"] = rule.name;
-      obj["enabled"] = rule.enabled;
+  // Prometheus text format; the handler reads only lock-free state
+  onTimed("/api/metrics", HTTP_GET, [](AsyncWebServerRequest *request) {
+    AsyncResponseStream *response = request->beginResponseStream("text/plain; version=0.0.4");
+    const MetricsWriter writer{writeToStream, response};
+    metricsWriteHistograms(writer);
+    writeSystemMetrics(writer);
+    request->send(response);
+  });
+
+  onTimed("/api/rules", HTTP_GET, [](AsyncWebServerRequest *request) {
+    // Owned by the filler, so it is released with the response even if the
+    // client goes away mid-stream
+    std::shared_ptr<RuleStream> stream(new RuleStream());
+    {
+      ControllerLock lock;
+      stream->generation = ruleSetGeneration();
+    }
+#ifdef TERRAHUB_HEAP_TRACE
+    stream->heapBefore = ESP.getFreeHeap();
+#endif
+
+    request->send(request->beginChunkedResponse("application/json", [stream](uint8_t *buffer, size_t maxLen, size_t index) {
+      return fillRuleStream(*stream, buffer, maxLen);
+    }));
+  });
 
-      JsonObject condition = obj.createNestedObject("condition");
-      condition["sensor"] = rule.condition.sensor;
-      condition["op"] = rule.condition.op;
-      condition["threshold"] = rule.condition.threshold;
-      condition["hysteresis"] = rule.condition.hysteresis;
+  onTimed("/api/history", HTTP_GET, [](AsyncWebServerRequest *request) {
+    const uint8_t tier = request->hasParam("tier") ? request->getParam("tier")->value().toInt() : 0;
+    const uint32_t since = request->hasParam("since") ? request->getParam("since")->value().toInt() : 0;
 
-      JsonObject action = obj.createNestedObject("action");
-      action["relayIndex"] = rule.action.relayIndex;
-      action["turnOn"] = rule.action.turnOn;
-      action["minDurationMs"] = rule.action.minDurationMs;
+    std::shared_ptr<HistoryExport> exp(new HistoryExport());
+    {
+      ControllerLock lock;
+      if (!historyExportBegin(*exp, tier, since)) {
+        request->send(400, "application/json", "{\"error\":\"Unknown history tier\"}");
+        return;
+      }
     }
 
-    String output;
-    serializeJson(doc, output);
-    server.send(200, "application/json", output);
+    // Streamed straight out of the rings; see sensor_history.h for the format
+    request->send(request->beginChunkedResponse("application/octet-stream", [exp](uint8_t *buffer, size_t maxLen, size_t index) {
+      ControllerLock lock;
+      return historyExportRead(*exp, buffer, maxLen);
+    }));
   });
 
-  server.on("/api/rules", HTTP_POST, []() {
-    if (!server.hasArg("plain")) {
-      server.send(400, "application/json", "{\"error\":\"Missing body\"}");
+  onTimed("/api/rules", HTTP_POST, [](AsyncWebServerRequest *request) {
+    if (rejectOversizedBody(request)) {
       return;
     }
+    ControllerLock lock;
+    sendRuleSetResponse(request, ruleSetReplaceRules(static_cast<const char *>(request->_tempObject)));
+  }, nullptr, collectBody);
+
+  // Per-rule edits. The /api/rules handlers above also match sub-paths, but
+  // only for GET and POST, so these see every PUT/PATCH/DELETE.
+  onTimed("/api/rules", HTTP_PUT, [](AsyncWebServerRequest *request) {
+    RuleId id;
+    if (!ruleIdFromPath(request, id) || rejectOversizedBody(request)) {
+      return;
+    }
+    ControllerLock lock;
+    sendRuleSetResponse(request, ruleSetPutRule(id, static_cast<const char *>(request->_tempObject)));
+  }, nullptr, collectBody);
 
-    DynamicJsonDocument doc(4096);
-    auto error = deserializeJson(doc, server.arg("plain"));
-    if (error) {
-      server.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+  onTimed("/api/rules", HTTP_PATCH, [](AsyncWebServerRequest *request) {
+    RuleId id;
+    if (!ruleIdFromPath(request, id) || rejectOversizedBody(request)) {
       return;
     }
+    ControllerLock lock;
+    sendRuleSetResponse(request, ruleSetPatchRule(id, static_cast<const char *>(request->_tempObject)));
+  }, nullptr, collectBody);
 
-    std::vector<RuleDefinition> nextRules;
-    for (JsonObject obj : doc.as<JsonArray>()) {
-      RuleDefinition rule;
-      rule.id = obj["id"].as<String>();
-      rule.name = obj["name"].as<String>();
-      rule.enabled = obj["enabled"] | true;
+  onTimed("/api/rules", HTTP_DELETE, [](AsyncWebServerRequest *request) {
+    RuleId id;
+    if (!ruleIdFromPath(request, id)) {
+      return;
+    }
+    ControllerLock lock;
+    sendRuleSetResponse(request, ruleSetDeleteRule(id));
+  });
 
-      JsonObject cond = obj["condition"].as<JsonObject>();
-      rule.condition.sensor = cond["sensor"].as<String>();
-      rule.condition.op = cond["op"].as<String>();
-      rule.condition.threshold = cond["threshold"] | 0;
-      rule.condition.hysteresis = cond["hysteresis"] | 0;
+  // Registered before /api/relays, which would otherwise also match this
+  // path because async handlers match sub-paths of their URI
+  onTimed("/api/schedules", HTTP_GET, [](AsyncWebServerRequest *request) {
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    ControllerLock lock;
+    const ControlSnapshot control = controlSnapshot();
+    const std::vector<ScheduleDefinition> &schedules = ruleSetSchedules();
+    const ControlProgram *latestProgram = ruleSetProgram();
+    const bool current = latestProgram != nullptr && control.generation == latestProgram->generation;
+
+    // One schedule at a time, so the response costs the same for 1 or 16
+    response->print('[');
+    for (size_t i = 0; i < schedules.size(); i++) {
+      StaticJsonDocument<SCHEDULE_JSON_CAPACITY + JSON_OBJECT_SIZE(1)> doc;
+      JsonObject obj = doc.to<JsonObject>();
+      writeScheduleJson(schedules[i], obj);
+
+      // Relay state the schedule asks for right now; null while disabled,
+      // before the clock is set or while a change is being applied
+      obj["on"] = nullptr;
+      for (size_t k = 0; current && control.clockValid && k < latestProgram->schedules.schedules.size(); k++) {
+        if (latestProgram->schedules.schedules[k].scheduleIndex == i) {
+          obj["on"] = (control.schedulesOn & (1u << k)) != 0;
+        }
+      }
 
-      JsonObject action = obj["action"].as<JsonObject>();
-      rule.action.relayIndex = action["relayIndex"] | 0;
-      rule.action.turnOn = action["turnOn"] | false;
-      rule.action.minDurationMs = action["minDurationMs"] | 0;
-      nextRules.push_back(rule);
+      if (i > 0) response->print(',');
+      serializeJson(doc, *response);
     }
-
-    rules = nextRules;
-    saveRulesToStorage();
-    server.send(204);
+    response->print(']');
+    request->send(response);
   });
 
-  server.on("/api/relays", HTTP_POST, []() {
-    if (!server.hasArg("plain")) {
-      server.send(400, "application/json", "{\"error\":\"Missing body\"}");
+  onTimed("/api/schedules", HTTP_POST, [](AsyncWebServerRequest *request) {
+    if (rejectOversizedBody(request)) {
+      return;
+    }
+    ControllerLock lock;
+    sendRuleSetResponse(request, ruleSetReplaceSchedules(static_cast<const char *>(request->_tempObject)));
+  }, nullptr, collectBody);
+
+  onTimed("/api/relays/policy", HTTP_POST, [](AsyncWebServerRequest *request) {
+    DynamicJsonDocument doc(256);
+    if (!parseJsonBody(request, doc)) {
+      return;
+    }
+
+    ControllerLock lock;
+
+    uint8_t index = doc["relayIndex"] | 0;
+    RelayPolicy policy = relayPolicyFromName(doc["policy"] | "");
+    if (index >= NUM_RELAY_CHANNELS || policy == RELAY_POLICY_COUNT) {
+      request->send(400, "application/json", "{\"error\":\"relayIndex and policy (priority, any-on, all-on) required\"}");
+      return;
+    }
+
+    if (!controlSetPolicy(index, policy)) {
+      request->send(503, "application/json", "{\"error\":\"Controller busy, retry\"}");
       return;
     }
+    relayPolicies[index] = policy;
+    saveRelayPoliciesToStorage();
+    request->send(204);
+  }, nullptr, collectBody);
 
+  onTimed("/api/relays", HTTP_POST, [](AsyncWebServerRequest *request) {
     DynamicJsonDocument doc(512);
-    auto error = deserializeJson(doc, server.arg("plain"));
-    if (error) {
-      server.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+    if (!parseJsonBody(request, doc)) {
       return;
     }
 
+    ControllerLock lock;
+
     uint8_t index = doc["relayIndex"] | 0;
     bool on = doc["turnOn"] | false;
-    setRelayState(index, on);
+    if (!controlSetRelay(index, on)) {
+      request->send(503, "application/json", "{\"error\":\"Controller busy, retry\"}");
+      return;
+    }
 
     DynamicJsonDocument resp(256);
     resp["relayIndex"] = index;
     resp["turnOn"] = on;
     String output;
     serializeJson(resp, output);
-    server.send(200, "application/json", output);
-  });
+    request->send(200, "application/json", output);
+  }, nullptr, collectBody);
 
   // Allows the UI to feed sensor values when hardware sensors are absent
-  server.on("/api/sensors/mock", HTTP_POST, []() {
-    if (!server.hasArg("plain")) {
-      server.send(400, "application/json", "{\"error\":\"Missing body\"}");
+  onTimed("/api/sensors/mock", HTTP_POST, [](AsyncWebServerRequest *request) {
+    DynamicJsonDocument doc(512);
+    if (!parseJsonBody(request, doc)) {
       return;
     }
 
-    DynamicJsonDocument doc(512);
-    auto error = deserializeJson(doc, server.arg("plain"));
-    if (error) {
-      server.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
-      return;
+    ControllerLock lock;
+
+    // Missing or non-numeric fields leave that sensor unchanged
+    for (uint8_t slot = 0; slot < SENSOR_SLOT_COUNT; slot++) {
+      JsonVariant value = doc[sensorSlotName(slot)];
+      if (value.is<float>() && !controlSetSensor(slot, value.as<float>())) {
+        request->send(503, "application/json", "{\"error\":\"Controller busy, retry\"}");
+        return;
+      }
     }
 
-    sensorValues.temperatureC = doc["temperatureC"] | sensorValues.temperatureC;
-    sensorValues.humidityPercent = doc["humidityPercent"] | sensorValues.humidityPercent;
-    sensorValues.lightLevelLux = doc["lightLevelLux"] | sensorValues.lightLevelLux;
+    request->send(204);
+  }, nullptr, collectBody);
 
-    server.send(204);
-  });
+  livePushBegin(server);
 
   server.begin();
   Serial.println("Web server started");
 }
 
 /**
- * Handle node enumeration (controller only)
+ * Start node enumeration (controller only). It runs from loop_controller()
+ * while the network comes up; see enumeration.h.
  */
 void handleEnumeration() {
   Serial.println("Starting node enumeration...");
-  
-  // TODO: Implement enumeration protocol
-  // 1. Scan for unassigned slaves at default address
-  // 2. Assign IDs to each slave
-  // 3. Enable downstream on each slave
-  // 4. Repeat until no more slaves found
-  
-  Serial.println("Enumeration complete");
+  enumerationBegin(halI2cBus(), millis());
+  enumerating = true;
+}
+
+/**
+ * Hand the enumerated nodes to the bus scheduler
+ */
+void startBusPolling() {
+  uint8_t nodeIds[BUS_MAX_SLAVES];
+  const uint8_t count = enumerationNodeCount();
+  for (uint8_t i = 0; i < count; i++) {
+    nodeIds[i] = enumerationNode(i).nodeId;
+  }
+  busSchedulerBegin(halI2cBus(), nodeIds, count, millis());
+  configSyncBegin(halI2cBus(), nodeIds, count);
 }
 
 void setupNetwork() {
   WiFi.mode(WIFI_AP_STA);
   WiFi.softAP(provisioningApSsid, provisioningApPassword);
 
+  // SNTP starts once the station has an address; schedules wait for it
+  configTzTime(TIME_ZONE, NTP_SERVER);
+
   Serial.print("Provisioning AP SSID: ");
   Serial.println(provisioningApSsid);
   Serial.print("AP IP: ");
   Serial.println(WiFi.softAPIP());
 
-  wifiConnected = connectToConfiguredWifi();
-  if (wifiConnected) {
-    Serial.print("Station mode active. IP: ");
-    Serial.println(WiFi.localIP());
+  wifiManagerBegin();
+  if (wifiConfig.configured) {
+    wifiManagerConnect(wifiConfig);
   }
 }
 
-void pollSensors() {
-  // TODO: Replace with real sensor reads. For now we keep the last values
-  // and allow the UI to push overrides via /api/sensors/mock.
-  Serial.printf("Polling sensors: T=%.2fC H=%.2f%% L=%.2flux\n", sensorValues.temperatureC,
-                sensorValues.humidityPercent, sensorValues.lightLevelLux);
-}
-
-float getSensorField(const String &key, const SensorValues &values) {
-  if (key == "temperatureC") {
-    return values.temperatureC;
-  }
-  if (key == "humidityPercent") {
-    return values.humidityPercent;
+/**
+ * Log load faults raised or cleared by the current monitor since the last
+ * call. Costs one atomic load when nothing changed.
+ */
+void reportCurrentFaults() {
+  const uint32_t events = currentMonitorFaultEvents();
+  if (events == reportedFaultEvents) {
+    return;
   }
-  if (key == "lightLevelLux") {
-    return values.lightLevelLux;
+  reportedFaultEvents = events;
+
+  const uint32_t mask = currentMonitorFaultMask();
+  const uint32_t changed = mask ^ reportedFaultMask;
+  reportedFaultMask = mask;
+  for (uint8_t i = 0; i < NUM_CURRENT_SENSORS; i++) {
+    if (!(changed & (1u << i))) continue;
+    const CurrentChannelStatus status = currentMonitorChannel(i);
+    if (mask & (1u << i)) {
+      // The controller's relay stage belongs to the control task
+      const bool relayOn = isController ? (controlSnapshot().relays & (1u << i)) != 0 : relayOutputState(i);
+      Serial.printf("Load fault on channel %u: %s (%u mA, relay %s)\n", i + 1, currentFaultName(status.fault),
+                    status.rmsMa, relayOn ? "on" : "off");
+    } else {
+      Serial.printf("Load fault on channel %u cleared\n", i + 1);
+    }
   }
-  return NAN;
 }
 
-bool evaluateCondition(const RuleCondition &condition, const SensorValues &values) {
-  float value = getSensorField(condition.sensor, values);
-  if (isnan(value)) {
-    return false;
-  }
+// One delta: changed relays, sensors and faults plus up to
+// LIVE_MAX_RULE_CHANGES rule transitions
+#define LIVE_DELTA_JSON_CAPACITY \
+  (JSON_OBJECT_SIZE(5) + JSON_ARRAY_SIZE(NUM_RELAY_CHANNELS) + JSON_OBJECT_SIZE(SENSOR_SLOT_COUNT) + \
+   JSON_ARRAY_SIZE(NUM_CURRENT_SENSORS) + JSON_OBJECT_SIZE(LIVE_MAX_RULE_CHANGES))
+#define LIVE_DELTA_MAX_BYTES (256 + LIVE_MAX_RULE_CHANGES * (MAX_RULE_ID_LENGTH + 10))
 
-  float target = condition.threshold;
-  if (condition.op == "gt") return value > target;
-  if (condition.op == "lt") return value < target;
-  if (condition.op == "gte") return value >= target;
-  if (condition.op == "lte") return value <= target;
-  if (condition.op == "eq") return fabs(value - target) <= condition.hysteresis;
-  return false;
+static bool sameSensorValue(float a, float b) {
+  return a == b || (isnan(a) && isnan(b));
 }
 
-void setRelayState(uint8_t index, bool on) {
-  if (index >= NUM_RELAY_CHANNELS) {
-    return;
-  }
-  digitalWrite(relayPins[index], on ? RELAY_ON_STATE : RELAY_OFF_STATE);
-  relayStates[index] = on;
+// Rules of the newest program, whose active flags the control task keeps up
+// to date once it has switched to it
+static size_t liveRuleCount() {
+  const ControlProgram *latestProgram = ruleSetProgram();
+  return latestProgram != nullptr ? latestProgram->ids.size() : 0;
+}
+
+static bool liveRuleIsActive(size_t programIndex) {
+  return ruleSetProgram()->active[programIndex].load(std::memory_order_relaxed);
 }
 
-void evaluateRules() {
-  const uint32_t now = millis();
+/**
+ * Take the current state as the live baseline without sending it; new
+ * subscribers receive it in their snapshot
+ */
+static void resetLiveBaseline(const ControlSnapshot &control) {
+  liveRelays = control.relays;
+  liveSensors = control.sensors;
+  for (uint8_t i = 0; i < NUM_CURRENT_SENSORS; i++) {
+    liveFaults[i] = currentMonitorChannel(i).fault;
+  }
+  liveRulesGeneration = ruleSetGeneration();
+  liveRuleActive.assign(liveRuleCount(), 0);
+  for (size_t i = 0; i < liveRuleActive.size(); i++) {
+    liveRuleActive[i] = liveRuleIsActive(i);
+  }
+}
 
-  // Clear expired actions
-  for (auto it = activeActions.begin(); it != activeActions.end();) {
-    if (now >= it->minEndTime) {
-      it = activeActions.erase(it);
+/**
+ * Full state in the same shape as a delta, with every field present. Only
+ * built when a subscriber connects, falls behind or the rule set changes.
+ */
+static void writeLiveSnapshot(String &out) {
+  const ControlSnapshot control = controlSnapshot();
+  DynamicJsonDocument doc(JSON_OBJECT_SIZE(6) + JSON_ARRAY_SIZE(NUM_RELAY_CHANNELS) +
+                          JSON_OBJECT_SIZE(SENSOR_SLOT_COUNT) + JSON_ARRAY_SIZE(NUM_CURRENT_SENSORS) +
+                          JSON_OBJECT_SIZE(liveRuleCount()));
+  JsonObject root = doc.to<JsonObject>();
+  root["seq"] = liveSequence;
+  root["snapshot"] = true;
+
+  JsonArray relays = root.createNestedArray("relays");
+  for (uint8_t i = 0; i < NUM_RELAY_CHANNELS; i++) {
+    relays.add((control.relays & (1u << i)) != 0);
+  }
+  JsonObject sensors = root.createNestedObject("sensors");
+  for (uint8_t slot = 0; slot < SENSOR_SLOT_COUNT; slot++) {
+    sensors[sensorSlotName(slot)] = control.sensors.slots[slot];
+  }
+  JsonArray faults = root.createNestedArray("faults");
+  for (uint8_t i = 0; i < NUM_CURRENT_SENSORS; i++) {
+    const CurrentChannelStatus status = currentMonitorChannel(i);
+    if (status.available) {
+      faults.add(currentFaultName(status.fault));
     } else {
-      ++it;
+      faults.add(nullptr);
     }
   }
+  JsonObject ruleActive = root.createNestedObject("rules");
+  for (size_t i = 0; i < liveRuleCount(); i++) {
+    ruleActive[ruleSetProgram()->ids[i].c_str()] = liveRuleIsActive(i);
+  }
 
-  for (const auto &rule : rules) {
-    if (!rule.enabled) continue;
+  serializeJson(doc, out);
+}
 
-    bool conditionMet = evaluateCondition(rule.condition, sensorValues);
-    auto existing = std::find_if(activeActions.begin(), activeActions.end(), [&](const ActiveAction &a) {
-      return a.ruleId == rule.id;
-    });
+/**
+ * Diff the state against what /api/live subscribers last received and
+ * broadcast the changes as one message. Everything the control task changed
+ * since the previous pass (a sensor update and the relays it switched)
+ * coalesces into one message. Does nothing while nobody is subscribed.
+ */
+void pushLiveStatus() {
+  if (!livePushHasSubscribers()) {
+    livePushed = false;
+    return;
+  }
 
-    if (conditionMet) {
-      if (existing == activeActions.end()) {
-        ActiveAction active{rule.id, now + rule.action.minDurationMs, rule.action};
-        activeActions.push_back(active);
+  const ControlSnapshot control = controlSnapshot();
+  if (!livePushed || liveRulesGeneration != ruleSetGeneration()) {
+    // Rule states are tracked by program index, which a new rule set
+    // reshuffles; everyone starts over from a snapshot
+    resetLiveBaseline(control);
+    livePushResync();
+    livePushed = true;
+  } else {
+    StaticJsonDocument<LIVE_DELTA_JSON_CAPACITY> doc;
+    JsonObject root = doc.to<JsonObject>();
+    root["seq"] = liveSequence + 1;
+    bool changed = false;
+
+    // Unchanged entries are null so indices keep their meaning
+    if (control.relays != liveRelays) {
+      JsonArray changes = root.createNestedArray("relays");
+      for (uint8_t i = 0; i < NUM_RELAY_CHANNELS; i++) {
+        if ((control.relays ^ liveRelays) & (1u << i)) {
+          changes.add((control.relays & (1u << i)) != 0);
+        } else {
+          changes.add(nullptr);
+        }
       }
-      setRelayState(rule.action.relayIndex, rule.action.turnOn);
-    } else if (existing != activeActions.end()) {
-      // Condition cleared, but respect minimum duration
-      if (now >= existing->minEndTime) {
-        setRelayState(rule.action.relayIndex, !rule.action.turnOn);
-        activeActions.erase(existing);
+      liveRelays = control.relays;
+      changed = true;
+    }
+
+    JsonObject sensors;
+    for (uint8_t slot = 0; slot < SENSOR_SLOT_COUNT; slot++) {
+      if (sameSensorValue(control.sensors.slots[slot], liveSensors.slots[slot])) continue;
+      if (sensors.isNull()) sensors = root.createNestedObject("sensors");
+      sensors[sensorSlotName(slot)] = control.sensors.slots[slot];
+      liveSensors.slots[slot] = control.sensors.slots[slot];
+      changed = true;
+    }
+
+    JsonArray faults;
+    for (uint8_t i = 0; i < NUM_CURRENT_SENSORS; i++) {
+      const CurrentFault fault = currentMonitorChannel(i).fault;
+      if (fault == liveFaults[i]) continue;
+      if (faults.isNull()) {
+        faults = root.createNestedArray("faults");
+        for (uint8_t j = 0; j < NUM_CURRENT_SENSORS; j++) faults.add(nullptr);
       }
+      faults[i] = currentFaultName(fault);
+      liveFaults[i] = fault;
+      changed = true;
+    }
+
+    // Transitions beyond the per-message limit stay pending for the next pass
+    JsonObject ruleActive;
+    uint8_t ruleChanges = 0;
+    for (size_t i = 0; i < liveRuleActive.size() && ruleChanges < LIVE_MAX_RULE_CHANGES; i++) {
+      const bool active = liveRuleIsActive(i);
+      if (active == (liveRuleActive[i] != 0)) continue;
+      if (ruleActive.isNull()) ruleActive = root.createNestedObject("rules");
+      ruleActive[ruleSetProgram()->ids[i].c_str()] = active;
+      liveRuleActive[i] = active;
+      ruleChanges++;
+      changed = true;
+    }
+
+    if (changed) {
+      liveSequence++;
+      char message[LIVE_DELTA_MAX_BYTES];
+      const size_t length = serializeJson(doc, message, sizeof(message));
+      livePushBroadcast(message, length);
     }
   }
+
+  livePushLoop(millis(), writeLiveSnapshot);
 }
 
-void loadRulesFromStorage() {
-  rules.clear();
-  preferences.begin("terrahub", true);
-  String raw = preferences.getString("rules", "");
-  preferences.end();
-  if (raw.isEmpty()) {
+/**
+ * Log and record each sensor poll the control task published. Both happen
+ * here so the control task never waits on the serial port.
+ */
+void recordSensorPoll() {
+  const ControlSnapshot control = controlSnapshot();
+  if (control.sensorPolls == recordedSensorPolls) {
     return;
   }
+  recordedSensorPolls = control.sensorPolls;
+
+  Serial.printf("Polling sensors: T=%.2fC H=%.2f%% L=%.2flux\n", control.sensors.slots[SENSOR_TEMPERATURE],
+                control.sensors.slots[SENSOR_HUMIDITY], control.sensors.slots[SENSOR_LIGHT_LEVEL]);
+  historyAppend(control.sensors, control.sensorPolledAt);
+}
+
+/**
+ * Drive a slave's relay on behalf of the controller. The controller's own
+ * relays belong to its control task and are driven through controlSetRelay().
+ */
+void setRelayState(uint8_t index, bool on) {
+  relayOutputForce(index, on);
+  relayOutputCommit();
+}
 
-  DynamicJsonDocument doc(4096);
-  if (deserializeJson(doc, raw)) {
-    Serial.println("Failed to parse stored rules");
+// Before the first NTP sync the clock counts from the epoch; anything
+// before 2024 is not a real local time yet
+#define SCHEDULE_CLOCK_VALID_AFTER 1704067200
+
+/**
+ * Hand the local time to the control task once it is known (after the
+ * first NTP sync), and again whenever it moved away from what the task
+ * assumes: an NTP step, a DST change or a manual clock change.
+ */
+void syncScheduleClock(uint32_t now) {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  if (tv.tv_sec < SCHEDULE_CLOCK_VALID_AFTER) {
     return;
   }
 
-  for (JsonObject obj : doc.as<JsonArray>()) {
-    RuleDefinition rule;
-    rule.id = obj["id"].as<String>();
-    rule.name = obj["name"].as<String>();
-    rule.enabled = obj["enabled"] | true;
+  struct tm local;
+  localtime_r(&tv.tv_sec, &local);
+  const uint32_t weekMs = ((local.tm_wday + SCHEDULE_DAY_COUNT - 1) % SCHEDULE_DAY_COUNT) * SCHEDULE_DAY_MS +
+                          (local.tm_hour * 3600UL + local.tm_min * 60UL + local.tm_sec) * 1000UL + tv.tv_usec / 1000;
 
-    JsonObject cond = obj["condition"].as<JsonObject>();
-    rule.condition.sensor = cond["sensor"].as<String>();
-    rule.condition.op = cond["op"].as<String>();
-    rule.condition.threshold = cond["threshold"] | 0;
-    rule.condition.hysteresis = cond["hysteresis"] | 0;
+  if (scheduleClockSent) {
+    const uint32_t expected = (scheduleClockWeekMs + static_cast<uint64_t>(now - scheduleClockAt)) % SCHEDULE_WEEK_MS;
+    const uint32_t ahead = (weekMs + SCHEDULE_WEEK_MS - expected) % SCHEDULE_WEEK_MS;
+    const uint32_t drift = ahead < SCHEDULE_WEEK_MS / 2 ? ahead : SCHEDULE_WEEK_MS - ahead;
+    if (drift <= SCHEDULE_CLOCK_TOLERANCE_MS) {
+      return;
+    }
+  }
 
-    JsonObject action = obj["action"].as<JsonObject>();
-    rule.action.relayIndex = action["relayIndex"] | 0;
-    rule.action.turnOn = action["turnOn"] | false;
-    rule.action.minDurationMs = action["minDurationMs"] | 0;
-    rules.push_back(rule);
+  if (controlSetClock(weekMs, now)) {
+    scheduleClockSent = true;
+    scheduleClockAt = now;
+    scheduleClockWeekMs = weekMs;
   }
 }
 
-void saveRulesToStorage() {
-  DynamicJsonDocument doc(4096);
-  JsonArray arr = doc.to<JsonArray>();
-  for (const auto &rule : rules) {
-    JsonObject obj = arr.createNestedObject();
-    obj["id"] = rule.id;
-    obj["name"] = rule.name;
-    obj["enabled"] = rule.enabled;
-
-    JsonObject cond = obj.createNestedObject("condition");
-    cond["sensor"] = rule.condition.sensor;
-    cond["op"] = rule.condition.op;
-    cond["threshold"] = rule.condition.threshold;
-    cond["hysteresis"] = rule.condition.hysteresis;
-
-    JsonObject action = obj.createNestedObject("action");
-    action["relayIndex"] = rule.action.relayIndex;
-    action["turnOn"] = rule.action.turnOn;
-    action["minDurationMs"] = rule.action.minDurationMs;
+/**
+ * Hand the current rule set to the slave config sync. Edits reach the
+ * slaves on the same debounce as the NVS write.
+ */
+void publishConfigImage() {
+  const std::vector<RuleDefinition> &rules = ruleSetRules();
+  std::vector<uint8_t> blob(ruleStoreEncodedSize(rules));
+  const size_t length = ruleStoreEncode(rules, blob.data(), blob.size());
+  if (length == 0 || !configSyncSetImage(blob.data(), length)) {
+    Serial.printf("Rule set (%u bytes) too large to sync to slaves\n", static_cast<unsigned>(blob.size()));
   }
+}
 
-  String output;
-  serializeJson(doc, output);
+void loadSlaveConfigFromStorage() {
+  slaveConfigImage.assign(CONFIG_IMAGE_MAX_BYTES, 0);
+  halNvsReadBlob("config_bin", slaveConfigImage.data(), slaveConfigImage.size());
 
-  preferences.begin("terrahub", false);
-  preferences.putString("rules", output);
-  preferences.end();
+  slaveConfigChanged = true;
+  refreshSlaveConfig();
+  slaveConfigSavedHash = slaveConfigHash;
 }
 
-void loadWifiFromStorage() {
-  preferences.begin("terrahub", true);
-  wifiConfig.ssid = preferences.getString("wifi_ssid", "");
-  wifiConfig.password = preferences.getString("wifi_pass", "");
-  wifiConfig.hostname = preferences.getString("wifi_hostname", "terrahub");
-  preferences.end();
+void saveSlaveConfigToStorage() {
+  refreshSlaveConfig();
+  if (slaveConfigLength == 0 || slaveConfigHash == slaveConfigSavedHash) {
+    return;
+  }
 
-  wifiConfig.configured = wifiConfig.ssid.length() > 0;
+  if (halNvsWriteBlob("config_bin", slaveConfigImage.data(), slaveConfigLength)) {
+    slaveConfigSavedHash = slaveConfigHash;
+    Serial.printf("Stored configuration image (%u bytes)\n", slaveConfigLength);
+  }
 }
 
-void saveWifiToStorage(const WifiConfig &config) {
-  preferences.begin("terrahub", false);
-  preferences.putString("wifi_ssid", config.ssid);
-  preferences.putString("wifi_pass", config.password);
-  preferences.putString("wifi_hostname", config.hostname.length() ? config.hostname : "terrahub");
-  preferences.end();
-}
+// Runs before the control task starts, so it sets the relay stage directly
+void loadRelayPoliciesFromStorage() {
+  uint8_t stored[NUM_RELAY_CHANNELS];
+  const size_t length = halNvsReadBlob("relay_policy", stored, sizeof(stored));
 
-bool connectToConfiguredWifi() {
-  if (!wifiConfig.configured) {
-    wifiConnected = false;
-    return false;
+  for (size_t i = 0; i < length; i++) {
+    relayOutputSetPolicy(i, static_cast<RelayPolicy>(stored[i]));
   }
+  for (uint8_t i = 0; i < NUM_RELAY_CHANNELS; i++) {
+    relayPolicies[i] = relayOutputPolicy(i);
+  }
+}
 
-  if (wifiConfig.hostname.length()) {
-    WiFi.setHostname(wifiConfig.hostname.c_str());
+void saveRelayPoliciesToStorage() {
+  uint8_t stored[NUM_RELAY_CHANNELS];
+  for (uint8_t i = 0; i < NUM_RELAY_CHANNELS; i++) {
+    stored[i] = relayPolicies[i];
   }
 
-  WiFi.begin(wifiConfig.ssid.c_str(), wifiConfig.password.c_str());
-  Serial.print("Connecting to Wi-Fi SSID: ");
-  Serial.println(wifiConfig.ssid);
+  halNvsWriteBlob("relay_policy", stored, sizeof(stored));
+}
 
-  unsigned long start = millis();
-  while (WiFi.status() != WL_CONNECTED && (millis() - start) < 15000) {
-    delay(200);
-    Serial.print(".");
+// Read an NVS string into `value`; missing, empty or oversized keys yield `fallback`
+template <size_t Capacity>
+static void loadStoredText(const char *key, FixedString<Capacity> &value, const char *fallback) {
+  std::string stored;
+  if (!halNvsReadString(key, stored) || stored.empty() || !value.assign(stored.c_str())) {
+    value.assign(fallback);
   }
+}
 
-  wifiConnected = WiFi.status() == WL_CONNECTED;
-  Serial.println();
-  if (wifiConnected) {
-    Serial.print("Wi-Fi connected. IP: ");
-    Serial.println(WiFi.localIP());
-  } else {
-    Serial.println("Wi-Fi connection timed out; staying in AP mode for setup.");
-  }
+void loadWifiFromStorage() {
+  loadStoredText("wifi_ssid", wifiConfig.ssid, "");
+  loadStoredText("wifi_pass", wifiConfig.password, "");
+  loadStoredText("wifi_hostname", wifiConfig.hostname, "terrahub");
 
-  return wifiConnected;
+  wifiConfig.configured = wifiConfig.ssid.length() > 0;
+}
+
+void saveWifiToStorage(const WifiConfig &config) {
+  halNvsWriteString("wifi_ssid", config.ssid.c_str());
+  halNvsWriteString("wifi_pass", config.password.c_str());
+  halNvsWriteString("wifi_hostname", config.hostname.length() ? config.hostname.c_str() : "terrahub");
 }
@@ -0,0 +1,129 @@
+/**
+ * TerraHub Controller Firmware - Metrics
+ *
+ * Histogram storage and the Prometheus text writer.
+ */
+
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#include "metrics.h"
+
+#define METRICS_LINE_BYTES 160
+
+static const char *const STAGE_NAMES[METRIC_STAGE_COUNT] = {
+  "http_request", "network_loop", "control_pass", "sensor_poll", "rule_eval", "relay_output", "nvs_write"};
+
+#if TERRAHUB_METRICS
+struct StageHistogram {
+  std::atomic<uint32_t> buckets[METRICS_BUCKETS];
+  std::atomic<uint32_t> count;
+  std::atomic<uint64_t> sumNs;
+};
+
+static StageHistogram histograms[METRIC_STAGE_COUNT];
+#endif
+
+const char *metricStageName(uint8_t stage) {
+  return stage < METRIC_STAGE_COUNT ? STAGE_NAMES[stage] : "unknown";
+}
+
+// ============================================================================
+// Recording
+// ============================================================================
+
+void metricsRecord(uint8_t stage, uint32_t cycles) {
+#if TERRAHUB_METRICS
+  // The rate follows frequency scaling, so convert at the current clock
+  const uint32_t mhz = halCpuMhz();
+  const uint32_t us = cycles / mhz;
+  const uint32_t remainder = cycles - us * mhz;
+  const uint64_t ns = static_cast<uint64_t>(us) * 1000 + remainder * 1000 / mhz;
+  // Bucket k holds durations up to 2^k us
+  const uint32_t usCeiling = us + (remainder != 0);
+  uint8_t bucket = usCeiling <= 1 ? 0 : 32 - __builtin_clz(usCeiling - 1);
+  if (bucket >= METRICS_BUCKETS) bucket = METRICS_BUCKETS - 1;
+
+  StageHistogram &histogram = histograms[stage];
+  histogram.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  histogram.sumNs.fetch_add(ns, std::memory_order_relaxed);
+  histogram.count.fetch_add(1, std::memory_order_relaxed);
+#else
+  (void)stage;
+  (void)cycles;
+#endif
+}
+
+MetricsHistogram metricsHistogram(uint8_t stage) {
+  MetricsHistogram copy;
+  memset(&copy, 0, sizeof(copy));
+#if TERRAHUB_METRICS
+  const StageHistogram &histogram = histograms[stage];
+  for (uint8_t i = 0; i < METRICS_BUCKETS; i++) {
+    copy.buckets[i] = histogram.buckets[i].load(std::memory_order_relaxed);
+  }
+  copy.count = histogram.count.load(std::memory_order_relaxed);
+  copy.sumNs = histogram.sumNs.load(std::memory_order_relaxed);
+#else
+  (void)stage;
+#endif
+  return copy;
+}
+
+// ============================================================================
+// Prometheus Text Format
+// ============================================================================
+
+static void writeLine(const MetricsWriter &writer, const char *line, int length) {
+  if (length > 0) {
+    writer.write(line, length < METRICS_LINE_BYTES ? length : METRICS_LINE_BYTES - 1, writer.context);
+  }
+}
+
+void metricsWriteFamily(const MetricsWriter &writer, const char *name, const char *type, const char *help) {
+  char line[METRICS_LINE_BYTES];
+  writeLine(writer, line, snprintf(line, sizeof(line), "# HELP %s %s\n", name, help));
+  writeLine(writer, line, snprintf(line, sizeof(line), "# TYPE %s %s\n", name, type));
+}
+
+void metricsWriteSample(const MetricsWriter &writer, const char *name, const char *labels, uint64_t value) {
+  char line[METRICS_LINE_BYTES];
+  writeLine(writer, line,
+            snprintf(line, sizeof(line), labels != nullptr ? "%s{%s} %llu\n" : "%s%s %llu\n", name,
+                     labels != nullptr ? labels : "", static_cast<unsigned long long>(value)));
+}
+
+void metricsWriteHistograms(const MetricsWriter &writer) {
+#if TERRAHUB_METRICS
+  static const char *const name = "terrahub_stage_duration_seconds";
+  metricsWriteFamily(writer, name, "histogram", "Time spent in each stage of the controller's loops.");
+  char line[METRICS_LINE_BYTES];
+  for (uint8_t stage = 0; stage < METRIC_STAGE_COUNT; stage++) {
+    // _count is summed from the buckets read, so it always matches +Inf
+    const MetricsHistogram histogram = metricsHistogram(stage);
+    const char *stageName = STAGE_NAMES[stage];
+    uint32_t cumulative = 0;
+    for (uint8_t i = 0; i < METRICS_BUCKETS; i++) {
+      cumulative += histogram.buckets[i];
+      if (i + 1 < METRICS_BUCKETS) {
+        writeLine(writer, line,
+                  snprintf(line, sizeof(line), "%s_bucket{stage=\"%s\",le=\"%.6f\"} %lu\n", name, stageName,
+                           (1UL << i) / 1e6, static_cast<unsigned long>(cumulative)));
+      } else {
+        writeLine(writer, line,
+                  snprintf(line, sizeof(line), "%s_bucket{stage=\"%s\",le=\"+Inf\"} %lu\n", name, stageName,
+                           static_cast<unsigned long>(cumulative)));
+      }
+    }
+    writeLine(writer, line,
+              snprintf(line, sizeof(line), "%s_sum{stage=\"%s\"} %llu.%09llu\n", name, stageName,
+                       static_cast<unsigned long long>(histogram.sumNs / 1000000000ULL),
+                       static_cast<unsigned long long>(histogram.sumNs % 1000000000ULL)));
+    writeLine(writer, line,
+              snprintf(line, sizeof(line), "%s_count{stage=\"%s\"} %lu\n", name, stageName,
+                       static_cast<unsigned long>(cumulative)));
+  }
+#else
+  (void)writer;
+#endif
+}
@@ -0,0 +1,156 @@
+/**
+ * TerraHub Controller Firmware - Power Management
+ *
+ * Waiting is a FreeRTOS task notification with a timeout, so a waiting task
+ * costs nothing until its deadline and the idle task is free to clock-gate
+ * the CPU or, with automatic light sleep, to put the chip to sleep until
+ * the next wake.
+ *
+ * Host builds have no tasks to block or wake: whoever drives the control
+ * pipeline runs each pass itself, so waits return at once and all time
+ * counts as active.
+ */
+
+#include <string.h>
+#include "power_manager.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include <Arduino.h>
+#include <WiFi.h>
+#include "esp_pm.h"
+#include "sdkconfig.h"
+#endif
+
+static const char *const powerStateNames[POWER_STATE_COUNT] = {
+  "active",
+  "idle",
+  "lightSleep"
+};
+
+const char *powerStateName(uint8_t state) {
+  return state < POWER_STATE_COUNT ? powerStateNames[state] : "";
+}
+
+#if defined(ARDUINO_ARCH_ESP32)
+
+static portMUX_TYPE powerMux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t handles[POWER_TASK_COUNT] = {nullptr, nullptr};
+static uint8_t awakeMask = 0;                   // registered tasks not waiting
+static PowerState waitState = POWER_STATE_IDLE;  // what all-waiting counts as
+static uint32_t segmentStartUs = 0;
+static PowerStats stats;
+
+// Close the segment that ends now; call inside powerMux before awakeMask changes
+static void closeSegment(uint32_t nowUs) {
+  stats.stateUs[awakeMask ? POWER_STATE_ACTIVE : waitState] += nowUs - segmentStartUs;
+  segmentStartUs = nowUs;
+}
+
+void powerBegin() {
+  memset(&stats, 0, sizeof(stats));
+
+#if CONFIG_PM_ENABLE
+  // Light sleep additionally needs tickless idle in the SDK configuration;
+  // without it, fall back to frequency scaling alone
+  esp_pm_config_esp32_t config = {POWER_MAX_CPU_MHZ, POWER_MIN_CPU_MHZ, true};
+  if (esp_pm_configure(&config) == ESP_OK) {
+    stats.lightSleep = true;
+    stats.cpuScaling = true;
+  } else {
+    config.light_sleep_enable = false;
+    stats.cpuScaling = esp_pm_configure(&config) == ESP_OK;
+  }
+#endif
+
+  // Only takes effect while the station runs without the setup AP
+  WiFi.setSleep(true);
+
+  portENTER_CRITICAL(&powerMux);
+  waitState = stats.lightSleep ? POWER_STATE_LIGHT_SLEEP : POWER_STATE_IDLE;
+  segmentStartUs = micros();
+  portEXIT_CRITICAL(&powerMux);
+}
+
+void powerRegister(PowerTask task) {
+  portENTER_CRITICAL(&powerMux);
+  closeSegment(micros());
+  handles[task] = xTaskGetCurrentTaskHandle();
+  awakeMask |= 1u << task;
+  portEXIT_CRITICAL(&powerMux);
+}
+
+bool powerWait(PowerTask task, uint32_t timeoutMs) {
+  TickType_t ticks = pdMS_TO_TICKS(timeoutMs);
+  if (ticks == 0) {
+    ticks = 1;
+  }
+
+  portENTER_CRITICAL(&powerMux);
+  closeSegment(micros());
+  awakeMask &= ~(1u << task);
+  portEXIT_CRITICAL(&powerMux);
+
+  // A wake that arrived while the task was busy ends the wait at once
+  const bool woken = ulTaskNotifyTake(pdTRUE, ticks) > 0;
+
+  portENTER_CRITICAL(&powerMux);
+  closeSegment(micros());
+  awakeMask |= 1u << task;
+  stats.wakeups[task]++;
+  if (woken) {
+    stats.woken[task]++;
+  }
+  portEXIT_CRITICAL(&powerMux);
+  return woken;
+}
+
+void powerWake(PowerTask task) {
+  const TaskHandle_t handle = handles[task];
+  if (handle != nullptr && handle != xTaskGetCurrentTaskHandle()) {
+    xTaskNotifyGive(handle);
+  }
+}
+
+PowerStats powerStats() {
+  portENTER_CRITICAL(&powerMux);
+  closeSegment(micros());
+  PowerStats copy = stats;
+  portEXIT_CRITICAL(&powerMux);
+
+  copy.modemSleep = WiFi.getSleep() != WIFI_PS_NONE && !(WiFi.getMode() & WIFI_AP);
+  return copy;
+}
+
+#else
+
+#include "hal.h"
+
+static uint32_t startedUs = 0;
+static PowerStats stats;
+
+void powerBegin() {
+  memset(&stats, 0, sizeof(stats));
+  startedUs = halMicros();
+}
+
+void powerRegister(PowerTask task) {
+  (void)task;
+}
+
+bool powerWait(PowerTask task, uint32_t timeoutMs) {
+  (void)timeoutMs;
+  stats.wakeups[task]++;
+  return false;
+}
+
+void powerWake(PowerTask task) {
+  (void)task;
+}
+
+PowerStats powerStats() {
+  PowerStats copy = stats;
+  copy.stateUs[POWER_STATE_ACTIVE] = halMicros() - startedUs;
+  return copy;
+}
+
+#endif
@@ -0,0 +1,192 @@
+/**
+ * TerraHub Controller Firmware - Relay Output Stage
+ *
+ * Relay pins are split across the two ESP32 output banks (GPIO0-31 and
+ * GPIO32-39); each commit issues at most one set and one clear register write
+ * per bank, and only for relays whose state changed. Other builds write each
+ * changed pin through the HAL.
+ */
+
+#include <string.h>
+#include "relay_output.h"
+#include "hal.h"
+#include "pinout.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include "soc/gpio_reg.h"
+#endif
+
+struct VoteTally {
+  uint16_t on;
+  uint16_t off;
+  int8_t bestPriority;
+  bool bestState;
+};
+
+static const char *const relayPolicyNames[RELAY_POLICY_COUNT] = {
+  "priority",
+  "any-on",
+  "all-on"
+};
+
+static RelayPolicy policies[NUM_RELAY_CHANNELS];
+static VoteTally activeVotes[NUM_RELAY_CHANNELS];
+static VoteTally fallbackVotes[NUM_RELAY_CHANNELS];
+static uint32_t pendingMask = 0;
+static uint32_t forcedMask = 0;
+static uint32_t forcedOnMask = 0;
+static uint32_t stateMask = 0;
+static uint32_t toggleCounts[NUM_RELAY_CHANNELS] = {0};
+
+// Precomputed register bit and bank (0 = GPIO0-31, 1 = GPIO32-39) per relay
+static uint32_t pinBits[NUM_RELAY_CHANNELS];
+static uint8_t pinBanks[NUM_RELAY_CHANNELS];
+
+const char *relayPolicyName(uint8_t policy) {
+  return policy < RELAY_POLICY_COUNT ? relayPolicyNames[policy] : "";
+}
+
+RelayPolicy relayPolicyFromName(const char *name) {
+  for (uint8_t policy = 0; policy < RELAY_POLICY_COUNT; policy++) {
+    if (strcmp(name, relayPolicyNames[policy]) == 0) {
+      return static_cast<RelayPolicy>(policy);
+    }
+  }
+  return RELAY_POLICY_COUNT;
+}
+
+static void addVote(VoteTally &tally, bool on, int8_t priority) {
+  if (tally.on + tally.off == 0 || priority >= tally.bestPriority) {
+    tally.bestPriority = priority;
+    tally.bestState = on;
+  }
+  if (on) {
+    tally.on++;
+  } else {
+    tally.off++;
+  }
+}
+
+static bool resolveVotes(const VoteTally &tally, RelayPolicy policy) {
+  switch (policy) {
+    case RELAY_POLICY_ANY_ON: return tally.on > 0;
+    case RELAY_POLICY_ALL_ON: return tally.on > 0 && tally.off == 0;
+    default: return tally.bestState;
+  }
+}
+
+static void writeRelayPins(uint32_t changed, uint32_t next) {
+#if defined(ARDUINO_ARCH_ESP32)
+  uint32_t setBits[2] = {0, 0};
+  uint32_t clearBits[2] = {0, 0};
+  for (uint8_t i = 0; i < NUM_RELAY_CHANNELS; i++) {
+    if (!(changed & (1u << i))) continue;
+    const bool high = ((next & (1u << i)) != 0) == (RELAY_ACTIVE_HIGH != 0);
+    (high ? setBits : clearBits)[pinBanks[i]] |= pinBits[i];
+  }
+
+  if (setBits[0]) REG_WRITE(GPIO_OUT_W1TS_REG, setBits[0]);
+  if (clearBits[0]) REG_WRITE(GPIO_OUT_W1TC_REG, clearBits[0]);
+  if (setBits[1]) REG_WRITE(GPIO_OUT1_W1TS_REG, setBits[1]);
+  if (clearBits[1]) REG_WRITE(GPIO_OUT1_W1TC_REG, clearBits[1]);
+#else
+  for (uint8_t i = 0; i < NUM_RELAY_CHANNELS; i++) {
+    if (!(changed & (1u << i))) continue;
+    halDigitalWrite(relayPins[i], ((next & (1u << i)) != 0) == (RELAY_ACTIVE_HIGH != 0));
+  }
+#endif
+}
+
+void relayOutputBegin() {
+  for (uint8_t i = 0; i < NUM_RELAY_CHANNELS; i++) {
+    halPinOutput(relayPins[i]);
+    halDigitalWrite(relayPins[i], RELAY_ACTIVE_HIGH == 0);
+    pinBanks[i] = relayPins[i] >= 32 ? 1 : 0;
+    pinBits[i] = 1u << (relayPins[i] & 31);
+    policies[i] = RELAY_DEFAULT_POLICY;
+    toggleCounts[i] = 0;
+  }
+
+  memset(activeVotes, 0, sizeof(activeVotes));
+  memset(fallbackVotes, 0, sizeof(fallbackVotes));
+  pendingMask = 0;
+  forcedMask = 0;
+  forcedOnMask = 0;
+  stateMask = 0;
+}
+
+void relayOutputSetPolicy(uint8_t relay, RelayPolicy policy) {
+  if (relay >= NUM_RELAY_CHANNELS || policy >= RELAY_POLICY_COUNT) {
+    return;
+  }
+  policies[relay] = policy;
+}
+
+RelayPolicy relayOutputPolicy(uint8_t relay) {
+  return relay < NUM_RELAY_CHANNELS ? policies[relay] : RELAY_DEFAULT_POLICY;
+}
+
+void relayOutputVote(uint8_t relay, bool on, int8_t priority, bool active) {
+  if (relay >= NUM_RELAY_CHANNELS) {
+    return;
+  }
+  addVote(active ? activeVotes[relay] : fallbackVotes[relay], on, priority);
+  pendingMask |= 1u << relay;
+}
+
+void relayOutputForce(uint8_t relay, bool on) {
+  if (relay >= NUM_RELAY_CHANNELS) {
+    return;
+  }
+  const uint32_t bit = 1u << relay;
+  forcedMask |= bit;
+  forcedOnMask = on ? (forcedOnMask | bit) : (forcedOnMask & ~bit);
+  pendingMask |= bit;
+}
+
+uint32_t relayOutputCommit() {
+  if (!pendingMask) {
+    return 0;
+  }
+
+  uint32_t next = stateMask;
+  for (uint8_t i = 0; i < NUM_RELAY_CHANNELS; i++) {
+    const uint32_t bit = 1u << i;
+    if (!(pendingMask & bit)) continue;
+
+    bool on;
+    if (forcedMask & bit) {
+      on = (forcedOnMask & bit) != 0;
+    } else if (activeVotes[i].on + activeVotes[i].off > 0) {
+      on = resolveVotes(activeVotes[i], policies[i]);
+    } else {
+      on = resolveVotes(fallbackVotes[i], policies[i]);
+    }
+    next = on ? (next | bit) : (next & ~bit);
+
+    activeVotes[i] = VoteTally{0, 0, 0, false};
+    fallbackVotes[i] = VoteTally{0, 0, 0, false};
+  }
+
+  pendingMask = 0;
+  forcedMask = 0;
+
+  const uint32_t changed = next ^ stateMask;
+  if (changed) {
+    writeRelayPins(changed, next);
+    for (uint8_t i = 0; i < NUM_RELAY_CHANNELS; i++) {
+      if (changed & (1u << i)) toggleCounts[i]++;
+    }
+    stateMask = next;
+  }
+
+  return changed;
+}
+
+bool relayOutputState(uint8_t relay) {
+  return relay < NUM_RELAY_CHANNELS && (stateMask & (1u << relay)) != 0;
+}
+
+uint32_t relayOutputToggleCount(uint8_t relay) {
+  return relay < NUM_RELAY_CHANNELS ? toggleCounts[relay] : 0;
+}
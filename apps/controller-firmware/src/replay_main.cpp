@@ -0,0 +1,241 @@
+/**
+ * TerraHub Controller Firmware - Trace Replay Entry Point
+ *
+ * Command-line front end to trace_replay.h, built by the replay
+ * environment:
+ *
+ *   pio run -e replay
+ *   .pio/build/replay/program --rules rules.json --generate 90
+ *   .pio/build/replay/program --rules rules.json --schedules schedules.json \
+ *       --start monday 08:00 --trace terrarium.csv --log transitions.csv
+ *
+ * Rules and schedules are read as the bodies of POST /api/rules and
+ * POST /api/schedules. Prints the replay throughput and each relay's duty
+ * cycle; --log writes every relay transition as "t_s,relay,state".
+ */
+
+#if !defined(ARDUINO_ARCH_ESP32) && defined(TERRAHUB_REPLAY)
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "control_task.h"
+#include "hal.h"
+#include "relay_output.h"
+#include "rule_set.h"
+#include "trace_replay.h"
+
+#define REPLAY_DEFAULT_STEP_S 60
+#define REPLAY_DEFAULT_SEED 1
+
+static void usage() {
+  fprintf(stderr,
+          "usage: program --rules <file.json> [--schedules <file.json>] [--start <day> <HH:MM>]\n"
+          "               (--trace <file> | --generate <days> [--step <seconds>] [--seed <n>])\n"
+          "               [--log <transitions.csv>] [--convert <out.bin>] [--verbose]\n");
+}
+
+static bool readFile(const char *path, std::string &text) {
+  FILE *file = fopen(path, "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  char buffer[4096];
+  size_t length;
+  while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    text.append(buffer, length);
+  }
+  fclose(file);
+  return true;
+}
+
+// Let the control task pick up the queued program and retire the old one
+static void settle() {
+  controlRunPass();
+  ruleSetDrainRetired();
+}
+
+static bool applyBody(const char *what, const char *path, RuleSetResponse (*apply)(const char *)) {
+  std::string body;
+  if (!readFile(path, body)) {
+    fprintf(stderr, "cannot read %s\n", path);
+    return false;
+  }
+  const RuleSetResponse response = apply(body.c_str());
+  if (response.status >= 300) {
+    fprintf(stderr, "%s rejected (%u): %s\n", what, response.status, response.body != nullptr ? response.body : "");
+    return false;
+  }
+  settle();
+  return true;
+}
+
+static bool setStart(const char *dayName, const char *time) {
+  const uint8_t day = scheduleDayFromName(dayName);
+  uint16_t minuteOfDay;
+  if (day == SCHEDULE_DAY_COUNT || !scheduleParseTime(time, minuteOfDay)) {
+    fprintf(stderr, "bad start time: %s %s\n", dayName, time);
+    return false;
+  }
+  controlSetClock(day * SCHEDULE_DAY_MS + minuteOfDay * 60000UL, halMillis());
+  settle();
+  return true;
+}
+
+static void logTransition(uint64_t atMs, uint8_t relay, bool on, void *context) {
+  fprintf(static_cast<FILE *>(context), "%llu.%03u,%u,%u\n", static_cast<unsigned long long>(atMs / 1000),
+          static_cast<unsigned>(atMs % 1000), relay, on ? 1 : 0);
+}
+
+static int convert(ReplayTrace &trace, const char *path) {
+  FILE *out = fopen(path, "wb");
+  if (out == nullptr) {
+    fprintf(stderr, "cannot write %s\n", path);
+    return 1;
+  }
+  bool written = replayWriteBinaryHeader(out);
+  uint64_t samples = 0;
+  ReplaySample sample;
+  while (written && replayNextSample(trace, sample)) {
+    written = replayWriteBinarySample(out, sample);
+    samples++;
+  }
+  written &= fclose(out) == 0;
+  if (trace.error[0] != '\0' || !written) {
+    fprintf(stderr, "conversion failed: %s\n", trace.error[0] != '\0' ? trace.error : "write error");
+    return 1;
+  }
+  printf("Wrote %llu samples to %s\n", static_cast<unsigned long long>(samples), path);
+  return 0;
+}
+
+static void formatDuration(uint64_t ms, char *text, size_t size) {
+  const uint64_t seconds = ms / 1000;
+  snprintf(text, size, "%llud %02u:%02u:%02u", static_cast<unsigned long long>(seconds / 86400),
+           static_cast<unsigned>(seconds / 3600 % 24), static_cast<unsigned>(seconds / 60 % 60),
+           static_cast<unsigned>(seconds % 60));
+}
+
+static void report(const ReplayStats &stats, double wallSeconds) {
+  const double simulatedSeconds = stats.simulatedMs / 1000.0;
+  const double wall = wallSeconds > 0 ? wallSeconds : 1e-9;
+  printf("Replayed %llu samples, %.2f days in %.3f s (%.0fx real time)\n",
+         static_cast<unsigned long long>(stats.samples), simulatedSeconds / 86400, wallSeconds, simulatedSeconds / wall);
+  printf("%llu passes (%.0f/s), %llu rule evaluations (%.0f/s)\n", static_cast<unsigned long long>(stats.passes),
+         stats.passes / wall, static_cast<unsigned long long>(stats.ruleEvaluations), stats.ruleEvaluations / wall);
+
+  printf("\nRelay  Toggles  On time         Duty\n");
+  for (uint8_t relay = 0; relay < NUM_RELAY_CHANNELS; relay++) {
+    char onTime[32];
+    formatDuration(stats.relayOnMs[relay], onTime, sizeof(onTime));
+    const double duty = stats.simulatedMs > 0 ? 100.0 * stats.relayOnMs[relay] / stats.simulatedMs : 0.0;
+    printf("%-5u  %7u  %-14s  %5.1f%%\n", relay, stats.relayToggles[relay], onTime, duty);
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *rulesPath = nullptr;
+  const char *schedulesPath = nullptr;
+  const char *tracePath = nullptr;
+  const char *logPath = nullptr;
+  const char *convertPath = nullptr;
+  const char *startDay = nullptr;
+  const char *startTime = nullptr;
+  uint32_t generateDays = 0;
+  uint32_t stepSeconds = REPLAY_DEFAULT_STEP_S;
+  uint32_t seed = REPLAY_DEFAULT_SEED;
+  bool verbose = false;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (strcmp(arg, "--rules") == 0 && hasValue) {
+      rulesPath = argv[++i];
+    } else if (strcmp(arg, "--schedules") == 0 && hasValue) {
+      schedulesPath = argv[++i];
+    } else if (strcmp(arg, "--trace") == 0 && hasValue) {
+      tracePath = argv[++i];
+    } else if (strcmp(arg, "--generate") == 0 && hasValue) {
+      generateDays = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(arg, "--step") == 0 && hasValue) {
+      stepSeconds = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(arg, "--seed") == 0 && hasValue) {
+      seed = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(arg, "--start") == 0 && i + 2 < argc) {
+      startDay = argv[++i];
+      startTime = argv[++i];
+    } else if (strcmp(arg, "--log") == 0 && hasValue) {
+      logPath = argv[++i];
+    } else if (strcmp(arg, "--convert") == 0 && hasValue) {
+      convertPath = argv[++i];
+    } else if (strcmp(arg, "--verbose") == 0) {
+      verbose = true;
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  if ((tracePath == nullptr) == (generateDays == 0) || (rulesPath == nullptr && convertPath == nullptr) ||
+      stepSeconds == 0) {
+    usage();
+    return 2;
+  }
+
+  ReplayTrace trace;
+  if (tracePath != nullptr) {
+    if (!replayOpenFile(trace, tracePath)) {
+      fprintf(stderr, "%s: %s\n", tracePath, trace.error);
+      replayClose(trace);
+      return 1;
+    }
+  } else {
+    replayOpenGenerated(trace, generateDays, stepSeconds * 1000, seed);
+  }
+  if (convertPath != nullptr) {
+    const int status = convert(trace, convertPath);
+    replayClose(trace);
+    return status;
+  }
+
+  halNativeSetLogging(verbose);
+  relayOutputBegin();
+  controlBegin();
+  settle();
+  if (!applyBody("rules", rulesPath, ruleSetReplaceRules) ||
+      (schedulesPath != nullptr && !applyBody("schedules", schedulesPath, ruleSetReplaceSchedules)) ||
+      (startDay != nullptr && !setStart(startDay, startTime))) {
+    replayClose(trace);
+    return 1;
+  }
+
+  FILE *log = nullptr;
+  if (logPath != nullptr) {
+    log = fopen(logPath, "w");
+    if (log == nullptr) {
+      fprintf(stderr, "cannot write %s\n", logPath);
+      replayClose(trace);
+      return 1;
+    }
+    fprintf(log, "t_s,relay,state\n");
+  }
+
+  ReplayStats stats;
+  const auto start = std::chrono::steady_clock::now();
+  const bool complete = replayRun(trace, stats, log != nullptr ? logTransition : nullptr, log);
+  const double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  replayClose(trace);
+  if (log != nullptr) {
+    fclose(log);
+  }
+
+  report(stats, wallSeconds);
+  if (!complete) {
+    fprintf(stderr, "trace stopped early: %s\n", trace.error);
+    return 1;
+  }
+  return 0;
+}
+
+#endif // !ARDUINO_ARCH_ESP32 && TERRAHUB_REPLAY
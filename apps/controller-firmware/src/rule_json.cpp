@@ -0,0 +1,192 @@
+/**
+ * TerraHub Controller Firmware - Rule JSON Codec
+ */
+
+#include "rule_json.h"
+
+template <typename T>
+static void patchField(JsonVariant value, T &field) {
+  if (!value.isNull()) {
+    field = value.as<T>();
+  }
+}
+
+// Returns false when the value does not fit; `field` is left unchanged then
+template <size_t Capacity>
+static bool patchText(JsonVariant value, FixedString<Capacity> &field) {
+  if (value.isNull()) {
+    return true;
+  }
+  return field.assign(value.as<const char *>());
+}
+
+static bool isCompoundCondition(JsonObject cond) {
+  return cond.containsKey("all") || cond.containsKey("any") || cond.containsKey("not") ||
+         cond.containsKey("rate") || cond.containsKey("against");
+}
+
+// Append the term for `value` and, depth first, its operands
+static bool readTerm(JsonVariant value, RuleExpression &expression) {
+  JsonObject obj = value.as<JsonObject>();
+  if (obj.isNull() || expression.termCount >= MAX_RULE_TERMS) {
+    return false;
+  }
+
+  RuleTerm &term = expression.terms[expression.termCount++];
+  term = RuleTerm();
+  term.against = RULE_INPUT_NONE;
+
+  JsonVariant all = obj["all"];
+  JsonVariant any = obj["any"];
+  JsonVariant negated = obj["not"];
+  if (!all.isNull() + !any.isNull() + !negated.isNull() > 1) {
+    return false;
+  }
+
+  if (!all.isNull() || !any.isNull()) {
+    JsonArray operands = (all.isNull() ? any : all).as<JsonArray>();
+    if (operands.isNull() || operands.size() == 0) {
+      return false;
+    }
+    term.type = all.isNull() ? RULE_TERM_ANY : RULE_TERM_ALL;
+    for (JsonVariant operand : operands) {
+      if (!readTerm(operand, expression)) {
+        return false;
+      }
+      term.operands++;
+    }
+    return true;
+  }
+
+  if (!negated.isNull()) {
+    term.type = RULE_TERM_NOT;
+    term.operands = 1;
+    return readTerm(negated, expression);
+  }
+
+  const uint8_t slot = sensorSlotFromName(obj["sensor"] | "");
+  term.type = RULE_TERM_COMPARE;
+  term.op = compareOpFromName(obj["op"] | "");
+  if (slot == SENSOR_SLOT_INVALID || term.op == COMPARE_NEVER) {
+    return false;
+  }
+  term.input = (obj["rate"] | false) ? ruleRateInput(slot) : slot;
+  term.threshold = obj["threshold"] | 0.0f;
+  term.hysteresis = obj["hysteresis"] | 0.0f;
+
+  const char *against = obj["against"];
+  if (against != nullptr) {
+    term.against = sensorSlotFromName(against);
+    if (term.against == SENSOR_SLOT_INVALID) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void writeTerm(const RuleExpression &expression, uint8_t &cursor, JsonObject obj) {
+  if (cursor >= expression.termCount) {
+    return;
+  }
+
+  const RuleTerm &term = expression.terms[cursor++];
+  switch (term.type) {
+    case RULE_TERM_ALL:
+    case RULE_TERM_ANY: {
+      JsonArray operands = obj.createNestedArray(term.type == RULE_TERM_ALL ? "all" : "any");
+      for (uint8_t i = 0; i < term.operands; i++) {
+        writeTerm(expression, cursor, operands.createNestedObject());
+      }
+      break;
+    }
+    case RULE_TERM_NOT:
+      writeTerm(expression, cursor, obj.createNestedObject("not"));
+      break;
+    default: {
+      const bool rate = term.input >= SENSOR_SLOT_COUNT;
+      obj["sensor"] = sensorSlotName(rate ? term.input - SENSOR_SLOT_COUNT : term.input);
+      obj["op"] = compareOpName(term.op);
+      obj["threshold"] = term.threshold;
+      obj["hysteresis"] = term.hysteresis;
+      if (rate) {
+        obj["rate"] = true;
+      }
+      if (term.against != RULE_INPUT_NONE) {
+        obj["against"] = sensorSlotName(term.against);
+      }
+      break;
+    }
+  }
+}
+
+bool readRuleJson(JsonObject obj, RuleDefinition &rule) {
+  rule.id.clear();
+  rule.name.clear();
+  rule.enabled = true;
+  rule.priority = 0;
+  rule.condition.sensor.clear();
+  rule.condition.op.clear();
+  rule.condition.threshold = 0;
+  rule.condition.hysteresis = 0;
+  rule.expression.termCount = 0;
+  rule.action.relayIndex = 0;
+  rule.action.turnOn = false;
+  rule.action.minDurationMs = 0;
+  return patchRuleJson(obj, rule);
+}
+
+bool patchRuleJson(JsonObject obj, RuleDefinition &rule) {
+  bool fits = patchText(obj["id"], rule.id);
+  fits &= patchText(obj["name"], rule.name);
+  patchField(obj["enabled"], rule.enabled);
+  patchField(obj["priority"], rule.priority);
+
+  JsonObject cond = obj["condition"].as<JsonObject>();
+  if (isCompoundCondition(cond)) {
+    rule.condition = RuleCondition();
+    rule.expression.termCount = 0;
+    fits &= readTerm(cond, rule.expression);
+  } else if (!cond.isNull()) {
+    if (rule.expression.termCount > 0) {
+      if (cond["sensor"].isNull() || cond["op"].isNull()) {
+        return false;
+      }
+      rule.condition = RuleCondition();
+      rule.expression.termCount = 0;
+    }
+    fits &= patchText(cond["sensor"], rule.condition.sensor);
+    fits &= patchText(cond["op"], rule.condition.op);
+    patchField(cond["threshold"], rule.condition.threshold);
+    patchField(cond["hysteresis"], rule.condition.hysteresis);
+  }
+
+  JsonObject action = obj["action"].as<JsonObject>();
+  patchField(action["relayIndex"], rule.action.relayIndex);
+  patchField(action["turnOn"], rule.action.turnOn);
+  patchField(action["minDurationMs"], rule.action.minDurationMs);
+
+  return fits;
+}
+
+void writeRuleJson(const RuleDefinition &rule, JsonObject obj) {
+  obj["id"] = rule.id.c_str();
+  obj["name"] = rule.name.c_str();
+  obj["enabled"] = rule.enabled;
+  obj["priority"] = rule.priority;
+
+  JsonObject cond = obj.createNestedObject("condition");
+  if (rule.expression.termCount > 0) {
+    uint8_t cursor = 0;
+    writeTerm(rule.expression, cursor, cond);
+  } else {
+    cond["sensor"] = rule.condition.sensor.c_str();
+    cond["op"] = rule.condition.op.c_str();
+    cond["threshold"] = rule.condition.threshold;
+    cond["hysteresis"] = rule.condition.hysteresis;
+  }
+
+  JsonObject action = obj.createNestedObject("action");
+  action["relayIndex"] = rule.action.relayIndex;
+  action["turnOn"] = rule.action.turnOn;
+  action["minDurationMs"] = rule.action.minDurationMs;
+}
@@ -0,0 +1,477 @@
+/**
+ * TerraHub Controller Firmware - Rule and Schedule Set
+ */
+
+#include <ArduinoJson.h>
+#include <memory>
+#include <string.h>
+#include <string>
+#include <type_traits>
+#include "rule_set.h"
+#include "hal.h"
+#include "rule_json.h"
+#include "rule_store.h"
+#include "schedule_json.h"
+#include "timer_queue.h"
+
+// Parsed rule body; strings are copied out of the request buffer
+#define RULE_BODY_JSON_CAPACITY (RULE_JSON_CAPACITY + RULE_JSON_MAX_BYTES)
+
+// A full POST /api/rules body. Compound conditions parse to many small
+// objects, so the pool gets twice the largest body.
+#define RULES_BODY_JSON_CAPACITY (2 * MAX_REQUEST_BODY_BYTES)
+
+// A full POST /api/schedules body; strings are copied out of the request
+#define SCHEDULES_BODY_JSON_CAPACITY \
+  (JSON_ARRAY_SIZE(MAX_SCHEDULES) + \
+   MAX_SCHEDULES * (SCHEDULE_JSON_CAPACITY + MAX_RULE_ID_LENGTH + MAX_RULE_NAME_LENGTH + 80))
+
+// Stored as a version byte followed by the ScheduleDefinition records;
+// bump the version whenever ScheduleDefinition changes layout
+#define SCHEDULE_STORE_VERSION 1
+static_assert(std::is_trivially_copyable<ScheduleDefinition>::value, "schedules are stored as raw records");
+
+static const RuleSetResponse RESPONSE_NO_CONTENT = {204, nullptr};
+static const RuleSetResponse RESPONSE_CREATED = {201, nullptr};
+static const RuleSetResponse RESPONSE_BUSY = {503, "{\"error\":\"Controller busy, retry\"}"};
+static const RuleSetResponse RESPONSE_BAD_RULE = {
+  400, "{\"error\":\"Rule id, name, sensor or op too long, duplicate rule id, or malformed condition\"}"};
+static const RuleSetResponse RESPONSE_UNKNOWN_RULE = {404, "{\"error\":\"Unknown rule\"}"};
+
+static std::vector<RuleDefinition> rules;
+static uint32_t rulesGeneration = 0;
+static std::vector<ScheduleDefinition> schedules;
+static uint32_t programGeneration = 0;  // bumped whenever rules or schedules are replaced
+static ControlProgram *latestProgram = nullptr;
+
+static bool savePending = false;
+static uint32_t saveRequestedAt = 0;  // first unsaved edit
+static uint32_t saveDueAt = 0;        // last edit + RULES_SAVE_DEBOUNCE_MS
+static uint32_t savedRulesCrc = 0;    // CRC of the record currently in NVS
+
+const std::vector<RuleDefinition> &ruleSetRules() {
+  return rules;
+}
+
+uint32_t ruleSetGeneration() {
+  return rulesGeneration;
+}
+
+const std::vector<ScheduleDefinition> &ruleSetSchedules() {
+  return schedules;
+}
+
+const ControlProgram *ruleSetProgram() {
+  return latestProgram;
+}
+
+void ruleSetDrainRetired() {
+  while (ControlProgram *program = controlTakeRetired()) {
+    delete program;
+  }
+}
+
+// ============================================================================
+// Programs
+// ============================================================================
+
+static bool sameCompiledBehaviour(const RuleProgram &programA, const CompiledRule &a, const RuleProgram &programB,
+                                  const CompiledRule &b) {
+  return sameCompiledCondition(programA, a, programB, b) && a.action.relayIndex == b.action.relayIndex &&
+         a.action.turnOn == b.action.turnOn && a.action.minDurationMs == b.action.minDurationMs;
+}
+
+static void markCompiledRuleDirty(const CompiledRule &compiled, SensorMask &sensors, uint32_t &relays) {
+  sensors |= compiled.inputs;
+  if (compiled.action.relayIndex < NUM_RELAY_CHANNELS) {
+    relays |= 1u << compiled.action.relayIndex;
+  }
+}
+
+/**
+ * Compile a new program from `nextRules` and `nextSchedules` and hand it to
+ * the control task. Rules that keep their id carry their active state and
+ * pending minimum-duration timer over to the new program; the task copies
+ * them across when it switches. Schedules need no carry-over: the task puts
+ * each one into the state for the current time.
+ *
+ * When `editedId` is given, only that rule differs from the current set. It
+ * keeps its state only if its condition and action are unchanged, and just
+ * the sensors and relays it used before or after the edit are re-evaluated.
+ * When `rulesReplaced` is set, every sensor and relay is re-evaluated.
+ *
+ * Returns false if the control task's command queue is full.
+ */
+static bool applyProgram(const std::vector<RuleDefinition> &nextRules, const std::vector<ScheduleDefinition> &nextSchedules,
+                         bool rulesReplaced, const RuleId *editedId) {
+  ruleSetDrainRetired();
+
+  const ControlProgram *previous = latestProgram;
+  std::unique_ptr<ControlProgram> next(new ControlProgram());
+  compileRules(nextRules, next->program);
+  const size_t count = next->program.rules.size();
+
+  next->dirtySensors = rulesReplaced ? SENSOR_MASK_ALL : 0;
+  next->dirtyRelays = rulesReplaced ? (1u << NUM_RELAY_CHANNELS) - 1 : 0;
+  if (editedId && previous != nullptr) {
+    for (size_t j = 0; j < previous->ids.size(); j++) {
+      if (previous->ids[j] == *editedId) {
+        markCompiledRuleDirty(previous->program.rules[j], next->dirtySensors, next->dirtyRelays);
+      }
+    }
+  }
+
+  next->ids.resize(count);
+  next->inheritFrom.assign(count, -1);
+  next->states.assign(count, RuleState{0, false, false, 0});
+  next->memo.assign(next->program.nodes.size(), 0);
+  next->active.reset(new std::atomic<bool>[count]);
+  for (size_t i = 0; i < count; i++) {
+    const RuleId &id = nextRules[next->program.rules[i].ruleIndex].id;
+    const bool edited = editedId && id == *editedId;
+    next->ids[i] = id;
+    if (edited) {
+      markCompiledRuleDirty(next->program.rules[i], next->dirtySensors, next->dirtyRelays);
+    }
+
+    bool active = false;
+    for (size_t j = 0; previous != nullptr && j < previous->ids.size(); j++) {
+      if (previous->ids[j] == id) {
+        if (!edited || sameCompiledBehaviour(previous->program, previous->program.rules[j], next->program,
+                                             next->program.rules[i])) {
+          next->inheritFrom[i] = static_cast<int32_t>(j);
+          active = previous->active[j].load(std::memory_order_relaxed);
+        }
+        break;
+      }
+    }
+    // Readers see the inherited state until the task switches over
+    next->active[i].store(active, std::memory_order_relaxed);
+  }
+
+  compileSchedules(nextSchedules, next->schedules);
+  next->scheduleStates.assign(next->schedules.schedules.size(), SCHEDULE_STATE_UNKNOWN);
+
+  // Room for every timer, so the task never grows the heap
+  timerQueueReset(next->timers, count);
+  timerQueueReset(next->scheduleTimers, next->schedules.schedules.size());
+  next->generation = programGeneration + 1;
+
+  if (!controlLoadProgram(next.get())) {
+    return false;
+  }
+  latestProgram = next.release();
+  programGeneration++;
+  return true;
+}
+
+bool ruleSetApplyRules(std::vector<RuleDefinition> &nextRules, const RuleId *editedId) {
+  if (!applyProgram(nextRules, schedules, editedId == nullptr, editedId)) {
+    return false;
+  }
+  rules.swap(nextRules);
+  rulesGeneration++;
+  return true;
+}
+
+// Every rule keeps its state
+bool ruleSetApplySchedules(std::vector<ScheduleDefinition> &nextSchedules) {
+  if (!applyProgram(rules, nextSchedules, false, nullptr)) {
+    return false;
+  }
+  schedules.swap(nextSchedules);
+  return true;
+}
+
+// ============================================================================
+// Requests
+// ============================================================================
+
+static bool parseBody(const char *body, JsonDocument &doc, RuleSetResponse &error) {
+  if (body == nullptr) {
+    error = RuleSetResponse{400, "{\"error\":\"Missing body\"}"};
+    return false;
+  }
+  if (deserializeJson(doc, body)) {
+    error = RuleSetResponse{400, "{\"error\":\"Invalid JSON\"}"};
+    return false;
+  }
+  return true;
+}
+
+static int findRuleIndex(const RuleId &id) {
+  for (size_t i = 0; i < rules.size(); i++) {
+    if (rules[i].id == id) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+// Apply a rule edit and schedule its save
+static RuleSetResponse commitRules(std::vector<RuleDefinition> &nextRules, const RuleId *editedId,
+                                   const RuleSetResponse &success) {
+  if (!ruleSetApplyRules(nextRules, editedId)) {
+    return RESPONSE_BUSY;
+  }
+  ruleSetScheduleSave(halMillis());
+  return success;
+}
+
+RuleSetResponse ruleSetReplaceRules(const char *body) {
+  DynamicJsonDocument doc(RULES_BODY_JSON_CAPACITY);
+  RuleSetResponse error;
+  if (!parseBody(body, doc, error)) {
+    return error;
+  }
+
+  std::vector<RuleDefinition> nextRules;
+  for (JsonObject obj : doc.as<JsonArray>()) {
+    RuleDefinition rule;
+    if (!readRuleJson(obj, rule)) {
+      return RESPONSE_BAD_RULE;
+    }
+    // Edits address rules by id, so two rules may not share one
+    for (const RuleDefinition &other : nextRules) {
+      if (other.id == rule.id) {
+        return RESPONSE_BAD_RULE;
+      }
+    }
+    nextRules.push_back(rule);
+  }
+  return commitRules(nextRules, nullptr, RESPONSE_NO_CONTENT);
+}
+
+RuleSetResponse ruleSetPutRule(const RuleId &id, const char *body) {
+  DynamicJsonDocument doc(RULE_BODY_JSON_CAPACITY);
+  RuleSetResponse error;
+  if (!parseBody(body, doc, error)) {
+    return error;
+  }
+
+  RuleDefinition rule;
+  if (!readRuleJson(doc.as<JsonObject>(), rule)) {
+    return RESPONSE_BAD_RULE;
+  }
+  rule.id = id;
+
+  std::vector<RuleDefinition> nextRules(rules);
+  const int index = findRuleIndex(id);
+  if (index < 0) {
+    nextRules.push_back(rule);
+  } else {
+    nextRules[index] = rule;
+  }
+  return commitRules(nextRules, &id, index < 0 ? RESPONSE_CREATED : RESPONSE_NO_CONTENT);
+}
+
+RuleSetResponse ruleSetPatchRule(const RuleId &id, const char *body) {
+  DynamicJsonDocument doc(RULE_BODY_JSON_CAPACITY);
+  RuleSetResponse error;
+  if (!parseBody(body, doc, error)) {
+    return error;
+  }
+
+  const int index = findRuleIndex(id);
+  if (index < 0) {
+    return RESPONSE_UNKNOWN_RULE;
+  }
+
+  std::vector<RuleDefinition> nextRules(rules);
+  if (!patchRuleJson(doc.as<JsonObject>(), nextRules[index])) {
+    return RESPONSE_BAD_RULE;
+  }
+  // The path names the rule; ids are not renamed through PATCH
+  nextRules[index].id = id;
+  return commitRules(nextRules, &id, RESPONSE_NO_CONTENT);
+}
+
+RuleSetResponse ruleSetDeleteRule(const RuleId &id) {
+  const int index = findRuleIndex(id);
+  if (index < 0) {
+    return RESPONSE_UNKNOWN_RULE;
+  }
+
+  std::vector<RuleDefinition> nextRules(rules);
+  nextRules.erase(nextRules.begin() + index);
+  return commitRules(nextRules, &id, RESPONSE_NO_CONTENT);
+}
+
+RuleSetResponse ruleSetReplaceSchedules(const char *body) {
+  DynamicJsonDocument doc(SCHEDULES_BODY_JSON_CAPACITY);
+  RuleSetResponse error;
+  if (!parseBody(body, doc, error)) {
+    return error;
+  }
+
+  JsonArray array = doc.as<JsonArray>();
+  if (array.size() > MAX_SCHEDULES) {
+    return RuleSetResponse{400, "{\"error\":\"Too many schedules\"}"};
+  }
+
+  std::vector<ScheduleDefinition> nextSchedules;
+  nextSchedules.reserve(array.size());
+  for (JsonObject obj : array) {
+    ScheduleDefinition schedule;
+    if (!readScheduleJson(obj, schedule)) {
+      return RuleSetResponse{
+        400, "{\"error\":\"Schedule id or name too long, unknown day, bad HH:MM time or too many entries\"}"};
+    }
+    if (schedule.nodeId != 1 || schedule.portId == 0 || schedule.portId > NUM_RELAY_CHANNELS) {
+      return RuleSetResponse{400, "{\"error\":\"Only the controller's relay ports (nodeId 1) can be scheduled\"}"};
+    }
+    nextSchedules.push_back(schedule);
+  }
+
+  if (!ruleSetApplySchedules(nextSchedules)) {
+    return RESPONSE_BUSY;
+  }
+  if (!ruleSetSaveSchedules()) {
+    halLog("Failed to save schedules\n");
+  }
+  return RESPONSE_NO_CONTENT;
+}
+
+// ============================================================================
+// Persistence
+// ============================================================================
+
+/**
+ * Load rules from the binary "rules_bin" record. Controllers that still hold
+ * the JSON text written by older firmware under "rules" are migrated once:
+ * the JSON is parsed, rewritten in binary form and the old key removed.
+ */
+static void loadRules() {
+  std::vector<RuleDefinition> storedRules;
+  const size_t length = halNvsBlobLength("rules_bin");
+  if (length > 0) {
+    std::vector<uint8_t> blob(length);
+    halNvsReadBlob("rules_bin", blob.data(), length);
+
+    const RuleStoreResult result = ruleStoreDecode(blob.data(), length, storedRules);
+    if (result != RULE_STORE_OK) {
+      halLog("Stored rules rejected: %s\n", ruleStoreResultName(result));
+      return;
+    }
+    savedRulesCrc = ruleStoreCrc32(blob.data(), length);
+    ruleSetApplyRules(storedRules);
+    return;
+  }
+
+  std::string raw;
+  if (!halNvsReadString("rules", raw) || raw.empty()) {
+    return;
+  }
+
+  DynamicJsonDocument doc(4096);
+  if (deserializeJson(doc, raw.c_str())) {
+    halLog("Failed to parse stored rules\n");
+    return;
+  }
+
+  for (JsonObject obj : doc.as<JsonArray>()) {
+    RuleDefinition rule;
+    if (!readRuleJson(obj, rule)) {
+      halLog("Skipping stored rule with oversized fields\n");
+      continue;
+    }
+    storedRules.push_back(rule);
+  }
+
+  ruleSetApplyRules(storedRules);
+  if (ruleSetSaveRules()) {
+    halNvsRemove("rules");
+    halLog("Migrated %u stored rules to binary format\n", static_cast<unsigned>(rules.size()));
+  }
+}
+
+static void loadSchedules() {
+  const size_t length = halNvsBlobLength("schedules");
+  if (length == 0) {
+    return;
+  }
+  std::vector<uint8_t> blob(length);
+  halNvsReadBlob("schedules", blob.data(), length);
+
+  const size_t count = (length - 1) / sizeof(ScheduleDefinition);
+  if (blob[0] != SCHEDULE_STORE_VERSION || length != 1 + count * sizeof(ScheduleDefinition) || count > MAX_SCHEDULES) {
+    halLog("Stored schedules rejected\n");
+    return;
+  }
+
+  std::vector<ScheduleDefinition> storedSchedules(count);
+  memcpy(storedSchedules.data(), blob.data() + 1, count * sizeof(ScheduleDefinition));
+  ruleSetApplySchedules(storedSchedules);
+}
+
+void ruleSetLoad() {
+  loadRules();
+  loadSchedules();
+}
+
+bool ruleSetSaveRules() {
+  std::vector<uint8_t> blob(ruleStoreEncodedSize(rules));
+  const size_t length = ruleStoreEncode(rules, blob.data(), blob.size());
+  if (length == 0) {
+    halLog("Failed to encode rules for storage\n");
+    return false;
+  }
+
+  // Edits that cancel out (e.g. a rule toggled off and on again) need no write
+  const uint32_t crc = ruleStoreCrc32(blob.data(), length);
+  if (crc == savedRulesCrc) {
+    return true;
+  }
+
+  if (!halNvsWriteBlob("rules_bin", blob.data(), length)) {
+    return false;
+  }
+  savedRulesCrc = crc;
+  return true;
+}
+
+bool ruleSetSaveSchedules() {
+  std::vector<uint8_t> blob(1 + schedules.size() * sizeof(ScheduleDefinition));
+  blob[0] = SCHEDULE_STORE_VERSION;
+  memcpy(blob.data() + 1, schedules.data(), schedules.size() * sizeof(ScheduleDefinition));
+  return halNvsWriteBlob("schedules", blob.data(), blob.size());
+}
+
+void ruleSetScheduleSave(uint32_t now) {
+  if (!savePending) {
+    savePending = true;
+    saveRequestedAt = now;
+  }
+  saveDueAt = now + RULES_SAVE_DEBOUNCE_MS;
+}
+
+bool ruleSetFlushSave(uint32_t now) {
+  if (!savePending) {
+    return false;
+  }
+  if (!deadlineReached(now, saveDueAt) && now - saveRequestedAt < RULES_SAVE_MAX_DELAY_MS) {
+    return false;
+  }
+
+  if (!ruleSetSaveRules()) {
+    // Keep the edit pending and try again once the debounce has passed
+    halLog("Failed to save rules\n");
+    saveRequestedAt = now;
+    saveDueAt = now + RULES_SAVE_DEBOUNCE_MS;
+    return false;
+  }
+  savePending = false;
+  return true;
+}
+
+bool ruleSetSaveDeadline(uint32_t &deadline) {
+  if (!savePending) {
+    return false;
+  }
+  deadline = saveDueAt;
+  const uint32_t latest = saveRequestedAt + RULES_SAVE_MAX_DELAY_MS;
+  if (static_cast<int32_t>(latest - deadline) < 0) {
+    deadline = latest;
+  }
+  return true;
+}
@@ -0,0 +1,238 @@
+/**
+ * TerraHub Controller Firmware - Binary Rule Storage
+ */
+
+#include <string.h>
+#include "rule_store.h"
+
+static const char *const resultNames[] = {
+  "ok",
+  "truncated",
+  "unsupported version",
+  "checksum mismatch",
+  "malformed record"
+};
+
+static const uint8_t FLAG_ENABLED = 0x01;
+static const uint8_t FLAG_TURN_ON = 0x02;
+
+const char *ruleStoreResultName(RuleStoreResult result) {
+  return result <= RULE_STORE_BAD_RECORD ? resultNames[result] : "";
+}
+
+uint32_t ruleStoreCrc32(const uint8_t *data, size_t length) {
+  // Nibble-wise CRC-32 (IEEE 802.3); 64 bytes of table instead of 1 KiB
+  static const uint32_t table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    crc = (crc >> 4) ^ table[crc & 0x0F];
+    crc = (crc >> 4) ^ table[crc & 0x0F];
+  }
+  return ~crc;
+}
+
+// ============================================================================
+// Encoding
+// ============================================================================
+
+struct Writer {
+  uint8_t *data;
+  size_t offset;
+
+  void u8(uint8_t value) { data[offset++] = value; }
+  void u16(uint16_t value) {
+    u8(value & 0xFF);
+    u8(value >> 8);
+  }
+  void u32(uint32_t value) {
+    u16(value & 0xFFFF);
+    u16(value >> 16);
+  }
+  void f32(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    u32(bits);
+  }
+  template <size_t Capacity>
+  void text(const FixedString<Capacity> &value) {
+    u8(value.length());
+    memcpy(data + offset, value.c_str(), value.length());
+    offset += value.length();
+  }
+};
+
+size_t ruleStoreEncodedSize(const std::vector<RuleDefinition> &rules) {
+  size_t size = RULE_STORE_HEADER_BYTES;
+  for (const auto &rule : rules) {
+    size += RULE_STORE_RECORD_FIXED_BYTES + rule.id.length() + rule.name.length() +
+            rule.condition.sensor.length() + rule.condition.op.length() +
+            rule.expression.termCount * RULE_STORE_TERM_BYTES;
+  }
+  return size;
+}
+
+size_t ruleStoreEncode(const std::vector<RuleDefinition> &rules, uint8_t *buffer, size_t capacity) {
+  const size_t size = ruleStoreEncodedSize(rules);
+  if (size > capacity || rules.size() > UINT16_MAX) {
+    return 0;
+  }
+  for (const auto &rule : rules) {
+    if (rule.expression.termCount > MAX_RULE_TERMS) {
+      return 0;
+    }
+  }
+
+  Writer out{buffer, RULE_STORE_HEADER_BYTES};
+  for (const auto &rule : rules) {
+    out.u8((rule.enabled ? FLAG_ENABLED : 0) | (rule.action.turnOn ? FLAG_TURN_ON : 0));
+    out.u8(static_cast<uint8_t>(rule.priority));
+    out.u8(rule.action.relayIndex);
+    out.u8(0);
+    out.f32(rule.condition.threshold);
+    out.f32(rule.condition.hysteresis);
+    out.u32(rule.action.minDurationMs);
+    out.text(rule.id);
+    out.text(rule.name);
+    out.text(rule.condition.sensor);
+    out.text(rule.condition.op);
+    out.u8(rule.expression.termCount);
+    for (uint8_t t = 0; t < rule.expression.termCount; t++) {
+      const RuleTerm &term = rule.expression.terms[t];
+      out.u8(term.type);
+      out.u8(term.operands);
+      out.u8(term.op);
+      out.u8(term.input);
+      out.u8(term.against);
+      out.f32(term.threshold);
+      out.f32(term.hysteresis);
+    }
+  }
+
+  const uint32_t payloadLength = size - RULE_STORE_HEADER_BYTES;
+  Writer header{buffer, 0};
+  header.u8(RULE_STORE_VERSION);
+  header.u8(0);
+  header.u16(rules.size());
+  header.u32(payloadLength);
+  header.u32(ruleStoreCrc32(buffer + RULE_STORE_HEADER_BYTES, payloadLength));
+  return size;
+}
+
+// ============================================================================
+// Decoding
+// ============================================================================
+
+struct Reader {
+  const uint8_t *data;
+  size_t length;
+  size_t offset;
+
+  bool has(size_t count) const { return length - offset >= count; }
+  uint8_t u8() { return data[offset++]; }
+  uint16_t u16() {
+    uint16_t value = data[offset] | (data[offset + 1] << 8);
+    offset += 2;
+    return value;
+  }
+  uint32_t u32() {
+    uint32_t low = u16();
+    return low | (static_cast<uint32_t>(u16()) << 16);
+  }
+  float f32() {
+    uint32_t bits = u32();
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+  template <size_t Capacity>
+  bool text(FixedString<Capacity> &value) {
+    if (!has(1)) return false;
+    const uint8_t count = u8();
+    if (!has(count) || !value.assign(reinterpret_cast<const char *>(data + offset), count)) return false;
+    offset += count;
+    return true;
+  }
+};
+
+RuleStoreResult ruleStoreDecode(const uint8_t *data, size_t length, std::vector<RuleDefinition> &rules) {
+  if (length < RULE_STORE_HEADER_BYTES) {
+    return RULE_STORE_TRUNCATED;
+  }
+
+  Reader header{data, length, 0};
+  const uint8_t version = header.u8();
+  header.u8();
+  const uint16_t count = header.u16();
+  const uint32_t payloadLength = header.u32();
+  const uint32_t crc = header.u32();
+
+  if (version != RULE_STORE_VERSION && version != 1) {
+    return RULE_STORE_BAD_VERSION;
+  }
+  if (length - RULE_STORE_HEADER_BYTES < payloadLength) {
+    return RULE_STORE_TRUNCATED;
+  }
+  if (ruleStoreCrc32(data + RULE_STORE_HEADER_BYTES, payloadLength) != crc) {
+    return RULE_STORE_BAD_CRC;
+  }
+
+  const size_t fixedBytes = version == 1 ? RULE_STORE_V1_RECORD_FIXED_BYTES : RULE_STORE_RECORD_FIXED_BYTES;
+  std::vector<RuleDefinition> decoded;
+  decoded.reserve(count);
+  Reader in{data, RULE_STORE_HEADER_BYTES + payloadLength, RULE_STORE_HEADER_BYTES};
+  for (uint16_t i = 0; i < count; i++) {
+    if (!in.has(fixedBytes)) {
+      return RULE_STORE_BAD_RECORD;
+    }
+
+    RuleDefinition rule;
+    const uint8_t flags = in.u8();
+    rule.enabled = (flags & FLAG_ENABLED) != 0;
+    rule.action.turnOn = (flags & FLAG_TURN_ON) != 0;
+    rule.priority = static_cast<int8_t>(in.u8());
+    rule.action.relayIndex = in.u8();
+    in.u8();
+    rule.condition.threshold = in.f32();
+    rule.condition.hysteresis = in.f32();
+    rule.action.minDurationMs = in.u32();
+
+    if (!in.text(rule.id) || !in.text(rule.name) || !in.text(rule.condition.sensor) ||
+        !in.text(rule.condition.op)) {
+      return RULE_STORE_BAD_RECORD;
+    }
+
+    rule.expression.termCount = 0;
+    if (version >= 2) {
+      if (!in.has(1)) {
+        return RULE_STORE_BAD_RECORD;
+      }
+      const uint8_t termCount = in.u8();
+      if (termCount > MAX_RULE_TERMS || !in.has(termCount * RULE_STORE_TERM_BYTES)) {
+        return RULE_STORE_BAD_RECORD;
+      }
+      for (uint8_t t = 0; t < termCount; t++) {
+        RuleTerm &term = rule.expression.terms[t];
+        const uint8_t type = in.u8();
+        if (type >= RULE_TERM_TYPE_COUNT) {
+          return RULE_STORE_BAD_RECORD;
+        }
+        term.type = static_cast<RuleTermType>(type);
+        term.operands = in.u8();
+        term.op = static_cast<CompareOp>(in.u8());
+        term.input = in.u8();
+        term.against = in.u8();
+        term.threshold = in.f32();
+        term.hysteresis = in.f32();
+      }
+      rule.expression.termCount = termCount;
+    }
+    decoded.push_back(rule);
+  }
+
+  rules.swap(decoded);
+  return RULE_STORE_OK;
+}
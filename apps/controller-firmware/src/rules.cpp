@@ -0,0 +1,422 @@
+/**
+ * TerraHub Controller Firmware - Rules Engine
+ *
+ * Compiles API/NVS rule definitions into the flat program evaluated by the
+ * control loop. All string handling happens here, never per tick.
+ */
+
+#include "rules.h"
+#include "timer_queue.h"
+#include <algorithm>
+#include <string.h>
+#include <unordered_map>
+
+static const char *const compareOpNames[COMPARE_NEVER] = {
+  "gt",
+  "lt",
+  "gte",
+  "lte",
+  "eq"
+};
+
+static const char *const sensorSlotNames[SENSOR_SLOT_COUNT] = {
+  "temperatureC",
+  "humidityPercent",
+  "lightLevelLux"
+};
+
+uint8_t sensorSlotFromName(const char *name) {
+  for (uint8_t slot = 0; slot < SENSOR_SLOT_COUNT; slot++) {
+    if (strcmp(name, sensorSlotNames[slot]) == 0) {
+      return slot;
+    }
+  }
+  return SENSOR_SLOT_INVALID;
+}
+
+const char *sensorSlotName(uint8_t slot) {
+  return slot < SENSOR_SLOT_COUNT ? sensorSlotNames[slot] : "";
+}
+
+CompareOp compareOpFromName(const char *name) {
+  for (uint8_t op = 0; op < COMPARE_NEVER; op++) {
+    if (strcmp(name, compareOpNames[op]) == 0) {
+      return static_cast<CompareOp>(op);
+    }
+  }
+  return COMPARE_NEVER;
+}
+
+const char *compareOpName(uint8_t op) {
+  return op < COMPARE_NEVER ? compareOpNames[op] : "";
+}
+
+// ============================================================================
+// Condition DAG
+// ============================================================================
+
+/**
+ * Builds the program's shared DAG. Nodes are interned: one equal to a node
+ * built before, with the same operands, is reused instead of added. All/any
+ * operands are sorted and deduplicated first, so "a and b" and "b and a"
+ * are the same node.
+ */
+struct ExprBuilder {
+  RuleProgram &program;
+  std::unordered_multimap<uint32_t, uint16_t> interned;  // hash -> node
+};
+
+static uint32_t hashNode(const ExprNode &node, const uint16_t *operands) {
+  // FNV-1a over the fields that make two nodes equal
+  uint32_t hash = 2166136261u;
+  auto mix = [&hash](const void *data, size_t length) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < length; i++) {
+      hash = (hash ^ bytes[i]) * 16777619u;
+    }
+  };
+  mix(&node.type, sizeof(node.type));
+  mix(&node.op, sizeof(node.op));
+  mix(&node.input, sizeof(node.input));
+  mix(&node.against, sizeof(node.against));
+  mix(&node.low, sizeof(node.low));
+  mix(&node.high, sizeof(node.high));
+  mix(operands, node.operandCount * sizeof(uint16_t));
+  return hash;
+}
+
+static bool sameNodeFields(const ExprNode &a, const ExprNode &b) {
+  return a.type == b.type && a.op == b.op && a.input == b.input && a.against == b.against && a.low == b.low &&
+         a.high == b.high && a.operandCount == b.operandCount;
+}
+
+static uint16_t internNode(ExprBuilder &builder, ExprNode node, const uint16_t *operands) {
+  RuleProgram &program = builder.program;
+  const uint32_t hash = hashNode(node, operands);
+  auto range = builder.interned.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    const ExprNode &existing = program.nodes[it->second];
+    if (sameNodeFields(existing, node) &&
+        std::equal(operands, operands + node.operandCount, program.exprOperands.begin() + existing.firstOperand)) {
+      return it->second;
+    }
+  }
+
+  // Indexes are 16 bit; a program that outgrows them compiles the rest of
+  // its rules as never matching
+  if (program.nodes.size() >= RULE_CONDITION_NEVER ||
+      program.exprOperands.size() + node.operandCount > UINT16_MAX) {
+    return RULE_CONDITION_NEVER;
+  }
+
+  node.firstOperand = static_cast<uint16_t>(program.exprOperands.size());
+  program.exprOperands.insert(program.exprOperands.end(), operands, operands + node.operandCount);
+  const uint16_t index = static_cast<uint16_t>(program.nodes.size());
+  program.nodes.push_back(node);
+  builder.interned.emplace(hash, index);
+  return index;
+}
+
+static uint16_t buildCompare(ExprBuilder &builder, CompareOp op, uint8_t input, uint8_t against, float threshold,
+                             float hysteresis) {
+  ExprNode node = ExprNode();
+  node.type = EXPR_COMPARE;
+  node.op = op;
+  node.input = input;
+  node.against = against;
+  node.low = threshold;
+  node.high = threshold;
+  if (op == COMPARE_BAND) {
+    node.low = threshold - hysteresis;
+    node.high = threshold + hysteresis;
+  }
+  return internNode(builder, node, nullptr);
+}
+
+static uint16_t buildCombination(ExprBuilder &builder, ExprNodeType type, std::vector<uint16_t> &operands) {
+  if (std::find(operands.begin(), operands.end(), RULE_CONDITION_NEVER) != operands.end()) {
+    return RULE_CONDITION_NEVER;
+  }
+
+  if (type == EXPR_NOT) {
+    const ExprNode &operand = builder.program.nodes[operands[0]];
+    if (operand.type == EXPR_NOT) {
+      return builder.program.exprOperands[operand.firstOperand];  // not not x = x
+    }
+  } else {
+    std::sort(operands.begin(), operands.end());
+    operands.erase(std::unique(operands.begin(), operands.end()), operands.end());
+    if (operands.size() == 1) {
+      return operands[0];
+    }
+  }
+
+  ExprNode node = ExprNode();
+  node.type = type;
+  node.against = RULE_INPUT_NONE;
+  node.operandCount = static_cast<uint16_t>(operands.size());
+  return internNode(builder, node, operands.data());
+}
+
+/**
+ * Build the subtree of the term at `cursor`, advancing past it. Returns
+ * RULE_CONDITION_NEVER if the terms are malformed, which only happens for
+ * corrupted storage since readRuleJson() validates them.
+ */
+static uint16_t buildTerm(ExprBuilder &builder, const RuleExpression &expression, uint8_t &cursor, SensorMask &inputs) {
+  if (cursor >= expression.termCount) {
+    return RULE_CONDITION_NEVER;
+  }
+
+  const RuleTerm &term = expression.terms[cursor++];
+  switch (term.type) {
+    case RULE_TERM_COMPARE: {
+      const bool againstValid = term.against == RULE_INPUT_NONE || term.against < RULE_INPUT_COUNT;
+      if (term.op >= COMPARE_NEVER || term.input >= RULE_INPUT_COUNT || !againstValid) {
+        return RULE_CONDITION_NEVER;
+      }
+      inputs |= 1u << term.input;
+      if (term.against != RULE_INPUT_NONE) {
+        inputs |= 1u << term.against;
+      }
+      return buildCompare(builder, term.op, term.input, term.against, term.threshold, term.hysteresis);
+    }
+
+    case RULE_TERM_ALL:
+    case RULE_TERM_ANY:
+    case RULE_TERM_NOT: {
+      if (term.operands == 0 || (term.type == RULE_TERM_NOT && term.operands != 1)) {
+        return RULE_CONDITION_NEVER;
+      }
+      std::vector<uint16_t> operands;
+      operands.reserve(term.operands);
+      for (uint8_t i = 0; i < term.operands; i++) {
+        operands.push_back(buildTerm(builder, expression, cursor, inputs));
+      }
+      const ExprNodeType type = term.type == RULE_TERM_ALL ? EXPR_ALL : term.type == RULE_TERM_ANY ? EXPR_ANY : EXPR_NOT;
+      return buildCombination(builder, type, operands);
+    }
+
+    default:
+      return RULE_CONDITION_NEVER;
+  }
+}
+
+static uint16_t buildCondition(ExprBuilder &builder, const RuleDefinition &rule, SensorMask &inputs) {
+  if (rule.expression.termCount == 0) {
+    const CompareOp op = compareOpFromName(rule.condition.op.c_str());
+    const uint8_t slot = sensorSlotFromName(rule.condition.sensor.c_str());
+    if (op == COMPARE_NEVER || slot == SENSOR_SLOT_INVALID) {
+      return RULE_CONDITION_NEVER;
+    }
+    inputs |= 1u << slot;
+    return buildCompare(builder, op, slot, RULE_INPUT_NONE, rule.condition.threshold, rule.condition.hysteresis);
+  }
+
+  uint8_t cursor = 0;
+  const uint16_t root = buildTerm(builder, rule.expression, cursor, inputs);
+  return cursor == rule.expression.termCount ? root : RULE_CONDITION_NEVER;
+}
+
+static CompiledRule compileRule(ExprBuilder &builder, const RuleDefinition &rule, uint16_t ruleIndex) {
+  CompiledRule compiled;
+  compiled.inputs = 0;
+  compiled.condition = buildCondition(builder, rule, compiled.inputs);
+  compiled.priority = rule.priority;
+  compiled.ruleIndex = ruleIndex;
+  compiled.action = rule.action;
+  if (compiled.action.minDurationMs > TIMER_MAX_DELAY_MS) {
+    compiled.action.minDurationMs = TIMER_MAX_DELAY_MS;
+  }
+
+  if (compiled.condition == RULE_CONDITION_NEVER) {
+    compiled.inputs = 0;
+  }
+  return compiled;
+}
+
+/**
+ * Drop nodes no rule reaches: folding "not not x" leaves the inner "not"
+ * behind, and a malformed rule the nodes built before it was rejected.
+ * Operands always precede their parents, so one backward sweep finds every
+ * reachable node and renumbering keeps operand lists sorted.
+ */
+static void pruneNodes(RuleProgram &program) {
+  std::vector<uint8_t> reachable(program.nodes.size(), 0);
+  for (const CompiledRule &compiled : program.rules) {
+    if (compiled.condition != RULE_CONDITION_NEVER) reachable[compiled.condition] = 1;
+  }
+  for (size_t i = program.nodes.size(); i-- > 0;) {
+    if (!reachable[i]) continue;
+    const ExprNode &node = program.nodes[i];
+    for (uint16_t j = 0; j < node.operandCount; j++) {
+      reachable[program.exprOperands[node.firstOperand + j]] = 1;
+    }
+  }
+
+  std::vector<uint16_t> renumbered(program.nodes.size(), RULE_CONDITION_NEVER);
+  std::vector<ExprNode> nodes;
+  std::vector<uint16_t> operands;
+  for (size_t i = 0; i < program.nodes.size(); i++) {
+    if (!reachable[i]) continue;
+    ExprNode node = program.nodes[i];
+    const uint16_t first = node.firstOperand;
+    node.firstOperand = static_cast<uint16_t>(operands.size());
+    for (uint16_t j = 0; j < node.operandCount; j++) {
+      operands.push_back(renumbered[program.exprOperands[first + j]]);
+    }
+    renumbered[i] = static_cast<uint16_t>(nodes.size());
+    nodes.push_back(node);
+  }
+
+  for (CompiledRule &compiled : program.rules) {
+    if (compiled.condition != RULE_CONDITION_NEVER) compiled.condition = renumbered[compiled.condition];
+  }
+  program.nodes.swap(nodes);
+  program.exprOperands.swap(operands);
+}
+
+/**
+ * Bucket program indices by the buckets each rule belongs to (a bit mask),
+ * keeping program order within each bucket.
+ */
+template <size_t bucketCount, typename BucketsFn>
+static void buildIndex(const std::vector<CompiledRule> &rules, BucketsFn buckets, uint16_t (&start)[bucketCount + 1],
+                       std::vector<uint16_t> &entries) {
+  uint16_t counts[bucketCount] = {0};
+  for (const CompiledRule &compiled : rules) {
+    const uint32_t mask = buckets(compiled);
+    for (size_t bucket = 0; bucket < bucketCount; bucket++) {
+      if (mask & (1u << bucket)) counts[bucket]++;
+    }
+  }
+
+  start[0] = 0;
+  for (size_t bucket = 0; bucket < bucketCount; bucket++) {
+    start[bucket + 1] = start[bucket] + counts[bucket];
+  }
+
+  entries.assign(start[bucketCount], 0);
+  uint16_t cursor[bucketCount];
+  memcpy(cursor, start, sizeof(cursor));
+  for (size_t i = 0; i < rules.size(); i++) {
+    const uint32_t mask = buckets(rules[i]);
+    for (size_t bucket = 0; bucket < bucketCount; bucket++) {
+      if (mask & (1u << bucket)) entries[cursor[bucket]++] = static_cast<uint16_t>(i);
+    }
+  }
+}
+
+void compileRules(const std::vector<RuleDefinition> &rules, RuleProgram &program) {
+  program.rules.clear();
+  program.rules.reserve(rules.size());
+  program.nodes.clear();
+  program.exprOperands.clear();
+
+  ExprBuilder builder{program, {}};
+  for (size_t i = 0; i < rules.size(); i++) {
+    if (!rules[i].enabled) continue;
+    program.rules.push_back(compileRule(builder, rules[i], static_cast<uint16_t>(i)));
+  }
+  pruneNodes(program);
+
+  // Rules that can never match are left out of both indexes
+  buildIndex<RULE_INPUT_COUNT>(program.rules, [](const CompiledRule &compiled) -> uint32_t {
+    return compiled.inputs;
+  }, program.inputRuleStart, program.inputRules);
+
+  buildIndex<NUM_RELAY_CHANNELS>(program.rules, [](const CompiledRule &compiled) -> uint32_t {
+    const bool drives = compiled.condition != RULE_CONDITION_NEVER && compiled.action.relayIndex < NUM_RELAY_CHANNELS;
+    return drives ? 1u << compiled.action.relayIndex : 0;
+  }, program.relayRuleStart, program.relayRules);
+}
+
+// Operands of all/any are deduplicated and nodes interned, so within one
+// program no two operands of a node are equal and matching them up one by
+// one is enough
+static bool sameNode(const RuleProgram &a, uint16_t nodeA, const RuleProgram &b, uint16_t nodeB) {
+  const ExprNode &x = a.nodes[nodeA];
+  const ExprNode &y = b.nodes[nodeB];
+  if (!sameNodeFields(x, y)) {
+    return false;
+  }
+
+  for (uint16_t i = 0; i < x.operandCount; i++) {
+    const uint16_t operand = a.exprOperands[x.firstOperand + i];
+    bool found = false;
+    for (uint16_t j = 0; j < y.operandCount && !found; j++) {
+      found = sameNode(a, operand, b, b.exprOperands[y.firstOperand + j]);
+    }
+    if (!found) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool sameCompiledCondition(const RuleProgram &a, const CompiledRule &ruleA, const RuleProgram &b,
+                           const CompiledRule &ruleB) {
+  if (ruleA.condition == RULE_CONDITION_NEVER || ruleB.condition == RULE_CONDITION_NEVER) {
+    return ruleA.condition == ruleB.condition;
+  }
+  return sameNode(a, ruleA.condition, b, ruleB.condition);
+}
+
+// ============================================================================
+// Evaluation
+// ============================================================================
+
+static bool evaluateCompare(const ExprNode &node, const RuleInputs &inputs) {
+  const float value = inputs.values[node.input];
+  const float offset = node.against == RULE_INPUT_NONE ? 0.0f : inputs.values[node.against];
+  switch (node.op) {
+    case COMPARE_GT: return value > offset + node.low;
+    case COMPARE_LT: return value < offset + node.low;
+    case COMPARE_GTE: return value >= offset + node.low;
+    case COMPARE_LTE: return value <= offset + node.low;
+    case COMPARE_BAND: return value >= offset + node.low && value <= offset + node.high;
+    default: return false;
+  }
+}
+
+static bool evaluateNode(uint16_t index, ExprEvaluation &evaluation) {
+  uint32_t &stamp = evaluation.memo[index];
+  if ((stamp >> 1) == evaluation.round) {
+    return (stamp & 1) != 0;
+  }
+
+  const RuleProgram &program = *evaluation.program;
+  const ExprNode &node = program.nodes[index];
+  const uint16_t *operands = program.exprOperands.data() + node.firstOperand;
+  bool result = false;
+  switch (node.type) {
+    case EXPR_COMPARE:
+      result = evaluateCompare(node, *evaluation.inputs);
+      break;
+    case EXPR_ALL:
+      result = true;
+      for (uint16_t i = 0; i < node.operandCount && result; i++) {
+        result = evaluateNode(operands[i], evaluation);
+      }
+      break;
+    case EXPR_ANY:
+      for (uint16_t i = 0; i < node.operandCount && !result; i++) {
+        result = evaluateNode(operands[i], evaluation);
+      }
+      break;
+    case EXPR_NOT:
+      result = !evaluateNode(operands[0], evaluation);
+      break;
+  }
+
+  evaluation.nodesEvaluated++;
+  stamp = (evaluation.round << 1) | (result ? 1 : 0);
+  return result;
+}
+
+bool evaluateCompiledRule(const CompiledRule &rule, ExprEvaluation &evaluation) {
+  if (rule.condition == RULE_CONDITION_NEVER) {
+    return false;
+  }
+  return evaluateNode(rule.condition, evaluation);
+}
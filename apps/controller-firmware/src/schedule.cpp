@@ -0,0 +1,110 @@
+/**
+ * TerraHub Controller Firmware - Time-of-Day Schedules
+ */
+
+#include "schedule.h"
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+static const char *const scheduleDayNames[SCHEDULE_DAY_COUNT] = {
+  "monday",
+  "tuesday",
+  "wednesday",
+  "thursday",
+  "friday",
+  "saturday",
+  "sunday"
+};
+
+const char *scheduleDayName(uint8_t day) {
+  return day < SCHEDULE_DAY_COUNT ? scheduleDayNames[day] : "";
+}
+
+uint8_t scheduleDayFromName(const char *name) {
+  for (uint8_t day = 0; day < SCHEDULE_DAY_COUNT; day++) {
+    if (strcmp(name, scheduleDayNames[day]) == 0) {
+      return day;
+    }
+  }
+  return SCHEDULE_DAY_COUNT;
+}
+
+bool scheduleParseTime(const char *text, uint16_t &minuteOfDay) {
+  if (text == nullptr || strlen(text) != 5 || text[2] != ':') {
+    return false;
+  }
+  for (uint8_t i : {0, 1, 3, 4}) {
+    if (text[i] < '0' || text[i] > '9') return false;
+  }
+  const uint16_t hours = (text[0] - '0') * 10 + (text[1] - '0');
+  const uint16_t minutes = (text[3] - '0') * 10 + (text[4] - '0');
+  if (hours > 23 || minutes > 59) {
+    return false;
+  }
+  minuteOfDay = hours * 60 + minutes;
+  return true;
+}
+
+void scheduleFormatTime(uint16_t minuteOfDay, char *text) {
+  snprintf(text, 6, "%02u:%02u", static_cast<unsigned>(minuteOfDay / 60 % 24), static_cast<unsigned>(minuteOfDay % 60));
+}
+
+void compileSchedules(const std::vector<ScheduleDefinition> &schedules, ScheduleProgram &program) {
+  program.schedules.clear();
+  program.schedules.reserve(schedules.size());
+
+  for (size_t i = 0; i < schedules.size(); i++) {
+    const ScheduleDefinition &schedule = schedules[i];
+    if (!schedule.enabled || schedule.days == 0 || schedule.entryCount == 0 || schedule.portId == 0 ||
+        schedule.portId > NUM_RELAY_CHANNELS) {
+      continue;
+    }
+
+    CompiledSchedule compiled;
+    compiled.relayIndex = schedule.portId - 1;
+    compiled.priority = schedule.priority;
+    compiled.scheduleIndex = static_cast<uint16_t>(i);
+    for (uint8_t day = 0; day < SCHEDULE_DAY_COUNT; day++) {
+      if (!(schedule.days & (1u << day))) continue;
+      for (uint8_t e = 0; e < schedule.entryCount && e < MAX_SCHEDULE_ENTRIES; e++) {
+        const uint32_t weekMs = day * SCHEDULE_DAY_MS + schedule.entries[e].minuteOfDay * 60000UL;
+        compiled.transitions.push_back(ScheduleTransition{weekMs, schedule.entries[e].state});
+      }
+    }
+
+    // Stable, so of two entries at the same time the later one wins
+    std::stable_sort(compiled.transitions.begin(), compiled.transitions.end(),
+                     [](const ScheduleTransition &a, const ScheduleTransition &b) { return a.weekMs < b.weekMs; });
+    program.schedules.push_back(std::move(compiled));
+  }
+}
+
+// First transition strictly after `weekMs`; transitions.size() if none
+static size_t nextTransition(const CompiledSchedule &schedule, uint32_t weekMs) {
+  size_t low = 0;
+  size_t high = schedule.transitions.size();
+  while (low < high) {
+    const size_t mid = (low + high) / 2;
+    if (schedule.transitions[mid].weekMs <= weekMs) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+bool scheduleStateAt(const CompiledSchedule &schedule, uint32_t weekMs) {
+  const size_t next = nextTransition(schedule, weekMs);
+  const size_t previous = next > 0 ? next - 1 : schedule.transitions.size() - 1;
+  return schedule.transitions[previous].state;
+}
+
+uint32_t scheduleMsUntilNext(const CompiledSchedule &schedule, uint32_t weekMs) {
+  const size_t next = nextTransition(schedule, weekMs);
+  if (next < schedule.transitions.size()) {
+    return schedule.transitions[next].weekMs - weekMs;
+  }
+  return SCHEDULE_WEEK_MS - weekMs + schedule.transitions[0].weekMs;
+}
@@ -0,0 +1,68 @@
+/**
+ * TerraHub Controller Firmware - Schedule JSON Codec
+ */
+
+#include "schedule_json.h"
+
+bool readScheduleJson(JsonObject obj, ScheduleDefinition &schedule) {
+  schedule = ScheduleDefinition();
+  bool valid = schedule.id.assign(obj["id"] | "");
+  valid &= schedule.name.assign(obj["name"] | "");
+  schedule.enabled = obj["enabled"] | true;
+  schedule.priority = obj["priority"] | 0;
+  schedule.nodeId = obj["nodeId"] | 1;
+  schedule.portId = obj["portId"] | 0;
+
+  JsonVariant days = obj["days"];
+  if (days.isNull()) {
+    schedule.days = SCHEDULE_EVERY_DAY;
+  } else {
+    for (JsonVariant day : days.as<JsonArray>()) {
+      const uint8_t index = scheduleDayFromName(day | "");
+      if (index >= SCHEDULE_DAY_COUNT) {
+        return false;
+      }
+      schedule.days |= 1u << index;
+    }
+  }
+
+  JsonArray entries = obj["entries"].as<JsonArray>();
+  if (entries.size() > MAX_SCHEDULE_ENTRIES) {
+    return false;
+  }
+  for (JsonObject entry : entries) {
+    ScheduleEntry &target = schedule.entries[schedule.entryCount];
+    if (!scheduleParseTime(entry["time"] | "", target.minuteOfDay)) {
+      return false;
+    }
+    target.state = entry["state"] | false;
+    schedule.entryCount++;
+  }
+
+  return valid;
+}
+
+void writeScheduleJson(const ScheduleDefinition &schedule, JsonObject obj) {
+  obj["id"] = schedule.id.c_str();
+  obj["name"] = schedule.name.c_str();
+  obj["enabled"] = schedule.enabled;
+  obj["priority"] = schedule.priority;
+  obj["nodeId"] = schedule.nodeId;
+  obj["portId"] = schedule.portId;
+
+  JsonArray days = obj.createNestedArray("days");
+  for (uint8_t day = 0; day < SCHEDULE_DAY_COUNT; day++) {
+    if (schedule.days & (1u << day)) {
+      days.add(scheduleDayName(day));
+    }
+  }
+
+  JsonArray entries = obj.createNestedArray("entries");
+  for (uint8_t i = 0; i < schedule.entryCount; i++) {
+    char time[6];
+    scheduleFormatTime(schedule.entries[i].minuteOfDay, time);
+    JsonObject entry = entries.createNestedObject();
+    entry["time"] = static_cast<char *>(time);  // copied into the document
+    entry["state"] = schedule.entries[i].state;
+  }
+}
@@ -0,0 +1,231 @@
+/**
+ * TerraHub Controller Firmware - Sensor History
+ *
+ * Buckets are aligned to multiples of their length since boot, so bucket
+ * number `n` of a tier always starts at n * bucketSeconds and lives in ring
+ * slot n % bucketCount. Every tier aggregates the raw samples itself; the
+ * coarser tiers are not derived from the finer ones.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "sensor_history.h"
+
+#define HISTORY_TOTAL_BUCKETS (HISTORY_TIER0_BUCKETS + HISTORY_TIER1_BUCKETS + HISTORY_TIER2_BUCKETS)
+
+struct HistoryBucket {
+  int16_t min;
+  int16_t max;
+  int16_t mean;
+};
+
+// Aggregates of the bucket still being filled
+struct OpenBucket {
+  float min;
+  float max;
+  float sum;
+  uint16_t count;
+};
+
+struct Tier {
+  uint32_t bucketSeconds;
+  uint16_t bucketCount;
+  uint16_t offset;          // first ring slot in `buckets`
+  uint32_t openBucket;      // absolute number of the bucket being filled
+  OpenBucket open[SENSOR_SLOT_COUNT];
+};
+
+// Value of one raw step per slot: 0.01 degC, 0.01 %RH, 4 lux (up to ~131 klx)
+static const float slotScales[SENSOR_SLOT_COUNT] = {0.01f, 0.01f, 4.0f};
+
+static Tier tiers[HISTORY_TIER_COUNT] = {
+  {HISTORY_TIER0_SECONDS, HISTORY_TIER0_BUCKETS, 0, 0, {}},
+  {HISTORY_TIER1_SECONDS, HISTORY_TIER1_BUCKETS, HISTORY_TIER0_BUCKETS, 0, {}},
+  {HISTORY_TIER2_SECONDS, HISTORY_TIER2_BUCKETS, HISTORY_TIER0_BUCKETS + HISTORY_TIER1_BUCKETS, 0, {}}
+};
+static HistoryBucket buckets[HISTORY_TOTAL_BUCKETS][SENSOR_SLOT_COUNT];
+
+// Seconds since boot, carried across millis() wraparound
+static uint32_t lastMs = 0;
+static uint32_t carryMs = 0;
+static uint32_t uptimeSeconds = 0;
+
+static int16_t quantize(float value, uint8_t slot) {
+  const float steps = roundf(value / slotScales[slot]);
+  if (steps > 32767.0f) return 32767;
+  if (steps < -32767.0f) return -32767;
+  return static_cast<int16_t>(steps);
+}
+
+static void resetOpen(Tier &tier) {
+  for (uint8_t slot = 0; slot < SENSOR_SLOT_COUNT; slot++) {
+    tier.open[slot] = OpenBucket{0.0f, 0.0f, 0.0f, 0};
+  }
+}
+
+static HistoryBucket openAggregate(const Tier &tier, uint8_t slot) {
+  const OpenBucket &open = tier.open[slot];
+  if (open.count == 0) {
+    return HistoryBucket{HISTORY_EMPTY, HISTORY_EMPTY, HISTORY_EMPTY};
+  }
+  return HistoryBucket{quantize(open.min, slot), quantize(open.max, slot), quantize(open.sum / open.count, slot)};
+}
+
+static void storeBucket(Tier &tier, uint32_t bucket, bool withData) {
+  HistoryBucket *row = buckets[tier.offset + bucket % tier.bucketCount];
+  for (uint8_t slot = 0; slot < SENSOR_SLOT_COUNT; slot++) {
+    row[slot] = withData ? openAggregate(tier, slot) : HistoryBucket{HISTORY_EMPTY, HISTORY_EMPTY, HISTORY_EMPTY};
+  }
+}
+
+/**
+ * Close the open bucket and move on to `bucket`, marking any buckets skipped
+ * in between as empty (at most one ring's worth)
+ */
+static void advanceTier(Tier &tier, uint32_t bucket) {
+  storeBucket(tier, tier.openBucket, true);
+  uint32_t skipped = bucket - tier.openBucket - 1;
+  if (skipped > tier.bucketCount) skipped = tier.bucketCount;
+  for (uint32_t i = 0; i < skipped; i++) {
+    storeBucket(tier, bucket - 1 - i, false);
+  }
+  tier.openBucket = bucket;
+  resetOpen(tier);
+}
+
+void historyBegin(uint32_t nowMs) {
+  for (size_t i = 0; i < HISTORY_TOTAL_BUCKETS; i++) {
+    for (uint8_t slot = 0; slot < SENSOR_SLOT_COUNT; slot++) {
+      buckets[i][slot] = HistoryBucket{HISTORY_EMPTY, HISTORY_EMPTY, HISTORY_EMPTY};
+    }
+  }
+  lastMs = nowMs;
+  carryMs = 0;
+  uptimeSeconds = nowMs / 1000;
+  for (uint8_t t = 0; t < HISTORY_TIER_COUNT; t++) {
+    tiers[t].openBucket = uptimeSeconds / tiers[t].bucketSeconds;
+    resetOpen(tiers[t]);
+  }
+}
+
+void historyAppend(const SensorValues &values, uint32_t nowMs) {
+  carryMs += nowMs - lastMs;
+  lastMs = nowMs;
+  uptimeSeconds += carryMs / 1000;
+  carryMs %= 1000;
+
+  for (uint8_t t = 0; t < HISTORY_TIER_COUNT; t++) {
+    Tier &tier = tiers[t];
+    const uint32_t bucket = uptimeSeconds / tier.bucketSeconds;
+    if (bucket != tier.openBucket) {
+      advanceTier(tier, bucket);
+    }
+
+    for (uint8_t slot = 0; slot < SENSOR_SLOT_COUNT; slot++) {
+      const float value = values.slots[slot];
+      if (isnan(value)) continue;
+      OpenBucket &open = tier.open[slot];
+      if (open.count == 0 || value < open.min) open.min = value;
+      if (open.count == 0 || value > open.max) open.max = value;
+      open.sum += value;
+      open.count++;
+    }
+  }
+}
+
+HistoryTierInfo historyTier(uint8_t tier) {
+  if (tier >= HISTORY_TIER_COUNT) {
+    return HistoryTierInfo{0, 0};
+  }
+  return HistoryTierInfo{tiers[tier].bucketSeconds, tiers[tier].bucketCount};
+}
+
+size_t historyMemoryBytes() {
+  return sizeof(buckets) + sizeof(tiers);
+}
+
+// ============================================================================
+// Export
+// ============================================================================
+
+static void putU16(uint8_t *data, uint16_t value) {
+  data[0] = value & 0xFF;
+  data[1] = value >> 8;
+}
+
+static void putU32(uint8_t *data, uint32_t value) {
+  putU16(data, value & 0xFFFF);
+  putU16(data + 2, value >> 16);
+}
+
+bool historyExportBegin(HistoryExport &exp, uint8_t tier, uint32_t sinceSeconds) {
+  if (tier >= HISTORY_TIER_COUNT) {
+    return false;
+  }
+  const Tier &source = tiers[tier];
+
+  // The ring plus the open bucket, back to boot at most
+  uint32_t first = source.openBucket >= source.bucketCount ? source.openBucket - source.bucketCount + 1 : 0;
+  if (sinceSeconds > 0 && sinceSeconds < uptimeSeconds) {
+    const uint32_t sinceBucket = (uptimeSeconds - sinceSeconds) / source.bucketSeconds;
+    if (sinceBucket > first) first = sinceBucket;
+  }
+
+  exp.tier = tier;
+  exp.firstBucket = first;
+  exp.bucketCount = source.openBucket - first + 1;
+  exp.totalBytes = HISTORY_HEADER_BYTES + static_cast<size_t>(SENSOR_SLOT_COUNT) * 3 * exp.bucketCount * 2;
+  exp.position = 0;
+
+  uint8_t *header = exp.header;
+  header[0] = HISTORY_FORMAT_VERSION;
+  header[1] = tier;
+  header[2] = SENSOR_SLOT_COUNT;
+  header[3] = 0;
+  putU32(header + 4, source.bucketSeconds);
+  putU32(header + 8, first * source.bucketSeconds);
+  putU32(header + 12, uptimeSeconds);
+  putU16(header + 16, exp.bucketCount);
+  putU16(header + 18, 0);
+  for (uint8_t slot = 0; slot < SENSOR_SLOT_COUNT; slot++) {
+    uint32_t bits;
+    memcpy(&bits, &slotScales[slot], sizeof(bits));
+    putU32(header + 20 + 4 * slot, bits);
+  }
+  return true;
+}
+
+static HistoryBucket bucketAt(const Tier &tier, uint32_t bucket, uint8_t slot) {
+  if (bucket == tier.openBucket) {
+    return openAggregate(tier, slot);
+  }
+  // Newer than the open bucket can only mean the clock was reset; older
+  // than the ring means it has been overwritten since the export began
+  if (bucket > tier.openBucket || tier.openBucket - bucket >= tier.bucketCount) {
+    return HistoryBucket{HISTORY_EMPTY, HISTORY_EMPTY, HISTORY_EMPTY};
+  }
+  return buckets[tier.offset + bucket % tier.bucketCount][slot];
+}
+
+size_t historyExportRead(HistoryExport &exp, uint8_t *buffer, size_t maxLen) {
+  size_t written = 0;
+  while (written < maxLen && exp.position < HISTORY_HEADER_BYTES) {
+    buffer[written++] = exp.header[exp.position++];
+  }
+
+  const Tier &tier = tiers[exp.tier];
+  while (written < maxLen && exp.position < exp.totalBytes) {
+    // Element index across the columns: slot, then min/max/mean, then bucket
+    const size_t element = (exp.position - HISTORY_HEADER_BYTES) / 2;
+    const uint16_t index = element % exp.bucketCount;
+    const uint8_t column = (element / exp.bucketCount) % 3;
+    const uint8_t slot = element / (static_cast<size_t>(exp.bucketCount) * 3);
+
+    const HistoryBucket bucket = bucketAt(tier, exp.firstBucket + index, slot);
+    const int16_t value = column == 0 ? bucket.min : column == 1 ? bucket.max : bucket.mean;
+    const uint16_t raw = static_cast<uint16_t>(value);
+    buffer[written++] = (exp.position - HISTORY_HEADER_BYTES) % 2 == 0 ? raw & 0xFF : raw >> 8;
+    exp.position++;
+  }
+  return written;
+}
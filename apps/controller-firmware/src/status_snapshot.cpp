@@ -0,0 +1,171 @@
+/**
+ * TerraHub Controller Firmware - Cached Status Snapshots
+ *
+ * Cache bookkeeping, If-None-Match matching and the /api/status document.
+ */
+
+#include <ArduinoJson.h>
+#include <stdio.h>
+#include <string.h>
+#include "status_snapshot.h"
+#include "relay_output.h"
+#include "rule_store.h"
+#include "rules.h"
+
+// Worst-case /api/status document; every string is a literal or outlives it
+#define STATUS_JSON_CAPACITY \
+  (JSON_OBJECT_SIZE(20) + 3 * JSON_ARRAY_SIZE(NUM_RELAY_CHANNELS) + 2 * JSON_ARRAY_SIZE(NUM_CURRENT_SENSORS) + \
+   2 * JSON_OBJECT_SIZE(SENSOR_SLOT_COUNT) + JSON_OBJECT_SIZE(5) + JSON_OBJECT_SIZE(6) + JSON_OBJECT_SIZE(8) + \
+   JSON_OBJECT_SIZE(POWER_STATE_COUNT))
+
+// ============================================================================
+// Cache
+// ============================================================================
+
+bool statusCacheStale(const StatusCache &cache, const void *key, size_t keyLength, uint32_t now,
+                      uint32_t maxAgeMs) {
+  return cache.body == nullptr || now - cache.builtAt >= maxAgeMs || cache.key.size() != keyLength ||
+         memcmp(cache.key.data(), key, keyLength) != 0;
+}
+
+void statusCacheStore(StatusCache &cache, const void *key, size_t keyLength, uint32_t now, std::string &&body) {
+  // Same length every time, so the key reuses its buffer after the first build
+  cache.key.assign(static_cast<const char *>(key), keyLength);
+  const uint32_t crc = ruleStoreCrc32(reinterpret_cast<const uint8_t *>(body.data()), body.size());
+  snprintf(cache.etag, sizeof(cache.etag), "\"%08lx\"", static_cast<unsigned long>(crc));
+  cache.body = std::make_shared<const std::string>(std::move(body));
+  cache.version++;
+  cache.builtAt = now;
+}
+
+bool statusCacheMatches(const StatusCache &cache, const char *ifNoneMatch) {
+  if (cache.body == nullptr || ifNoneMatch == nullptr) {
+    return false;
+  }
+  const size_t etagLength = strlen(cache.etag);
+  const char *cursor = ifNoneMatch;
+  while (*cursor != '\0') {
+    while (*cursor == ' ' || *cursor == '\t' || *cursor == ',') cursor++;
+    const char *end = cursor;
+    while (*end != '\0' && *end != ',') end++;
+    const char *tag = cursor;
+    size_t length = end - cursor;
+    while (length > 0 && (tag[length - 1] == ' ' || tag[length - 1] == '\t')) length--;
+    // If-None-Match compares weakly: W/"x" names the same body as "x"
+    if (length > 2 && tag[0] == 'W' && tag[1] == '/') {
+      tag += 2;
+      length -= 2;
+    }
+    if ((length == 1 && tag[0] == '*') || (length == etagLength && memcmp(tag, cache.etag, length) == 0)) {
+      return true;
+    }
+    cursor = end;
+  }
+  return false;
+}
+
+// ============================================================================
+// /api/status
+// ============================================================================
+
+void statusStateFromControl(const ControlSnapshot &control, StatusState &state) {
+  memset(&state, 0, sizeof(state));
+  state.clockValid = control.clockValid;
+  state.relays = control.relays;
+  for (uint8_t i = 0; i < NUM_RELAY_CHANNELS; i++) {
+    state.toggleCounts[i] = control.toggleCounts[i];
+    state.policies[i] = control.policies[i];
+  }
+  state.sensors = control.sensors;
+  state.rates = control.rates;
+  state.ruleGeneration = control.generation;
+  state.rulesEvaluated = control.rulesEvaluated;
+  state.nodesEvaluated = control.nodesEvaluated;
+}
+
+void statusWriteJson(const char *version, const StatusState &state, const StatusCounters &counters,
+                     std::string &out) {
+  char ip[16];
+  snprintf(ip, sizeof(ip), "%u.%u.%u.%u", static_cast<unsigned>(state.ip & 0xFF),
+           static_cast<unsigned>(state.ip >> 8 & 0xFF), static_cast<unsigned>(state.ip >> 16 & 0xFF),
+           static_cast<unsigned>(state.ip >> 24));
+
+  StaticJsonDocument<STATUS_JSON_CAPACITY> doc;
+  JsonObject root = doc.to<JsonObject>();
+  root["version"] = version;
+  root["role"] = state.isController ? "controller" : "slave";
+  root["nodeId"] = state.nodeId;
+  root["online"] = state.online;
+  root["ip"] = static_cast<const char *>(ip);
+
+  JsonArray relays = root.createNestedArray("relays");
+  JsonArray toggles = root.createNestedArray("relayToggleCounts");
+  JsonArray policies = root.createNestedArray("relayPolicies");
+  for (uint8_t i = 0; i < NUM_RELAY_CHANNELS; i++) {
+    relays.add((state.relays & (1u << i)) != 0);
+    toggles.add(state.toggleCounts[i]);
+    policies.add(relayPolicyName(state.policies[i]));
+  }
+
+  JsonArray currents = root.createNestedArray("currentMa");
+  JsonArray faults = root.createNestedArray("currentFaults");
+  for (uint8_t i = 0; i < NUM_CURRENT_SENSORS; i++) {
+    if (state.currentAvailable & (1u << i)) {
+      currents.add(counters.currentMa[i]);
+      faults.add(currentFaultName(state.currentFaults[i]));
+    } else {
+      currents.add(nullptr);
+      faults.add(nullptr);
+    }
+  }
+
+  JsonObject sensors = root.createNestedObject("sensors");
+  for (uint8_t slot = 0; slot < SENSOR_SLOT_COUNT; slot++) {
+    sensors[sensorSlotName(slot)] = state.sensors.slots[slot];
+  }
+  JsonObject rates = root.createNestedObject("sensorRates");
+  for (uint8_t slot = 0; slot < SENSOR_SLOT_COUNT; slot++) {
+    rates[sensorSlotName(slot)] = state.rates.slots[slot];
+  }
+
+  root["ruleCount"] = state.ruleCount;
+  root["rulesEvaluatedLastTick"] = state.rulesEvaluated;
+  root["conditionNodesEvaluatedLastTick"] = state.nodesEvaluated;
+  root["scheduleCount"] = state.scheduleCount;
+  root["clockSynced"] = state.clockValid;
+
+  JsonObject timing = root.createNestedObject("control");
+  timing["passes"] = counters.passes;
+  timing["jitterMeanUs"] = counters.timing.jitterMeanUs;
+  timing["jitterMaxUs"] = counters.timing.jitterMaxUs;
+  timing["jitterWorstUs"] = counters.timing.jitterWorstUs;
+  timing["busyMaxUs"] = counters.timing.busyMaxUs;
+  timing["overruns"] = counters.timing.overruns;
+
+  JsonObject live = root.createNestedObject("live");
+  live["subscribers"] = counters.liveSubscribers;
+  live["messages"] = counters.liveMessages;
+  live["snapshots"] = counters.liveSnapshots;
+  live["skipped"] = counters.liveSkipped;
+  live["disconnected"] = counters.liveDisconnected;
+
+  const PowerStats &powerInfo = counters.power;
+  JsonObject power = root.createNestedObject("power");
+  JsonObject stateMs = power.createNestedObject("stateMs");
+  for (uint8_t powerState = 0; powerState < POWER_STATE_COUNT; powerState++) {
+    stateMs[powerStateName(powerState)] = powerInfo.stateUs[powerState] / 1000;
+  }
+  power["controlWakeups"] = powerInfo.wakeups[POWER_TASK_CONTROL];
+  power["controlWoken"] = powerInfo.woken[POWER_TASK_CONTROL];
+  power["networkWakeups"] = powerInfo.wakeups[POWER_TASK_NETWORK];
+  power["networkWoken"] = powerInfo.woken[POWER_TASK_NETWORK];
+  power["lightSleep"] = powerInfo.lightSleep;
+  power["cpuScaling"] = powerInfo.cpuScaling;
+  power["modemSleep"] = powerInfo.modemSleep;
+
+  // Sized once, then written in place
+  const size_t length = measureJson(doc);
+  out.resize(length + 1);
+  serializeJson(doc, &out[0], length + 1);
+  out.resize(length);
+}
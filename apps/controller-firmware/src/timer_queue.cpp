@@ -0,0 +1,68 @@
+/**
+ * TerraHub Controller Firmware - Timer Queue
+ *
+ * Heap ordering compares deadlines as signed differences so entries keep
+ * their order when millis() wraps around after ~49.7 days.
+ */
+
+#include "timer_queue.h"
+
+static inline bool earlier(const TimerEntry &a, const TimerEntry &b) {
+  return static_cast<int32_t>(a.deadline - b.deadline) < 0;
+}
+
+void timerQueueReset(TimerQueue &queue, size_t capacity) {
+  queue.heap.clear();
+  queue.heap.reserve(capacity);
+}
+
+void timerQueuePush(TimerQueue &queue, uint16_t id, uint32_t deadline) {
+  std::vector<TimerEntry> &heap = queue.heap;
+  heap.push_back(TimerEntry{deadline, id});
+
+  size_t i = heap.size() - 1;
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (!earlier(heap[i], heap[parent])) break;
+    TimerEntry tmp = heap[i];
+    heap[i] = heap[parent];
+    heap[parent] = tmp;
+    i = parent;
+  }
+}
+
+bool timerQueuePopExpired(TimerQueue &queue, uint32_t now, uint16_t &id) {
+  std::vector<TimerEntry> &heap = queue.heap;
+  if (heap.empty() || !deadlineReached(now, heap[0].deadline)) {
+    return false;
+  }
+
+  id = heap[0].id;
+  heap[0] = heap.back();
+  heap.pop_back();
+
+  size_t i = 0;
+  const size_t count = heap.size();
+  while (true) {
+    size_t left = 2 * i + 1;
+    size_t right = left + 1;
+    size_t smallest = i;
+    if (left < count && earlier(heap[left], heap[smallest])) smallest = left;
+    if (right < count && earlier(heap[right], heap[smallest])) smallest = right;
+    if (smallest == i) break;
+    TimerEntry tmp = heap[i];
+    heap[i] = heap[smallest];
+    heap[smallest] = tmp;
+    i = smallest;
+  }
+
+  return true;
+}
+
+bool timerQueueNextDeadline(const TimerQueue &queue, uint32_t &deadline) {
+  if (queue.heap.empty()) {
+    return false;
+  }
+  deadline = queue.heap[0].deadline;
+  return true;
+}
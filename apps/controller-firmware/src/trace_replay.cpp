@@ -0,0 +1,395 @@
+/**
+ * TerraHub Controller Firmware - Sensor Trace Replay
+ *
+ * Trace readers and the replay loop. The loop wakes the pipeline exactly
+ * where the control task would, so sensor polls, rate windows, minimum
+ * durations and schedule transitions behave as on the device.
+ */
+
+#if !defined(ARDUINO_ARCH_ESP32)
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "control_task.h"
+#include "hal.h"
+#include "trace_replay.h"
+
+static const uint8_t REPLAY_MAGIC[4] = {'T', 'H', 'R', 'T'};
+
+#define REPLAY_HEADER_BYTES 8
+#define REPLAY_DAY_MS 86400000ULL
+
+static void traceReset(ReplayTrace &trace, ReplayTraceKind kind) {
+  memset(&trace, 0, sizeof(trace));
+  trace.kind = kind;
+}
+
+static bool traceFail(ReplayTrace &trace, const char *format, uint32_t value = 0) {
+  snprintf(trace.error, sizeof(trace.error), format, static_cast<unsigned>(value));
+  return false;
+}
+
+static bool traceAccept(ReplayTrace &trace, ReplaySample &sample) {
+  if (sample.atMs < trace.lastAtMs) {
+    return traceFail(trace, trace.kind == REPLAY_TRACE_CSV ? "line %u: time goes backwards"
+                                                           : "record %u: time goes backwards",
+                     trace.line);
+  }
+  trace.lastAtMs = sample.atMs;
+  return true;
+}
+
+// ============================================================================
+// CSV
+// ============================================================================
+
+// Cut the next comma-separated field out of `cursor`, trimmed
+static char *nextField(char *&cursor) {
+  char *field = cursor;
+  char *comma = strchr(cursor, ',');
+  if (comma != nullptr) {
+    *comma = '\0';
+    cursor = comma + 1;
+  } else {
+    cursor = nullptr;
+  }
+  while (*field == ' ' || *field == '\t') field++;
+  char *end = field + strlen(field);
+  while (end > field && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n')) end--;
+  *end = '\0';
+  return field;
+}
+
+// Next line with content, or false at the end of the file
+static bool nextCsvLine(ReplayTrace &trace, char *line) {
+  while (fgets(line, REPLAY_MAX_LINE_BYTES, trace.file) != nullptr) {
+    trace.line++;
+    if (strchr(line, '\n') == nullptr && !feof(trace.file)) {
+      return traceFail(trace, "line %u: too long", trace.line);
+    }
+    const char *start = line;
+    while (*start == ' ' || *start == '\t') start++;
+    if (*start != '\0' && *start != '\r' && *start != '\n' && *start != '#') {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool readCsvHeader(ReplayTrace &trace) {
+  char line[REPLAY_MAX_LINE_BYTES];
+  if (!nextCsvLine(trace, line)) {
+    return trace.error[0] != '\0' ? false : traceFail(trace, "empty trace");
+  }
+
+  char *cursor = line;
+  if (strcmp(nextField(cursor), "t") != 0) {
+    return traceFail(trace, "line %u: the first column must be \"t\"", trace.line);
+  }
+  bool anySensor = false;
+  while (cursor != nullptr) {
+    if (trace.columnCount == REPLAY_MAX_COLUMNS) {
+      return traceFail(trace, "more than %u columns", REPLAY_MAX_COLUMNS);
+    }
+    const uint8_t slot = sensorSlotFromName(nextField(cursor));
+    trace.columnSlots[trace.columnCount++] = slot;
+    anySensor |= slot != SENSOR_SLOT_INVALID;
+  }
+  return anySensor ? true : traceFail(trace, "line %u: no sensor columns", trace.line);
+}
+
+static bool readCsvSample(ReplayTrace &trace, ReplaySample &sample) {
+  char line[REPLAY_MAX_LINE_BYTES];
+  if (!nextCsvLine(trace, line)) {
+    return false;
+  }
+
+  char *cursor = line;
+  char *end;
+  const char *time = nextField(cursor);
+  const double seconds = strtod(time, &end);
+  if (*time == '\0' || *end != '\0' || !(seconds >= 0)) {
+    return traceFail(trace, "line %u: bad time", trace.line);
+  }
+  sample.atMs = static_cast<uint64_t>(llround(seconds * 1000.0));
+  sample.present = 0;
+
+  for (uint8_t column = 0; cursor != nullptr && column < trace.columnCount; column++) {
+    const char *field = nextField(cursor);
+    const uint8_t slot = trace.columnSlots[column];
+    if (slot == SENSOR_SLOT_INVALID || *field == '\0') {
+      continue;
+    }
+    const float value = strtof(field, &end);
+    if (*end != '\0') {
+      return traceFail(trace, "line %u: bad value", trace.line);
+    }
+    sample.values[slot] = value;
+    sample.present |= 1u << slot;
+  }
+  return traceAccept(trace, sample);
+}
+
+// ============================================================================
+// Binary
+// ============================================================================
+
+static uint32_t readLe32(const uint8_t *bytes) {
+  return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | static_cast<uint32_t>(bytes[3]) << 24;
+}
+
+static void writeLe32(uint8_t *bytes, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    bytes[i] = value >> (8 * i);
+  }
+}
+
+static bool readBinarySample(ReplayTrace &trace, ReplaySample &sample) {
+  uint8_t head[12];
+  const size_t length = fread(head, 1, sizeof(head), trace.file);
+  if (length == 0) {
+    return false;
+  }
+  trace.line++;
+  if (length != sizeof(head)) {
+    return traceFail(trace, "record %u: truncated", trace.line);
+  }
+  sample.atMs = readLe32(head) | static_cast<uint64_t>(readLe32(head + 4)) << 32;
+  const uint32_t present = readLe32(head + 8);
+  sample.present = 0;
+
+  for (uint8_t slot = 0; slot < trace.fileSlotCount; slot++) {
+    if ((present & (1u << slot)) == 0) {
+      continue;
+    }
+    uint8_t bytes[4];
+    if (fread(bytes, 1, sizeof(bytes), trace.file) != sizeof(bytes)) {
+      return traceFail(trace, "record %u: truncated", trace.line);
+    }
+    // Slots this firmware does not know are read past
+    if (slot < SENSOR_SLOT_COUNT) {
+      const uint32_t bits = readLe32(bytes);
+      memcpy(&sample.values[slot], &bits, sizeof(float));
+      sample.present |= 1u << slot;
+    }
+  }
+  return traceAccept(trace, sample);
+}
+
+bool replayWriteBinaryHeader(FILE *file) {
+  const uint8_t header[REPLAY_HEADER_BYTES] = {
+    REPLAY_MAGIC[0], REPLAY_MAGIC[1], REPLAY_MAGIC[2], REPLAY_MAGIC[3], REPLAY_BINARY_VERSION, SENSOR_SLOT_COUNT, 0, 0};
+  return fwrite(header, 1, sizeof(header), file) == sizeof(header);
+}
+
+bool replayWriteBinarySample(FILE *file, const ReplaySample &sample) {
+  uint8_t record[12 + 4 * SENSOR_SLOT_COUNT];
+  writeLe32(record, static_cast<uint32_t>(sample.atMs));
+  writeLe32(record + 4, static_cast<uint32_t>(sample.atMs >> 32));
+  const uint32_t present = sample.present & ((1u << SENSOR_SLOT_COUNT) - 1);
+  writeLe32(record + 8, present);
+  size_t length = 12;
+  for (uint8_t slot = 0; slot < SENSOR_SLOT_COUNT; slot++) {
+    if (present & (1u << slot)) {
+      uint32_t bits;
+      memcpy(&bits, &sample.values[slot], sizeof(bits));
+      writeLe32(record + length, bits);
+      length += 4;
+    }
+  }
+  return fwrite(record, 1, length, file) == length;
+}
+
+// ============================================================================
+// Generated
+// ============================================================================
+
+// xorshift32: cheap, and the same on every host
+static float noise(ReplayTrace &trace, float amplitude) {
+  uint32_t x = trace.seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  trace.seed = x;
+  return amplitude * (static_cast<float>(x) / 4294967296.0f * 2.0f - 1.0f);
+}
+
+static void generateSample(ReplayTrace &trace, ReplaySample &sample) {
+  const double days = static_cast<double>(trace.nextAtMs) / REPLAY_DAY_MS;
+  const double hour = (days - floor(days)) * 24.0;
+  // Warmest at 14:00, with the whole day drifting over a week
+  const double daily = cos(2 * M_PI * (hour - 14.0) / 24.0);
+  const double weekly = sin(2 * M_PI * days / 7.0);
+
+  sample.atMs = trace.nextAtMs;
+  sample.present = (1u << SENSOR_SLOT_COUNT) - 1;
+  sample.values[SENSOR_TEMPERATURE] = static_cast<float>(25.0 + 4.0 * daily + 1.5 * weekly) + noise(trace, 0.3f);
+  sample.values[SENSOR_HUMIDITY] = static_cast<float>(65.0 - 12.0 * daily - 4.0 * weekly) + noise(trace, 2.0f);
+  const double light = hour >= 8.0 && hour < 20.0 ? 900.0 * sin(M_PI * (hour - 8.0) / 12.0) : 0.0;
+  sample.values[SENSOR_LIGHT_LEVEL] = light > 0.0 ? static_cast<float>(light) + noise(trace, 20.0f) : 0.0f;
+  if (sample.values[SENSOR_LIGHT_LEVEL] < 0.0f) sample.values[SENSOR_LIGHT_LEVEL] = 0.0f;
+  trace.nextAtMs += trace.stepMs;
+}
+
+void replayOpenGenerated(ReplayTrace &trace, uint32_t days, uint32_t stepMs, uint32_t seed) {
+  traceReset(trace, REPLAY_TRACE_GENERATED);
+  trace.endMs = days * REPLAY_DAY_MS;
+  trace.stepMs = stepMs > 0 ? stepMs : 1;
+  trace.seed = seed != 0 ? seed : 1;
+}
+
+// ============================================================================
+// Traces
+// ============================================================================
+
+bool replayOpenFile(ReplayTrace &trace, const char *path) {
+  traceReset(trace, REPLAY_TRACE_CSV);
+  trace.file = fopen(path, "rb");
+  if (trace.file == nullptr) {
+    return traceFail(trace, "cannot open the trace");
+  }
+
+  uint8_t header[REPLAY_HEADER_BYTES];
+  if (fread(header, 1, sizeof(header), trace.file) == sizeof(header) &&
+      memcmp(header, REPLAY_MAGIC, sizeof(REPLAY_MAGIC)) == 0) {
+    trace.kind = REPLAY_TRACE_BINARY;
+    trace.fileSlotCount = header[5];
+    if (header[4] != REPLAY_BINARY_VERSION) {
+      return traceFail(trace, "unsupported binary version %u", header[4]);
+    }
+    if (trace.fileSlotCount > 32) {
+      return traceFail(trace, "bad slot count %u", trace.fileSlotCount);
+    }
+    return true;
+  }
+
+  rewind(trace.file);
+  return readCsvHeader(trace);
+}
+
+bool replayNextSample(ReplayTrace &trace, ReplaySample &sample) {
+  if (trace.error[0] != '\0') {
+    return false;
+  }
+  switch (trace.kind) {
+    case REPLAY_TRACE_CSV:
+      return readCsvSample(trace, sample);
+    case REPLAY_TRACE_BINARY:
+      return readBinarySample(trace, sample);
+    case REPLAY_TRACE_GENERATED:
+      if (trace.nextAtMs >= trace.endMs) {
+        return false;
+      }
+      generateSample(trace, sample);
+      return true;
+  }
+  return false;
+}
+
+void replayClose(ReplayTrace &trace) {
+  if (trace.file != nullptr) {
+    fclose(trace.file);
+    trace.file = nullptr;
+  }
+}
+
+// ============================================================================
+// Replay
+// ============================================================================
+
+struct ReplayRunner {
+  ReplayStats &stats;
+  ReplayTransitionHandler onTransition;
+  void *context;
+  uint64_t nowMs;                   // trace time
+  uint32_t relays;                  // as of the last pass
+  uint32_t evaluations;             // snapshot counter as of the last pass
+  uint64_t onSince[NUM_RELAY_CHANNELS];
+};
+
+static void advance(ReplayRunner &runner, uint32_t ms) {
+  halNativeAdvanceMillis(ms);
+  runner.nowMs += ms;
+}
+
+// Run a pass, then account for the relays it switched
+static void runPass(ReplayRunner &runner) {
+  controlRunPass();
+  const ControlSnapshot snapshot = controlSnapshot();
+  ReplayStats &stats = runner.stats;
+  stats.passes++;
+  stats.ruleEvaluations += snapshot.ruleEvaluations - runner.evaluations;
+  runner.evaluations = snapshot.ruleEvaluations;
+
+  const uint32_t changed = snapshot.relays ^ runner.relays;
+  if (changed == 0) {
+    return;
+  }
+  for (uint8_t relay = 0; relay < NUM_RELAY_CHANNELS; relay++) {
+    if ((changed & (1u << relay)) == 0) {
+      continue;
+    }
+    const bool on = (snapshot.relays & (1u << relay)) != 0;
+    stats.relayToggles[relay]++;
+    if (on) {
+      runner.onSince[relay] = runner.nowMs;
+    } else {
+      stats.relayOnMs[relay] += runner.nowMs - runner.onSince[relay];
+    }
+    if (runner.onTransition != nullptr) {
+      runner.onTransition(runner.nowMs, relay, on, runner.context);
+    }
+  }
+  runner.relays = snapshot.relays;
+}
+
+// Wake at every deadline before `targetMs`, then stop on it. Deadlines are
+// never more than a sensor poll interval away, so the steps fit in 32 bits.
+static void advanceTo(ReplayRunner &runner, uint64_t targetMs) {
+  while (runner.nowMs < targetMs) {
+    const uint32_t now = halMillis();
+    const uint32_t deadline = controlNextDeadline();
+    const uint32_t step = deadlineReached(now, deadline) ? 1 : deadline - now;
+    if (step >= targetMs - runner.nowMs) {
+      advance(runner, static_cast<uint32_t>(targetMs - runner.nowMs));
+      return;
+    }
+    advance(runner, step);
+    runPass(runner);
+  }
+}
+
+bool replayRun(ReplayTrace &trace, ReplayStats &stats, ReplayTransitionHandler onTransition, void *context) {
+  memset(&stats, 0, sizeof(stats));
+  ReplayRunner runner{stats, onTransition, context, 0, 0, 0, {}};
+  const ControlSnapshot initial = controlSnapshot();
+  runner.relays = initial.relays;
+  runner.evaluations = initial.ruleEvaluations;
+
+  ReplaySample sample;
+  while (replayNextSample(trace, sample)) {
+    advanceTo(runner, sample.atMs);
+    for (uint8_t slot = 0; slot < SENSOR_SLOT_COUNT; slot++) {
+      if ((sample.present & (1u << slot)) == 0) {
+        continue;
+      }
+      // A full queue is drained by a pass at the same instant
+      while (!controlSetSensor(slot, sample.values[slot])) {
+        runPass(runner);
+      }
+    }
+    runPass(runner);
+    stats.samples++;
+  }
+
+  for (uint8_t relay = 0; relay < NUM_RELAY_CHANNELS; relay++) {
+    if (runner.relays & (1u << relay)) {
+      stats.relayOnMs[relay] += runner.nowMs - runner.onSince[relay];
+    }
+  }
+  stats.simulatedMs = runner.nowMs;
+  return trace.error[0] == '\0';
+}
+
+#endif // !ARDUINO_ARCH_ESP32
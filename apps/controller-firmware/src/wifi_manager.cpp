@@ -0,0 +1,176 @@
+/**
+ * TerraHub Controller Firmware - Wi-Fi Station Manager
+ *
+ * Wi-Fi events arrive on the system event task, so the handler only records
+ * what happened; all state transitions and WiFi.* calls run in
+ * wifiManagerLoop() on the main loop.
+ */
+
+#include <WiFi.h>
+#include "config.h"
+#include "power_manager.h"
+#include "wifi_manager.h"
+
+static const char *const wifiStateNames[] = {
+  "unconfigured",
+  "connecting",
+  "connected",
+  "backoff"
+};
+
+static WifiConfig activeConfig{.configured = false};
+static WifiState state = WIFI_STATE_UNCONFIGURED;
+static uint32_t stateSince = 0;
+static uint32_t backoffMs = WIFI_RETRY_BACKOFF_MIN_MS;
+static uint16_t failedAttempts = 0;
+static bool connectRequested = false;
+
+static volatile bool gotIpEvent = false;
+static volatile bool disconnectedEvent = false;
+
+const char *wifiStateName(WifiState value) {
+  return value <= WIFI_STATE_BACKOFF ? wifiStateNames[value] : "";
+}
+
+static void onWifiEvent(WiFiEvent_t event) {
+  if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+    gotIpEvent = true;
+  } else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) {
+    disconnectedEvent = true;
+  }
+  // Handled by the next wifiManagerLoop()
+  powerWake(POWER_TASK_NETWORK);
+}
+
+static void enterState(WifiState next, uint32_t now) {
+  if (next != state) {
+    Serial.printf("Wi-Fi: %s -> %s\n", wifiStateName(state), wifiStateName(next));
+  }
+  state = next;
+  stateSince = now;
+}
+
+static void startAttempt(uint32_t now) {
+  gotIpEvent = false;
+  disconnectedEvent = false;
+
+  if (activeConfig.hostname.length()) {
+    WiFi.setHostname(activeConfig.hostname.c_str());
+  }
+  WiFi.begin(activeConfig.ssid.c_str(), activeConfig.password.c_str());
+  Serial.print("Connecting to Wi-Fi SSID: ");
+  Serial.println(activeConfig.ssid.c_str());
+  enterState(WIFI_STATE_CONNECTING, now);
+}
+
+static void scheduleRetry(uint32_t now) {
+  failedAttempts++;
+  WiFi.disconnect();
+  enterState(WIFI_STATE_BACKOFF, now);
+  Serial.printf("Wi-Fi: retrying in %lu ms\n", static_cast<unsigned long>(backoffMs));
+}
+
+void wifiManagerBegin() {
+  // Reconnects are driven by the state machine, not the core's auto-reconnect
+  WiFi.setAutoReconnect(false);
+  WiFi.onEvent(onWifiEvent);
+}
+
+void wifiManagerConnect(const WifiConfig &config) {
+  activeConfig = config;
+  connectRequested = true;
+}
+
+void wifiManagerLoop(uint32_t now) {
+  if (connectRequested) {
+    connectRequested = false;
+    failedAttempts = 0;
+    backoffMs = WIFI_RETRY_BACKOFF_MIN_MS;
+    if (state == WIFI_STATE_CONNECTED || state == WIFI_STATE_CONNECTING) {
+      WiFi.disconnect();
+    }
+
+    if (!activeConfig.configured) {
+      enterState(WIFI_STATE_UNCONFIGURED, now);
+      return;
+    }
+    startAttempt(now);
+    return;
+  }
+
+  switch (state) {
+    case WIFI_STATE_UNCONFIGURED:
+      break;
+
+    case WIFI_STATE_CONNECTING: {
+      const wl_status_t status = WiFi.status();
+      if (gotIpEvent || status == WL_CONNECTED) {
+        gotIpEvent = false;
+        failedAttempts = 0;
+        backoffMs = WIFI_RETRY_BACKOFF_MIN_MS;
+        enterState(WIFI_STATE_CONNECTED, now);
+        Serial.print("Wi-Fi connected. IP: ");
+        Serial.println(WiFi.localIP());
+      } else if (status == WL_CONNECT_FAILED || status == WL_NO_SSID_AVAIL) {
+        Serial.println("Wi-Fi connection failed; staying in AP mode for setup.");
+        scheduleRetry(now);
+      } else if (now - stateSince >= WIFI_CONNECT_TIMEOUT_SEC * 1000UL) {
+        Serial.println("Wi-Fi connection timed out; staying in AP mode for setup.");
+        scheduleRetry(now);
+      }
+      break;
+    }
+
+    case WIFI_STATE_CONNECTED:
+      if (disconnectedEvent || WiFi.status() != WL_CONNECTED) {
+        // Reconnect right away after a drop; backoff only kicks in if that fails
+        Serial.println("Wi-Fi connection lost; reconnecting");
+        startAttempt(now);
+      }
+      break;
+
+    case WIFI_STATE_BACKOFF:
+      if (now - stateSince >= backoffMs) {
+        backoffMs = backoffMs * 2 > WIFI_RETRY_BACKOFF_MAX_MS ? WIFI_RETRY_BACKOFF_MAX_MS : backoffMs * 2;
+        startAttempt(now);
+      }
+      break;
+  }
+}
+
+WifiState wifiManagerState() {
+  return state;
+}
+
+bool wifiManagerConnected() {
+  return state == WIFI_STATE_CONNECTED;
+}
+
+uint16_t wifiManagerFailedAttempts() {
+  return failedAttempts;
+}
+
+uint32_t wifiManagerRetryInMs(uint32_t now) {
+  if (state != WIFI_STATE_BACKOFF) {
+    return 0;
+  }
+  const uint32_t elapsed = now - stateSince;
+  return elapsed >= backoffMs ? 0 : backoffMs - elapsed;
+}
+
+bool wifiManagerNextDeadline(uint32_t now, uint32_t &deadline) {
+  if (connectRequested) {
+    deadline = now;
+    return true;
+  }
+  switch (state) {
+    case WIFI_STATE_CONNECTING:
+      deadline = stateSince + WIFI_CONNECT_TIMEOUT_SEC * 1000UL;
+      return true;
+    case WIFI_STATE_BACKOFF:
+      deadline = stateSince + backoffMs;
+      return true;
+    default:
+      return false;
+  }
+}
@@ -0,0 +1,444 @@
+/**
+ * TerraHub Controller Firmware - Host Micro-Benchmarks
+ *
+ * Rule evaluation, rule storage, request handling, the I2C node loopback
+ * and cached status polls timed on the host, built with -O2 by the bench
+ * environment:
+ *
+ *   pio test -e bench -v | grep '^BENCH'
+ *
+ * Each line reads "BENCH <name> <ns per op> ns/op <ops>"; the I2C loopback
+ * adds "BENCH <name>_rate <frames> frames/s" and rule storage
+ * "BENCH rule_store_size_<count> <bytes> bytes <bytes> json", the stored
+ * blob next to the same rules as JSON. Host numbers do not predict
+ * the ESP32's, but they compare one change against another.
+ */
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unity.h>
+#include "control_task.h"
+#include "hal.h"
+#include "i2c_dispatcher.h"
+#include "rule_json.h"
+#include "rule_set.h"
+#include "rule_store.h"
+#include "status_snapshot.h"
+
+static const int RULE_COUNTS[] = {8, 16, 64, 256};
+
+// What the async TCP stack asks a response filler for at a time
+#define TCP_CHUNK_BYTES 1460
+
+// Keeps the optimizer from dropping the work being timed
+static volatile uint32_t sink;
+
+// Returns the time per op in ns
+template <typename Body>
+static double bench(const char *name, uint32_t iterations, Body body) {
+  for (uint32_t i = 0; i < iterations / 10 + 1; i++) {
+    body(i);
+  }
+  const auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < iterations; i++) {
+    body(i);
+  }
+  const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  printf("BENCH %s %.1f ns/op %u\n", name, ns / iterations, iterations);
+  return ns / iterations;
+}
+
+// Mixed flat and compound rules over the first three sensors, spread
+// across the relays; flat only without `compound`
+static std::vector<RuleDefinition> makeRules(int count, bool compound = true) {
+  std::vector<RuleDefinition> rules(count);
+  for (int i = 0; i < count; i++) {
+    RuleDefinition &rule = rules[i];
+    char id[16];
+    snprintf(id, sizeof(id), "rule-%03d", i);
+    rule.id.assign(id);
+    rule.name.assign("Heat mat when cold at night");
+    rule.enabled = true;
+    rule.priority = i % 5;
+    rule.action.relayIndex = i % NUM_RELAY_CHANNELS;
+    rule.action.turnOn = i % 2;
+    rule.action.minDurationMs = i % 3 ? 0 : 60000;
+    if (!compound || i % 4 != 3) {
+      rule.condition.sensor.assign(i % 2 ? "humidityPercent" : "temperatureC");
+      rule.condition.op.assign(i % 3 ? "lt" : "gt");
+      rule.condition.threshold = 20 + i % 10;
+      rule.condition.hysteresis = 0.5f;
+      rule.expression.termCount = 0;
+      continue;
+    }
+    rule.condition = RuleCondition();
+    RuleExpression &expression = rule.expression;
+    expression.termCount = 5;
+    expression.terms[0] = RuleTerm{0, 0, RULE_TERM_ANY, 2, COMPARE_GT, 0, RULE_INPUT_NONE};
+    expression.terms[1] = RuleTerm{0, 0, RULE_TERM_ALL, 2, COMPARE_GT, 0, RULE_INPUT_NONE};
+    expression.terms[2] = RuleTerm{20.0f + i % 10, 0, RULE_TERM_COMPARE, 0, COMPARE_LT, 0, RULE_INPUT_NONE};
+    expression.terms[3] = RuleTerm{60, 0, RULE_TERM_COMPARE, 0, COMPARE_GT, 1, RULE_INPUT_NONE};
+    expression.terms[4] = RuleTerm{10, 0, RULE_TERM_COMPARE, 0, COMPARE_LT, 2, RULE_INPUT_NONE};
+  }
+  return rules;
+}
+
+static std::string ruleBody(int index) {
+  char body[320];
+  snprintf(body, sizeof(body),
+           "{\"id\":\"rule-%03d\",\"name\":\"Heat mat when cold at night\",\"enabled\":true,\"priority\":%d,"
+           "\"condition\":{\"sensor\":\"temperatureC\",\"op\":\"lt\",\"threshold\":%d,\"hysteresis\":0.5},"
+           "\"action\":{\"relayIndex\":%d,\"turnOn\":true,\"minDurationMs\":0}}",
+           index, index % 5, 20 + index % 10, index % NUM_RELAY_CHANNELS);
+  return body;
+}
+
+// Bytes GET /api/rules sends for `rules`
+static size_t ruleListJsonSize(const std::vector<RuleDefinition> &rules) {
+  size_t size = 2 + (rules.empty() ? 0 : rules.size() - 1);
+  for (const RuleDefinition &rule : rules) {
+    StaticJsonDocument<RULE_JSON_CAPACITY> doc;
+    writeRuleJson(rule, doc.to<JsonObject>());
+    size += measureJson(doc);
+  }
+  return size;
+}
+
+static void settle() {
+  controlRunPass();
+  ruleSetDrainRetired();
+}
+
+static void loadRules(int count) {
+  std::vector<RuleDefinition> rules = makeRules(count);
+  ruleSetApplyRules(rules);
+  settle();
+}
+
+void setUp(void) {
+  halNativeNvsClear();
+}
+
+void tearDown(void) {
+}
+
+/**
+ * The evaluation compiled rules replaced, kept as the baseline: every pass
+ * looked up each rule's sensor and operator by name.
+ */
+struct StringCondition {
+  std::string sensor;
+  std::string op;
+  float threshold;
+  float hysteresis;
+};
+
+static float getSensorField(const std::string &key, const SensorValues &values) {
+  if (key == "temperatureC") {
+    return values.slots[SENSOR_TEMPERATURE];
+  }
+  if (key == "humidityPercent") {
+    return values.slots[SENSOR_HUMIDITY];
+  }
+  if (key == "lightLevelLux") {
+    return values.slots[SENSOR_LIGHT_LEVEL];
+  }
+  return NAN;
+}
+
+static bool evaluateCondition(const StringCondition &condition, const SensorValues &values) {
+  float value = getSensorField(condition.sensor, values);
+  if (isnan(value)) {
+    return false;
+  }
+
+  float target = condition.threshold;
+  if (condition.op == "gt") return value > target;
+  if (condition.op == "lt") return value < target;
+  if (condition.op == "gte") return value >= target;
+  if (condition.op == "lte") return value <= target;
+  if (condition.op == "eq") return fabs(value - target) <= condition.hysteresis;
+  return false;
+}
+
+void test_bench_evaluate_rules(void) {
+  // Flat rules, which both paths can run: names against the compiled program
+  for (int count : RULE_COUNTS) {
+    const std::vector<RuleDefinition> rules = makeRules(count, false);
+    std::vector<StringCondition> conditions;
+    for (const RuleDefinition &rule : rules) {
+      conditions.push_back(StringCondition{rule.condition.sensor.c_str(), rule.condition.op.c_str(),
+                                           rule.condition.threshold, rule.condition.hysteresis});
+    }
+    SensorValues values;
+    char name[48];
+    snprintf(name, sizeof(name), "evaluate_strings_%d", count);
+    bench(name, 20000, [&](uint32_t i) {
+      values.slots[0] = 15.0f + i % 20;
+      values.slots[1] = 40.0f + i % 40;
+      values.slots[2] = static_cast<float>(i % 20);
+      uint32_t met = 0;
+      for (const StringCondition &condition : conditions) {
+        met += evaluateCondition(condition, values);
+      }
+      sink = met;
+    });
+
+    RuleProgram program;
+    compileRules(rules, program);
+    std::vector<uint32_t> memo(program.nodes.size(), 0);
+    RuleInputs inputs;
+    uint32_t round = 0;
+    snprintf(name, sizeof(name), "evaluate_flat_%d", count);
+    bench(name, 20000, [&](uint32_t i) {
+      inputs.values[0] = 15.0f + i % 20;
+      inputs.values[1] = 40.0f + i % 40;
+      inputs.values[2] = static_cast<float>(i % 20);
+      ExprEvaluation evaluation{&program, &inputs, memo.data(), ++round, 0};
+      uint32_t met = 0;
+      for (const CompiledRule &compiled : program.rules) {
+        met += evaluateCompiledRule(compiled, evaluation);
+      }
+      sink = met;
+    });
+  }
+
+  // The usual mix, compound conditions included
+  for (int count : RULE_COUNTS) {
+    RuleProgram program;
+    compileRules(makeRules(count), program);
+    std::vector<uint32_t> memo(program.nodes.size(), 0);
+    RuleInputs inputs;
+    uint32_t round = 0;
+    char name[48];
+    snprintf(name, sizeof(name), "evaluate_all_%d", count);
+    bench(name, 20000, [&](uint32_t i) {
+      inputs.values[0] = 15.0f + i % 20;
+      inputs.values[1] = 40.0f + i % 40;
+      inputs.values[2] = static_cast<float>(i % 20);
+      ExprEvaluation evaluation{&program, &inputs, memo.data(), ++round, 0};
+      uint32_t met = 0;
+      for (const CompiledRule &compiled : program.rules) {
+        met += evaluateCompiledRule(compiled, evaluation);
+      }
+      sink = met;
+    });
+  }
+}
+
+void test_bench_control_pass(void) {
+  // One sensor changes per pass, as when the network side pushes a reading
+  for (int count : RULE_COUNTS) {
+    loadRules(count);
+    char name[48];
+    snprintf(name, sizeof(name), "control_pass_%d", count);
+    bench(name, 20000, [&](uint32_t i) {
+      controlSetSensor(i % 3, 15.0f + i % 20);
+      halNativeAdvanceMillis(1);
+      controlRunPass();
+    });
+    sink = controlSnapshot().rulesEvaluated;
+  }
+}
+
+void test_bench_rule_store(void) {
+  for (int count : RULE_COUNTS) {
+    const std::vector<RuleDefinition> rules = makeRules(count);
+    std::vector<uint8_t> blob(ruleStoreEncodedSize(rules));
+    printf("BENCH rule_store_size_%d %u bytes %u json\n", count, static_cast<unsigned>(blob.size()),
+           static_cast<unsigned>(ruleListJsonSize(rules)));
+    char name[48];
+    snprintf(name, sizeof(name), "rule_store_encode_%d", count);
+    bench(name, 2000, [&](uint32_t) { sink = ruleStoreEncode(rules, blob.data(), blob.size()); });
+
+    std::vector<RuleDefinition> decoded;
+    snprintf(name, sizeof(name), "rule_store_decode_%d", count);
+    bench(name, 2000, [&](uint32_t) {
+      decoded.clear();
+      sink = ruleStoreDecode(blob.data(), blob.size(), decoded);
+    });
+    TEST_ASSERT_EQUAL(count, decoded.size());
+  }
+}
+
+void test_bench_save_and_load(void) {
+  for (int count : RULE_COUNTS) {
+    loadRules(count);
+    char name[48];
+    // The CRC check skips the write when nothing changed
+    snprintf(name, sizeof(name), "rule_set_save_unchanged_%d", count);
+    ruleSetSaveRules();
+    bench(name, 2000, [&](uint32_t) { sink = ruleSetSaveRules(); });
+
+    snprintf(name, sizeof(name), "rule_set_load_%d", count);
+    bench(name, 500, [&](uint32_t) {
+      ruleSetLoad();
+      settle();
+    });
+    TEST_ASSERT_EQUAL(count, ruleSetRules().size());
+  }
+}
+
+void test_bench_requests(void) {
+  for (int count : RULE_COUNTS) {
+    std::string all = "[";
+    for (int i = 0; i < count; i++) {
+      all += (i > 0 ? "," : "") + ruleBody(i);
+    }
+    all += "]";
+
+    char name[48];
+    snprintf(name, sizeof(name), "request_replace_rules_%d", count);
+    bench(name, 200, [&](uint32_t) {
+      sink = ruleSetReplaceRules(all.c_str()).status;
+      settle();
+    });
+    TEST_ASSERT_EQUAL(count, ruleSetRules().size());
+
+    RuleId id;
+    id.assign("rule-001");
+    const std::string one = ruleBody(1);
+    snprintf(name, sizeof(name), "request_put_rule_%d", count);
+    bench(name, 2000, [&](uint32_t) {
+      sink = ruleSetPutRule(id, one.c_str()).status;
+      settle();
+    });
+
+    snprintf(name, sizeof(name), "request_patch_rule_%d", count);
+    bench(name, 2000, [&](uint32_t i) {
+      sink = ruleSetPatchRule(id, i % 2 ? "{\"enabled\":false}" : "{\"enabled\":true}").status;
+      settle();
+    });
+  }
+}
+
+static uint8_t echo(const I2cFrameView &request, uint8_t *response, uint8_t &responseLength) {
+  memcpy(response, request.payload, request.length);
+  responseLength = request.length;
+  return I2C_STATUS_OK;
+}
+
+void test_bench_i2c_loopback(void) {
+  // A request encoded by the master, received into the node's ring, handled
+  // by the loop, and its response read back and decoded: everything but the
+  // wire itself
+  static const uint8_t PAYLOAD_SIZES[] = {4, 200};
+  for (uint8_t size : PAYLOAD_SIZES) {
+    i2cDispatcherBegin();
+    i2cDispatcherRegister(I2C_CMD_PING, echo);
+    uint8_t payload[I2C_FRAME_MAX_PAYLOAD];
+    for (uint8_t i = 0; i < size; i++) {
+      payload[i] = i;
+    }
+    uint8_t request[I2C_FRAME_MAX_BYTES];
+    I2cFrameView view;
+    char name[48];
+    snprintf(name, sizeof(name), "i2c_loopback_%u", size);
+    const double ns = bench(name, 200000, [&](uint32_t i) {
+      payload[0] = static_cast<uint8_t>(i);
+      const size_t length = i2cEncodeFrame(I2C_CMD_PING, payload, size, request, sizeof(request));
+      uint8_t *slot = i2cDispatcherRxBuffer();
+      if (slot != nullptr) {
+        memcpy(slot, request, length);
+      }
+      i2cDispatcherRxCommit(length);
+      i2cDispatcherPoll();
+      const uint8_t *response;
+      const size_t responseLength = i2cDispatcherTxFrame(&response);
+      sink = i2cDecodeFrame(response, responseLength, view) == I2C_FRAME_OK ? view.payload[0] : 0xFFFF;
+    });
+    printf("BENCH %s_rate %.0f frames/s\n", name, 1e9 / ns);
+    TEST_ASSERT_EQUAL(I2C_STATUS_OK, view.code);
+    TEST_ASSERT_EQUAL(size, view.length);
+    TEST_ASSERT_EQUAL(0, i2cDispatcherStats().overruns + i2cDispatcherStats().framesRejected);
+  }
+}
+
+/**
+ * One GET /api/status as main.cpp serves it, less the Wi-Fi, current sensor
+ * and live push reads only the device has: gather the state, rebuild the
+ * body if stale, then either match the client's tag or copy the body out
+ * the way the response filler does. Returns the bytes sent.
+ */
+static size_t pollStatus(StatusCache &cache, uint32_t maxAgeMs, const char *ifNoneMatch) {
+  const uint32_t now = halMillis();
+  const ControlSnapshot control = controlSnapshot();
+  StatusState state;
+  statusStateFromControl(control, state);
+  state.nodeId = 1;
+  state.isController = true;
+  state.online = true;
+  state.ruleCount = ruleSetRules().size();
+  state.scheduleCount = ruleSetSchedules().size();
+  if (statusCacheStale(cache, &state, sizeof(state), now, maxAgeMs)) {
+    StatusCounters counters;
+    memset(&counters, 0, sizeof(counters));
+    counters.passes = control.passes;
+    counters.timing = control.timing;
+    std::string body;
+    statusWriteJson("0.1.0", state, counters, body);
+    statusCacheStore(cache, &state, sizeof(state), now, std::move(body));
+  }
+  if (statusCacheMatches(cache, ifNoneMatch)) {
+    return 0;
+  }
+  const std::shared_ptr<const std::string> body = cache.body;
+  uint8_t chunk[TCP_CHUNK_BYTES];
+  size_t sent = 0;
+  while (sent < body->size()) {
+    const size_t count = body->size() - sent < sizeof(chunk) ? body->size() - sent : sizeof(chunk);
+    memcpy(chunk, body->data() + sent, count);
+    sink = chunk[count - 1];
+    sent += count;
+  }
+  return sent;
+}
+
+void test_bench_status_polls(void) {
+  loadRules(RULE_COUNTS[0]);
+  controlSetSensor(SENSOR_TEMPERATURE, 24.5f);
+  settle();
+
+  // Every request rebuilt, as before the cache
+  StatusCache cache;
+  bench("status_rebuild", 20000, [&](uint32_t) { sink = pollStatus(cache, 0, nullptr); });
+
+  // Unchanged state within the refresh age: a client without the tag, then
+  // one revalidating
+  cache = StatusCache();
+  pollStatus(cache, STATUS_REFRESH_MS, nullptr);
+  bench("status_unchanged_200", 200000, [&](uint32_t) { sink = pollStatus(cache, STATUS_REFRESH_MS, nullptr); });
+  const std::string etag = cache.etag;
+  bench("status_unchanged_304", 200000,
+        [&](uint32_t) { sink = pollStatus(cache, STATUS_REFRESH_MS, etag.c_str()); });
+  TEST_ASSERT_EQUAL(1, cache.version);
+
+  // A dashboard revalidating at 20 Hz while the control task runs: the
+  // counters refresh once a second, so one poll in 20 pays for a rebuild
+  std::string clientTag = cache.etag;
+  const uint32_t builtBefore = cache.version;
+  bench("status_poll_20hz", 20000, [&](uint32_t i) {
+    halNativeAdvanceMillis(50);
+    if (i % 20 == 0) controlRunPass();
+    if (pollStatus(cache, STATUS_REFRESH_MS, clientTag.c_str()) > 0) clientTag = cache.etag;
+  });
+  // Warm-up included, about one rebuild per second of simulated time
+  TEST_ASSERT_LESS_OR_EQUAL(20000 / 10 + 1, cache.version - builtBefore);
+}
+
+int main(int argc, char **argv) {
+  halNativeSetLogging(false);
+  controlBegin();
+  UNITY_BEGIN();
+  RUN_TEST(test_bench_evaluate_rules);
+  RUN_TEST(test_bench_control_pass);
+  RUN_TEST(test_bench_rule_store);
+  RUN_TEST(test_bench_save_and_load);
+  RUN_TEST(test_bench_requests);
+  RUN_TEST(test_bench_i2c_loopback);
+  RUN_TEST(test_bench_status_polls);
+  return UNITY_END();
+}
@@ -0,0 +1,329 @@
+/**
+ * TerraHub Controller Firmware - Node Bus Tests
+ *
+ * Enumeration, the polling scheduler and config sync against a simulated
+ * chain of nodes installed as the native HAL's bus. The HAL charges the
+ * clock for every byte moved; nodes answer BUSY until their loop has had
+ * NODE_LATENCY_MS to pick a request up.
+ */
+
+#include <initializer_list>
+#include <string.h>
+#include <unity.h>
+#include "bus_scheduler.h"
+#include "config_sync.h"
+#include "enumeration.h"
+#include "hal.h"
+#include "rule_store.h"
+
+#define CHAIN_LENGTH 16
+#define NODE_BOOT_MS 200
+#define NODE_LATENCY_MS 2
+
+struct SimulatedNode {
+  bool powered;
+  bool dead;
+  uint32_t poweredAt;
+  uint8_t address;
+  uint8_t pendingAddress;
+  uint8_t response[300];
+  size_t responseLength;
+  uint32_t readyAt;
+  uint8_t image[CONFIG_IMAGE_MAX_BYTES];
+};
+
+static SimulatedNode chain[CHAIN_LENGTH];
+static uint8_t chainLength = 0;
+
+static SimulatedNode *findNode(uint8_t address) {
+  for (uint8_t i = 0; i < chainLength; i++) {
+    SimulatedNode &node = chain[i];
+    if (node.powered && !node.dead && halMillis() - node.poweredAt >= NODE_BOOT_MS && node.address == address) {
+      return &node;
+    }
+  }
+  return nullptr;
+}
+
+static void put32(uint8_t *data, uint32_t value) {
+  for (int i = 0; i < 4; i++) data[i] = value >> (8 * i);
+}
+
+static bool nodeWrite(uint8_t address, const uint8_t *data, size_t length) {
+  SimulatedNode *node = findNode(address);
+  if (node == nullptr) {
+    return false;
+  }
+  const int index = node - chain;
+  I2cFrameView request;
+  if (i2cDecodeFrame(data, length, request) != I2C_FRAME_OK) {
+    return false;
+  }
+
+  uint8_t reply[256];
+  uint8_t replyLength = 0;
+  uint8_t status = I2C_STATUS_OK;
+  switch (request.code) {
+    case I2C_CMD_HELLO_UNASSIGNED:
+      reply[0] = 0;
+      reply[1] = 1;
+      replyLength = 2;
+      break;
+    case I2C_CMD_ASSIGN_ID:
+      node->pendingAddress = I2C_ADDRESS_BASE + request.payload[0];
+      reply[0] = request.payload[0];
+      replyLength = 1;
+      break;
+    case I2C_CMD_ENABLE_DOWNSTREAM:
+      if (index + 1 < chainLength) {
+        chain[index + 1].powered = true;
+        chain[index + 1].poweredAt = halMillis();
+      }
+      break;
+    case I2C_CMD_GET_SENSOR_VALUES:
+      reply[0] = 3;
+      for (int s = 0; s < 3; s++) {
+        reply[1 + 4 * s] = s + 1;
+        reply[2 + 4 * s] = index * 10 + s;
+        reply[3 + 4 * s] = 0;
+        reply[4 + 4 * s] = 1;
+      }
+      replyLength = 13;
+      break;
+    case I2C_CMD_GET_PORT_STATE:
+      reply[0] = request.payload[0];
+      reply[1] = (request.payload[0] + index) & 1;
+      reply[2] = 100;
+      reply[3] = 0;
+      replyLength = 4;
+      break;
+    case I2C_CMD_SET_CONFIG_CHUNK: {
+      const uint16_t offset = request.payload[0] | request.payload[1] << 8;
+      memcpy(node->image + offset, request.payload + 2, request.length - 2);
+      reply[0] = request.length - 2;
+      reply[1] = 0;
+      replyLength = 2;
+      break;
+    }
+    case I2C_CMD_GET_CONFIG_HASH:
+      if (request.length == 0) {
+        const uint16_t imageLength = configImageLength(node->image, sizeof(node->image));
+        put32(reply, imageLength ? ruleStoreCrc32(node->image, imageLength) : 0);
+        reply[4] = imageLength;
+        reply[5] = imageLength >> 8;
+        replyLength = 6;
+      } else {
+        const uint16_t first = request.payload[0] | request.payload[1] << 8;
+        for (uint8_t k = 0; k < request.payload[2]; k++) {
+          put32(reply + 4 * k, configChunkHash(node->image, first + k));
+        }
+        replyLength = 4 * request.payload[2];
+      }
+      break;
+    default:
+      status = I2C_STATUS_UNKNOWN_COMMAND;
+      break;
+  }
+  node->responseLength = i2cEncodeFrame(status, reply, replyLength, node->response, sizeof(node->response));
+  node->readyAt = halMillis() + NODE_LATENCY_MS;
+  return true;
+}
+
+static size_t nodeRead(uint8_t address, uint8_t *data, size_t length) {
+  SimulatedNode *node = findNode(address);
+  if (node == nullptr) {
+    return 0;
+  }
+  memset(data, 0xFF, length);
+  if (halMillis() < node->readyAt) {
+    const uint8_t busy[3] = {I2C_STATUS_BUSY, 0, I2C_STATUS_BUSY};
+    memcpy(data, busy, sizeof(busy));
+    return length;
+  }
+  memcpy(data, node->response, node->responseLength < length ? node->responseLength : length);
+  if (node->pendingAddress != 0) {
+    node->address = node->pendingAddress;
+    node->pendingAddress = 0;
+  }
+  return length;
+}
+
+static const I2cBus simulatedBus = {nodeWrite, nodeRead};
+
+// Nodes 2 - 16, already enumerated and running
+static uint8_t nodeIds[CHAIN_LENGTH - 1];
+
+static void startEnumeratedChain() {
+  chainLength = CHAIN_LENGTH - 1;
+  for (uint8_t i = 0; i < chainLength; i++) {
+    nodeIds[i] = i + 2;
+    chain[i].powered = true;
+    chain[i].poweredAt = halMillis() - NODE_BOOT_MS;
+    chain[i].address = I2C_ADDRESS_BASE + nodeIds[i];
+  }
+}
+
+static std::vector<uint8_t> makeImage(int ruleCount, int tweaked) {
+  std::vector<RuleDefinition> rules(ruleCount);
+  for (int i = 0; i < ruleCount; i++) {
+    char id[16];
+    snprintf(id, sizeof(id), "rule-%03d", i);
+    rules[i].id.assign(id);
+    rules[i].name.assign("Heat mat when cold at night");
+    rules[i].enabled = true;
+    rules[i].condition.sensor.assign("temperatureC");
+    rules[i].condition.op.assign("lt");
+    rules[i].condition.threshold = 20 + i + (i == tweaked ? 0.5f : 0.0f);
+    rules[i].action.relayIndex = i % NUM_RELAY_CHANNELS;
+  }
+  std::vector<uint8_t> image(ruleStoreEncodedSize(rules));
+  image.resize(ruleStoreEncode(rules, image.data(), image.size()));
+  return image;
+}
+
+// Run config sync to completion, sleeping between ticks like the network task
+static void runConfigSync() {
+  for (int tick = 0; configSyncPending(halMillis()); tick++) {
+    TEST_ASSERT_LESS_OR_EQUAL(100000, tick);
+    halNativeAdvanceMillis(configSyncLoop(halMillis()) ? 1 : 10);
+  }
+}
+
+static void assertNodesHold(const std::vector<uint8_t> &image, int deadIndex) {
+  for (int i = 0; i < chainLength; i++) {
+    if (i != deadIndex) {
+      TEST_ASSERT_EQUAL(image.size(), configImageLength(chain[i].image, CONFIG_IMAGE_MAX_BYTES));
+      TEST_ASSERT_EQUAL_MEMORY(image.data(), chain[i].image, image.size());
+    }
+  }
+}
+
+void setUp(void) {
+  for (SimulatedNode &node : chain) {
+    node = SimulatedNode();
+    node.address = I2C_ADDRESS_BASE;
+  }
+  chainLength = 0;
+  halNativeSetMicros(0);
+  halNativeSetI2cBus(&simulatedBus);
+  halNativeSetLogging(false);
+}
+
+void tearDown(void) {
+  halNativeSetI2cBus(nullptr);
+}
+
+void test_enumeration_assigns_every_node(void) {
+  for (int length : {CHAIN_LENGTH, 3, 0}) {
+    setUp();
+    chainLength = length;
+    if (length > 0) {
+      chain[0].powered = true;
+    }
+    enumerationBegin(halI2cBus(), halMillis());
+    while (enumerationLoop(halMillis())) {
+      halNativeAdvanceMillis(1);
+    }
+
+    const int expected = length > 15 ? 15 : length;
+    TEST_ASSERT_EQUAL(ENUM_STATE_DONE, enumerationState());
+    TEST_ASSERT_EQUAL(expected, enumerationNodeCount());
+
+    // Per node: boot, a hello interval and a few round trips; then the
+    // wait for a node past the end of the chain
+    const uint32_t bound = expected * (NODE_BOOT_MS + ENUM_HELLO_INTERVAL_MS + 40 +
+                                       3 * (NODE_LATENCY_MS + I2C_RESPONSE_POLL_MS)) +
+                           (length > 15 ? 0 : ENUM_NODE_BOOT_TIMEOUT_MS + 50);
+    TEST_ASSERT_LESS_OR_EQUAL(bound, enumerationElapsedMs(halMillis()));
+  }
+}
+
+void test_scheduler_polls_every_node(void) {
+  startEnumeratedChain();
+  chain[5].dead = true;
+  busSchedulerBegin(halI2cBus(), nodeIds, chainLength, halMillis());
+  while (busSchedulerStats().cycles < 5) {
+    halNativeAdvanceMillis(busSchedulerLoop(halMillis()) ? 1 : 10);
+  }
+
+  const ClusterSnapshot &snapshot = busSchedulerSnapshot();
+  for (int i = 0; i < chainLength; i++) {
+    const NodeReading &reading = snapshot.nodes[i];
+    TEST_ASSERT_EQUAL(i != 5, reading.online);
+    if (i != 5) {
+      TEST_ASSERT_EQUAL(3, reading.sensorCount);
+      TEST_ASSERT_EQUAL(i * 10, reading.sensors[0].value);
+      TEST_ASSERT_EQUAL(100, reading.portCurrentMa[0]);
+    }
+  }
+  TEST_ASSERT_EQUAL(0, busSchedulerNodeStats(0).failures);
+  TEST_ASSERT_GREATER_THAN(0, busSchedulerNodeStats(5).failures);
+}
+
+void test_config_sync_sends_only_changed_chunks(void) {
+  startEnumeratedChain();
+  chain[7].dead = true;
+  configSyncBegin(halI2cBus(), nodeIds, chainLength);
+  const ConfigSyncStats &stats = configSyncStats();
+
+  const std::vector<uint8_t> first = makeImage(60, -1);
+  TEST_ASSERT_TRUE(configSyncSetImage(first.data(), first.size()));
+  runConfigSync();
+  TEST_ASSERT_EQUAL(14, stats.nodesInSync);
+  TEST_ASSERT_EQUAL(1, stats.nodesFailed);
+  assertNodesHold(first, 7);
+
+  // One rule edited: a fraction of a full push
+  const uint32_t sentBefore = stats.bytesSent;
+  const uint32_t fullBefore = stats.fullPushBytes;
+  const std::vector<uint8_t> edited = makeImage(60, 30);
+  configSyncSetImage(edited.data(), edited.size());
+  runConfigSync();
+  assertNodesHold(edited, 7);
+  TEST_ASSERT_LESS_OR_EQUAL((stats.fullPushBytes - fullBefore) / 4, stats.bytesSent - sentBefore);
+
+  // Controller restart with the image the nodes already hold: no chunks
+  configSyncBegin(halI2cBus(), nodeIds, chainLength);
+  configSyncSetImage(edited.data(), edited.size());
+  runConfigSync();
+  TEST_ASSERT_EQUAL(0, configSyncNode(0).chunksSent);
+
+  // Restart and an edit: chunk hashes fetched from the nodes
+  configSyncBegin(halI2cBus(), nodeIds, chainLength);
+  const std::vector<uint8_t> grown = makeImage(61, 5);
+  configSyncSetImage(grown.data(), grown.size());
+  runConfigSync();
+  assertNodesHold(grown, 7);
+
+  // A node corrupted behind the controller's back fails verification and
+  // is brought back
+  chain[3].image[200] ^= 0xFF;
+  const std::vector<uint8_t> last = makeImage(61, 6);
+  configSyncSetImage(last.data(), last.size());
+  runConfigSync();
+  assertNodesHold(last, 7);
+  TEST_ASSERT_EQUAL(CONFIG_NODE_IN_SYNC, configSyncNode(3).state);
+
+  // An edit while a push is on the bus reuses the chunk hashes the
+  // controller already knows instead of fetching them again
+  const std::vector<uint8_t> pushing = makeImage(61, 10);
+  configSyncSetImage(pushing.data(), pushing.size());
+  while (configSyncNode(0).chunksSent == 0) {
+    halNativeAdvanceMillis(configSyncLoop(halMillis()) ? 1 : 10);
+  }
+  const uint32_t midPushBefore = stats.bytesSent;
+  const std::vector<uint8_t> replaced = makeImage(61, 20);
+  configSyncSetImage(replaced.data(), replaced.size());
+  runConfigSync();
+  assertNodesHold(replaced, 7);
+  // Whole chunks only, no chunk hashes
+  TEST_ASSERT_EQUAL(0, (stats.bytesSent - midPushBefore) % CONFIG_CHUNK_BYTES);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_enumeration_assigns_every_node);
+  RUN_TEST(test_scheduler_polls_every_node);
+  RUN_TEST(test_config_sync_sends_only_changed_chunks);
+  return UNITY_END();
+}
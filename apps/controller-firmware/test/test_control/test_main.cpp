@@ -0,0 +1,266 @@
+/**
+ * TerraHub Controller Firmware - Control Pipeline Tests
+ *
+ * Programs are built by the rule set as they are on the device and run one
+ * pass at a time on the HAL clock, waking at the deadlines the control task
+ * would sleep until. Relays are checked both in the snapshot and on the pins.
+ */
+
+#include <atomic>
+#include <thread>
+#include <unity.h>
+#include "control_task.h"
+#include "hal.h"
+#include "pinout.h"
+#include "relay_output.h"
+#include "rule_set.h"
+#include "snapshot_buffer.h"
+#include "spsc_queue.h"
+#include "timer_queue.h"
+
+static RuleDefinition makeRule(const char *id, float threshold, uint8_t relay, uint32_t minDurationMs = 0) {
+  RuleDefinition rule;
+  rule.id.assign(id);
+  rule.name.assign(id);
+  rule.enabled = true;
+  rule.priority = 0;
+  rule.condition.sensor.assign("temperatureC");
+  rule.condition.op.assign("gt");
+  rule.condition.threshold = threshold;
+  rule.condition.hysteresis = 0.0f;
+  rule.expression.termCount = 0;
+  rule.action.relayIndex = relay;
+  rule.action.turnOn = true;
+  rule.action.minDurationMs = minDurationMs;
+  return rule;
+}
+
+static void applyRules(std::vector<RuleDefinition> rules) {
+  TEST_ASSERT_TRUE(ruleSetApplyRules(rules));
+}
+
+// Run passes at each deadline the task would wake for, up to `until`
+static void runUntil(uint32_t until) {
+  controlRunPass();
+  while (!deadlineReached(halMillis(), until)) {
+    const uint32_t deadline = controlNextDeadline();
+    const uint32_t wake = deadlineReached(until, deadline) ? deadline : until;
+    const uint32_t now = halMillis();
+    halNativeAdvanceMillis(deadlineReached(now, wake) ? 1 : wake - now);
+    controlRunPass();
+  }
+}
+
+static void runFor(uint32_t ms) {
+  runUntil(halMillis() + ms);
+}
+
+static bool relayOn(uint8_t relay) {
+  const bool on = (controlSnapshot().relays & (1u << relay)) != 0;
+  TEST_ASSERT_EQUAL(on == (RELAY_ACTIVE_HIGH != 0), halNativePinLevel(relayPins[relay]));
+  return on;
+}
+
+// The clock keeps running across tests, as the task's rate history does
+void setUp(void) {
+  halNativeSetLogging(false);
+  // Empty the rule set while the previous test's program is still running,
+  // so nothing carries state over into the fresh one below
+  std::vector<ScheduleDefinition> noSchedules;
+  ruleSetApplySchedules(noSchedules);
+  applyRules({});
+  controlRunPass();
+  ruleSetDrainRetired();
+
+  relayOutputBegin();
+  controlBegin();
+}
+
+void tearDown(void) {
+}
+
+void test_rules_drive_relay_pins(void) {
+  applyRules({makeRule("heat", 30, 0), makeRule("fan", 40, 1, 300000)});
+  runFor(10);
+  TEST_ASSERT_EQUAL(ruleSetProgram()->generation, controlSnapshot().generation);
+  TEST_ASSERT_FALSE(relayOn(0));
+  TEST_ASSERT_FALSE(relayOn(1));
+
+  TEST_ASSERT_TRUE(controlSetSensor(SENSOR_TEMPERATURE, 45));
+  runFor(10);
+  TEST_ASSERT_TRUE(relayOn(0));
+  TEST_ASSERT_TRUE(relayOn(1));
+  TEST_ASSERT_TRUE(ruleSetProgram()->active[0] && ruleSetProgram()->active[1]);
+
+  // Cooling: the heater drops at once, the fan holds its minimum duration
+  TEST_ASSERT_TRUE(controlSetSensor(SENSOR_TEMPERATURE, 20));
+  runFor(10);
+  TEST_ASSERT_FALSE(relayOn(0));
+  TEST_ASSERT_TRUE(relayOn(1));
+  runFor(290000);
+  TEST_ASSERT_TRUE(relayOn(1));
+  runFor(20000);
+  TEST_ASSERT_FALSE(relayOn(1));
+}
+
+void test_reload_keeps_rule_state(void) {
+  applyRules({makeRule("heat", 30, 0), makeRule("fan", 40, 1)});
+  TEST_ASSERT_TRUE(controlSetSensor(SENSOR_TEMPERATURE, 45));
+  runFor(10);
+  const uint32_t pinWrites = halNativePinWrites();
+
+  // Same ids in another order: state carries over and no relay toggles
+  applyRules({makeRule("fan", 40, 1), makeRule("heat", 30, 0)});
+  const uint32_t generation = ruleSetProgram()->generation;
+  TEST_ASSERT_TRUE(ruleSetProgram()->active[0] && ruleSetProgram()->active[1]);
+  runFor(10);
+  TEST_ASSERT_EQUAL(generation, controlSnapshot().generation);
+  TEST_ASSERT_TRUE(relayOn(0));
+  TEST_ASSERT_TRUE(relayOn(1));
+  TEST_ASSERT_EQUAL(pinWrites, halNativePinWrites());
+
+  TEST_ASSERT_NOT_NULL(controlTakeRetired());
+  TEST_ASSERT_NULL(controlTakeRetired());
+}
+
+void test_manual_override(void) {
+  TEST_ASSERT_TRUE(controlSetRelay(4, true));
+  runFor(10);
+  TEST_ASSERT_TRUE(relayOn(4));
+  TEST_ASSERT_TRUE(controlSetRelay(4, false));
+  runFor(10);
+  TEST_ASSERT_FALSE(relayOn(4));
+}
+
+void test_schedule_follows_clock(void) {
+  // Relay 2 on from 10:00 to 10:01 every day
+  ScheduleDefinition lamp = ScheduleDefinition();
+  lamp.id.assign("lamp");
+  lamp.enabled = true;
+  lamp.nodeId = 1;
+  lamp.portId = 3;
+  lamp.days = SCHEDULE_EVERY_DAY;
+  lamp.entryCount = 2;
+  lamp.entries[0] = ScheduleEntry{600, true};
+  lamp.entries[1] = ScheduleEntry{601, false};
+  std::vector<ScheduleDefinition> schedules{lamp};
+  TEST_ASSERT_TRUE(ruleSetApplySchedules(schedules));
+  runFor(10);
+  TEST_ASSERT_FALSE(controlSnapshot().clockValid);
+  TEST_ASSERT_FALSE(relayOn(2));
+
+  TEST_ASSERT_TRUE(controlSetClock(600 * 60000UL - 500, halMillis()));
+  runFor(400);
+  TEST_ASSERT_TRUE(controlSnapshot().clockValid);
+  TEST_ASSERT_FALSE(relayOn(2));
+  runFor(100);
+  TEST_ASSERT_TRUE(relayOn(2));
+  TEST_ASSERT_EQUAL(1, controlSnapshot().schedulesOn);
+
+  // A jump past the off entry takes effect at once, not at the next transition
+  TEST_ASSERT_TRUE(controlSetClock(602 * 60000UL, halMillis()));
+  runFor(1);
+  TEST_ASSERT_FALSE(relayOn(2));
+  TEST_ASSERT_TRUE(controlSetClock(600 * 60000UL + 1000, halMillis()));
+  runFor(1);
+  TEST_ASSERT_TRUE(relayOn(2));
+
+  // Dropping the schedule leaves the relay as it was, like a deleted rule
+  schedules.clear();
+  TEST_ASSERT_TRUE(ruleSetApplySchedules(schedules));
+  runFor(10);
+  TEST_ASSERT_TRUE(relayOn(2));
+  TEST_ASSERT_EQUAL(0, controlSnapshot().schedulesOn);
+}
+
+void test_rate_rule_follows_trend(void) {
+  // Relay 3 on while the temperature rises faster than 1 per minute
+  RuleDefinition rising = makeRule("rising", 0, 3);
+  rising.expression.termCount = 1;
+  rising.expression.terms[0] = RuleTerm{1.0f, 0.0f, RULE_TERM_COMPARE, 0, COMPARE_GT, ruleRateInput(SENSOR_TEMPERATURE),
+                                        RULE_INPUT_NONE};
+  applyRules({rising});
+  float temperature = 20.0f;
+  TEST_ASSERT_TRUE(controlSetSensor(SENSOR_TEMPERATURE, temperature));
+  runFor(RULE_RATE_WINDOW_MS);
+  TEST_ASSERT_FALSE(relayOn(3));
+
+  // 3 per minute: on once the window shows more than 1
+  for (uint32_t seconds = 0; seconds < 2 * RULE_RATE_WINDOW_MS / 1000 && !relayOn(3); seconds++) {
+    temperature += 0.05f;
+    TEST_ASSERT_TRUE(controlSetSensor(SENSOR_TEMPERATURE, temperature));
+    runFor(1000);
+  }
+  TEST_ASSERT_TRUE(relayOn(3));
+  TEST_ASSERT_GREATER_THAN(1.0f, controlSnapshot().rates.slots[SENSOR_TEMPERATURE]);
+
+  // Holding steady releases it within another window
+  runFor(RULE_RATE_WINDOW_MS + SENSOR_POLL_INTERVAL_MS);
+  TEST_ASSERT_FALSE(relayOn(3));
+}
+
+void test_spsc_queue_keeps_order_across_threads(void) {
+  static SpscQueue<uint32_t, 16> queue;
+  const uint32_t count = 100000;
+  std::thread producer([&]() {
+    for (uint32_t i = 0; i < count;) {
+      if (queue.push(i)) {
+        i++;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  uint32_t expected = 0;
+  bool ordered = true;
+  uint32_t value;
+  while (expected < count) {
+    if (queue.pop(value)) {
+      ordered &= value == expected;
+      expected++;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+  TEST_ASSERT_TRUE(ordered);
+}
+
+void test_snapshot_reads_are_never_torn(void) {
+  struct Wide {
+    uint32_t words[16];
+  };
+  static SnapshotBuffer<Wide> buffer{Wide{}};
+  std::atomic<bool> stop{false};
+  std::thread writer([&]() {
+    Wide value;
+    for (uint32_t n = 1; !stop.load(); n++) {
+      for (uint32_t &word : value.words) word = n;
+      buffer.publish(value);
+    }
+  });
+
+  bool consistent = true;
+  for (int i = 0; i < 200000; i++) {
+    const Wide value = buffer.read();
+    for (uint32_t word : value.words) consistent &= word == value.words[0];
+  }
+  stop = true;
+  writer.join();
+  TEST_ASSERT_TRUE(consistent);
+}
+
+int main(int argc, char **argv) {
+  relayOutputBegin();
+  controlBegin();
+  UNITY_BEGIN();
+  RUN_TEST(test_rules_drive_relay_pins);
+  RUN_TEST(test_reload_keeps_rule_state);
+  RUN_TEST(test_manual_override);
+  RUN_TEST(test_schedule_follows_clock);
+  RUN_TEST(test_rate_rule_follows_trend);
+  RUN_TEST(test_spsc_queue_keeps_order_across_threads);
+  RUN_TEST(test_snapshot_reads_are_never_torn);
+  return UNITY_END();
+}
@@ -0,0 +1,101 @@
+/**
+ * TerraHub Controller Firmware - I2C Framing and Dispatcher Tests
+ *
+ * Frames are looped from the master-side encoder straight into the
+ * node-side dispatcher's receive buffer, the way the bus delivers them.
+ */
+
+#include <string.h>
+#include <unity.h>
+#include "i2c_dispatcher.h"
+
+static uint8_t echo(const I2cFrameView &request, uint8_t *response, uint8_t &responseLength) {
+  memcpy(response, request.payload, request.length);
+  responseLength = request.length;
+  return I2C_STATUS_OK;
+}
+
+static void deliver(const uint8_t *frame, size_t length) {
+  uint8_t *slot = i2cDispatcherRxBuffer();
+  if (slot != nullptr) {
+    memcpy(slot, frame, length);
+  }
+  i2cDispatcherRxCommit(length);
+}
+
+static uint8_t responseStatus() {
+  const uint8_t *frame;
+  i2cDispatcherTxFrame(&frame);
+  return frame[0];
+}
+
+static const uint8_t payload[4] = {1, 2, 3, 4};
+
+void setUp(void) {
+  i2cDispatcherBegin();
+  i2cDispatcherRegister(0x10, echo);
+}
+
+void tearDown(void) {
+}
+
+void test_frame_round_trip(void) {
+  uint8_t frame[I2C_FRAME_MAX_BYTES];
+  const size_t length = i2cEncodeFrame(0x10, payload, sizeof(payload), frame, sizeof(frame));
+  TEST_ASSERT_EQUAL(sizeof(payload) + 3, length);
+
+  I2cFrameView view;
+  TEST_ASSERT_EQUAL(I2C_FRAME_OK, i2cDecodeFrame(frame, length, view));
+  TEST_ASSERT_EQUAL(0x10, view.code);
+  TEST_ASSERT_EQUAL(sizeof(payload), view.length);
+  TEST_ASSERT_EQUAL_MEMORY(payload, view.payload, sizeof(payload));
+
+  frame[length - 1] ^= 1;
+  TEST_ASSERT_TRUE(i2cDecodeFrame(frame, length, view) != I2C_FRAME_OK);
+}
+
+void test_request_is_busy_until_polled(void) {
+  uint8_t frame[I2C_FRAME_MAX_BYTES];
+  deliver(frame, i2cEncodeFrame(0x10, payload, sizeof(payload), frame, sizeof(frame)));
+  TEST_ASSERT_EQUAL(I2C_STATUS_BUSY, responseStatus());
+
+  TEST_ASSERT_EQUAL(1, i2cDispatcherPoll());
+  const uint8_t *response;
+  const size_t length = i2cDispatcherTxFrame(&response);
+  I2cFrameView view;
+  TEST_ASSERT_EQUAL(I2C_FRAME_OK, i2cDecodeFrame(response, length, view));
+  TEST_ASSERT_EQUAL(I2C_STATUS_OK, view.code);
+  TEST_ASSERT_EQUAL_MEMORY(payload, view.payload, sizeof(payload));
+}
+
+void test_bad_frames_and_unknown_commands(void) {
+  uint8_t frame[I2C_FRAME_MAX_BYTES];
+  const size_t length = i2cEncodeFrame(0x10, payload, sizeof(payload), frame, sizeof(frame));
+  frame[length - 1] ^= 1;
+  deliver(frame, length);
+  TEST_ASSERT_EQUAL(I2C_STATUS_GENERAL_ERROR, responseStatus());
+
+  deliver(frame, i2cEncodeFrame(0x99, nullptr, 0, frame, sizeof(frame)));
+  i2cDispatcherPoll();
+  TEST_ASSERT_EQUAL(I2C_STATUS_UNKNOWN_COMMAND, responseStatus());
+}
+
+void test_overrun_is_counted(void) {
+  uint8_t frame[I2C_FRAME_MAX_BYTES];
+  const size_t length = i2cEncodeFrame(0x10, payload, sizeof(payload), frame, sizeof(frame));
+  for (int i = 0; i < 5; i++) {
+    deliver(frame, length);
+  }
+  TEST_ASSERT_EQUAL(1, i2cDispatcherStats().overruns);
+  TEST_ASSERT_EQUAL(I2C_STATUS_BUSY, responseStatus());
+  TEST_ASSERT_EQUAL(4, i2cDispatcherPoll());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_frame_round_trip);
+  RUN_TEST(test_request_is_busy_until_polled);
+  RUN_TEST(test_bad_frames_and_unknown_commands);
+  RUN_TEST(test_overrun_is_counted);
+  return UNITY_END();
+}
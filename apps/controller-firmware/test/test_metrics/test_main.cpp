@@ -0,0 +1,128 @@
+/**
+ * TerraHub Controller Firmware - Metrics Tests
+ *
+ * Bucket bounds and sums for durations timed on the native cycle counter,
+ * which runs off the HAL clock at 240 MHz, the stages a control pass
+ * records, and the Prometheus text the histograms are served as.
+ */
+
+#include <string>
+#include <unity.h>
+#include "control_task.h"
+#include "hal.h"
+#include "metrics.h"
+#include "relay_output.h"
+
+#define CYCLES_PER_US 240
+
+static void appendText(const char *text, size_t length, void *context) {
+  static_cast<std::string *>(context)->append(text, length);
+}
+
+static uint32_t stageCount(uint8_t stage) {
+  return metricsHistogram(stage).count;
+}
+
+static bool contains(const std::string &text, const char *line) {
+  return text.find(line) != std::string::npos;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_durations_land_in_power_of_two_buckets(void) {
+  const MetricsHistogram before = metricsHistogram(METRIC_STAGE_NVS_WRITE);
+  metricsRecord(METRIC_STAGE_NVS_WRITE, 0);                        // le 1 us
+  metricsRecord(METRIC_STAGE_NVS_WRITE, CYCLES_PER_US);            // exactly 1 us: le 1 us
+  metricsRecord(METRIC_STAGE_NVS_WRITE, CYCLES_PER_US + 1);        // le 2 us
+  metricsRecord(METRIC_STAGE_NVS_WRITE, 5 * CYCLES_PER_US);        // le 8 us
+  metricsRecord(METRIC_STAGE_NVS_WRITE, 65536 * CYCLES_PER_US);    // le 65.536 ms
+  metricsRecord(METRIC_STAGE_NVS_WRITE, 100000 * CYCLES_PER_US);   // +Inf
+
+  const MetricsHistogram after = metricsHistogram(METRIC_STAGE_NVS_WRITE);
+  TEST_ASSERT_EQUAL(6, after.count - before.count);
+  TEST_ASSERT_EQUAL(2, after.buckets[0] - before.buckets[0]);
+  TEST_ASSERT_EQUAL(1, after.buckets[1] - before.buckets[1]);
+  TEST_ASSERT_EQUAL(1, after.buckets[3] - before.buckets[3]);
+  TEST_ASSERT_EQUAL(1, after.buckets[16] - before.buckets[16]);
+  TEST_ASSERT_EQUAL(1, after.buckets[METRICS_BUCKETS - 1] - before.buckets[METRICS_BUCKETS - 1]);
+  // 1 cycle is 4.17 ns, rounded down
+  TEST_ASSERT_EQUAL(1000 + 1004 + 5000 + 65536000 + 100000000, after.sumNs - before.sumNs);
+}
+
+void test_timer_measures_its_scope(void) {
+  const MetricsHistogram before = metricsHistogram(METRIC_STAGE_HTTP);
+  {
+    MetricsTimer timer(METRIC_STAGE_HTTP);
+    halNativeAdvanceMicros(300);
+  }
+  const MetricsHistogram after = metricsHistogram(METRIC_STAGE_HTTP);
+  TEST_ASSERT_EQUAL(1, after.count - before.count);
+  TEST_ASSERT_EQUAL(1, after.buckets[9] - before.buckets[9]);  // le 512 us
+  TEST_ASSERT_EQUAL(300000, after.sumNs - before.sumNs);
+}
+
+void test_control_pass_records_its_stages(void) {
+  const uint32_t passes = stageCount(METRIC_STAGE_CONTROL_PASS);
+  const uint32_t polls = stageCount(METRIC_STAGE_SENSOR_POLL);
+  const uint32_t rules = stageCount(METRIC_STAGE_RULES);
+  const uint32_t relays = stageCount(METRIC_STAGE_RELAY_OUTPUT);
+
+  // A poll comes due in the first pass; the second follows at once
+  halNativeAdvanceMillis(SENSOR_POLL_INTERVAL_MS);
+  controlRunPass();
+  controlRunPass();
+
+  TEST_ASSERT_EQUAL(passes + 2, stageCount(METRIC_STAGE_CONTROL_PASS));
+  TEST_ASSERT_EQUAL(polls + 1, stageCount(METRIC_STAGE_SENSOR_POLL));
+  TEST_ASSERT_EQUAL(rules + 2, stageCount(METRIC_STAGE_RULES));
+  TEST_ASSERT_EQUAL(relays + 2, stageCount(METRIC_STAGE_RELAY_OUTPUT));
+}
+
+void test_prometheus_text(void) {
+  metricsRecord(METRIC_STAGE_NETWORK_LOOP, 3 * CYCLES_PER_US);
+  const MetricsHistogram loop = metricsHistogram(METRIC_STAGE_NETWORK_LOOP);
+
+  std::string text;
+  const MetricsWriter writer{appendText, &text};
+  metricsWriteHistograms(writer);
+  metricsWriteFamily(writer, "terrahub_heap_free_bytes", "gauge", "Free heap.");
+  metricsWriteSample(writer, "terrahub_heap_free_bytes", nullptr, 123456);
+  metricsWriteSample(writer, "terrahub_task_stack_free_min_bytes", "task=\"control\"", 1800);
+
+  TEST_ASSERT_TRUE(contains(text, "# TYPE terrahub_stage_duration_seconds histogram\n"));
+  // Buckets are cumulative and end in +Inf, which _count matches
+  char line[160];
+  snprintf(line, sizeof(line), "terrahub_stage_duration_seconds_bucket{stage=\"network_loop\",le=\"0.000002\"} %u\n",
+           loop.buckets[0] + loop.buckets[1]);
+  TEST_ASSERT_TRUE(contains(text, line));
+  TEST_ASSERT_TRUE(contains(text, "{stage=\"network_loop\",le=\"0.065536\"}"));
+  snprintf(line, sizeof(line), "terrahub_stage_duration_seconds_bucket{stage=\"network_loop\",le=\"+Inf\"} %u\n",
+           loop.count);
+  TEST_ASSERT_TRUE(contains(text, line));
+  snprintf(line, sizeof(line), "terrahub_stage_duration_seconds_count{stage=\"network_loop\"} %u\n", loop.count);
+  TEST_ASSERT_TRUE(contains(text, line));
+  snprintf(line, sizeof(line), "terrahub_stage_duration_seconds_sum{stage=\"network_loop\"} %llu.%09llu\n",
+           static_cast<unsigned long long>(loop.sumNs / 1000000000ULL),
+           static_cast<unsigned long long>(loop.sumNs % 1000000000ULL));
+  TEST_ASSERT_TRUE(contains(text, line));
+
+  TEST_ASSERT_TRUE(contains(text, "# HELP terrahub_heap_free_bytes Free heap.\n# TYPE terrahub_heap_free_bytes gauge\n"
+                                  "terrahub_heap_free_bytes 123456\n"));
+  TEST_ASSERT_TRUE(contains(text, "terrahub_task_stack_free_min_bytes{task=\"control\"} 1800\n"));
+}
+
+int main(int argc, char **argv) {
+  halNativeSetLogging(false);
+  relayOutputBegin();
+  controlBegin();
+  UNITY_BEGIN();
+  RUN_TEST(test_durations_land_in_power_of_two_buckets);
+  RUN_TEST(test_timer_measures_its_scope);
+  RUN_TEST(test_control_pass_records_its_stages);
+  RUN_TEST(test_prometheus_text);
+  return UNITY_END();
+}
@@ -0,0 +1,258 @@
+/**
+ * TerraHub Controller Firmware - Trace Replay Tests
+ *
+ * Trace files written to the working directory and read back, and a
+ * generated week replayed through rules built by the rule set, checked
+ * against the transition log the harness emits.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <unity.h>
+#include <vector>
+#include "control_task.h"
+#include "hal.h"
+#include "relay_output.h"
+#include "rule_set.h"
+#include "trace_replay.h"
+
+#define TRACE_PATH "test_replay_trace.tmp"
+#define WEEK_DAYS 7
+#define STEP_MS 60000
+
+struct Transition {
+  uint64_t atMs;
+  uint8_t relay;
+  bool on;
+};
+
+static void writeTrace(const char *text) {
+  FILE *file = fopen(TRACE_PATH, "wb");
+  TEST_ASSERT_NOT_NULL(file);
+  fputs(text, file);
+  fclose(file);
+}
+
+static void recordTransition(uint64_t atMs, uint8_t relay, bool on, void *context) {
+  static_cast<std::vector<Transition> *>(context)->push_back(Transition{atMs, relay, on});
+}
+
+static RuleDefinition makeRule(const char *id, const char *op, float threshold, uint8_t relay,
+                               uint32_t minDurationMs = 0) {
+  RuleDefinition rule;
+  rule.id.assign(id);
+  rule.name.assign(id);
+  rule.enabled = true;
+  rule.priority = 0;
+  rule.condition.sensor.assign("temperatureC");
+  rule.condition.op.assign(op);
+  rule.condition.threshold = threshold;
+  rule.condition.hysteresis = 0.5f;
+  rule.expression.termCount = 0;
+  rule.action.relayIndex = relay;
+  rule.action.turnOn = true;
+  rule.action.minDurationMs = minDurationMs;
+  return rule;
+}
+
+void setUp(void) {
+  halNativeSetLogging(false);
+  std::vector<RuleDefinition> noRules;
+  ruleSetApplyRules(noRules);
+  controlRunPass();
+  ruleSetDrainRetired();
+
+  relayOutputBegin();
+  controlBegin();
+}
+
+void tearDown(void) {
+  remove(TRACE_PATH);
+}
+
+void test_csv_trace_is_read(void) {
+  writeTrace("# bench log\n"
+             "t, temperatureC ,notes,humidityPercent\r\n"
+             "0,21.5,start,60\r\n"
+             "\n"
+             "1.5,,,61\n"
+             "3,nan,x,\n");
+  ReplayTrace trace;
+  TEST_ASSERT_TRUE(replayOpenFile(trace, TRACE_PATH));
+  TEST_ASSERT_EQUAL(REPLAY_TRACE_CSV, trace.kind);
+
+  ReplaySample sample;
+  TEST_ASSERT_TRUE(replayNextSample(trace, sample));
+  TEST_ASSERT_EQUAL(0, sample.atMs);
+  TEST_ASSERT_EQUAL((1u << SENSOR_TEMPERATURE) | (1u << SENSOR_HUMIDITY), sample.present);
+  TEST_ASSERT_EQUAL_FLOAT(21.5f, sample.values[SENSOR_TEMPERATURE]);
+  TEST_ASSERT_EQUAL_FLOAT(60.0f, sample.values[SENSOR_HUMIDITY]);
+
+  TEST_ASSERT_TRUE(replayNextSample(trace, sample));
+  TEST_ASSERT_EQUAL(1500, sample.atMs);
+  TEST_ASSERT_EQUAL(1u << SENSOR_HUMIDITY, sample.present);
+
+  // "nan" is a reading: the sensor is unavailable
+  TEST_ASSERT_TRUE(replayNextSample(trace, sample));
+  TEST_ASSERT_EQUAL(3000, sample.atMs);
+  TEST_ASSERT_EQUAL(1u << SENSOR_TEMPERATURE, sample.present);
+  TEST_ASSERT_TRUE(isnan(sample.values[SENSOR_TEMPERATURE]));
+
+  TEST_ASSERT_FALSE(replayNextSample(trace, sample));
+  TEST_ASSERT_EQUAL_STRING("", trace.error);
+  replayClose(trace);
+}
+
+void test_bad_traces_are_reported(void) {
+  ReplayTrace trace;
+  ReplaySample sample;
+  writeTrace("time,temperatureC\n0,20\n");
+  TEST_ASSERT_FALSE(replayOpenFile(trace, TRACE_PATH));
+  replayClose(trace);
+
+  writeTrace("t,temperatureC\n0,20\n1,warm\n");
+  TEST_ASSERT_TRUE(replayOpenFile(trace, TRACE_PATH));
+  TEST_ASSERT_TRUE(replayNextSample(trace, sample));
+  TEST_ASSERT_FALSE(replayNextSample(trace, sample));
+  TEST_ASSERT_EQUAL_STRING("line 3: bad value", trace.error);
+  replayClose(trace);
+
+  writeTrace("t,temperatureC\n5,20\n4,21\n");
+  TEST_ASSERT_TRUE(replayOpenFile(trace, TRACE_PATH));
+  TEST_ASSERT_TRUE(replayNextSample(trace, sample));
+  TEST_ASSERT_FALSE(replayNextSample(trace, sample));
+  TEST_ASSERT_EQUAL_STRING("line 3: time goes backwards", trace.error);
+
+  // Replay stops there too, and says so
+  ReplayStats stats;
+  TEST_ASSERT_FALSE(replayRun(trace, stats));
+  replayClose(trace);
+}
+
+void test_binary_round_trip(void) {
+  ReplayTrace generated;
+  replayOpenGenerated(generated, 1, STEP_MS, 7);
+  std::vector<ReplaySample> written;
+  FILE *file = fopen(TRACE_PATH, "wb");
+  TEST_ASSERT_NOT_NULL(file);
+  TEST_ASSERT_TRUE(replayWriteBinaryHeader(file));
+  ReplaySample sample;
+  while (replayNextSample(generated, sample)) {
+    // Drop a slot now and then, as a trace of irregular sensors would
+    if (written.size() % 5 == 0) sample.present &= ~(1u << SENSOR_LIGHT_LEVEL);
+    TEST_ASSERT_TRUE(replayWriteBinarySample(file, sample));
+    written.push_back(sample);
+  }
+  fclose(file);
+  TEST_ASSERT_EQUAL(24 * 60, written.size());
+
+  ReplayTrace trace;
+  TEST_ASSERT_TRUE(replayOpenFile(trace, TRACE_PATH));
+  TEST_ASSERT_EQUAL(REPLAY_TRACE_BINARY, trace.kind);
+  size_t read = 0;
+  while (replayNextSample(trace, sample)) {
+    const ReplaySample &expected = written[read++];
+    TEST_ASSERT_EQUAL(expected.atMs, sample.atMs);
+    TEST_ASSERT_EQUAL(expected.present, sample.present);
+    for (uint8_t slot = 0; slot < SENSOR_SLOT_COUNT; slot++) {
+      if (expected.present & (1u << slot)) {
+        TEST_ASSERT_EQUAL_FLOAT(expected.values[slot], sample.values[slot]);
+      }
+    }
+  }
+  TEST_ASSERT_EQUAL_STRING("", trace.error);
+  TEST_ASSERT_EQUAL(written.size(), read);
+  replayClose(trace);
+}
+
+void test_generated_trace_is_repeatable(void) {
+  ReplayTrace first;
+  ReplayTrace second;
+  replayOpenGenerated(first, 2, STEP_MS, 42);
+  replayOpenGenerated(second, 2, STEP_MS, 42);
+  ReplaySample a;
+  ReplaySample b;
+  float coolest = 100.0f;
+  float warmest = -100.0f;
+  while (replayNextSample(first, a)) {
+    TEST_ASSERT_TRUE(replayNextSample(second, b));
+    TEST_ASSERT_EQUAL_FLOAT(a.values[SENSOR_TEMPERATURE], b.values[SENSOR_TEMPERATURE]);
+    coolest = fminf(coolest, a.values[SENSOR_TEMPERATURE]);
+    warmest = fmaxf(warmest, a.values[SENSOR_TEMPERATURE]);
+  }
+  TEST_ASSERT_FALSE(replayNextSample(second, b));
+  // A day and night swing either side of 25
+  TEST_ASSERT_TRUE(coolest < 22.0f);
+  TEST_ASSERT_TRUE(warmest > 28.0f);
+}
+
+void test_replay_reports_duty_and_transitions(void) {
+  // Heat below 24, fan above 28 for at least half an hour
+  const uint32_t fanMinMs = 30 * 60000UL;
+  std::vector<RuleDefinition> rules{makeRule("heat", "lt", 24, 0), makeRule("fan", "gt", 28, 1, fanMinMs)};
+  TEST_ASSERT_TRUE(ruleSetApplyRules(rules));
+  // Start between the two, with both relays off
+  TEST_ASSERT_TRUE(controlSetSensor(SENSOR_TEMPERATURE, 26));
+  controlRunPass();
+  ruleSetDrainRetired();
+  TEST_ASSERT_EQUAL(0, controlSnapshot().relays);
+
+  ReplayTrace trace;
+  replayOpenGenerated(trace, WEEK_DAYS, STEP_MS, 3);
+  ReplayStats stats;
+  std::vector<Transition> transitions;
+  TEST_ASSERT_TRUE(replayRun(trace, stats, recordTransition, &transitions));
+
+  TEST_ASSERT_EQUAL(WEEK_DAYS * 24 * 60, stats.samples);
+  TEST_ASSERT_EQUAL((stats.samples - 1) * STEP_MS, stats.simulatedMs);
+  // A pass for every sensor poll, at least
+  TEST_ASSERT_GREATER_OR_EQUAL(stats.simulatedMs / SENSOR_POLL_INTERVAL_MS, stats.passes);
+  TEST_ASSERT_GREATER_OR_EQUAL(stats.samples, stats.ruleEvaluations);
+
+  // Both relays cycle daily, neither runs all the time
+  for (uint8_t relay = 0; relay < 2; relay++) {
+    TEST_ASSERT_GREATER_OR_EQUAL(2 * WEEK_DAYS - 2, stats.relayToggles[relay]);
+    TEST_ASSERT_GREATER_THAN(0, stats.relayOnMs[relay]);
+    TEST_ASSERT_LESS_THAN(stats.simulatedMs, stats.relayOnMs[relay]);
+  }
+  TEST_ASSERT_EQUAL(0, stats.relayToggles[2]);
+
+  // The log accounts for every toggle and all of the on time
+  uint64_t onSince[NUM_RELAY_CHANNELS] = {};
+  uint64_t onMs[NUM_RELAY_CHANNELS] = {};
+  uint32_t toggles[NUM_RELAY_CHANNELS] = {};
+  uint64_t last = 0;
+  for (const Transition &transition : transitions) {
+    TEST_ASSERT_GREATER_OR_EQUAL(last, transition.atMs);
+    last = transition.atMs;
+    toggles[transition.relay]++;
+    if (transition.on) {
+      onSince[transition.relay] = transition.atMs;
+      continue;
+    }
+    const uint64_t heldMs = transition.atMs - onSince[transition.relay];
+    onMs[transition.relay] += heldMs;
+    if (transition.relay == 1) {
+      TEST_ASSERT_GREATER_OR_EQUAL(fanMinMs, heldMs);
+    }
+  }
+  for (uint8_t relay = 0; relay < NUM_RELAY_CHANNELS; relay++) {
+    TEST_ASSERT_EQUAL(stats.relayToggles[relay], toggles[relay]);
+    if (toggles[relay] % 2 == 1) {
+      onMs[relay] += stats.simulatedMs - onSince[relay];
+    }
+    TEST_ASSERT_EQUAL(stats.relayOnMs[relay], onMs[relay]);
+  }
+}
+
+int main(int argc, char **argv) {
+  relayOutputBegin();
+  controlBegin();
+  UNITY_BEGIN();
+  RUN_TEST(test_csv_trace_is_read);
+  RUN_TEST(test_bad_traces_are_reported);
+  RUN_TEST(test_binary_round_trip);
+  RUN_TEST(test_generated_trace_is_repeatable);
+  RUN_TEST(test_replay_reports_duty_and_transitions);
+  return UNITY_END();
+}
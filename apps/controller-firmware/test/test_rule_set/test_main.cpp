@@ -0,0 +1,275 @@
+/**
+ * TerraHub Controller Firmware - Rule Set Request and Persistence Tests
+ *
+ * Request bodies as the HTTP API receives them, the debounced rule saves and
+ * a reload from the native HAL's NVS, including the migration of rules
+ * stored as JSON by older firmware.
+ */
+
+#include <stdio.h>
+#include <string>
+#include <unity.h>
+#include "control_task.h"
+#include "hal.h"
+#include "rule_set.h"
+
+static const char *HEAT_RULE =
+  "{\"name\":\"Heat lamp\",\"priority\":2,"
+  "\"condition\":{\"sensor\":\"temperatureC\",\"op\":\"lt\",\"threshold\":24,\"hysteresis\":0.5},"
+  "\"action\":{\"relayIndex\":0,\"turnOn\":true,\"minDurationMs\":60000}}";
+
+static const char *LAMP_SCHEDULE =
+  "[{\"id\":\"lamp\",\"name\":\"Day light\",\"portId\":3,\"days\":[\"monday\",\"friday\"],"
+  "\"entries\":[{\"time\":\"08:00\",\"state\":true},{\"time\":\"20:00\",\"state\":false}]}]";
+
+static RuleId ruleId(const char *text) {
+  RuleId id;
+  id.assign(text);
+  return id;
+}
+
+// Let the control task pick up the queued program and retire the old one
+static void settle() {
+  controlRunPass();
+  ruleSetDrainRetired();
+}
+
+static const RuleDefinition *findRule(const char *id) {
+  for (const RuleDefinition &rule : ruleSetRules()) {
+    if (rule.id == ruleId(id)) {
+      return &rule;
+    }
+  }
+  return nullptr;
+}
+
+void setUp(void) {
+  std::vector<RuleDefinition> noRules;
+  std::vector<ScheduleDefinition> noSchedules;
+  ruleSetApplyRules(noRules);
+  ruleSetApplySchedules(noSchedules);
+  settle();
+  // Drop any save left pending by the previous test
+  halNativeAdvanceMillis(RULES_SAVE_MAX_DELAY_MS);
+  ruleSetFlushSave(halMillis());
+  halNativeNvsClear();
+}
+
+void tearDown(void) {
+}
+
+void test_missing_and_invalid_bodies(void) {
+  TEST_ASSERT_EQUAL(400, ruleSetReplaceRules(nullptr).status);
+  TEST_ASSERT_EQUAL(400, ruleSetPutRule(ruleId("heat"), "{\"name\":").status);
+  TEST_ASSERT_EQUAL(400, ruleSetReplaceSchedules("[").status);
+  TEST_ASSERT_EQUAL(0, ruleSetRules().size());
+}
+
+void test_put_creates_then_replaces(void) {
+  TEST_ASSERT_EQUAL(201, ruleSetPutRule(ruleId("heat"), HEAT_RULE).status);
+  settle();
+  TEST_ASSERT_EQUAL(204, ruleSetPutRule(ruleId("heat"), HEAT_RULE).status);
+  settle();
+
+  TEST_ASSERT_EQUAL(1, ruleSetRules().size());
+  const RuleDefinition *heat = findRule("heat");
+  TEST_ASSERT_NOT_NULL(heat);
+  TEST_ASSERT_EQUAL_STRING("Heat lamp", heat->name.c_str());
+  TEST_ASSERT_EQUAL(2, heat->priority);
+  TEST_ASSERT_EQUAL_FLOAT(24.0f, heat->condition.threshold);
+  TEST_ASSERT_EQUAL(60000, heat->action.minDurationMs);
+  TEST_ASSERT_EQUAL(ruleSetProgram()->generation, controlSnapshot().generation);
+}
+
+void test_patch_and_delete(void) {
+  ruleSetPutRule(ruleId("heat"), HEAT_RULE);
+  settle();
+  const uint32_t generation = ruleSetGeneration();
+
+  TEST_ASSERT_EQUAL(204, ruleSetPatchRule(ruleId("heat"), "{\"enabled\":false,\"id\":\"renamed\"}").status);
+  settle();
+  const RuleDefinition *heat = findRule("heat");
+  TEST_ASSERT_NOT_NULL(heat);
+  TEST_ASSERT_FALSE(heat->enabled);
+  TEST_ASSERT_EQUAL_FLOAT(24.0f, heat->condition.threshold);
+  TEST_ASSERT_EQUAL(generation + 1, ruleSetGeneration());
+
+  TEST_ASSERT_EQUAL(404, ruleSetPatchRule(ruleId("fan"), "{\"enabled\":true}").status);
+  TEST_ASSERT_EQUAL(204, ruleSetDeleteRule(ruleId("heat")).status);
+  settle();
+  TEST_ASSERT_EQUAL(0, ruleSetRules().size());
+  TEST_ASSERT_EQUAL(404, ruleSetDeleteRule(ruleId("heat")).status);
+}
+
+void test_replace_rules_and_reject_bad_ones(void) {
+  const char *body =
+    "[{\"id\":\"heat\",\"name\":\"Heat\",\"condition\":{\"sensor\":\"temperatureC\",\"op\":\"lt\",\"threshold\":24},"
+    "\"action\":{\"relayIndex\":0,\"turnOn\":true}},"
+    "{\"id\":\"mist\",\"name\":\"Mist\",\"condition\":{\"all\":["
+    "{\"sensor\":\"temperatureC\",\"op\":\"lt\",\"threshold\":24},"
+    "{\"sensor\":\"humidityPercent\",\"op\":\"lt\",\"threshold\":60}]},"
+    "\"action\":{\"relayIndex\":1,\"turnOn\":true}}]";
+  TEST_ASSERT_EQUAL(204, ruleSetReplaceRules(body).status);
+  settle();
+  TEST_ASSERT_EQUAL(2, ruleSetRules().size());
+  TEST_ASSERT_EQUAL(3, findRule("mist")->expression.termCount);
+
+  // An over-long name leaves the set alone
+  char tooLong[MAX_RULE_NAME_LENGTH + 64];
+  snprintf(tooLong, sizeof(tooLong), "{\"name\":\"%0*d\"}", MAX_RULE_NAME_LENGTH + 1, 0);
+  TEST_ASSERT_EQUAL(400, ruleSetPutRule(ruleId("fan"), tooLong).status);
+  TEST_ASSERT_EQUAL(2, ruleSetRules().size());
+
+  // So does a list that uses one id twice
+  const char *twice =
+    "[{\"id\":\"fan\",\"name\":\"Fan\",\"condition\":{\"sensor\":\"temperatureC\",\"op\":\"gt\",\"threshold\":28},"
+    "\"action\":{\"relayIndex\":2,\"turnOn\":true}},"
+    "{\"id\":\"fan\",\"name\":\"Fan\",\"condition\":{\"sensor\":\"temperatureC\",\"op\":\"gt\",\"threshold\":30},"
+    "\"action\":{\"relayIndex\":3,\"turnOn\":true}}]";
+  const uint32_t generation = ruleSetGeneration();
+  TEST_ASSERT_EQUAL(400, ruleSetReplaceRules(twice).status);
+  TEST_ASSERT_EQUAL(generation, ruleSetGeneration());
+  TEST_ASSERT_EQUAL(2, ruleSetRules().size());
+  TEST_ASSERT_NOT_NULL(findRule("mist"));
+}
+
+void test_full_command_queue_is_busy(void) {
+  while (controlSetSensor(SENSOR_TEMPERATURE, 20.0f)) {
+  }
+  const uint32_t generation = ruleSetGeneration();
+  TEST_ASSERT_EQUAL(503, ruleSetPutRule(ruleId("heat"), HEAT_RULE).status);
+  TEST_ASSERT_EQUAL(generation, ruleSetGeneration());
+  TEST_ASSERT_EQUAL(0, ruleSetRules().size());
+
+  settle();
+  TEST_ASSERT_EQUAL(201, ruleSetPutRule(ruleId("heat"), HEAT_RULE).status);
+  settle();
+}
+
+void test_rule_saves_are_debounced(void) {
+  ruleSetPutRule(ruleId("heat"), HEAT_RULE);
+  settle();
+  uint32_t deadline;
+  TEST_ASSERT_TRUE(ruleSetSaveDeadline(deadline));
+  TEST_ASSERT_EQUAL(halMillis() + RULES_SAVE_DEBOUNCE_MS, deadline);
+
+  // A steady stream of edits is still written within the maximum delay
+  uint32_t elapsed = 0;
+  bool saved = false;
+  for (int edit = 0; !saved && elapsed <= RULES_SAVE_MAX_DELAY_MS; edit++) {
+    ruleSetPatchRule(ruleId("heat"), edit % 2 ? "{\"priority\":1}" : "{\"priority\":3}");
+    settle();
+    halNativeAdvanceMillis(RULES_SAVE_DEBOUNCE_MS / 2);
+    elapsed += RULES_SAVE_DEBOUNCE_MS / 2;
+    saved = ruleSetFlushSave(halMillis());
+  }
+  TEST_ASSERT_TRUE(saved);
+  TEST_ASSERT_EQUAL(1, halNativeNvsWrites());
+  TEST_ASSERT_FALSE(ruleSetSaveDeadline(deadline));
+
+  // Saving the same rules again writes nothing
+  TEST_ASSERT_TRUE(ruleSetSaveRules());
+  TEST_ASSERT_EQUAL(1, halNativeNvsWrites());
+}
+
+void test_failed_saves_are_retried(void) {
+  std::vector<RuleDefinition> rules(1);
+  rules[0].id.assign("heat");
+  rules[0].name.assign("heat");
+  rules[0].enabled = true;
+  rules[0].condition.sensor.assign("temperatureC");
+  rules[0].condition.op.assign("lt");
+  rules[0].condition.threshold = 24;
+  rules[0].expression.termCount = 0;
+  rules[0].action.relayIndex = 0;
+  rules[0].action.turnOn = true;
+  TEST_ASSERT_TRUE(ruleSetApplyRules(rules));
+  settle();
+  ruleSetScheduleSave(halMillis());
+
+  halNativeNvsSetFailing(true);
+  halNativeAdvanceMillis(RULES_SAVE_DEBOUNCE_MS);
+  TEST_ASSERT_FALSE(ruleSetFlushSave(halMillis()));
+  uint32_t deadline;
+  TEST_ASSERT_TRUE(ruleSetSaveDeadline(deadline));
+  TEST_ASSERT_EQUAL(halMillis() + RULES_SAVE_DEBOUNCE_MS, deadline);
+  // Not before the retry is due, even past the maximum delay
+  halNativeAdvanceMillis(RULES_SAVE_DEBOUNCE_MS - 1);
+  halNativeNvsSetFailing(false);
+  TEST_ASSERT_FALSE(ruleSetFlushSave(halMillis()));
+  TEST_ASSERT_EQUAL(0, halNativeNvsWrites());
+
+  halNativeAdvanceMillis(1);
+  TEST_ASSERT_TRUE(ruleSetFlushSave(halMillis()));
+  TEST_ASSERT_EQUAL(1, halNativeNvsWrites());
+  TEST_ASSERT_FALSE(ruleSetSaveDeadline(deadline));
+}
+
+void test_rules_and_schedules_reload(void) {
+  ruleSetPutRule(ruleId("heat"), HEAT_RULE);
+  settle();
+  TEST_ASSERT_EQUAL(204, ruleSetReplaceSchedules(LAMP_SCHEDULE).status);
+  settle();
+  TEST_ASSERT_TRUE(ruleSetSaveRules());
+  TEST_ASSERT_GREATER_THAN(0, halNvsBlobLength("schedules"));
+
+  // Forget the set in memory, then load it back
+  std::vector<RuleDefinition> noRules;
+  std::vector<ScheduleDefinition> noSchedules;
+  ruleSetApplyRules(noRules);
+  ruleSetApplySchedules(noSchedules);
+  settle();
+  ruleSetLoad();
+  settle();
+
+  TEST_ASSERT_EQUAL(1, ruleSetRules().size());
+  TEST_ASSERT_EQUAL(2, findRule("heat")->priority);
+  TEST_ASSERT_EQUAL(1, ruleSetSchedules().size());
+  const ScheduleDefinition &lamp = ruleSetSchedules()[0];
+  TEST_ASSERT_EQUAL(3, lamp.portId);
+  TEST_ASSERT_EQUAL((1u << SCHEDULE_MONDAY) | (1u << SCHEDULE_FRIDAY), lamp.days);
+  TEST_ASSERT_EQUAL(2, lamp.entryCount);
+  TEST_ASSERT_EQUAL(20 * 60, lamp.entries[1].minuteOfDay);
+}
+
+void test_schedules_for_other_nodes_are_rejected(void) {
+  TEST_ASSERT_EQUAL(400, ruleSetReplaceSchedules("[{\"id\":\"x\",\"name\":\"x\",\"nodeId\":2,\"portId\":1,"
+                                                 "\"entries\":[{\"time\":\"08:00\",\"state\":true}]}]")
+                           .status);
+  TEST_ASSERT_EQUAL(400, ruleSetReplaceSchedules("[{\"id\":\"x\",\"name\":\"x\",\"portId\":1,"
+                                                 "\"entries\":[{\"time\":\"25:00\",\"state\":true}]}]")
+                           .status);
+  TEST_ASSERT_EQUAL(0, ruleSetSchedules().size());
+  TEST_ASSERT_EQUAL(0, halNativeNvsWrites());
+}
+
+void test_legacy_json_rules_are_migrated(void) {
+  halNvsWriteString("rules",
+                    "[{\"id\":\"heat\",\"name\":\"Heat\",\"enabled\":true,\"priority\":1,"
+                    "\"condition\":{\"sensor\":\"temperatureC\",\"op\":\"lt\",\"threshold\":24,\"hysteresis\":0},"
+                    "\"action\":{\"relayIndex\":0,\"turnOn\":true,\"minDurationMs\":0}}]");
+  ruleSetLoad();
+  settle();
+
+  TEST_ASSERT_EQUAL(1, ruleSetRules().size());
+  TEST_ASSERT_GREATER_THAN(0, halNvsBlobLength("rules_bin"));
+  std::string legacy;
+  TEST_ASSERT_FALSE(halNvsReadString("rules", legacy));
+}
+
+int main(int argc, char **argv) {
+  halNativeSetLogging(false);
+  controlBegin();
+  UNITY_BEGIN();
+  RUN_TEST(test_missing_and_invalid_bodies);
+  RUN_TEST(test_put_creates_then_replaces);
+  RUN_TEST(test_patch_and_delete);
+  RUN_TEST(test_replace_rules_and_reject_bad_ones);
+  RUN_TEST(test_full_command_queue_is_busy);
+  RUN_TEST(test_rule_saves_are_debounced);
+  RUN_TEST(test_failed_saves_are_retried);
+  RUN_TEST(test_rules_and_schedules_reload);
+  RUN_TEST(test_schedules_for_other_nodes_are_rejected);
+  RUN_TEST(test_legacy_json_rules_are_migrated);
+  return UNITY_END();
+}
@@ -0,0 +1,150 @@
+/**
+ * TerraHub Controller Firmware - Binary Rule Storage Tests
+ */
+
+#include <stdio.h>
+#include <unity.h>
+#include "rule_store.h"
+
+static RuleDefinition makeRule(int index) {
+  char id[16];
+  snprintf(id, sizeof(id), "rule-%d", index);
+  RuleDefinition rule;
+  rule.id.assign(id);
+  rule.name.assign("Heat lamp on when cold");
+  rule.enabled = index % 2;
+  rule.priority = -3 + index % 7;
+  rule.condition.sensor.assign("temperatureC");
+  rule.condition.op.assign("band");
+  rule.condition.threshold = 22.5f + index;
+  rule.condition.hysteresis = 0.5f;
+  rule.expression.termCount = 0;
+  rule.action.relayIndex = index % NUM_RELAY_CHANNELS;
+  rule.action.turnOn = index % 3;
+  rule.action.minDurationMs = 60000u * index;
+  return rule;
+}
+
+// "temperature < 24 and humidity rising"
+static RuleDefinition makeCompoundRule() {
+  RuleDefinition rule = makeRule(99);
+  rule.condition = RuleCondition();
+  RuleExpression &expression = rule.expression;
+  expression.termCount = 3;
+  expression.terms[0] = RuleTerm{0.0f, 0.0f, RULE_TERM_ALL, 2, COMPARE_GT, 0, RULE_INPUT_NONE};
+  expression.terms[1] = RuleTerm{24.0f, 0.0f, RULE_TERM_COMPARE, 0, COMPARE_LT, SENSOR_TEMPERATURE, RULE_INPUT_NONE};
+  expression.terms[2] = RuleTerm{1.5f, 0.25f, RULE_TERM_COMPARE, 0, COMPARE_BAND, ruleRateInput(SENSOR_HUMIDITY),
+                                 SENSOR_TEMPERATURE};
+  return rule;
+}
+
+static std::vector<uint8_t> encode(const std::vector<RuleDefinition> &rules) {
+  std::vector<uint8_t> blob(ruleStoreEncodedSize(rules));
+  TEST_ASSERT_EQUAL(blob.size(), ruleStoreEncode(rules, blob.data(), blob.size()));
+  return blob;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_crc_matches_check_value(void) {
+  TEST_ASSERT_EQUAL_HEX32(0xCBF43926, ruleStoreCrc32(reinterpret_cast<const uint8_t *>("123456789"), 9));
+}
+
+void test_round_trip(void) {
+  std::vector<RuleDefinition> rules;
+  for (int i = 0; i < 64; i++) {
+    rules.push_back(makeRule(i));
+  }
+  rules.push_back(makeCompoundRule());
+
+  const std::vector<uint8_t> blob = encode(rules);
+  std::vector<RuleDefinition> decoded;
+  TEST_ASSERT_EQUAL(RULE_STORE_OK, ruleStoreDecode(blob.data(), blob.size(), decoded));
+  TEST_ASSERT_EQUAL(rules.size(), decoded.size());
+
+  for (size_t i = 0; i < rules.size(); i++) {
+    const RuleDefinition &a = rules[i];
+    const RuleDefinition &b = decoded[i];
+    TEST_ASSERT_TRUE(a.id == b.id);
+    TEST_ASSERT_TRUE(a.name == b.name);
+    TEST_ASSERT_EQUAL(a.enabled, b.enabled);
+    TEST_ASSERT_EQUAL(a.priority, b.priority);
+    TEST_ASSERT_TRUE(a.condition.sensor == b.condition.sensor);
+    TEST_ASSERT_TRUE(a.condition.op == b.condition.op);
+    TEST_ASSERT_EQUAL_FLOAT(a.condition.threshold, b.condition.threshold);
+    TEST_ASSERT_EQUAL_FLOAT(a.condition.hysteresis, b.condition.hysteresis);
+    TEST_ASSERT_EQUAL(a.action.relayIndex, b.action.relayIndex);
+    TEST_ASSERT_EQUAL(a.action.turnOn, b.action.turnOn);
+    TEST_ASSERT_EQUAL(a.action.minDurationMs, b.action.minDurationMs);
+    TEST_ASSERT_EQUAL(a.expression.termCount, b.expression.termCount);
+    for (uint8_t t = 0; t < a.expression.termCount; t++) {
+      const RuleTerm &x = a.expression.terms[t];
+      const RuleTerm &y = b.expression.terms[t];
+      TEST_ASSERT_EQUAL(x.type, y.type);
+      TEST_ASSERT_EQUAL(x.operands, y.operands);
+      TEST_ASSERT_EQUAL(x.op, y.op);
+      TEST_ASSERT_EQUAL(x.input, y.input);
+      TEST_ASSERT_EQUAL(x.against, y.against);
+      TEST_ASSERT_EQUAL_FLOAT(x.threshold, y.threshold);
+      TEST_ASSERT_EQUAL_FLOAT(x.hysteresis, y.hysteresis);
+    }
+  }
+}
+
+void test_damaged_blobs_are_rejected(void) {
+  std::vector<uint8_t> blob = encode({makeRule(1), makeCompoundRule()});
+  std::vector<RuleDefinition> decoded{makeRule(7)};
+
+  TEST_ASSERT_EQUAL(RULE_STORE_TRUNCATED, ruleStoreDecode(blob.data(), blob.size() - 1, decoded));
+  blob.back() ^= 1;
+  TEST_ASSERT_EQUAL(RULE_STORE_BAD_CRC, ruleStoreDecode(blob.data(), blob.size(), decoded));
+  blob.back() ^= 1;
+  blob[0] = RULE_STORE_VERSION + 1;
+  TEST_ASSERT_EQUAL(RULE_STORE_BAD_VERSION, ruleStoreDecode(blob.data(), blob.size(), decoded));
+
+  // Failed decodes leave the previous rules alone
+  TEST_ASSERT_EQUAL(1, decoded.size());
+  TEST_ASSERT_TRUE(decoded[0].id == makeRule(7).id);
+}
+
+void test_version_1_records_decode(void) {
+  // Version 2 records of flat rules minus their trailing term count
+  const std::vector<RuleDefinition> rules{makeRule(1), makeRule(2)};
+  const std::vector<uint8_t> current = encode(rules);
+  std::vector<uint8_t> legacy(current.begin(), current.begin() + RULE_STORE_HEADER_BYTES);
+  size_t offset = RULE_STORE_HEADER_BYTES;
+  for (const RuleDefinition &rule : rules) {
+    const size_t length = RULE_STORE_RECORD_FIXED_BYTES + rule.id.length() + rule.name.length() +
+                          rule.condition.sensor.length() + rule.condition.op.length();
+    legacy.insert(legacy.end(), current.begin() + offset, current.begin() + offset + length - 1);
+    offset += length;
+  }
+
+  const uint32_t payload = legacy.size() - RULE_STORE_HEADER_BYTES;
+  const uint32_t crc = ruleStoreCrc32(legacy.data() + RULE_STORE_HEADER_BYTES, payload);
+  legacy[0] = 1;
+  for (int i = 0; i < 4; i++) {
+    legacy[4 + i] = payload >> (8 * i);
+    legacy[8 + i] = crc >> (8 * i);
+  }
+
+  std::vector<RuleDefinition> decoded;
+  TEST_ASSERT_EQUAL(RULE_STORE_OK, ruleStoreDecode(legacy.data(), legacy.size(), decoded));
+  TEST_ASSERT_EQUAL(2, decoded.size());
+  TEST_ASSERT_EQUAL(0, decoded[1].expression.termCount);
+  TEST_ASSERT_TRUE(decoded[1].condition.op == rules[1].condition.op);
+  TEST_ASSERT_EQUAL_FLOAT(rules[0].condition.threshold, decoded[0].condition.threshold);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_crc_matches_check_value);
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_damaged_blobs_are_rejected);
+  RUN_TEST(test_version_1_records_decode);
+  return UNITY_END();
+}
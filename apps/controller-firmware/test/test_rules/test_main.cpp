@@ -0,0 +1,256 @@
+/**
+ * TerraHub Controller Firmware - Rules Engine Tests
+ *
+ * Compilation into the shared condition DAG, the input and relay indexes,
+ * memoized evaluation, and random expressions checked against a direct
+ * recursive evaluation of their terms.
+ */
+
+#include <functional>
+#include <math.h>
+#include <random>
+#include <unity.h>
+#include "rules.h"
+
+static RuleTerm compareTerm(uint8_t input, CompareOp op, float threshold, float hysteresis = 0.0f,
+                            uint8_t against = RULE_INPUT_NONE) {
+  RuleTerm term = RuleTerm();
+  term.type = RULE_TERM_COMPARE;
+  term.op = op;
+  term.input = input;
+  term.against = against;
+  term.threshold = threshold;
+  term.hysteresis = hysteresis;
+  return term;
+}
+
+static RuleTerm groupTerm(RuleTermType type, uint8_t operands) {
+  RuleTerm term = RuleTerm();
+  term.type = type;
+  term.operands = operands;
+  term.against = RULE_INPUT_NONE;
+  return term;
+}
+
+static RuleDefinition compoundRule(const char *id, const std::vector<RuleTerm> &terms, uint8_t relay = 0) {
+  RuleDefinition rule;
+  rule.id.assign(id);
+  rule.name.assign(id);
+  rule.enabled = true;
+  rule.priority = 0;
+  rule.condition = RuleCondition();
+  rule.expression.termCount = terms.size();
+  for (size_t i = 0; i < terms.size(); i++) {
+    rule.expression.terms[i] = terms[i];
+  }
+  rule.action.relayIndex = relay;
+  rule.action.turnOn = true;
+  rule.action.minDurationMs = 0;
+  return rule;
+}
+
+static RuleDefinition flatRule(const char *id, const char *sensor, const char *op, float threshold, uint8_t relay = 0) {
+  RuleDefinition rule = compoundRule(id, {}, relay);
+  rule.condition.sensor.assign(sensor);
+  rule.condition.op.assign(op);
+  rule.condition.threshold = threshold;
+  rule.condition.hysteresis = 0.0f;
+  return rule;
+}
+
+// Reference evaluation straight from the pre-order terms; `cursor` ends
+// one past the subtree
+static bool referenceEvaluate(const RuleExpression &expression, uint8_t &cursor, const RuleInputs &inputs) {
+  const RuleTerm &term = expression.terms[cursor++];
+  switch (term.type) {
+    case RULE_TERM_COMPARE: {
+      const float value = inputs.values[term.input];
+      const float offset = term.against == RULE_INPUT_NONE ? 0.0f : inputs.values[term.against];
+      const float threshold = offset + term.threshold;
+      switch (term.op) {
+        case COMPARE_GT: return value > threshold;
+        case COMPARE_LT: return value < threshold;
+        case COMPARE_GTE: return value >= threshold;
+        case COMPARE_LTE: return value <= threshold;
+        case COMPARE_BAND: return value >= threshold - term.hysteresis && value <= threshold + term.hysteresis;
+        default: return false;
+      }
+    }
+    case RULE_TERM_ALL: {
+      bool result = true;
+      for (uint8_t i = 0; i < term.operands; i++) result &= referenceEvaluate(expression, cursor, inputs);
+      return result;
+    }
+    case RULE_TERM_ANY: {
+      bool result = false;
+      for (uint8_t i = 0; i < term.operands; i++) result |= referenceEvaluate(expression, cursor, inputs);
+      return result;
+    }
+    default:
+      return !referenceEvaluate(expression, cursor, inputs);
+  }
+}
+
+// "temperature < 24 and humidity > 60, or light < 10" and friends sharing its parts
+static std::vector<RuleDefinition> sharedRules() {
+  return {
+    compoundRule("heat", {groupTerm(RULE_TERM_ANY, 2), groupTerm(RULE_TERM_ALL, 2), compareTerm(0, COMPARE_LT, 24),
+                          compareTerm(1, COMPARE_GT, 60), compareTerm(2, COMPARE_LT, 10)}),
+    compoundRule("mist", {groupTerm(RULE_TERM_ALL, 2), compareTerm(1, COMPARE_GT, 60), compareTerm(0, COMPARE_LT, 24)}, 1),
+    flatRule("fan", "temperatureC", "lt", 24),
+    flatRule("unknown-sensor", "nope", "gt", 1),
+    compoundRule("double-not", {groupTerm(RULE_TERM_NOT, 1), groupTerm(RULE_TERM_NOT, 1), compareTerm(2, COMPARE_LT, 10)}, 2),
+    compoundRule("rising", {compareTerm(ruleRateInput(0), COMPARE_GT, 0.5f)}, 3),
+    compoundRule("difference", {compareTerm(0, COMPARE_GT, 2, 0, 1)}, 3),
+    compoundRule("malformed", {groupTerm(RULE_TERM_ALL, 3), compareTerm(0, COMPARE_LT, 1)}, 3),
+  };
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_shared_subexpressions_compile_to_one_node(void) {
+  RuleProgram program;
+  compileRules(sharedRules(), program);
+
+  // t<24, h>60, their ALL, light<10, the ANY, the rate and the difference
+  TEST_ASSERT_EQUAL(7, program.nodes.size());
+  const ExprNode &any = program.nodes[program.rules[0].condition];
+  TEST_ASSERT_EQUAL(EXPR_ANY, any.type);
+  const uint16_t mist = program.rules[1].condition;
+  TEST_ASSERT_TRUE(program.exprOperands[any.firstOperand] == mist || program.exprOperands[any.firstOperand + 1] == mist);
+
+  // The flat rule reuses the comparison inside the compound ones
+  const ExprNode &fan = program.nodes[program.rules[2].condition];
+  TEST_ASSERT_EQUAL(EXPR_COMPARE, fan.type);
+  TEST_ASSERT_EQUAL(0, fan.input);
+
+  // "not not x" folds to x
+  TEST_ASSERT_EQUAL(EXPR_COMPARE, program.nodes[program.rules[4].condition].type);
+}
+
+void test_invalid_conditions_never_fire(void) {
+  RuleProgram program;
+  compileRules(sharedRules(), program);
+
+  TEST_ASSERT_EQUAL(RULE_CONDITION_NEVER, program.rules[3].condition);
+  TEST_ASSERT_EQUAL(0, program.rules[3].inputs);
+  TEST_ASSERT_EQUAL(RULE_CONDITION_NEVER, program.rules[7].condition);
+}
+
+void test_indexes_cover_inputs_and_relays(void) {
+  RuleProgram program;
+  compileRules(sharedRules(), program);
+
+  TEST_ASSERT_EQUAL(0x7, program.rules[0].inputs);
+  TEST_ASSERT_EQUAL(1u << ruleRateInput(0), program.rules[5].inputs);
+  TEST_ASSERT_EQUAL(0x3, program.rules[6].inputs);
+
+  // Temperature drives heat, mist, fan and difference
+  TEST_ASSERT_EQUAL(4, program.inputRuleStart[1] - program.inputRuleStart[0]);
+  TEST_ASSERT_EQUAL(1, program.inputRuleStart[ruleRateInput(0) + 1] - program.inputRuleStart[ruleRateInput(0)]);
+  // Rules that can never fire are left out of the relay index
+  TEST_ASSERT_EQUAL(2, program.relayRuleStart[4] - program.relayRuleStart[3]);
+}
+
+void test_evaluation_is_memoized_and_short_circuits(void) {
+  RuleProgram program;
+  compileRules(sharedRules(), program);
+  std::vector<uint32_t> memo(program.nodes.size(), 0);
+  RuleInputs inputs{{20.0f, 70.0f, 50.0f, 0.6f, 0.0f, 0.0f}};
+  ExprEvaluation evaluation{&program, &inputs, memo.data(), 1, 0};
+
+  const bool expected[] = {true, true, true, false, false, true, false, false};
+  for (size_t i = 0; i < program.rules.size(); i++) {
+    TEST_ASSERT_EQUAL(expected[i], evaluateCompiledRule(program.rules[i], evaluation));
+  }
+  TEST_ASSERT_LESS_OR_EQUAL(program.nodes.size(), evaluation.nodesEvaluated);
+
+  // Too warm: the ALL stops at its first (sorted) operand
+  inputs.values[0] = 30.0f;
+  evaluation.round = 2;
+  evaluation.nodesEvaluated = 0;
+  TEST_ASSERT_FALSE(evaluateCompiledRule(program.rules[1], evaluation));
+  TEST_ASSERT_EQUAL(2, evaluation.nodesEvaluated);
+}
+
+void test_same_condition_across_programs(void) {
+  const std::vector<RuleDefinition> rules = sharedRules();
+  RuleProgram a;
+  RuleProgram b;
+  compileRules(rules, a);
+  compileRules({rules[4], rules[1], rules[0]}, b);
+
+  TEST_ASSERT_TRUE(sameCompiledCondition(a, a.rules[0], b, b.rules[2]));
+  TEST_ASSERT_TRUE(sameCompiledCondition(a, a.rules[1], b, b.rules[1]));
+  TEST_ASSERT_FALSE(sameCompiledCondition(a, a.rules[0], b, b.rules[1]));
+}
+
+void test_random_expressions_match_reference(void) {
+  std::mt19937 rng(42);
+  uint32_t round = 10;
+
+  for (int iteration = 0; iteration < 500; iteration++) {
+    std::vector<RuleDefinition> rules;
+    for (int r = 0; r < 20; r++) {
+      std::vector<RuleTerm> terms;
+      const int budget = 1 + rng() % MAX_RULE_TERMS;
+      std::function<void()> generate = [&]() {
+        if (budget - static_cast<int>(terms.size()) <= 2 || rng() % 3 == 0) {
+          const uint8_t against = rng() % 4 == 0 ? rng() % RULE_INPUT_COUNT : RULE_INPUT_NONE;
+          terms.push_back(compareTerm(rng() % RULE_INPUT_COUNT, static_cast<CompareOp>(rng() % 5), rng() % 5, rng() % 2,
+                                      against));
+          return;
+        }
+        const int type = rng() % 3;
+        if (type == 2) {
+          terms.push_back(groupTerm(RULE_TERM_NOT, 1));
+          generate();
+          return;
+        }
+        const size_t at = terms.size();
+        terms.push_back(groupTerm(type ? RULE_TERM_ANY : RULE_TERM_ALL, 0));
+        const int operands = 1 + rng() % 3;
+        for (int i = 0; i < operands && static_cast<int>(terms.size()) < budget; i++) {
+          terms[at].operands++;
+          generate();
+        }
+      };
+      generate();
+      rules.push_back(compoundRule("r", terms));
+    }
+
+    RuleProgram program;
+    compileRules(rules, program);
+    std::vector<uint32_t> memo(program.nodes.size(), 0);
+    for (int sample = 0; sample < 5; sample++) {
+      RuleInputs inputs;
+      for (float &value : inputs.values) {
+        value = rng() % 7 == 0 ? NAN : static_cast<float>(rng() % 5);
+      }
+      ExprEvaluation evaluation{&program, &inputs, memo.data(), ++round, 0};
+      for (const CompiledRule &compiled : program.rules) {
+        const RuleExpression &expression = rules[compiled.ruleIndex].expression;
+        uint8_t cursor = 0;
+        const bool expected = referenceEvaluate(expression, cursor, inputs);
+        TEST_ASSERT_EQUAL(expression.termCount, cursor);
+        TEST_ASSERT_EQUAL(expected, evaluateCompiledRule(compiled, evaluation));
+      }
+      TEST_ASSERT_LESS_OR_EQUAL(program.nodes.size(), evaluation.nodesEvaluated);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_shared_subexpressions_compile_to_one_node);
+  RUN_TEST(test_invalid_conditions_never_fire);
+  RUN_TEST(test_indexes_cover_inputs_and_relays);
+  RUN_TEST(test_evaluation_is_memoized_and_short_circuits);
+  RUN_TEST(test_same_condition_across_programs);
+  RUN_TEST(test_random_expressions_match_reference);
+  return UNITY_END();
+}
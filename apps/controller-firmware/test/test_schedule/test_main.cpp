@@ -0,0 +1,173 @@
+/**
+ * TerraHub Controller Firmware - Schedule Tests
+ *
+ * Time parsing, compiled transitions, and a simulated week driven by the
+ * timer queue the way the control task drives it, checked minute by minute
+ * against a scan of every entry.
+ */
+
+#include <string.h>
+#include <unity.h>
+#include "schedule.h"
+#include "timer_queue.h"
+
+struct EntrySpec {
+  const char *time;
+  bool state;
+};
+
+static ScheduleDefinition makeSchedule(const char *id, uint8_t portId, uint8_t days,
+                                       std::initializer_list<EntrySpec> entries) {
+  ScheduleDefinition schedule = ScheduleDefinition();
+  schedule.id.assign(id);
+  schedule.name.assign(id);
+  schedule.enabled = true;
+  schedule.nodeId = 1;
+  schedule.portId = portId;
+  schedule.days = days;
+  for (const EntrySpec &entry : entries) {
+    scheduleParseTime(entry.time, schedule.entries[schedule.entryCount].minuteOfDay);
+    schedule.entries[schedule.entryCount++].state = entry.state;
+  }
+  return schedule;
+}
+
+// State from the latest entry at or before `weekMs`, else the week's last
+static bool referenceState(const ScheduleDefinition &schedule, uint32_t weekMs) {
+  int64_t latest = -1;
+  int64_t last = -1;
+  bool latestState = false;
+  bool lastState = false;
+  for (int day = 0; day < SCHEDULE_DAY_COUNT; day++) {
+    if (!(schedule.days & (1u << day))) {
+      continue;
+    }
+    for (uint8_t i = 0; i < schedule.entryCount; i++) {
+      const int64_t at = day * static_cast<int64_t>(SCHEDULE_DAY_MS) + schedule.entries[i].minuteOfDay * 60000LL;
+      if (at <= weekMs && at >= latest) {
+        latest = at;
+        latestState = schedule.entries[i].state;
+      }
+      if (at >= last) {
+        last = at;
+        lastState = schedule.entries[i].state;
+      }
+    }
+  }
+  return latest >= 0 ? latestState : lastState;
+}
+
+static std::vector<ScheduleDefinition> testSchedules() {
+  std::vector<ScheduleDefinition> schedules = {
+    makeSchedule("light", 1, SCHEDULE_EVERY_DAY, {{"08:00", true}, {"20:00", false}}),
+    makeSchedule("mist", 2, (1u << SCHEDULE_MONDAY) | (1u << SCHEDULE_THURSDAY),
+                 {{"09:00", true}, {"09:05", false}, {"18:00", true}, {"18:02", false}}),
+    makeSchedule("night", 3, (1u << SCHEDULE_SATURDAY) | (1u << SCHEDULE_SUNDAY), {{"22:00", true}, {"06:00", false}}),
+    makeSchedule("same-time", 4, SCHEDULE_EVERY_DAY, {{"12:00", true}, {"12:00", false}}),
+    makeSchedule("disabled", 5, SCHEDULE_EVERY_DAY, {{"01:00", true}}),
+  };
+  schedules.back().enabled = false;
+  return schedules;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_times_parse_and_format(void) {
+  char text[6];
+  scheduleFormatTime(8 * 60 + 5, text);
+  TEST_ASSERT_EQUAL_STRING("08:05", text);
+
+  uint16_t minuteOfDay = 0;
+  TEST_ASSERT_TRUE(scheduleParseTime("23:59", minuteOfDay));
+  TEST_ASSERT_EQUAL(1439, minuteOfDay);
+  TEST_ASSERT_FALSE(scheduleParseTime("24:00", minuteOfDay));
+  TEST_ASSERT_FALSE(scheduleParseTime("8:00", minuteOfDay));
+  TEST_ASSERT_FALSE(scheduleParseTime("08:60", minuteOfDay));
+
+  TEST_ASSERT_EQUAL(SCHEDULE_SUNDAY, scheduleDayFromName("sunday"));
+  TEST_ASSERT_EQUAL(SCHEDULE_DAY_COUNT, scheduleDayFromName("someday"));
+}
+
+void test_disabled_schedules_are_dropped(void) {
+  ScheduleProgram program;
+  compileSchedules(testSchedules(), program);
+  TEST_ASSERT_EQUAL(4, program.schedules.size());
+  TEST_ASSERT_EQUAL(3, program.schedules[3].relayIndex);
+}
+
+void test_later_entry_at_same_time_wins(void) {
+  ScheduleProgram program;
+  compileSchedules(testSchedules(), program);
+  const CompiledSchedule &sameTime = program.schedules[3];
+  TEST_ASSERT_FALSE(scheduleStateAt(sameTime, 0));
+  TEST_ASSERT_FALSE(scheduleStateAt(sameTime, 12 * 3600000UL));
+}
+
+void test_simulated_week_matches_reference(void) {
+  const std::vector<ScheduleDefinition> schedules = testSchedules();
+  ScheduleProgram program;
+  compileSchedules(schedules, program);
+  const uint16_t count = program.schedules.size();
+
+  for (uint32_t start : {0UL, 5 * 3600000UL + 123, SCHEDULE_WEEK_MS - 1}) {
+    // millis() close to wrapping, as on a device that has run for 46 days
+    uint32_t clockAt = 4000000000UL;
+    uint32_t clockWeekMs = start;
+    auto weekMsAt = [&](uint32_t now) {
+      return static_cast<uint32_t>((clockWeekMs + static_cast<uint64_t>(now - clockAt)) % SCHEDULE_WEEK_MS);
+    };
+
+    TimerQueue queue;
+    std::vector<bool> states(count);
+    uint32_t now = clockAt;
+    auto resync = [&]() {
+      timerQueueReset(queue, count);
+      for (uint16_t i = 0; i < count; i++) {
+        states[i] = scheduleStateAt(program.schedules[i], weekMsAt(now));
+        timerQueuePush(queue, i, now + scheduleMsUntilNext(program.schedules[i], weekMsAt(now)));
+      }
+    };
+    resync();
+
+    uint32_t transitions = 0;
+    for (uint32_t minute = 0; minute < 8 * 1440; minute++) {
+      now += 60000;
+      // Clock jumps: forward 3 h 17 min, later back two days
+      if (minute == 3000 || minute == 7000) {
+        const uint32_t jump = minute == 3000 ? 3 * 3600000UL + 17 * 60000UL : SCHEDULE_WEEK_MS - 2 * SCHEDULE_DAY_MS;
+        clockWeekMs = (weekMsAt(now) + jump) % SCHEDULE_WEEK_MS;
+        clockAt = now;
+        resync();
+      }
+
+      uint16_t id;
+      while (timerQueuePopExpired(queue, now, id)) {
+        transitions++;
+        const uint32_t weekMs = weekMsAt(now);
+        states[id] = scheduleStateAt(program.schedules[id], weekMs);
+        const uint32_t untilNext = scheduleMsUntilNext(program.schedules[id], weekMs);
+        TEST_ASSERT_TRUE(untilNext > 0 && untilNext <= SCHEDULE_WEEK_MS);
+        timerQueuePush(queue, id, now + untilNext);
+      }
+
+      for (uint16_t i = 0; i < count; i++) {
+        const ScheduleDefinition &schedule = schedules[program.schedules[i].scheduleIndex];
+        TEST_ASSERT_EQUAL(referenceState(schedule, weekMsAt(now)), states[i]);
+      }
+    }
+    TEST_ASSERT_GREATER_THAN(30, transitions);
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_times_parse_and_format);
+  RUN_TEST(test_disabled_schedules_are_dropped);
+  RUN_TEST(test_later_entry_at_same_time_wins);
+  RUN_TEST(test_simulated_week_matches_reference);
+  return UNITY_END();
+}
@@ -0,0 +1,174 @@
+/**
+ * TerraHub Controller Firmware - Signal Processing Tests
+ *
+ * RMS current windows and relay fault detection on synthesized ADC samples,
+ * and the tiered sensor history read back through its export format.
+ */
+
+#include <initializer_list>
+#include <math.h>
+#include <string.h>
+#include <unity.h>
+#include <vector>
+#include "current_dsp.h"
+#include "sensor_history.h"
+
+#define SAMPLE_RATE_HZ 5000
+
+static std::vector<uint8_t> exportTier(uint8_t tier, uint32_t sinceSeconds, size_t chunk) {
+  HistoryExport exp;
+  std::vector<uint8_t> data;
+  if (!historyExportBegin(exp, tier, sinceSeconds)) {
+    return data;
+  }
+  uint8_t buffer[4096];
+  size_t length;
+  while ((length = historyExportRead(exp, buffer, chunk)) > 0) {
+    data.insert(data.end(), buffer, buffer + length);
+  }
+  return data;
+}
+
+static uint16_t bucketCount(const std::vector<uint8_t> &data) {
+  return data[16] | data[17] << 8;
+}
+
+// Column 0 - 2 is min, max, mean
+static int16_t bucketValue(const std::vector<uint8_t> &data, int slot, int column, int bucket) {
+  const size_t offset = HISTORY_HEADER_BYTES + ((slot * 3 + column) * static_cast<size_t>(bucketCount(data)) + bucket) * 2;
+  return static_cast<int16_t>(data[offset] | data[offset + 1] << 8);
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_rms_of_noisy_sine(void) {
+  const uint16_t samples = currentWindowSamples(SAMPLE_RATE_HZ, 50, 5);
+  TEST_ASSERT_EQUAL(500, samples);
+  TEST_ASSERT_EQUAL(500, currentWindowSamples(SAMPLE_RATE_HZ, 60, 6));
+
+  // 1 A RMS on the mid-rail bias, at any phase, with a few counts of noise
+  for (double phase : {0.0, 0.7, 2.1}) {
+    CurrentRmsWindow window;
+    currentRmsBegin(window, samples);
+    float rms = 0.0f;
+    int windows = 0;
+    for (uint32_t i = 0; i < samples * 3u; i++) {
+      const double amps = sqrt(2.0) * sin(2 * M_PI * 50 * i / SAMPLE_RATE_HZ + phase);
+      const long raw = lround(2048 + amps * 1000 / CURRENT_MA_PER_COUNT + static_cast<int>((i * 7919) % 7) - 3);
+      if (currentRmsAdd(window, raw < 0 ? 0 : raw > 4095 ? 4095 : raw, rms)) {
+        windows++;
+      }
+    }
+    TEST_ASSERT_EQUAL(3, windows);
+    TEST_ASSERT_FLOAT_WITHIN(15.0f, 1000.0f, rms * CURRENT_MA_PER_COUNT);
+  }
+}
+
+void test_rms_ignores_bias(void) {
+  CurrentRmsWindow window;
+  currentRmsBegin(window, 500);
+  float rms = -1.0f;
+  for (int i = 0; i < 500; i++) {
+    currentRmsAdd(window, 2000, rms);
+  }
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, rms);
+}
+
+void test_relay_faults(void) {
+  // Relay on with no current: a missing load within half a second
+  CurrentFaultState state;
+  currentFaultBegin(state, false, 0);
+  uint32_t raisedAt = 0;
+  for (uint32_t t = 100; t <= 1000; t += 100) {
+    if (currentFaultUpdate(state, true, 3, t) && raisedAt == 0) raisedAt = t;
+  }
+  TEST_ASSERT_EQUAL(CURRENT_FAULT_NO_LOAD, state.fault);
+  TEST_ASSERT_LESS_OR_EQUAL(500, raisedAt);
+
+  // The load comes back: cleared after two windows
+  TEST_ASSERT_FALSE(currentFaultUpdate(state, true, 900, 1100));
+  TEST_ASSERT_TRUE(currentFaultUpdate(state, true, 900, 1200));
+  TEST_ASSERT_EQUAL(CURRENT_FAULT_NONE, state.fault);
+
+  // Relay off and the load keeps drawing, as with a welded contact
+  bool raised = false;
+  for (uint32_t t = 1300; t < 2500 && !raised; t += 100) {
+    raised = currentFaultUpdate(state, false, 900, t);
+  }
+  TEST_ASSERT_TRUE(raised);
+  TEST_ASSERT_EQUAL(CURRENT_FAULT_UNEXPECTED_LOAD, state.fault);
+}
+
+void test_single_noisy_window_is_not_a_fault(void) {
+  CurrentFaultState state;
+  currentFaultBegin(state, true, 0);
+  TEST_ASSERT_FALSE(currentFaultUpdate(state, true, 900, 400));
+  TEST_ASSERT_FALSE(currentFaultUpdate(state, true, 10, 500));
+  TEST_ASSERT_FALSE(currentFaultUpdate(state, true, 900, 600));
+  TEST_ASSERT_EQUAL(CURRENT_FAULT_NONE, state.fault);
+}
+
+void test_history_tiers(void) {
+  historyBegin(0);
+  SensorValues values;
+  uint32_t ms = 0;
+  // Two hours at 1 Hz: temperature cycles 20 - 29, light unknown at first
+  for (int i = 0; i < 7200; i++) {
+    ms += 1000;
+    values.slots[0] = 20 + i % 10;
+    values.slots[1] = 55.5f;
+    values.slots[2] = i < 100 ? NAN : 1000;
+    historyAppend(values, ms);
+  }
+
+  // Read in small chunks to cross every boundary of the export
+  const std::vector<uint8_t> fine = exportTier(0, 0, 7);
+  TEST_ASSERT_EQUAL(360, bucketCount(fine));
+  TEST_ASSERT_EQUAL(10, fine[4] | fine[5] << 8);
+  float scale;
+  memcpy(&scale, &fine[20], sizeof(scale));
+  TEST_ASSERT_EQUAL_FLOAT(0.01f, scale);
+  TEST_ASSERT_EQUAL(2000, bucketValue(fine, 0, 0, 5));
+  TEST_ASSERT_EQUAL(2900, bucketValue(fine, 0, 1, 5));
+  TEST_ASSERT_EQUAL(2450, bucketValue(fine, 0, 2, 5));
+  TEST_ASSERT_EQUAL(5550, bucketValue(fine, 1, 2, 5));
+
+  const std::vector<uint8_t> coarse = exportTier(1, 0, 4096);
+  TEST_ASSERT_EQUAL(7200 / 300 + 1, bucketCount(coarse));
+  TEST_ASSERT_EQUAL(250, bucketValue(coarse, 2, 0, 0));  // 1000 lux at 4 per count
+
+  // A 30 minute stall leaves the skipped buckets empty
+  ms += 1800 * 1000;
+  historyAppend(values, ms);
+  const std::vector<uint8_t> stalled = exportTier(0, 0, 4096);
+  TEST_ASSERT_EQUAL(HISTORY_EMPTY, bucketValue(stalled, 0, 0, bucketCount(stalled) - 2));
+}
+
+void test_history_across_millis_wrap(void) {
+  historyBegin(0xFFFFF000UL);
+  SensorValues values;
+  values.slots[0] = 21.0f;
+  uint32_t ms = 0xFFFFF000UL;
+  for (int i = 0; i < 20; i++) {
+    ms += 1000;
+    historyAppend(values, ms);
+  }
+  const std::vector<uint8_t> data = exportTier(0, 0, 64);
+  TEST_ASSERT_GREATER_THAN(0, bucketCount(data));
+  TEST_ASSERT_EQUAL(2100, bucketValue(data, 0, 0, bucketCount(data) - 1));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_rms_of_noisy_sine);
+  RUN_TEST(test_rms_ignores_bias);
+  RUN_TEST(test_relay_faults);
+  RUN_TEST(test_single_noisy_window_is_not_a_fault);
+  RUN_TEST(test_history_tiers);
+  RUN_TEST(test_history_across_millis_wrap);
+  return UNITY_END();
+}
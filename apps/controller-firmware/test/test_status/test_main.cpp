@@ -0,0 +1,148 @@
+/**
+ * TerraHub Controller Firmware - Status Snapshot Tests
+ *
+ * When a cached body is rebuilt, the tags it is served with and the
+ * If-None-Match values that match them, the state key taken from a control
+ * snapshot, and the /api/status document written from it.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <string>
+#include <unity.h>
+#include "control_task.h"
+#include "hal.h"
+#include "relay_output.h"
+#include "status_snapshot.h"
+
+struct Key {
+  uint32_t relays;
+  float temperature;
+};
+
+static StatusCache cache;
+
+void setUp(void) {
+  cache = StatusCache();
+}
+
+void tearDown(void) {
+}
+
+void test_cache_rebuilds_on_change_or_age(void) {
+  Key key{1, 24.5f};
+  TEST_ASSERT_TRUE(statusCacheStale(cache, &key, sizeof(key), 0, STATUS_REFRESH_MS));
+
+  statusCacheStore(cache, &key, sizeof(key), 5000, "{\"relays\":1}");
+  TEST_ASSERT_EQUAL(1, cache.version);
+  TEST_ASSERT_FALSE(statusCacheStale(cache, &key, sizeof(key), 5000 + STATUS_REFRESH_MS - 1, STATUS_REFRESH_MS));
+  TEST_ASSERT_TRUE(statusCacheStale(cache, &key, sizeof(key), 5000 + STATUS_REFRESH_MS, STATUS_REFRESH_MS));
+
+  Key changed = key;
+  changed.temperature = 24.6f;
+  TEST_ASSERT_TRUE(statusCacheStale(cache, &changed, sizeof(changed), 5000, STATUS_REFRESH_MS));
+  // Ages are measured across the millisecond counter wrapping
+  statusCacheStore(cache, &changed, sizeof(changed), UINT32_MAX - 10, "{\"relays\":1}");
+  TEST_ASSERT_FALSE(statusCacheStale(cache, &changed, sizeof(changed), 100, STATUS_REFRESH_MS));
+  TEST_ASSERT_EQUAL(2, cache.version);
+}
+
+void test_responses_keep_the_body_they_started_with(void) {
+  Key key{0, 20.0f};
+  statusCacheStore(cache, &key, sizeof(key), 0, "{\"relays\":0}");
+  const std::shared_ptr<const std::string> sending = cache.body;
+  key.relays = 3;
+  statusCacheStore(cache, &key, sizeof(key), 10, "{\"relays\":3}");
+  TEST_ASSERT_EQUAL_STRING("{\"relays\":0}", sending->c_str());
+  TEST_ASSERT_EQUAL_STRING("{\"relays\":3}", cache.body->c_str());
+}
+
+void test_etag_is_the_body_crc(void) {
+  Key key{0, 20.0f};
+  // CRC-32 of "123456789"
+  statusCacheStore(cache, &key, sizeof(key), 0, "123456789");
+  TEST_ASSERT_EQUAL_STRING("\"cbf43926\"", cache.etag);
+
+  // The same body gets the same tag, whatever its version
+  StatusCache other;
+  statusCacheStore(other, &key, sizeof(key), 0, "first");
+  statusCacheStore(other, &key, sizeof(key), 0, "123456789");
+  TEST_ASSERT_EQUAL_STRING(cache.etag, other.etag);
+}
+
+void test_if_none_match(void) {
+  TEST_ASSERT_FALSE(statusCacheMatches(cache, "*"));
+
+  Key key{0, 20.0f};
+  statusCacheStore(cache, &key, sizeof(key), 0, "123456789");
+  TEST_ASSERT_TRUE(statusCacheMatches(cache, "\"cbf43926\""));
+  TEST_ASSERT_TRUE(statusCacheMatches(cache, "W/\"cbf43926\""));
+  TEST_ASSERT_TRUE(statusCacheMatches(cache, "\"00000000\", \"cbf43926\" "));
+  TEST_ASSERT_TRUE(statusCacheMatches(cache, "*"));
+  TEST_ASSERT_FALSE(statusCacheMatches(cache, "\"cbf43927\""));
+  TEST_ASSERT_FALSE(statusCacheMatches(cache, "cbf43926"));
+  TEST_ASSERT_FALSE(statusCacheMatches(cache, "\"cbf43926\"x"));
+  TEST_ASSERT_FALSE(statusCacheMatches(cache, ""));
+  TEST_ASSERT_FALSE(statusCacheMatches(cache, nullptr));
+}
+
+void test_state_from_control(void) {
+  TEST_ASSERT_TRUE(controlSetRelay(1, true));
+  TEST_ASSERT_TRUE(controlSetSensor(SENSOR_TEMPERATURE, 24.5f));
+  controlRunPass();
+  const ControlSnapshot control = controlSnapshot();
+
+  StatusState first;
+  StatusState second;
+  statusStateFromControl(control, first);
+  statusStateFromControl(control, second);
+  TEST_ASSERT_EQUAL(1u << 1, first.relays);
+  TEST_ASSERT_EQUAL_FLOAT(24.5f, first.sensors.slots[SENSOR_TEMPERATURE]);
+  // Rates are NaN until a window of readings and still compare equal
+  TEST_ASSERT_TRUE(isnan(first.rates.slots[SENSOR_TEMPERATURE]));
+  TEST_ASSERT_EQUAL(0, memcmp(&first, &second, sizeof(first)));
+
+  statusCacheStore(cache, &first, sizeof(first), 0, "{}");
+  TEST_ASSERT_TRUE(controlSetSensor(SENSOR_TEMPERATURE, 24.75f));
+  controlRunPass();
+  statusStateFromControl(controlSnapshot(), second);
+  TEST_ASSERT_TRUE(statusCacheStale(cache, &second, sizeof(second), 0, STATUS_REFRESH_MS));
+}
+
+void test_status_json(void) {
+  StatusState state;
+  statusStateFromControl(controlSnapshot(), state);
+  state.nodeId = 1;
+  state.isController = true;
+  state.online = true;
+  state.ip = 192 | 168u << 8 | 1u << 16 | 20u << 24;
+  state.relays = 1u << 0;
+  state.ruleCount = 3;
+  StatusCounters counters;
+  memset(&counters, 0, sizeof(counters));
+  counters.passes = 42;
+
+  std::string body;
+  statusWriteJson("9.9.9", state, counters, body);
+  TEST_ASSERT_EQUAL('{', body[0]);
+  TEST_ASSERT_EQUAL('}', body[body.size() - 1]);
+  TEST_ASSERT_EQUAL(strlen(body.c_str()), body.size());
+  TEST_ASSERT_TRUE(body.find("\"version\":\"9.9.9\",\"role\":\"controller\",\"nodeId\":1,\"online\":true,"
+                             "\"ip\":\"192.168.1.20\",\"relays\":[true,false") != std::string::npos);
+  TEST_ASSERT_TRUE(body.find("\"ruleCount\":3,") != std::string::npos);
+  TEST_ASSERT_TRUE(body.find("\"control\":{\"passes\":42,") != std::string::npos);
+}
+
+int main(int argc, char **argv) {
+  halNativeSetLogging(false);
+  relayOutputBegin();
+  controlBegin();
+  UNITY_BEGIN();
+  RUN_TEST(test_cache_rebuilds_on_change_or_age);
+  RUN_TEST(test_responses_keep_the_body_they_started_with);
+  RUN_TEST(test_etag_is_the_body_crc);
+  RUN_TEST(test_if_none_match);
+  RUN_TEST(test_state_from_control);
+  RUN_TEST(test_status_json);
+  return UNITY_END();
+}
@@ -0,0 +1,92 @@
+#!/usr/bin/env node
+/**
+ * TerraHub Controller Firmware - HTTP load test
+ *
+ * Hammers one API endpoint with a fixed number of keep-alive clients and
+ * reports throughput and latency percentiles per concurrency level.
+ *
+ * Usage:
+ *   node tools/http-loadtest.mjs --host 192.168.4.1 [--path /api/status]
+ *        [--concurrency 1,4,16] [--duration 10]
+ */
+
+import http from 'node:http';
+import { performance } from 'node:perf_hooks';
+
+const parseArgs = (argv) => {
+  const args = { host: '192.168.4.1', port: 80, path: '/api/status', concurrency: [1, 4, 16], duration: 10 };
+  for (let i = 0; i < argv.length; i += 2) {
+    const key = argv[i].replace(/^--/, '');
+    const value = argv[i + 1];
+    if (key === 'concurrency') {
+      args.concurrency = value.split(',').map(Number);
+    } else if (key === 'port' || key === 'duration') {
+      args[key] = Number(value);
+    } else {
+      args[key] = value;
+    }
+  }
+  return args;
+};
+
+const percentile = (sorted, p) => {
+  if (sorted.length === 0) return 0;
+  const index = Math.min(sorted.length - 1, Math.ceil((p / 100) * sorted.length) - 1);
+  return sorted[Math.max(0, index)];
+};
+
+const request = (agent, { host, port, path }) =>
+  new Promise((resolve) => {
+    const start = performance.now();
+    const req = http.get({ host, port, path, agent }, (res) => {
+      res.resume();
+      res.on('end', () => resolve({ ok: res.statusCode < 400, ms: performance.now() - start }));
+    });
+    req.setTimeout(5000, () => req.destroy(new Error('timeout')));
+    req.on('error', () => resolve({ ok: false, ms: performance.now() - start }));
+  });
+
+const run = async (args, concurrency) => {
+  const agent = new http.Agent({ keepAlive: true, maxSockets: concurrency });
+  const latencies = [];
+  let errors = 0;
+  const deadline = performance.now() + args.duration * 1000;
+
+  const client = async () => {
+    while (performance.now() < deadline) {
+      const result = await request(agent, args);
+      if (result.ok) {
+        latencies.push(result.ms);
+      } else {
+        errors++;
+      }
+    }
+  };
+
+  const started = performance.now();
+  await Promise.all(Array.from({ length: concurrency }, client));
+  const elapsedSec = (performance.now() - started) / 1000;
+  agent.destroy();
+
+  latencies.sort((a, b) => a - b);
+  return {
+    concurrency,
+    requests: latencies.length,
+    errors,
+    rps: latencies.length / elapsedSec,
+    p50: percentile(latencies, 50),
+    p99: percentile(latencies, 99),
+    max: latencies.length ? latencies[latencies.length - 1] : 0,
+  };
+};
+
+const args = parseArgs(process.argv.slice(2));
+console.log(`GET http://${args.host}:${args.port}${args.path} for ${args.duration}s per level`);
+console.log('clients  requests  errors      req/s   p50 ms   p99 ms   max ms');
+for (const concurrency of args.concurrency) {
+  const r = await run(args, concurrency);
+  console.log(
+    `${String(r.concurrency).padStart(7)}  ${String(r.requests).padStart(8)}  ${String(r.errors).padStart(6)}  ` +
+      `${r.rps.toFixed(1).padStart(9)}  ${r.p50.toFixed(1).padStart(7)}  ${r.p99.toFixed(1).padStart(7)}  ${r.max.toFixed(1).padStart(7)}`
+  );
+}
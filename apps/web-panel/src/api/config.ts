@@ -13,6 +13,7 @@ export const fetchDeviceConfig = async (): Promise<DeviceConfig> => {
     apIp: data.apIp,
     stationIp: data.stationIp,
     stationConnected: data.stationConnected,
+    stationState: data.stationState,
     wifiConfigured: data.wifiConfigured,
     stationSsid: data.stationSsid,
     hostname: data.hostname
@@ -21,5 +22,5 @@ export const fetchDeviceConfig = async (): Promise<DeviceConfig> => {
 
 export const updateWifiConfig = async (payload: WifiConfigPayload) => {
   const { data } = await api.post('/config/wifi', payload);
-  return data as { connected: boolean; ip?: string; ssid?: string; hostname?: string };
+  return data as { connected: boolean; state?: string; ssid?: string; hostname?: string };
 };
@@ -31,6 +31,7 @@ export interface DeviceConfig {
   apIp?: string;
   stationIp?: string;
   stationConnected: boolean;
+  stationState?: 'unconfigured' | 'connecting' | 'connected' | 'backoff';
   wifiConfigured: boolean;
   stationSsid?: string;
   hostname?: string;